@@ -0,0 +1,79 @@
+"""
+Build the web UI into the SPIFFS image.
+
+Reads the sources in web/, and writes to .data/ (PlatformIO's data_dir):
+
+  * every asset gzipped (-9, with a zero timestamp so unchanged sources give byte-identical output);
+  * app.css and app.js renamed with a fingerprint of their content, and index.html rewritten to refer
+    to them, so they can be cached for a year and a change to either is still picked up at once;
+  * web.manifest, one line per asset: URL, SPIFFS path, ETag, content type and cache lifetime.
+    The firmware reads it once at boot and answers revalidations from memory.
+
+Run by PlatformIO before every build (extra_scripts), or by hand: python scripts/build_web.py
+"""
+
+import gzip
+import hashlib
+import os
+import shutil
+
+# Source name -> (content type, fingerprinted)
+ASSETS = {
+    "app.css": ("text/css", True),
+    "app.js": ("application/javascript", True),
+    "index.html": ("text/html", False),  # Served at /, so its URL can't change
+}
+IMMUTABLE_SECONDS = 31536000
+
+
+def fingerprint(data):
+    return hashlib.sha256(data).hexdigest()[:10]
+
+
+def build(project_dir):
+    source_dir = os.path.join(project_dir, "web")
+    data_dir = os.path.join(project_dir, ".data")
+    if os.path.isdir(data_dir):
+        shutil.rmtree(data_dir)
+    os.makedirs(data_dir)
+
+    urls = {}
+    manifest = []
+    raw_total = 0
+    gzip_total = 0
+    for name in sorted(ASSETS, key=lambda n: n == "index.html"):  # index.html last, once the others have names
+        content_type, fingerprinted = ASSETS[name]
+        with open(os.path.join(source_dir, name), "rb") as f:
+            data = f.read()
+        for placeholder, url in urls.items():
+            data = data.replace(("{{%s}}" % placeholder).encode(), url.encode())
+
+        tag = fingerprint(data)
+        if fingerprinted:
+            stem, ext = os.path.splitext(name)
+            url = "/%s.%s%s" % (stem, tag, ext)
+            max_age = IMMUTABLE_SECONDS
+        else:
+            url = "/"
+            max_age = 0
+        urls[name] = url
+
+        path = (url if fingerprinted else "/" + name) + ".gz"
+        packed = gzip.compress(data, 9, mtime=0)
+        with open(os.path.join(data_dir, path.lstrip("/")), "wb") as f:
+            f.write(packed)
+        manifest.append("%s %s %s %s %d\n" % (url, path, tag, content_type, max_age))
+        raw_total += len(data)
+        gzip_total += len(packed)
+
+    with open(os.path.join(data_dir, "web.manifest"), "w") as f:
+        f.writelines(manifest)
+    print("Web assets: %d bytes -> %d gzipped (%.1fx)" % (raw_total, gzip_total, float(raw_total) / gzip_total))
+
+
+try:
+    Import("env")  # noqa: F821 - defined when PlatformIO runs this as an extra script
+    build(env["PROJECT_DIR"])  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        build(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,63 @@
+"""
+Report the flash and static RAM a build takes, once it has linked.
+
+Prints one line per build and keeps the latest figures for every environment in .pio/footprint.csv,
+so the minimal, standard and full builds can be compared side by side (columns env, flash and
+static_ram, in bytes).
+
+Flash is what goes into the app partition (code, read-only data and initialized data); static RAM is
+DRAM taken before the heap starts (initialized and zeroed data).  Free heap at idle and boot time can
+only be measured on the device: the `footprint` serial command reports them, with the same two sizes.
+
+Run by PlatformIO after linking (extra_scripts = post:scripts/footprint.py).
+"""
+
+import csv
+import os
+import re
+import subprocess
+
+# Sections of `size -A` output counted as each, as PlatformIO's own RAM / Flash summary does
+FLASH_SECTIONS = re.compile(r"^(?:\.iram0\.text|\.iram0\.vectors|\.dram0\.data|\.flash\.text|\.flash\.rodata|\.flash\.appdesc)\s+(\d+)")
+RAM_SECTIONS = re.compile(r"^(?:\.dram0\.data|\.dram0\.bss|\.noinit)\s+(\d+)")
+
+
+def measure(size_tool, elf):
+    output = subprocess.check_output([size_tool, "-A", "-d", elf]).decode()
+    flash = 0
+    ram = 0
+    for line in output.splitlines():
+        match = FLASH_SECTIONS.match(line)
+        if match:
+            flash += int(match.group(1))
+        match = RAM_SECTIONS.match(line)
+        if match:
+            ram += int(match.group(1))
+    return flash, ram
+
+
+def record(project_dir, name, flash, ram):
+    path = os.path.join(project_dir, ".pio", "footprint.csv")
+    rows = {}
+    if os.path.isfile(path):
+        with open(path) as f:
+            for row in csv.DictReader(f):
+                rows[row["env"]] = row
+    rows[name] = {"env": name, "flash": flash, "static_ram": ram}
+    with open(path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=["env", "flash", "static_ram"])
+        writer.writeheader()
+        for key in sorted(rows):
+            writer.writerow(rows[key])
+
+
+def report(target, source, env):
+    elf = str(target[0])
+    flash, ram = measure(env.subst("$SIZETOOL"), elf)
+    name = env["PIOENV"]
+    print("Footprint %s: flash %d bytes, static RAM %d bytes" % (name, flash, ram))
+    record(env["PROJECT_DIR"], name, flash, ram)
+
+
+Import("env")  # noqa: F821 - defined when PlatformIO runs this as an extra script
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)  # noqa: F821
@@ -0,0 +1,100 @@
+"""
+Hammer the controller's HTTP endpoints from a host and report what it did to the animation.
+
+Reads /frametime (percentiles of the time between new frames on the strip) after a quiet period, then
+again after --seconds of load: --connections clients fetching the page and the JSON endpoints as fast
+as they can, and --slow clients that send their request and read the reply a few bytes at a time, as
+a phone on a weak link does.  Run it against a build with -D HTTP_TASK=0 as well to see the difference.
+
+  python scripts/http_load.py 192.168.1.50 --seconds 30 --connections 8 --slow 2
+"""
+
+import argparse
+import json
+import socket
+import threading
+import time
+import urllib.request
+
+
+def get(host, path, timeout=10):
+    with urllib.request.urlopen("http://%s%s" % (host, path), timeout=timeout) as reply:
+        return reply.read()
+
+
+def frame_times(host):
+    """Frame time percentiles since the last read, which starts them over."""
+    return json.loads(get(host, "/frametime?reset=1"))
+
+
+def hammer(host, paths, stop, counts, lock):
+    while not stop.is_set():
+        for path in paths:
+            try:
+                get(host, path)
+                key = "ok"
+            except OSError:
+                key = "errors"
+            with lock:
+                counts[key] += 1
+
+
+def slow_client(host, stop, counts, lock):
+    request = ("GET / HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n" % host).encode()
+    while not stop.is_set():
+        try:
+            with socket.create_connection((host, 80), timeout=10) as conn:
+                for i in range(0, len(request), 8):
+                    conn.sendall(request[i:i + 8])
+                    time.sleep(0.05)
+                while conn.recv(64):
+                    time.sleep(0.05)
+            key = "ok"
+        except OSError:
+            key = "errors"
+        with lock:
+            counts[key] += 1
+
+
+def report(name, stats):
+    print("%-8s %6d frames at %d ms: p50 %6d us  p90 %6d us  p99 %6d us  max %6d us" % (
+        name, stats["frames"], stats["frameMs"], stats["p50Us"], stats["p90Us"], stats["p99Us"], stats["maxUs"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--seconds", type=float, default=30)
+    parser.add_argument("--connections", type=int, default=8)
+    parser.add_argument("--slow", type=int, default=2)
+    args = parser.parse_args()
+
+    # Leave the show as it is: /set just writes back the current brightness
+    status = json.loads(get(args.host, "/status"))
+    paths = ["/", "/status", "/debug", "/program", "/set?brightness=%d" % status["brightness"]]
+
+    frame_times(args.host)
+    time.sleep(args.seconds)
+    quiet = frame_times(args.host)
+    print("HTTP on its own task: %s" % ("yes" if quiet.get("httpTask") else "no"))
+    report("quiet", quiet)
+
+    stop = threading.Event()
+    lock = threading.Lock()
+    counts = {"ok": 0, "errors": 0}
+    threads = [threading.Thread(target=hammer, args=(args.host, paths, stop, counts, lock)) for _ in range(args.connections)]
+    threads += [threading.Thread(target=slow_client, args=(args.host, stop, counts, lock)) for _ in range(args.slow)]
+    for thread in threads:
+        thread.start()
+    time.sleep(args.seconds)
+    loaded = frame_times(args.host)
+    stop.set()
+    for thread in threads:
+        thread.join()
+    report("loaded", loaded)
+    print("%d requests (%.1f/s), %d errors; longest a handler waited for the loop %d us" % (
+        counts["ok"], counts["ok"] / args.seconds, counts["errors"], loaded["httpWaitMaxUs"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+/**
+ * @file alloc_stats.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Heap allocation accounting per frame and per subsystem
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   WiFi and BLE share the heap with everything else, and steady small allocations from the frame
+ *   loop slowly fragment it.  Built with ALLOC_TRACE=1 and linked with -Wl,--wrap for malloc, calloc
+ *   and realloc (the mhetesp32minikit_alloc environment does both), every allocation that goes
+ *   through them - new, String, std::string and the C library alike - is counted and charged to the
+ *   TraceScope open on the allocating task, or to "other".
+ *
+ *   Once AllocArm() has been called at the end of setup, an allocation inside the render or show
+ *   scope is a violation: logged with its caller's address (for addr2line) from the loop, or with
+ *   ALLOC_STRICT=1, a panic on the spot with the backtrace.
+ *
+ *   Without ALLOC_TRACE none of this is compiled in and the hooks are empty inlines.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial accounting
+ *   0.2 - 10/19/26 - Open scope looked up per task rather than per core
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "trace.h"
+
+#ifndef ALLOC_STRICT
+#define ALLOC_STRICT 0 // 1: abort on a render or show allocation once armed; 0: log it
+#endif
+
+const uint8_t kAllocOther = TRACE_COUNT; // Allocations made outside any TraceScope
+
+#if ALLOC_TRACE
+
+#include <esp32/rom/ets_sys.h>
+
+struct AllocCounter
+{
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> bytes;
+};
+
+static AllocCounter g_allocBySubsystem[TRACE_COUNT + 1];
+static volatile bool g_allocArmed = false;
+static std::atomic<uint32_t> g_allocViolations(0);
+static volatile uint32_t g_allocViolationBytes = 0;
+static void *volatile g_allocViolationCaller = nullptr;
+static volatile uint8_t g_allocViolationScope = kAllocOther;
+static uint32_t g_allocViolationsLogged = 0;
+
+// Per frame, from AllocFrameDone()
+static uint32_t g_allocFrameTotal = 0;   // Allocation count at the end of the last frame
+static uint32_t g_allocFrameCount = 0;   // Allocations during the last frame
+static uint32_t g_allocFrameBytes = 0;
+static uint32_t g_allocFrameMax = 0;     // Most allocations in one frame since armed
+static uint32_t g_allocDirtyFrames = 0;  // Frames since armed with any allocation at all
+static uint32_t g_allocFrameBytesTotal = 0;
+
+static inline uint8_t AllocScope()
+{
+  return TraceOpenScope(); // TRACE_COUNT, i.e. kAllocOther, outside any scope
+}
+
+static inline void AllocCount(size_t size, void *caller)
+{
+  const uint8_t scope = AllocScope();
+  g_allocBySubsystem[scope].count.fetch_add(1, std::memory_order_relaxed);
+  g_allocBySubsystem[scope].bytes.fetch_add(size, std::memory_order_relaxed);
+  if (g_allocArmed && (scope == TRACE_RENDER || scope == TRACE_SHOW))
+  {
+    g_allocViolationBytes = size;
+    g_allocViolationCaller = caller;
+    g_allocViolationScope = scope;
+    g_allocViolations.fetch_add(1, std::memory_order_relaxed);
+#if ALLOC_STRICT
+    ets_printf("alloc: %u bytes in %s from %p\n", (unsigned)size, TraceName(scope), caller);
+    abort();
+#endif
+  }
+}
+
+extern "C"
+{
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t count, size_t size);
+  void *__real_realloc(void *pointer, size_t size);
+
+  void *__wrap_malloc(size_t size)
+  {
+    AllocCount(size, __builtin_return_address(0));
+    return __real_malloc(size);
+  }
+
+  void *__wrap_calloc(size_t count, size_t size)
+  {
+    AllocCount(count * size, __builtin_return_address(0));
+    return __real_calloc(count, size);
+  }
+
+  void *__wrap_realloc(void *pointer, size_t size)
+  {
+    AllocCount(size, __builtin_return_address(0));
+    return __real_realloc(pointer, size);
+  }
+}
+
+static uint32_t AllocTotal(uint32_t *bytes)
+{
+  uint32_t count = 0;
+  uint32_t total = 0;
+  for (uint8_t s = 0; s <= TRACE_COUNT; s++)
+  {
+    count += g_allocBySubsystem[s].count.load(std::memory_order_relaxed);
+    total += g_allocBySubsystem[s].bytes.load(std::memory_order_relaxed);
+  }
+  *bytes = total;
+  return count;
+}
+
+// AllocArm
+//
+// Startup is over: from here on the render and show paths must not allocate.  Also restarts the
+// per-frame figures.
+
+void AllocArm()
+{
+  g_allocFrameTotal = AllocTotal(&g_allocFrameBytesTotal);
+  g_allocFrameMax = 0;
+  g_allocDirtyFrames = 0;
+  g_allocArmed = true;
+}
+
+// AllocFrameDone
+//
+// Call once per frame, when it has been shown.
+
+void AllocFrameDone()
+{
+  uint32_t bytes;
+  const uint32_t total = AllocTotal(&bytes);
+  g_allocFrameCount = total - g_allocFrameTotal;
+  g_allocFrameBytes = bytes - g_allocFrameBytesTotal;
+  g_allocFrameTotal = total;
+  g_allocFrameBytesTotal = bytes;
+  if (g_allocArmed)
+  {
+    g_allocFrameMax = max(g_allocFrameMax, g_allocFrameCount);
+    if (g_allocFrameCount != 0)
+    {
+      g_allocDirtyFrames++;
+    }
+  }
+}
+
+// AllocReport
+//
+// From the loop: log render and show allocations that happened since the last call.
+
+void AllocReport()
+{
+  const uint32_t violations = g_allocViolations.load(std::memory_order_relaxed);
+  if (violations == g_allocViolationsLogged)
+  {
+    return;
+  }
+  Serial.printf("alloc: %lu bytes in %s from %p (%lu so far)\n", (unsigned long)g_allocViolationBytes,
+                TraceName(g_allocViolationScope), g_allocViolationCaller, (unsigned long)violations);
+  g_allocViolationsLogged = violations;
+}
+
+// AllocFormat
+//
+// Counts per frame and per subsystem (count/bytes), as one line.
+
+void AllocFormat(char *line, size_t size)
+{
+  int length = snprintf(line, size, "alloc armed=%u frame=%lu/%luB frameMax=%lu dirtyFrames=%lu violations=%lu",
+                        g_allocArmed, (unsigned long)g_allocFrameCount, (unsigned long)g_allocFrameBytes,
+                        (unsigned long)g_allocFrameMax, (unsigned long)g_allocDirtyFrames,
+                        (unsigned long)g_allocViolations.load());
+  for (uint8_t s = 0; s <= TRACE_COUNT && length > 0 && (size_t)length < size; s++)
+  {
+    length += snprintf(line + length, size - length, " %s=%lu/%luB", s == kAllocOther ? "other" : TraceName(s),
+                       (unsigned long)g_allocBySubsystem[s].count.load(),
+                       (unsigned long)g_allocBySubsystem[s].bytes.load());
+  }
+}
+
+#else
+
+static inline void AllocArm() {}
+static inline void AllocFrameDone() {}
+static inline void AllocReport() {}
+
+void AllocFormat(char *line, size_t size)
+{
+  snprintf(line, size, "alloc accounting not built in; use the mhetesp32minikit_alloc environment");
+}
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file audio.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief I2S microphone capture and analysis on core 0, published to the effects once per frame
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   An INMP441 (or any I2S MEMS microphone giving 24 bits left-justified in 32-bit slots) is read by a
+ *   task pinned to core 0, away from the render loop on core 1.  Every hop it pushes the samples through
+ *   the AudioAnalyzer in audio_dsp.h and publishes the features under a sequence counter.  AudioFrame()
+ *   copies the latest features into g_Audio at the start of each rendered frame, so every effect in a
+ *   frame sees the same values and none of them ever waits on the audio task.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial I2S capture
+ *   0.2 - 10/19/26 - Fences around the published features, as in SharedSnapshot
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <driver/i2s.h>
+#include "audio_dsp.h"
+#include "trace.h"
+
+#ifndef ENABLE_AUDIO
+#define ENABLE_AUDIO 1
+#endif
+
+#ifndef AUDIO_I2S_SCK
+#define AUDIO_I2S_SCK 26 // Bit clock
+#endif
+#ifndef AUDIO_I2S_WS
+#define AUDIO_I2S_WS 25 // Word select (L/R clock)
+#endif
+#ifndef AUDIO_I2S_SD
+#define AUDIO_I2S_SD 35 // Data from the microphone; input-only pins are fine
+#endif
+#ifndef AUDIO_SAMPLE_SHIFT
+#define AUDIO_SAMPLE_SHIFT 14 // 32-bit slot to 16-bit sample, keeping the top 18 bits of the 24 less two of headroom
+#endif
+
+AudioFeatures g_Audio = {}; // Features for the frame being rendered; see AudioFrame()
+
+static AudioAnalyzer g_audioAnalyzer;
+static AudioFeatures g_audioShared = {};         // Written by the audio task only
+static std::atomic<uint32_t> g_audioSequence(0); // Odd while g_audioShared is being written
+static TaskHandle_t g_audioTask = nullptr;
+static uint32_t g_audioAnalyzeUs = 0;            // Smoothed cost of one hop's analysis
+static uint32_t g_audioLastBeatCount = 0;
+
+static void AudioTask(void *)
+{
+  static int32_t raw[AUDIO_HOP];
+  static int16_t samples[AUDIO_HOP];
+
+  for (;;)
+  {
+    size_t bytes = 0;
+    if (i2s_read(I2S_NUM_0, raw, sizeof(raw), &bytes, portMAX_DELAY) != ESP_OK || bytes == 0)
+    {
+      continue;
+    }
+    const size_t count = bytes / sizeof(raw[0]);
+    for (size_t i = 0; i < count; i++)
+    {
+      const int32_t value = raw[i] >> AUDIO_SAMPLE_SHIFT;
+      samples[i] = (int16_t)constrain(value, -32768, 32767);
+    }
+
+    const uint32_t start = micros();
+    TraceBegin(TRACE_AUDIO);
+    const uint16_t analyses = g_audioAnalyzer.Push(samples, count);
+    TraceEnd(TRACE_AUDIO);
+    if (analyses == 0)
+    {
+      continue;
+    }
+    const uint32_t elapsed = (micros() - start) / analyses;
+    g_audioAnalyzeUs = g_audioAnalyzeUs == 0 ? elapsed : (g_audioAnalyzeUs * 7 + elapsed) / 8;
+
+    g_audioSequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // No write to g_audioShared can be seen before the odd count
+    g_audioShared = g_audioAnalyzer.Features();
+    g_audioSequence.fetch_add(1, std::memory_order_release);
+  }
+}
+
+// AudioBegin
+//
+// Install the I2S driver and start the analysis task.  Returns false (and the effects just see silence)
+// if the driver can't be installed.
+
+bool AudioBegin()
+{
+#if ENABLE_AUDIO
+  g_audioAnalyzer.Begin(AUDIO_SAMPLE_RATE);
+
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX);
+  config.sample_rate = AUDIO_SAMPLE_RATE;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT; // L/R pin tied low
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1;
+  config.dma_buf_count = 4;
+  config.dma_buf_len = AUDIO_HOP;
+  config.use_apll = false;
+
+  i2s_pin_config_t pins = {};
+  pins.mck_io_num = I2S_PIN_NO_CHANGE;
+  pins.bck_io_num = AUDIO_I2S_SCK;
+  pins.ws_io_num = AUDIO_I2S_WS;
+  pins.data_out_num = I2S_PIN_NO_CHANGE;
+  pins.data_in_num = AUDIO_I2S_SD;
+
+  if (i2s_driver_install(I2S_NUM_0, &config, 0, nullptr) != ESP_OK || i2s_set_pin(I2S_NUM_0, &pins) != ESP_OK)
+  {
+    Serial.println("Audio: I2S driver install failed.");
+    return false;
+  }
+  xTaskCreatePinnedToCore(AudioTask, "audio", 4096, nullptr, 2, &g_audioTask, 0);
+  Serial.printf("Audio: I2S %u Hz on SCK %u, WS %u, SD %u\n", AUDIO_SAMPLE_RATE, AUDIO_I2S_SCK, AUDIO_I2S_WS, AUDIO_I2S_SD);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// AudioFrame
+//
+// Snapshot the latest features into g_Audio for the frame about to be rendered.  Never blocks: if the
+// audio task is mid-update the copy is simply retried, which takes nanoseconds.
+
+void AudioFrame()
+{
+  if (g_audioTask == nullptr)
+  {
+    return;
+  }
+  AudioFeatures snapshot;
+  uint32_t before;
+  do
+  {
+    before = g_audioSequence.load(std::memory_order_acquire);
+    snapshot = g_audioShared;
+    std::atomic_thread_fence(std::memory_order_acquire); // The copy is finished before the count is checked again
+  } while ((before & 1) || g_audioSequence.load(std::memory_order_relaxed) != before);
+
+  snapshot.beat = snapshot.beatCount != g_audioLastBeatCount;
+  g_audioLastBeatCount = snapshot.beatCount;
+  g_Audio = snapshot;
+}
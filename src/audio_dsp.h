@@ -0,0 +1,340 @@
+/**
+ * @file audio_dsp.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Fixed-point audio analysis: FFT, band energies, smoothing and beat detection
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   Samples are pushed in as 16-bit mono PCM.  Every AUDIO_HOP samples the last AUDIO_FFT_SIZE are
+ *   windowed and run through a Q15 radix-2 FFT that halves the data at every stage, so it can never
+ *   overflow.  Bin magnitudes are summed into AUDIO_BANDS log-spaced bands, put on a log scale under a
+ *   slow automatic gain, and smoothed with a fast attack and a slow release.  A beat is a jump in bass
+ *   energy well above its running average, with a refractory period so one kick counts once.
+ *
+ *   At 22.05 kHz, 512 points and a 256-sample hop that is 86 analyses a second, each well under a
+ *   millisecond on the ESP32; see "audio" in main.cpp for the measured figure.
+ *
+ *   Only <stdint.h>, <string.h> and <math.h> (for building the tables) are used, so a WAV file read on
+ *   the host can be pushed through exactly the same code: see test/test_audio_beats.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial analyzer
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef AUDIO_SAMPLE_RATE
+#define AUDIO_SAMPLE_RATE 22050
+#endif
+#define AUDIO_FFT_BITS 9
+#define AUDIO_FFT_SIZE (1 << AUDIO_FFT_BITS) // 43 Hz per bin at 22.05 kHz
+#define AUDIO_HOP (AUDIO_FFT_SIZE / 2)       // 50% overlap
+#define AUDIO_BANDS 8
+
+const uint16_t kAudioLowHz = 40;        // Bottom of the first band
+const uint16_t kAudioHighHz = 10000;    // Top of the last band
+const uint16_t kAudioRangeQ8 = 6 * 256; // Dynamic range mapped onto 0-255: six octaves of magnitude, 36 dB
+const uint16_t kAudioFloorQ8 = 8 * 256; // Gain never rises past this, so silence reads as silence
+const uint8_t kAudioAttack = 3;         // Smoothing: rises take 1/2^attack ... (of the step) per hop
+const uint8_t kAudioRelease = 3;        // ... falls take 1/2^release per hop
+const uint16_t kBeatRatioQ8 = 384;      // Beat when bass energy exceeds 1.5x its average
+const uint16_t kBeatRefractoryMs = 250; // Fastest beat reported: 240 BPM
+
+// What effects see each frame.  Everything is 0-255 unless noted.
+struct AudioFeatures
+{
+  uint8_t level;              // Overall loudness
+  uint8_t bands[AUDIO_BANDS]; // Smoothed band levels, lowest frequencies first
+  uint8_t bass;               // Bands 0-1
+  uint8_t mid;                // Bands 2-4
+  uint8_t treble;             // Bands 5-7
+  uint8_t beatPulse;          // 255 on a beat, decaying to 0 over about 300 ms
+  bool beat;                  // A beat arrived since the previous frame (set per frame by the caller)
+  uint32_t beatCount;         // Beats since start
+  uint32_t hops;              // Analyses since start
+};
+
+static int16_t g_audioSin[AUDIO_FFT_SIZE * 3 / 4]; // sin(2 pi i / N) in Q15; cos is a quarter turn on
+static int16_t g_audioWindow[AUDIO_FFT_SIZE];      // Hann window in Q15
+static uint16_t g_audioBandEdge[AUDIO_BANDS + 1];  // First FFT bin of each band
+
+// AudioBuildTables
+//
+// Sine, window and band tables.  Floating point, but only once at start-up.
+
+void AudioBuildTables(uint32_t sampleRate)
+{
+  for (int i = 0; i < AUDIO_FFT_SIZE * 3 / 4; i++)
+  {
+    g_audioSin[i] = (int16_t)lrintf(32767.0f * sinf(2.0f * (float)M_PI * i / AUDIO_FFT_SIZE));
+  }
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++)
+  {
+    g_audioWindow[i] = (int16_t)lrintf(32767.0f * 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (AUDIO_FFT_SIZE - 1))));
+  }
+
+  const float high = fminf((float)kAudioHighHz, sampleRate / 2.0f);
+  for (int band = 0; band <= AUDIO_BANDS; band++)
+  {
+    const float hz = kAudioLowHz * powf(high / kAudioLowHz, (float)band / AUDIO_BANDS);
+    uint16_t bin = (uint16_t)lrintf(hz * AUDIO_FFT_SIZE / sampleRate);
+    bin = bin < 1 ? 1 : (bin > AUDIO_FFT_SIZE / 2 ? AUDIO_FFT_SIZE / 2 : bin);
+    if (band > 0 && bin <= g_audioBandEdge[band - 1])
+    {
+      bin = g_audioBandEdge[band - 1] + 1; // Low bands are narrower than a bin; give each at least one
+    }
+    g_audioBandEdge[band] = bin;
+  }
+}
+
+// AudioFft
+//
+// In-place complex FFT of AUDIO_FFT_SIZE Q15 points.  Each stage halves its output, so the result is
+// the transform divided by AUDIO_FFT_SIZE.
+
+void AudioFft(int16_t *re, int16_t *im)
+{
+  const uint16_t n = AUDIO_FFT_SIZE;
+
+  for (uint16_t i = 1, j = 0; i < n; i++)
+  {
+    uint16_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+    {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j)
+    {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  uint8_t shift = AUDIO_FFT_BITS - 1;
+  for (uint16_t half = 1; half < n; half <<= 1, shift--)
+  {
+    for (uint16_t m = 0; m < half; m++)
+    {
+      const int32_t wr = g_audioSin[(m << shift) + n / 4]; // cos
+      const int32_t wi = -g_audioSin[m << shift];          // -sin
+      for (uint16_t i = m; i < n; i += half << 1)
+      {
+        const uint16_t k = i + half;
+        // >> 15 for Q15 and one more to halve, rounded so truncation doesn't leave a noise floor
+        const int32_t tr = (wr * re[k] - wi * im[k] + 0x8000) >> 16;
+        const int32_t ti = (wr * im[k] + wi * re[k] + 0x8000) >> 16;
+        const int32_t qr = (re[i] + 1) >> 1;
+        const int32_t qi = (im[i] + 1) >> 1;
+        re[k] = (int16_t)(qr - tr);
+        im[k] = (int16_t)(qi - ti);
+        re[i] = (int16_t)(qr + tr);
+        im[i] = (int16_t)(qi + ti);
+      }
+    }
+  }
+}
+
+// |z| to within about 4% without a square root
+static inline uint32_t AudioMagnitude(int32_t re, int32_t im)
+{
+  const uint32_t a = re < 0 ? -re : re;
+  const uint32_t b = im < 0 ? -im : im;
+  return a > b ? a + (b * 3 >> 3) : b + (a * 3 >> 3);
+}
+
+// log2(v) in 8.8 fixed point, from the leading bit and a linear fraction; 0 for 0
+static inline uint16_t AudioLog2Q8(uint32_t v)
+{
+  if (v == 0)
+  {
+    return 0;
+  }
+  uint8_t whole = 31;
+  while (!(v & (1UL << whole)))
+  {
+    whole--;
+  }
+  const uint32_t fraction = whole >= 8 ? (v >> (whole - 8)) & 0xFF : (v << (8 - whole)) & 0xFF;
+  return (uint16_t)((whole << 8) | fraction);
+}
+
+// AudioAnalyzer
+//
+// The whole pipeline.  Not thread safe; one task pushes and reads Features() (see audio.h).
+
+class AudioAnalyzer
+{
+public:
+  void Begin(uint32_t sampleRate = AUDIO_SAMPLE_RATE)
+  {
+    AudioBuildTables(sampleRate);
+    memset(this, 0, sizeof(*this));
+    _refractoryHops = (uint16_t)((uint32_t)kBeatRefractoryMs * sampleRate / 1000 / AUDIO_HOP);
+    _peakQ8 = kAudioFloorQ8 + kAudioRangeQ8;
+  }
+
+  /**
+   * @brief Feed mono samples; runs an analysis for every AUDIO_HOP of them.
+   *
+   * @return Number of analyses run
+   */
+  uint16_t Push(const int16_t *samples, size_t count)
+  {
+    uint16_t analyses = 0;
+    while (count > 0)
+    {
+      const size_t take = count < (size_t)(AUDIO_HOP - _fill) ? count : (size_t)(AUDIO_HOP - _fill);
+      for (size_t i = 0; i < take; i++)
+      {
+        // One-pole DC blocker; MEMS microphones commonly sit well off zero
+        const int32_t x = (int32_t)samples[i] << 8;
+        _dc += (x - _dc) >> 10;
+        const int32_t y = (x - _dc) >> 8;
+        _history[AUDIO_HOP + _fill + i] = (int16_t)(y > 32767 ? 32767 : (y < -32768 ? -32768 : y));
+      }
+      _fill += take;
+      samples += take;
+      count -= take;
+      if (_fill == AUDIO_HOP)
+      {
+        Analyze();
+        analyses++;
+        memmove(_history, _history + AUDIO_HOP, sizeof(_history[0]) * (AUDIO_FFT_SIZE - AUDIO_HOP));
+        _fill = 0;
+      }
+    }
+    return analyses;
+  }
+
+  const AudioFeatures &Features() const
+  {
+    return _features;
+  }
+
+private:
+  // Map a log magnitude onto 0-255 below the current gain peak
+  uint8_t Scale(uint16_t logQ8) const
+  {
+    const int32_t bottom = (int32_t)_peakQ8 - kAudioRangeQ8;
+    const int32_t value = ((int32_t)logQ8 - bottom) * 255 / kAudioRangeQ8;
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+  }
+
+  static uint8_t Smooth(uint8_t previous, uint8_t target)
+  {
+    if (target > previous)
+    {
+      return previous + ((target - previous + (1 << kAudioAttack) - 1) >> kAudioAttack);
+    }
+    return previous - ((previous - target + (1 << kAudioRelease) - 1) >> kAudioRelease);
+  }
+
+  void Analyze()
+  {
+    // The history holds the previous hop followed by the new one, i.e. the last AUDIO_FFT_SIZE samples.
+    // Quiet blocks are scaled up before the transform (block floating point) and the logs scaled back
+    // down after, so they aren't lost in the FFT's rounding.
+    int32_t largest = 0;
+    for (uint16_t i = 0; i < AUDIO_FFT_SIZE; i++)
+    {
+      const int32_t windowed = ((int32_t)_history[i] * g_audioWindow[i]) >> 15;
+      largest = windowed > largest ? windowed : (-windowed > largest ? -windowed : largest);
+      _re[i] = (int16_t)windowed;
+      _im[i] = 0;
+    }
+    uint8_t headroom = 0;
+    while (largest != 0 && (largest << (headroom + 1)) < 16384 && headroom < 12)
+    {
+      headroom++;
+    }
+    for (uint16_t i = 0; headroom != 0 && i < AUDIO_FFT_SIZE; i++)
+    {
+      _re[i] = (int16_t)(_re[i] << headroom);
+    }
+    AudioFft(_re, _im);
+
+    uint16_t loudest = 0;
+    uint16_t logs[AUDIO_BANDS];
+    uint32_t energy[AUDIO_BANDS];
+    for (uint8_t band = 0; band < AUDIO_BANDS; band++)
+    {
+      uint32_t sum = 0;
+      for (uint16_t bin = g_audioBandEdge[band]; bin < g_audioBandEdge[band + 1]; bin++)
+      {
+        sum += AudioMagnitude(_re[bin], _im[bin]);
+      }
+      energy[band] = sum;
+      // Sum rather than mean: a wide treble band should count for more than one bass bin, and
+      // music's falling spectrum roughly evens the bands out
+      const uint16_t logQ8 = AudioLog2Q8(sum << 4);
+      logs[band] = logQ8 > (headroom << 8) ? logQ8 - (headroom << 8) : 0;
+      loudest = logs[band] > loudest ? logs[band] : loudest;
+    }
+
+    // Automatic gain: snap up to a louder peak, drift back down by 1/256 octave per hop (0.3 per second)
+    if (loudest > _peakQ8)
+    {
+      _peakQ8 = loudest;
+    }
+    else if (_peakQ8 > kAudioFloorQ8 + kAudioRangeQ8)
+    {
+      _peakQ8--;
+    }
+
+    uint16_t total = 0;
+    for (uint8_t band = 0; band < AUDIO_BANDS; band++)
+    {
+      _features.bands[band] = Smooth(_features.bands[band], Scale(logs[band]));
+      total += _features.bands[band];
+    }
+    _features.level = (uint8_t)(total / AUDIO_BANDS);
+    _features.bass = (uint8_t)((_features.bands[0] + _features.bands[1]) / 2);
+    _features.mid = (uint8_t)((_features.bands[2] + _features.bands[3] + _features.bands[4]) / 3);
+    _features.treble = (uint8_t)((_features.bands[5] + _features.bands[6] + _features.bands[7]) / 3);
+
+    // Beat: bass energy jumps well above its running average (about a second's worth), while rising,
+    // loud enough to register on the scale, and not too soon after the last one
+    const uint32_t bass = (energy[0] + energy[1]) >> headroom;
+    const bool onset = (uint64_t)bass * 256 > (uint64_t)_bassAverage * kBeatRatioQ8 && bass > _lastBass &&
+                       Scale(logs[0] > logs[1] ? logs[0] : logs[1]) > 64;
+    if (_sinceBeat < 0xFFFF)
+    {
+      _sinceBeat++;
+    }
+    if (onset && _sinceBeat >= _refractoryHops)
+    {
+      _features.beatCount++;
+      _features.beatPulse = 255;
+      _sinceBeat = 0;
+    }
+    else
+    {
+      _features.beatPulse = _features.beatPulse > 10 ? _features.beatPulse - 10 : 0;
+    }
+    _bassAverage = _bassAverage - _bassAverage / 64 + bass / 64;
+    _lastBass = bass;
+    _features.hops++;
+  }
+
+  int16_t _history[AUDIO_FFT_SIZE];
+  int16_t _re[AUDIO_FFT_SIZE];
+  int16_t _im[AUDIO_FFT_SIZE];
+  uint16_t _fill;
+  int32_t _dc;
+  uint16_t _peakQ8;
+  uint32_t _bassAverage;
+  uint32_t _lastBass;
+  uint16_t _sinceBeat;
+  uint16_t _refractoryHops;
+  AudioFeatures _features;
+};
@@ -0,0 +1,77 @@
+/**
+ * @file bench.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Cycle-counted samples and their summary lines for the on-device benchmark
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   The "bench" command (RunBench() in main.cpp) times each stage of a frame with the CPU cycle
+ *   counter, which is exact to the cycle and costs one instruction to read, and so catches what a
+ *   host benchmark can't: flash cache misses, code in flash rather than IRAM, and the real cost of
+ *   the output driver.
+ *
+ *   Every result is one comma-separated line, "bench,<stage>,<name>,<frames>,<min>,<median>,<max>"
+ *   in cycles, so the output of two builds can be compared with diff or loaded into a spreadsheet.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial benchmark
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef BENCH_FRAMES
+#define BENCH_FRAMES 100 // Frames per effect when the command doesn't say
+#endif
+#define BENCH_MAX_FRAMES 256
+
+static inline uint32_t BenchCycles()
+{
+  return ESP.getCycleCount();
+}
+
+class BenchSamples
+{
+public:
+  void Clear()
+  {
+    _count = 0;
+  }
+
+  void Add(uint32_t cycles)
+  {
+    if (_count < BENCH_MAX_FRAMES)
+    {
+      _samples[_count++] = cycles;
+    }
+  }
+
+  // Format the summary line for @p stage and @p name.  Sorts the samples.
+  void Format(char *line, size_t size, const char *stage, const char *name)
+  {
+    // Insertion sort: at most a few hundred samples, and usually close to sorted already
+    for (uint16_t i = 1; i < _count; i++)
+    {
+      const uint32_t sample = _samples[i];
+      uint16_t j = i;
+      for (; j > 0 && _samples[j - 1] > sample; j--)
+      {
+        _samples[j] = _samples[j - 1];
+      }
+      _samples[j] = sample;
+    }
+    if (_count == 0)
+    {
+      snprintf(line, size, "bench,%s,%s,0,0,0,0", stage, name);
+      return;
+    }
+    snprintf(line, size, "bench,%s,%s,%u,%lu,%lu,%lu", stage, name, _count, (unsigned long)_samples[0],
+             (unsigned long)_samples[_count / 2], (unsigned long)_samples[_count - 1]);
+  }
+
+private:
+  uint32_t _samples[BENCH_MAX_FRAMES];
+  uint16_t _count = 0;
+};
@@ -0,0 +1,116 @@
+/**
+ * @file ble_protocol.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Binary GATT profile for controlling the lights over BLE
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   Every parameter has its own characteristic holding just its value, so setting one is a single
+ *   write without response of one to three bytes, with nothing to format or parse at either end.  The
+ *   STATE characteristic holds all of them packed together: read it (or subscribe to it) to follow
+ *   the controller, or write it to change everything in one operation.
+ *
+ *   STATE notifications are coalesced: however many parameters change, at most one goes out per
+ *   connection interval, which is as often as the link could deliver them anyway.
+ *
+ *   The text service (Nordic UART UUIDs) stays alongside for the commands with no binary form.
+ *
+ *   Only the C library is used, so a client can include this as is.  Multi-byte fields are
+ *   little-endian.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial profile
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// 128-bit UUIDs differing only in their second group of four hex digits
+#define BLE_CONTROL_SERVICE_UUID "55420000-4c47-4854-8000-0a55b1d93e01"
+#define BLE_STATE_UUID "55420001-4c47-4854-8000-0a55b1d93e01"
+#define BLE_PARAM_UUID_FORMAT "5542%04x-4c47-4854-8000-0a55b1d93e01"
+
+const uint8_t kBleProtocolVersion = 1;
+
+// Parameter characteristics; the UUID of each is BLE_PARAM_UUID_FORMAT with 0x0100 + its value
+enum BleParam : uint8_t
+{
+  BLE_PARAM_POWER,      // uint8 0 or 1
+  BLE_PARAM_BRIGHTNESS, // uint8
+  BLE_PARAM_EFFECT,     // uint8 effect number; also loads that effect's speed and count
+  BLE_PARAM_COLOR,      // uint8 r, g, b
+  BLE_PARAM_SPEED,      // uint8 1-255
+  BLE_PARAM_COUNT,      // uint8 1-16
+  BLE_PARAM_TRANSITION, // uint8 style, uint16 ms
+  BLE_PARAM_COUNT_
+};
+
+const uint8_t kBleParamSize[BLE_PARAM_COUNT_] = {1, 1, 1, 3, 1, 1, 3};
+
+struct __attribute__((packed)) BleState
+{
+  uint8_t version;
+  uint8_t effectCount; // Effects are numbered 0 to effectCount - 1
+  uint8_t power;
+  uint8_t brightness;
+  uint8_t effect;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t speed;
+  uint8_t count;
+  uint8_t transition;
+  uint16_t transitionMs;
+};
+
+// Where each parameter's value sits in BleState, so parameter and state writes share one decoder
+const uint8_t kBleParamOffset[BLE_PARAM_COUNT_] = {
+    offsetof(BleState, power),
+    offsetof(BleState, brightness),
+    offsetof(BleState, effect),
+    offsetof(BleState, r),
+    offsetof(BleState, speed),
+    offsetof(BleState, count),
+    offsetof(BleState, transition)};
+
+static inline void BleParamUuid(char *uuid, size_t size, BleParam param)
+{
+  snprintf(uuid, size, BLE_PARAM_UUID_FORMAT, 0x0100 + param);
+}
+
+/**
+ * @brief Copy a write to parameter @p param into @p state.
+ *
+ * @return false, leaving @p state alone, if @p length is wrong for the parameter
+ */
+static inline bool BleWriteParam(BleState &state, BleParam param, const uint8_t *data, size_t length)
+{
+  if (param >= BLE_PARAM_COUNT_ || length != kBleParamSize[param])
+  {
+    return false;
+  }
+  memcpy(reinterpret_cast<uint8_t *>(&state) + kBleParamOffset[param], data, length);
+  return true;
+}
+
+/**
+ * @brief Copy a write to the STATE characteristic into @p state.
+ *
+ * The version and effect count are the controller's and aren't taken from the write.
+ */
+static inline bool BleWriteState(BleState &state, const uint8_t *data, size_t length)
+{
+  if (length != sizeof(BleState) || data[0] != kBleProtocolVersion)
+  {
+    return false;
+  }
+  const uint8_t effectCount = state.effectCount;
+  memcpy(&state, data, sizeof(BleState));
+  state.effectCount = effectCount;
+  return true;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file beatpulse.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Every beat launches a ring of color out from the middle of the bar over a bass-driven glow
+ * @version 0.1
+ * @date 10/19/26
+ */
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "audio_dsp.h"
+
+extern CRGB *g_LEDs;
+extern uint8_t g_EffectSpeed;
+extern uint8_t g_EffectCount;
+extern AudioFeatures g_Audio;
+
+static const uint8_t kMaxRipples = 16;
+
+static uint32_t g_ripplePos[kMaxRipples]; // Distance from the middle, 16.16; 0 when unused
+static uint8_t g_rippleHue[kMaxRipples];
+static uint8_t g_beatHue = 0;
+static uint8_t g_nextRipple = 0;
+
+void ResetBeatPulse()
+{
+    memset(g_ripplePos, 0, sizeof(g_ripplePos));
+    g_beatHue = 0;
+    g_nextRipple = 0;
+}
+
+void DrawBeatPulse()
+{
+    const uint16_t half = NUM_LEDS / 2;
+    const uint8_t ripples = constrain(g_EffectCount, 1, kMaxRipples);
+    const uint32_t step = (uint32_t)g_EffectSpeed << 11; // Up to 4 pixels a frame
+
+    if (g_Audio.beat)
+    {
+        g_beatHue += 40;
+        g_nextRipple = (g_nextRipple + 1) % ripples;
+        g_ripplePos[g_nextRipple] = 1UL << 16;
+        g_rippleHue[g_nextRipple] = g_beatHue;
+    }
+
+    // Background glow follows the bass in the current beat's color
+    fill_solid(g_LEDs, NUM_LEDS, CHSV(g_beatHue, 255, scale8(g_Audio.bass, 96)));
+
+    for (uint8_t r = 0; r < ripples; r++)
+    {
+        if (g_ripplePos[r] == 0)
+        {
+            continue;
+        }
+        const uint16_t pos = g_ripplePos[r] >> 16;
+        if (pos >= half)
+        {
+            g_ripplePos[r] = 0;
+            continue;
+        }
+        // Rings dim as they travel
+        const CRGB color = CHSV(g_rippleHue[r], 200, 255 - (uint8_t)((uint32_t)pos * 200 / half));
+        for (uint8_t w = 0; w < 3 && pos + w < half; w++)
+        {
+            g_LEDs[half + pos + w] += color;
+            g_LEDs[half - 1 - pos - w] += color;
+        }
+        g_ripplePos[r] += step;
+    }
+}
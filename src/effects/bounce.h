@@ -2,26 +2,28 @@
  * @file bounce.h
  * @author Kevin Murphy (https://www.SomerledDesign.com)
  * @brief Bouncing Ball effect on an LED strip
- * @version 0.1
- * @date 09/02/24
+ * @version 0.3
+ * @date 10/19/26
  *
  *   Version History -
  *
  *   0.1 - 09/02/24 - A work in progress
+ *   0.2 - 10/19/26 - Advance() runs the physics without drawing
+ *   0.3 - 10/19/26 - Balls fly the length of the bar from the layout, through its corners, and mirror from its far end
  *
  *
  */
-#include <sys/time.h>
-
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h> // https://github.com/FastLED/FastLED
+#include "particles.h"
+#include "layout.h"
 
 using namespace std;
-#include <vector>
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
+extern uint64_t g_EffectTimeUs;
 
 #define ARRAYSIZE(a) (sizeof(a) / sizeof(a[0])) // Calculate the number of elements in an array
 
@@ -54,14 +56,15 @@ class BouncingBallEffect
     const double ImpactVelocity = InitialBallSpeed(StartHeight);
     const double SpeedKnob = 4.0; // Higher values will slow the effect
 
-    vector<double> ClockTimeAtLastBounce, Height, BallSpeed, Dampening;
-    vector<CRGB> Colors;
+    static const size_t MaxBalls = 16; // Fixed storage, so a change of ball count never touches the heap
+
+    double ClockTimeAtLastBounce[MaxBalls], Height[MaxBalls], BallSpeed[MaxBalls], Dampening[MaxBalls];
+    ParticleSystem<MaxBalls> Balls; // Distance along the bar and color; the physics above moves them
 
+    // Effect time rather than wall time, so that synchronized controllers bounce in step
     static double Time()
     {
-        timeval tv = {0};
-        gettimeofday(&tv, nullptr);
-        return (double)(tv.tv_usec / 1000000.0 + (double)tv.tv_sec);
+        return g_EffectTimeUs / 1000000.0;
     }
 
   public:
@@ -72,58 +75,39 @@ class BouncingBallEffect
 
     BouncingBallEffect(size_t cLength, size_t ballCount = 3, byte fade = 0, bool bMirrored = false)
         : _cLength(cLength - 1),
-          _cBalls(ballCount),
+          _cBalls(ballCount < MaxBalls ? ballCount : (size_t)MaxBalls),
           _fadeRate(fade),
-          _bMirrored(bMirrored),
-          ClockTimeAtLastBounce(ballCount),
-          Height(ballCount),
-          BallSpeed(ballCount),
-          Dampening(ballCount),
-          Colors(ballCount)
+          _bMirrored(bMirrored)
     {
         Reset();
     }
 
     void Reset()
     {
+        Balls.Clear();
         for (size_t i = 0; i < _cBalls; i++)
         {
             Height[i] = StartHeight;                      // Starting height
             ClockTimeAtLastBounce[i] = Time();            // When ball last hit ground state
             Dampening[i] = 0.90 - i / pow(_cBalls, 2);    // Bounciness of this ball
             BallSpeed[i] = InitialBallSpeed(StartHeight); // Don't dampen initial launch
-            Colors[i] = ballColors[i % ARRAYSIZE(ballColors)];
+            Balls.Spawn(Top(), 0, ballColors[i % ARRAYSIZE(ballColors)]);
         }
     }
 
     void Resize(size_t ballCount)
     {
-        _cBalls = ballCount;
-        ClockTimeAtLastBounce.assign(ballCount, 0.0);
-        Height.assign(ballCount, 0.0);
-        BallSpeed.assign(ballCount, 0.0);
-        Dampening.assign(ballCount, 0.0);
-        Colors.assign(ballCount, CRGB::Black);
+        _cBalls = ballCount < MaxBalls ? ballCount : (size_t)MaxBalls;
         Reset();
     }
 
-    // Draw
+    // Advance
     //
-    // Draw each of the balls.  When any ball settles with too little energy it is 'kicked' to the other direction
-
-    virtual void Draw()
-    {   
-        if (_fadeRate != 0)
-        {
-            for (size_t i = 0; i < _cLength; i++)
-               g_LEDs[i].fadeToBlackBy(_fadeRate);
-        }
-        else
-            FastLED.clear();
-
-        // Draw each of the balls
-
+    // Move each of the balls to where it is at the current effect time, without drawing them.  When any ball
+    // settles with too little energy it is 'kicked' to the other direction
 
+    void Advance()
+    {
         for (size_t i = 0; i < _cBalls; i++)
         {
             double speedKnob = 8.0 - (g_EffectSpeed / 255.0) * 6.0;
@@ -144,17 +128,53 @@ class BouncingBallEffect
                     BallSpeed[i] = InitialBallSpeed(StartHeight) * Dampening[i];
             }
 
-            size_t position = (size_t)(Height[i] * (_cLength - 1 ) / StartHeight);
+            // Sub-pixel position, so a slow ball near the top of its arc glides rather than steps
+            Balls.pos[i] = constrain((int32_t)(Height[i] * Top() / StartHeight), 0, Top());
+        }
+    }
+
+    // Top
+    //
+    // Highest a ball goes, in particle units: a ball's width short of the far end.  For the whole strip that is
+    // the length of the bar from the layout, corner gaps and all.
+
+    int32_t Top() const
+    {
+        const int32_t length = _cLength + 1 == NUM_LEDS ? LayoutLength() : _cLength + 1;
+        return ParticlePixels(length - 2);
+    }
+
+    // DrawBall
+    //
+    // Splat a ball at @p distance along the bar, wherever the layout puts that; nothing while it crosses a gap
 
-            g_LEDs[position]     += Colors[i];
-            g_LEDs[position + 1] += Colors[i];
+    void DrawBall(int32_t distance, const CRGB &color)
+    {
+        const int32_t pos = LayoutLogicalAt(distance);
+        if (pos >= 0)
+            ParticleSplat(g_LEDs, NUM_LEDS, pos, ParticlePixels(2), color, PARTICLE_ADD);
+    }
 
+    // Draw
+    //
+    // Draw each of the balls
+
+    virtual void Draw()
+    {   
+        if (_fadeRate != 0)
+        {
+            for (size_t i = 0; i < _cLength; i++)
+               g_LEDs[i].fadeToBlackBy(_fadeRate);
+        }
+        else
+            fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+
+        Advance();
+        for (size_t i = 0; i < _cBalls; i++)
+        {
+            DrawBall(Balls.pos[i], Balls.color[i]);
             if (_bMirrored)
-            {
-                g_LEDs[_cLength - 1 - position] += Colors[i];
-                g_LEDs[_cLength - position]     += Colors[i];
-            }
+                DrawBall(Top() - Balls.pos[i], Balls.color[i]);
         }
-            delay(20);
     }
 };
@@ -15,37 +15,44 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h> // https://github.com/FastLED/FastLED  
+#include "particles.h"
+#include "hue_lut.h"
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
 
+static byte g_cometHue = HUE_RED;    // Current color
+static ParticleSystem<1> g_comet;    // The head; its velocity's sign is the direction
+
+void ResetComet()
+{
+    g_cometHue = HUE_RED;
+    g_comet.Clear();
+}
+
 void DrawComet()
 {
     const byte fadeAmt = 64;       // Fraction of 256 to fade a pixel by if it is chosen to be faded
     const int cometSize = constrain(g_EffectCount, 2, 20);        // Size of the comet in pixels
     const int deltaHue = 4;         // How far to step the cycling hue each draw call
-    const double cometSpeed = 0.2 + (g_EffectSpeed / 255.0) * 1.6;  // How far to advance the comet every frame
-
-    static byte hue = HUE_RED;      // Current color
-    static int iDirection = 1;      // current direction (-1 or +1)
-    static double iPos = 0.0;       // current comet position on strip
+    const int16_t cometSpeed = PARTICLE_ONE / 5 + (g_EffectSpeed * 8 * PARTICLE_ONE) / (5 * 255);  // 0.2 to 1.8 pixels a frame
 
-    hue += deltaHue;                // Update comet color
-    iPos += iDirection * cometSpeed;// Updtate comet position
+    // The head's origin stays in [0, NUM_LEDS - cometSize], so the whole comet is always on the strip
+    g_comet.SetBounds(0, ParticlePixels(NUM_LEDS - cometSize), PARTICLE_BOUNCE);
+    if (g_comet.Count() == 0)
+        g_comet.Spawn(0, cometSpeed, CRGB::Black);
 
-// Flip the comet direction when it hits either side
-if (iPos == (NUM_LEDS - cometSize) || iPos == 0)
-    iDirection *= -1;
-    
-// Draw a comet at its current position
-for (int i = 0; i < cometSize; i++)
-    g_LEDs[(int)iPos + i].setHue(hue);
+    g_cometHue += deltaHue;                                             // Update comet color
+    g_comet.color[0] = HueColor(g_cometHue);
+    g_comet.vel[0] = g_comet.vel[0] < 0 ? -cometSpeed : cometSpeed;
+    g_comet.Update();                                                   // Move it, bouncing off either end
 
-// Fade the LEDs one step
-for (int j = 0; j < NUM_LEDS; j++)
-    if (random(2) == 1)
-        g_LEDs[j] = g_LEDs[j].fadeToBlackBy(fadeAmt);
+    // Draw a comet at its current position
+    g_comet.Render(g_LEDs, NUM_LEDS, ParticlePixels(cometSize), 0, PARTICLE_LIGHTEN);
 
-    delay(10);
-}   
+    // Fade the LEDs one step
+    for (int j = 0; j < NUM_LEDS; j++)
+        if (random(2) == 1)
+            g_LEDs[j] = g_LEDs[j].fadeToBlackBy(fadeAmt);
+}
@@ -10,19 +10,30 @@
 #define FASTLED_INTERNAL
 #include <FastLED.h>
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
+extern uint16_t g_RenderLeds;
+extern uint8_t g_LodShift;
 
 static inline uint8_t MapU8Double(uint8_t x, uint8_t inMin, uint8_t inMax, uint8_t outMin, uint8_t outMax)
 {
     return (uint8_t)(((uint32_t)(x - inMin) * (outMax - outMin)) / (inMax - inMin) + outMin);
 }
 
+static uint8_t g_doublePaletteIndexA = 0;
+static uint8_t g_doublePaletteIndexB = 0;
+
+void ResetDoublePalette()
+{
+    g_doublePaletteIndexA = 0;
+    g_doublePaletteIndexB = 0;
+}
+
 void DrawDoublePalette()
 {
-    static uint8_t indexA = 0;
-    static uint8_t indexB = 0;
+    uint8_t &indexA = g_doublePaletteIndexA;
+    uint8_t &indexB = g_doublePaletteIndexB;
     CRGBPalette256 paletteA = RainbowColors_p;
     CRGBPalette256 paletteB = PartyColors_p;
     uint8_t step = max<uint8_t>(1, g_EffectSpeed / 10);
@@ -32,9 +43,9 @@ void DrawDoublePalette()
     indexA += step;
     indexB -= step;
 
-    for (int i = 0; i < NUM_LEDS; i++)
+    for (int i = 0; i < g_RenderLeds; i++)
     {
-        uint8_t idx = i * scale;
+        uint8_t idx = (i << g_LodShift) * scale;
         CRGB colorA = ColorFromPalette(paletteA, indexA + idx, 255, LINEARBLEND);
         CRGB colorB = ColorFromPalette(paletteB, indexB + idx, 255, LINEARBLEND);
         g_LEDs[i] = blend(colorA, colorB, blendAmount);
@@ -10,30 +10,43 @@
 #define FASTLED_INTERNAL
 #include <FastLED.h>
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
+extern uint16_t g_RenderLeds;
 
 static inline uint8_t MapU8Fire(uint8_t x, uint8_t inMin, uint8_t inMax, uint8_t outMin, uint8_t outMax)
 {
     return (uint8_t)(((uint32_t)(x - inMin) * (outMax - outMin)) / (inMax - inMin) + outMin);
 }
 
-void DrawFire()
+static byte g_fireHeat[NUM_LEDS];
+
+void ResetFire()
+{
+    memset(g_fireHeat, 0, sizeof(g_fireHeat));
+}
+
+// AdvanceFire
+//
+// One frame of the heat simulation, without drawing it
+
+void AdvanceFire()
 {
-    static byte heat[NUM_LEDS];
+    byte *heat = g_fireHeat;
+    const int count = g_RenderLeds; // Simulate at the governor's resolution; see quality.h
     const uint8_t cooling = MapU8Fire(g_EffectSpeed, 1, 255, 80, 20);
     const uint8_t sparking = MapU8Fire(g_EffectSpeed, 1, 255, 60, 180);
     const uint8_t sparks = constrain(g_EffectCount, 1, 8);
 
     // Cool down every cell a little
-    for (int i = 0; i < NUM_LEDS; i++)
+    for (int i = 0; i < count; i++)
     {
-        heat[i] = qsub8(heat[i], random8(0, ((cooling * 10) / NUM_LEDS) + 2));
+        heat[i] = qsub8(heat[i], random8(0, ((cooling * 10) / count) + 2));
     }
 
     // Heat drifts up and diffuses
-    for (int k = NUM_LEDS - 1; k >= 2; k--)
+    for (int k = count - 1; k >= 2; k--)
     {
         heat[k] = (heat[k - 1] + heat[k - 2] + heat[k - 2]) / 3;
     }
@@ -47,10 +60,16 @@ void DrawFire()
             heat[y] = qadd8(heat[y], random8(160, 255));
         }
     }
+}
+
+void DrawFire()
+{
+    AdvanceFire();
 
     // Map heat to LED colors
-    for (int j = 0; j < NUM_LEDS; j++)
+    const int count = g_RenderLeds;
+    for (int j = 0; j < count; j++)
     {
-        g_LEDs[j] = HeatColor(heat[j]);
+        g_LEDs[j] = HeatColor(g_fireHeat[j]);
     }
 }
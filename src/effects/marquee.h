@@ -15,28 +15,32 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h>
+#include "hue_lut.h"
 
-void DrawMarquee()
+static uint16_t g_marqueeHue = HUE_BLUE << 8;
+static float g_marqueeScroll = 0.0f;
+
+void ResetMarquee()
 {
-    static byte j = HUE_BLUE;
-    j += 4;
-    byte k = j;
+    g_marqueeHue = HUE_BLUE << 8;
+    g_marqueeScroll = 0.0f;
+}
 
-    // The following is roughly equivalent to fill_rainbow(g_LEDs, NUM_LEDS, j, 8);
+void DrawMarquee()
+{
+    // Hue and scroll steps are per render (~26 ms); they used to be paced by a delay(50) in here
+    g_marqueeHue += 384;
+    byte k = g_marqueeHue >> 8;
 
-    CRGB c;
-    for (int i = 0; i < NUM_LEDS; i++)
-        g_LEDs[i] = c.setHue(k += 8);
+    // Same as setHue() on each pixel with the hue stepping by 8, starting one step past k
+    FillHueGradient(g_LEDs, NUM_LEDS, (uint8_t)(k + 8) << 8, 8 << 8);
 
-    static float scroll = 0.0f;
-    scroll += 0.1f;
-    if (scroll > 5.0f)
-        scroll -= 5.0f;
+    g_marqueeScroll += 0.04f;
+    if (g_marqueeScroll > 5.0f)
+        g_marqueeScroll -= 5.0f;
 
-    for (float i = scroll; i < NUM_LEDS / 2 - 1; i += 5)
+    for (float i = g_marqueeScroll; i < NUM_LEDS / 2 - 1; i += 5)
     {
         DrawPixels(i, 3, CRGB::Green);
     }
-
-    delay(50);
 }
@@ -9,35 +9,58 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h>
+#include "particles.h"
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
 
-void DrawMeteor()
+static const uint8_t kMaxMeteors = 8;
+
+static ParticleSystem<kMaxMeteors> g_meteors;
+static uint16_t g_meteorSpeed[kMaxMeteors]; // Particle units per frame before the speed knob
+static uint16_t g_meteorHue[kMaxMeteors];   // 1/256 of a hue step
+
+void ResetMeteor()
 {
-    const uint8_t meteorSize = 6;
-    const uint8_t trailDecay = 64;
-    const bool randomDecay = true;
-    static const uint8_t kMaxMeteors = 8;
+    g_meteors.Clear();
+}
+
+static const uint8_t kMeteorSize = 6;
+
+// AdvanceMeteor
+//
+// Move the meteors on by one frame, without drawing them
+
+void AdvanceMeteor()
+{
+    // Each meteor is drawn over the kMeteorSize pixels ending at its position, so keep that on the strip
+    g_meteors.SetBounds(ParticlePixels(kMeteorSize), ParticlePixels(NUM_LEDS - 1), PARTICLE_BOUNCE);
 
-    static bool initialized = false;
-    static float pos[kMaxMeteors];
-    static float speed[kMaxMeteors];
-    static float hue[kMaxMeteors];
-    static bool left[kMaxMeteors];
+    uint8_t meteorCount = constrain(g_EffectCount, 1, kMaxMeteors);
+    g_meteors.Truncate(meteorCount);
+    while (g_meteors.Count() < meteorCount)
+    {
+        const int i = g_meteors.Count();
+        g_meteorSpeed[i] = PARTICLE_ONE * 6 / 10 + random(0, PARTICLE_ONE * 4 / 10);
+        g_meteorHue[i] = ((i * 48) % 255) << 8;
+        g_meteors.Spawn(ParticlePixels((NUM_LEDS / kMaxMeteors) * i), (i & 1) ? -1 : 1, CRGB::Black);
+    }
 
-    if (!initialized)
+    const uint16_t speedScale = 102 + (g_EffectSpeed * 410) / 255; // 0.4 to 2.0, in 1/256
+    for (int i = 0; i < meteorCount; i++)
     {
-        for (int i = 0; i < kMaxMeteors; i++)
-        {
-            pos[i] = (NUM_LEDS / kMaxMeteors) * i;
-            speed[i] = 0.6f + (random(0, 40) / 100.0f);
-            hue[i] = (i * 48) % 255;
-            left[i] = (i & 1) != 0;
-        }
-        initialized = true;
+        const int16_t speed = (g_meteorSpeed[i] * speedScale) >> 8;
+        g_meteors.vel[i] = g_meteors.vel[i] < 0 ? -speed : speed;
+        g_meteorHue[i] = (g_meteorHue[i] + 154) % (255 << 8); // 0.6 of a step a frame
     }
+    g_meteors.Update();
+}
+
+void DrawMeteor()
+{
+    const uint8_t trailDecay = 64;
+    const bool randomDecay = true;
 
     // Fade all LEDs down slightly
     for (int j = 0; j < NUM_LEDS; j++)
@@ -49,40 +72,11 @@ void DrawMeteor()
     }
 
     // Move and draw each meteor
-    uint8_t meteorCount = constrain(g_EffectCount, 1, kMaxMeteors);
-    float speedScale = 0.4f + (g_EffectSpeed / 255.0f) * 1.6f;
-    for (int i = 0; i < meteorCount; i++)
+    AdvanceMeteor();
+    for (int i = 0; i < g_meteors.Count(); i++)
     {
-        pos[i] = left[i] ? pos[i] - (speed[i] * speedScale) : pos[i] + (speed[i] * speedScale);
-
-        if (pos[i] < meteorSize)
-        {
-            left[i] = false;
-            pos[i] = meteorSize;
-        }
-        if (pos[i] >= NUM_LEDS)
-        {
-            left[i] = true;
-            pos[i] = NUM_LEDS - 1;
-        }
-
-        hue[i] += 0.6f;
-        if (hue[i] > 255.0f)
-        {
-            hue[i] -= 255.0f;
-        }
-
-        CHSV hsv((uint8_t)hue[i], 240, 255);
-        CRGB rgb;
-        hsv2rgb_rainbow(hsv, rgb);
-
-        for (int j = 0; j < meteorSize; j++)
-        {
-            int idx = (int)(pos[i] - j);
-            if (idx >= 0 && idx < NUM_LEDS)
-            {
-                nblend(g_LEDs[idx], rgb, 128);
-            }
-        }
+        CHSV hsv(g_meteorHue[i] >> 8, 240, 255);
+        hsv2rgb_rainbow(hsv, g_meteors.color[i]);
     }
+    g_meteors.Render(g_LEDs, NUM_LEDS, ParticlePixels(kMeteorSize), ParticlePixels(1 - kMeteorSize), PARTICLE_LIGHTEN);
 }
@@ -10,22 +10,31 @@
 #define FASTLED_INTERNAL
 #include <FastLED.h>
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
+extern uint16_t g_RenderLeds;
+extern uint8_t g_LodShift;
+
+static uint8_t g_paletteIndex = 0;
+
+void ResetPalette()
+{
+    g_paletteIndex = 0;
+}
 
 void DrawPalette()
 {
-    static uint8_t startIndex = 0;
+    uint8_t &startIndex = g_paletteIndex;
     CRGBPalette256 palette = RainbowColors_p;
     uint8_t step = max<uint8_t>(1, g_EffectSpeed / 12);
     uint8_t scale = constrain(g_EffectCount, 1, 16);
 
     startIndex += step;
 
-    for (int i = 0; i < NUM_LEDS; i++)
+    for (int i = 0; i < g_RenderLeds; i++)
     {
-        uint8_t colorIndex = startIndex + (i * scale);
+        uint8_t colorIndex = startIndex + ((i << g_LodShift) * scale);
         g_LEDs[i] = ColorFromPalette(palette, colorIndex, 255, LINEARBLEND);
     }
 }
@@ -15,16 +15,24 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h> // https://github.com/FastLED/FastLED
+#include "hue_lut.h"
 
 uint8_t initalHue = 0;
 const uint8_t deltaHue = 4;
 const uint8_t hueDensity = 8;
 
 extern uint8_t g_EffectSpeed;
+extern uint16_t g_RenderLeds;
+extern uint8_t g_LodShift;
 
+void ResetRainbow()
+{
+    initalHue = 0;
+}
+
 void DrawRainbow()
 {
-    fill_rainbow(g_LEDs, NUM_LEDS, initalHue, deltaHue);
+    FillHueGradient(g_LEDs, g_RenderLeds, initalHue << 8, (deltaHue << g_LodShift) << 8);
 
     uint8_t step = max<uint8_t>(1, g_EffectSpeed / 8);
     initalHue += step;
@@ -0,0 +1,30 @@
+/**
+ * @file sequence.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Plays the loaded FSEQ sequence as an effect (see fseq.h)
+ * @version 0.1
+ * @date 10/19/26
+ */
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+extern CRGB *g_LEDs;
+extern uint64_t g_EffectTimeUs;
+
+void FseqSeek(uint32_t position, uint64_t nowUs);
+bool FseqDraw(CRGB *leds, uint64_t nowUs);
+
+void ResetSequence()
+{
+    FseqSeek(0, g_EffectTimeUs);
+}
+
+void DrawSequence()
+{
+    if (!FseqDraw(g_LEDs, g_EffectTimeUs))
+    {
+        fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+    }
+}
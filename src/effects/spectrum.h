@@ -0,0 +1,47 @@
+/**
+ * @file spectrum.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Audio spectrum: one bar per band, mirrored out from the middle of the bar
+ * @version 0.1
+ * @date 10/19/26
+ */
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "audio_dsp.h"
+
+extern CRGB *g_LEDs;
+extern uint8_t g_EffectSpeed;
+extern AudioFeatures g_Audio;
+
+static uint16_t g_spectrumHue = 0; // 8.8
+
+void ResetSpectrum()
+{
+    g_spectrumHue = 0;
+}
+
+void DrawSpectrum()
+{
+    const uint16_t half = NUM_LEDS / 2;
+    const uint16_t segment = max<uint16_t>(1, half / AUDIO_BANDS);
+
+    g_spectrumHue += g_EffectSpeed;
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+
+    // Bass in the middle, treble at the ends; each bar grows outward from its inner edge
+    for (uint8_t band = 0; band < AUDIO_BANDS; band++)
+    {
+        const uint8_t value = g_Audio.bands[band];
+        const uint16_t lit = ((uint32_t)segment * value + 127) / 255;
+        const uint8_t hue = (g_spectrumHue >> 8) + band * (256 / AUDIO_BANDS);
+        for (uint16_t i = 0; i < lit; i++)
+        {
+            const CRGB color = CHSV(hue, 255, max<uint8_t>(64, value));
+            const uint16_t offset = band * segment + i;
+            g_LEDs[half + offset] = color;
+            g_LEDs[half - 1 - offset] = color;
+        }
+    }
+}
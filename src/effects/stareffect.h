@@ -9,8 +9,9 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h>
+#include "particles.h"
 
-extern CRGB g_LEDs[];
+extern CRGB *g_LEDs;
 extern uint8_t g_EffectSpeed;
 extern uint8_t g_EffectCount;
 
@@ -19,18 +20,32 @@ static inline uint8_t MapU8Star(uint8_t x, uint8_t inMin, uint8_t inMax, uint8_t
     return (uint8_t)(((uint32_t)(x - inMin) * (outMax - outMin)) / (inMax - inMin) + outMin);
 }
 
+static const uint16_t kMaxStars = 384;
+static ParticleSystem<kMaxStars> g_stars;
+
+void ResetStarEffect()
+{
+    g_stars.Clear();
+}
+
 void DrawStarEffect()
 {
+    // Stars fade out linearly over about the time the old per-frame fade took to darken them
     uint8_t fadeAmount = MapU8Star(g_EffectSpeed, 1, 255, 30, 6);
-    fadeToBlackBy(g_LEDs, NUM_LEDS, fadeAmount);
+    uint8_t lifetime = 512 / fadeAmount;
 
     uint8_t count = constrain(g_EffectCount, 1, 16);
     uint16_t starMax = max(2, NUM_LEDS / 12);
     uint16_t stars = MapU8Star(count, 1, 16, 1, (uint8_t)min<uint16_t>(255, starMax));
     for (uint16_t i = 0; i < stars; i++)
     {
-        int idx = random(NUM_LEDS);
+        // Anywhere along the strip, not only on a pixel: a star between two pixels lights both
+        int32_t pos = random(ParticlePixels(NUM_LEDS - 1));
         uint8_t hue = random8();
-        g_LEDs[idx] += CHSV(hue, 180, 255);
+        g_stars.Spawn(pos, 0, CHSV(hue, 180, 255), lifetime, true);
     }
+    g_stars.Update();
+
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+    g_stars.Render(g_LEDs, NUM_LEDS, PARTICLE_ONE, 0, PARTICLE_ADD);
 }
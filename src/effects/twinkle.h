@@ -15,6 +15,7 @@
 #include <Arduino.h>
 #define FASTLED_INTERNAL
 #include <FastLED.h> // https://github.com/FastLED/FastLED
+#include "particles.h"
 
 extern int g_Brightness;
 extern uint8_t g_EffectSpeed;
@@ -31,7 +32,7 @@ static const CRGB TwinkleColors[NUM_COLORS] =
 
 void DrawTwinkleOld()
 {
-    FastLED.clear(false); // Clear the strip, but don't push out the bits quite yet
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black); // Clear the frame; the output stage pushes it out
 
     for (int i = 0; i < NUM_LEDS / 4; i++)
     {
@@ -40,21 +41,27 @@ void DrawTwinkleOld()
     }
 }
 
+static const uint16_t kMaxTwinkles = 256;
+static ParticleSystem<kMaxTwinkles> g_twinkles;
+
+void ResetTwinkle()
+{
+    g_twinkles.Clear();
+}
+
 void DrawTwinkle()
 {
-    static int passCount = 0;
-    passCount += max<uint8_t>(1, g_EffectSpeed / 64);
-    // Every time passCount reaches a quarter of the LED total, we reset the strip
-    if (passCount == NUM_LEDS )
-    {
-        passCount = 0;
-        FastLED.clear(false); // Clear the strip, but don't push out the bits quite yet
-    }
+    // Each twinkle stays lit for a while and then goes out; the faster the speed, the sooner
+    const uint8_t lifetime = 250 - (g_EffectSpeed * 210) / 255;
 
     uint16_t count = constrain(g_EffectCount, 1, NUM_LEDS / 2);
     for (uint16_t i = 0; i < count; i++)
     {
-        g_LEDs[random(NUM_LEDS)] = TwinkleColors[random(NUM_COLORS)];
+        // Spawn fails once the system is full, which caps the density
+        g_twinkles.Spawn(ParticlePixels(random(NUM_LEDS)), 0, TwinkleColors[random(NUM_COLORS)], lifetime);
     }
-    // delay(200);
+    g_twinkles.Update();
+
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black); // Clear the frame; the output stage pushes it out
+    g_twinkles.Render(g_LEDs, NUM_LEDS, PARTICLE_ONE, 0, PARTICLE_ADD);
 }
@@ -0,0 +1,96 @@
+/**
+ * @file userprogram.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Runs the user's per-pixel program (see pixelvm.h) as an effect
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   The program is compiled into a scratch copy first, so one with a mistake in it never replaces the
+ *   one that is running.  It keeps no state between frames, so it can be drawn at a reduced level of
+ *   detail, and t counts from the effect's start so synchronized controllers agree on it.
+ *
+ */
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "audio_dsp.h"
+#include "pixelvm.h"
+
+extern CRGB *g_LEDs;
+extern uint8_t g_EffectSpeed;
+extern uint8_t g_EffectCount;
+extern uint16_t g_RenderLeds;
+extern uint8_t g_LodShift;
+extern uint64_t g_EffectTimeUs;
+extern AudioFeatures g_Audio;
+
+static const char kDefaultUserProgram[] = "h = x * count + t * speed / 4\nv = wave(x * 3 - t * speed)";
+
+static PixelProgram g_userProgram = {};
+static PixelProgram g_userProgramScratch = {};
+static char g_userProgramSource[PIXELVM_MAX_SOURCE] = {0};
+static uint64_t g_userProgramStartUs = 0;
+
+/**
+ * @brief Compile @p source and, if it compiles, make it the running program.
+ *
+ * @param error Receives "column N: message" on failure
+ * @return True if the program compiled
+ */
+bool CompileUserProgram(const char *source, char *error, size_t errorSize)
+{
+    if (strlen(source) >= sizeof(g_userProgramSource))
+    {
+        snprintf(error, errorSize, "column %u: program too long", (unsigned)sizeof(g_userProgramSource) - 1);
+        return false;
+    }
+    PixelVmCompiler compiler;
+    if (!compiler.Compile(source, g_userProgramScratch))
+    {
+        snprintf(error, errorSize, "column %u: %s", compiler.ErrorColumn() + 1, compiler.Error());
+        return false;
+    }
+    g_userProgram = g_userProgramScratch;
+    if (source != g_userProgramSource)
+    {
+        strcpy(g_userProgramSource, source);
+    }
+    return true;
+}
+
+void ResetUserProgram()
+{
+    g_userProgramStartUs = g_EffectTimeUs;
+}
+
+void DrawUserProgram()
+{
+    if (!g_userProgram.valid)
+    {
+        fill_solid(g_LEDs, g_RenderLeds, CRGB::Black);
+        return;
+    }
+
+    PixelVmFrame frame;
+    frame.t = (int32_t)(((g_EffectTimeUs - g_userProgramStartUs) << 16) / 1000000); // Wraps after nine hours
+    frame.speed = ((int32_t)g_EffectSpeed << 16) / 255;
+    frame.count = (int32_t)g_EffectCount << 16;
+    frame.level = ((int32_t)g_Audio.level << 16) / 255;
+    frame.bass = ((int32_t)g_Audio.bass << 16) / 255;
+    frame.mid = ((int32_t)g_Audio.mid << 16) / 255;
+    frame.treble = ((int32_t)g_Audio.treble << 16) / 255;
+    frame.beat = ((int32_t)g_Audio.beatPulse << 16) / 255;
+
+    // CRGB is three bytes, so the interpreter writes straight into the frame buffer
+    PixelVmRun(g_userProgram, frame, reinterpret_cast<uint8_t *>(g_LEDs), g_RenderLeds, NUM_LEDS, g_LodShift);
+
+    if (!g_userProgram.rgb)
+    {
+        for (uint16_t i = 0; i < g_RenderLeds; i++)
+        {
+            const CHSV hsv(g_LEDs[i].r, g_LEDs[i].g, g_LEDs[i].b);
+            hsv2rgb_rainbow(hsv, g_LEDs[i]);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/**
+ * @file vumeter.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Audio level meter from the middle of the bar outward, with a falling peak marker
+ * @version 0.1
+ * @date 10/19/26
+ */
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "audio_dsp.h"
+
+extern CRGB *g_LEDs;
+extern uint8_t g_EffectSpeed;
+extern AudioFeatures g_Audio;
+
+static uint32_t g_vuPeak = 0; // Peak marker distance from the middle, 16.16
+
+void ResetVuMeter()
+{
+    g_vuPeak = 0;
+}
+
+void DrawVuMeter()
+{
+    const uint16_t half = NUM_LEDS / 2;
+    const uint16_t lit = ((uint32_t)half * g_Audio.level) / 255;
+
+    // The peak marker jumps up with the level and falls back at a rate set by speed
+    const uint32_t level = (uint32_t)lit << 16;
+    const uint32_t fall = (uint32_t)g_EffectSpeed << 10;
+    g_vuPeak = level > g_vuPeak ? level : (g_vuPeak > level + fall ? g_vuPeak - fall : level);
+
+    fadeToBlackBy(g_LEDs, NUM_LEDS, 96);
+    for (uint16_t i = 0; i < lit; i++)
+    {
+        const CRGB color = CHSV(96 - (uint8_t)((uint32_t)i * 96 / half), 255, 255); // Green through yellow to red
+        g_LEDs[half + i] = color;
+        g_LEDs[half - 1 - i] = color;
+    }
+
+    const uint16_t peak = min<uint16_t>(half - 1, g_vuPeak >> 16);
+    g_LEDs[half + peak] = CRGB::White;
+    g_LEDs[half - 1 - peak] = CRGB::White;
+}
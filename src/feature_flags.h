@@ -0,0 +1,107 @@
+/**
+ * @file feature_flags.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Build-time switches for the optional subsystems, and the footprint they leave
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   Each subsystem below can be left out with -D ENABLE_<name>=0.  A subsystem that is left out is not
+ *   started and nothing refers to its library, so the linker drops its code, its static buffers and
+ *   the heap it would have taken at startup:
+ *
+ *     ENABLE_BLE        BLE control: the binary GATT profile and the text command service
+ *     ENABLE_WIFI       WiFi station, and the multicast sync that runs over it
+ *     ENABLE_WEBSERVER  HTTP control, web UI, /debug and uploads; needs WiFi
+ *     ENABLE_SPIFFS     Filesystem: saved user program, FSEQ sequences and web UI assets
+ *     ENABLE_OTA        ArduinoOTA and the /update and /updatefs uploads; needs WiFi
+ *     ENABLE_OLED       U8g2 status display, and the I2C scan that finds it
+ *
+ *   The LEDs, effects, serial commands and touch pad are always there.  platformio.ini has minimal
+ *   (LEDs and serial), standard (no BLE) and full builds of each board.
+ *
+ *   FootprintFormat() reports what the running build costs: image size, static RAM, free heap once
+ *   setup has finished (the frame loop allocates nothing after that; see alloc_stats.h) and boot time.
+ *   scripts/footprint.py reports image and static RAM sizes for every build as it links.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial feature switches
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef ENABLE_BLE
+#define ENABLE_BLE 1
+#endif
+#ifndef ENABLE_WIFI
+#define ENABLE_WIFI 1
+#endif
+#ifndef ENABLE_WEBSERVER
+#define ENABLE_WEBSERVER ENABLE_WIFI
+#endif
+#ifndef ENABLE_SPIFFS
+#define ENABLE_SPIFFS 1
+#endif
+#ifndef ENABLE_OTA
+#define ENABLE_OTA ENABLE_WIFI
+#endif
+#ifndef ENABLE_OLED
+#define ENABLE_OLED 1
+#endif
+
+#if ENABLE_WEBSERVER && !ENABLE_WIFI
+#error "ENABLE_WEBSERVER needs ENABLE_WIFI"
+#endif
+#if ENABLE_OTA && !ENABLE_WIFI
+#error "ENABLE_OTA needs ENABLE_WIFI"
+#endif
+
+// Ends of static DRAM (initialized data, then zeroed), from the linker script
+extern "C" char _data_start;
+extern "C" char _bss_end;
+
+static uint32_t g_footprintBootMs = 0;   // Reset to the end of setup()
+static uint32_t g_footprintHeapFree = 0; // Free heap at the end of setup()
+
+// FootprintBootDone
+//
+// Call as the last thing in setup(), once everything that allocates has.
+
+void FootprintBootDone()
+{
+  g_footprintBootMs = millis();
+  g_footprintHeapFree = ESP.getFreeHeap();
+}
+
+// FootprintFormat
+//
+// Subsystems built in and what they cost, as one line.
+
+void FootprintFormat(char *line, size_t size)
+{
+  static const struct
+  {
+    bool enabled;
+    const char *name;
+  } kFeatures[] = {{ENABLE_BLE, "ble"}, {ENABLE_WIFI, "wifi"}, {ENABLE_WEBSERVER, "web"},
+                   {ENABLE_SPIFFS, "spiffs"}, {ENABLE_OTA, "ota"}, {ENABLE_OLED, "oled"}};
+  char features[40] = "";
+  for (const auto &feature : kFeatures)
+  {
+    if (feature.enabled)
+    {
+      if (features[0] != '\0')
+      {
+        strcat(features, ",");
+      }
+      strcat(features, feature.name);
+    }
+  }
+
+  snprintf(line, size, "footprint features=%s flash=%lu staticRam=%lu heapFree=%lu heapNow=%lu heapMin=%lu bootMs=%lu",
+           features[0] != '\0' ? features : "none", (unsigned long)ESP.getSketchSize(), (unsigned long)(&_bss_end - &_data_start),
+           (unsigned long)g_footprintHeapFree, (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+           (unsigned long)g_footprintBootMs);
+}
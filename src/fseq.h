@@ -0,0 +1,592 @@
+/**
+ * @file fseq.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Streams FSEQ v2 sequences from SPIFFS, read ahead on core 0
+ * @version 0.3
+ * @date 10/19/26
+ *
+ *   A reader task on core 0 opens the sequence, inflates its compression blocks and keeps two decoded
+ *   frames queued ahead of the one on the strip.  The render loop only ever copies a frame that is
+ *   already there, so a slow flash read or a long inflate shows up as a late frame in the counters,
+ *   never as a stalled render.  Which frame is due comes from the effect clock, so playback is frame
+ *   accurate at the sequence's own rate, drops frames rather than drifting if it falls behind, and
+ *   plays in step across synchronized controllers.
+ *
+ *   Uncompressed and zlib files play; zlib is inflated with the copy of miniz in the ESP32's ROM.
+ *   zstd needs a decoder the ROM doesn't have, so export those from xLights with zlib instead.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial streamed playback
+ *   0.2 - 10/19/26 - Left out with SPIFFS (ENABLE_SPIFFS=0)
+ *   0.3 - 10/19/26 - Reader and its task compiled out too, so nothing includes SPIFFS.h
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include "feature_flags.h"
+
+#ifndef ENABLE_FSEQ
+#define ENABLE_FSEQ ENABLE_SPIFFS // Sequences are read from SPIFFS
+#endif
+
+#if ENABLE_FSEQ
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <esp32/rom/miniz.h>
+#endif
+#include <atomic>
+#include "fseq_format.h"
+#include "trace.h"
+
+#ifndef FSEQ_START_CHANNEL
+#define FSEQ_START_CHANNEL 0 // First channel of the sequence this strip plays, counting from 0
+#endif
+
+#define FSEQ_DEFAULT_PATH "/show.fseq"
+#define FSEQ_MAX_PATH 32 // SPIFFS names, including the leading slash
+
+const uint16_t kFseqFrameBytes = NUM_LEDS * 3;
+const uint16_t kFseqReadChunk = 1024;
+const uint8_t kFseqMinStepMs = 10; // Faster sequences play at 100 FPS, dropping frames
+
+#if ENABLE_FSEQ
+// Inflate state, allocated once by FseqBegin() as it is far bigger than everything else here
+struct FseqInflate
+{
+  tinfl_decompressor inflator;
+  uint8_t dictionary[TINFL_LZ_DICT_SIZE]; // Output window; tinfl wraps around it
+  uint8_t input[kFseqReadChunk];
+};
+
+// FseqReader
+//
+// Sequential frame reader for one open file.  Only the reader task touches it.
+
+class FseqReader
+{
+public:
+  /**
+   * @brief Open @p path and parse its header.
+   *
+   * @return nullptr, or why it can't be played
+   */
+  const char *Open(const char *path, FseqInflate *inflate)
+  {
+    Close();
+    _inflate = inflate;
+    _file = SPIFFS.open(path, FILE_READ);
+    if (!_file)
+    {
+      return "file not found";
+    }
+
+    uint8_t header[kFseqHeaderSize];
+    const char *error = nullptr;
+    if (_file.read(header, sizeof(header)) != sizeof(header))
+    {
+      error = "file too short";
+    }
+    else
+    {
+      error = FseqParseHeader(header, _info);
+    }
+    if (!error && _info.compression == FSEQ_ZSTD)
+    {
+      error = "zstd compression isn't supported; export with zlib or none";
+    }
+    if (!error && _info.compression == FSEQ_ZLIB && _inflate == nullptr)
+    {
+      error = "no memory to inflate";
+    }
+
+    // The block index and sparse ranges are read through the inflate buffer, or a small local one when
+    // there is no inflate buffer (and so no index worth reading)
+    uint8_t ranges[kFseqMaxRanges * kFseqRangeEntrySize];
+    if (!error)
+    {
+      const size_t indexBytes = (size_t)_info.blockCount * kFseqBlockEntrySize;
+      if (indexBytes > 0 && _inflate != nullptr)
+      {
+        if (_file.read(_inflate->dictionary, indexBytes) != indexBytes)
+        {
+          error = "file too short";
+        }
+        else
+        {
+          error = FseqParseBlocks(_inflate->dictionary, _info);
+        }
+      }
+      else
+      {
+        _file.seek(kFseqHeaderSize + indexBytes);
+        _info.blockCount = 0;
+      }
+    }
+    if (!error)
+    {
+      const size_t rangeBytes = (size_t)_info.rangeCount * kFseqRangeEntrySize;
+      if (_file.read(ranges, rangeBytes) != rangeBytes)
+      {
+        error = "file too short";
+      }
+    }
+    if (error)
+    {
+      Close();
+      return error;
+    }
+
+    FseqBuildSegments(ranges, FSEQ_START_CHANNEL, kFseqFrameBytes, _info);
+    return Seek(0) ? nullptr : "can't read the first frame";
+  }
+
+  void Close()
+  {
+    if (_file)
+    {
+      _file.close();
+    }
+    _info.frameCount = 0;
+  }
+
+  bool IsOpen() const
+  {
+    return _info.frameCount != 0;
+  }
+
+  const FseqInfo &Info() const
+  {
+    return _info;
+  }
+
+  // Frame the next ReadFrame() returns
+  uint32_t Next() const
+  {
+    return _next;
+  }
+
+  bool Seek(uint32_t frame)
+  {
+    if (frame >= _info.frameCount)
+    {
+      return false;
+    }
+    if (_info.compression == FSEQ_NONE)
+    {
+      _next = frame;
+      return true;
+    }
+    const uint16_t block = FseqBlockFor(_info, frame);
+    StartBlock(block);
+    _next = _info.blocks[block].firstFrame;
+    while (_next < frame) // Blocks only start on their first frame, so inflate up to this one
+    {
+      if (!ReadFrame(nullptr))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read the next frame's part of the window into @p window, or skip it if that is null.
+   *
+   * @return False at the end of the sequence or on a read error
+   */
+  bool ReadFrame(uint8_t *window)
+  {
+    if (_next >= _info.frameCount)
+    {
+      return false;
+    }
+    const bool ok = _info.compression == FSEQ_NONE ? ReadStored(window) : ReadInflated(window);
+    if (ok)
+    {
+      _next++;
+    }
+    return ok;
+  }
+
+private:
+  // Uncompressed: read just the segments this strip plays
+  bool ReadStored(uint8_t *window)
+  {
+    if (window == nullptr)
+    {
+      return true;
+    }
+    const uint32_t frameStart = _info.dataOffset + _next * _info.channelCount;
+    for (uint8_t s = 0; s < _info.segmentCount; s++)
+    {
+      const FseqSegment &segment = _info.segments[s];
+      if (!_file.seek(frameStart + segment.frameOffset) ||
+          _file.read(window + segment.windowOffset, segment.length) != segment.length)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // zlib: inflate the whole frame, keeping the window's part of it
+  bool ReadInflated(uint8_t *window)
+  {
+    uint32_t done = 0;
+    while (done < _info.channelCount)
+    {
+      if (_outRead == _outWrite)
+      {
+        if (!Inflate())
+        {
+          return false;
+        }
+        continue;
+      }
+      const uint32_t length = min<uint32_t>(_outWrite - _outRead, _info.channelCount - done);
+      if (window != nullptr)
+      {
+        FseqCopySegments(_info, done, _inflate->dictionary + _outRead, length, window);
+      }
+      _outRead += length;
+      done += length;
+    }
+    return true;
+  }
+
+  void StartBlock(uint16_t block)
+  {
+    _block = block;
+    _file.seek(_info.blocks[block].offset);
+    _blockRemaining = _info.blocks[block].length;
+    _inPos = 0;
+    _inLength = 0;
+    _outRead = 0;
+    _outWrite = 0;
+    _blockDone = false;
+    tinfl_init(&_inflate->inflator);
+  }
+
+  // Inflate some more output into the dictionary, moving on to the next block at the end of one
+  bool Inflate()
+  {
+    if (_blockDone)
+    {
+      if (_block + 1 >= _info.blockCount)
+      {
+        return false;
+      }
+      StartBlock(_block + 1);
+    }
+    if (_outWrite == TINFL_LZ_DICT_SIZE)
+    {
+      _outRead = 0; // All consumed; tinfl wraps its back-references around the window
+      _outWrite = 0;
+    }
+    if (_inPos == _inLength && _blockRemaining > 0)
+    {
+      const size_t length = min<uint32_t>(sizeof(_inflate->input), _blockRemaining);
+      if (_file.read(_inflate->input, length) != length)
+      {
+        return false;
+      }
+      _inPos = 0;
+      _inLength = length;
+      _blockRemaining -= length;
+    }
+
+    size_t inBytes = _inLength - _inPos;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - _outWrite;
+    const mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (_blockRemaining > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    const tinfl_status status = tinfl_decompress(&_inflate->inflator, _inflate->input + _inPos, &inBytes,
+                                                 _inflate->dictionary, _inflate->dictionary + _outWrite, &outBytes, flags);
+    _inPos += inBytes;
+    _outWrite += outBytes;
+    if (status == TINFL_STATUS_DONE)
+    {
+      _blockDone = true;
+      return true;
+    }
+    if (status < 0 || (status == TINFL_STATUS_NEEDS_MORE_INPUT && _blockRemaining == 0 && _inPos == _inLength))
+    {
+      return false; // Corrupt or truncated block
+    }
+    return true;
+  }
+
+  File _file;
+  FseqInfo _info = {};
+  FseqInflate *_inflate = nullptr;
+  uint32_t _next = 0;
+  uint16_t _block = 0;
+  uint32_t _blockRemaining = 0; // Compressed bytes of the block not read from the file yet
+  size_t _inPos = 0;
+  size_t _inLength = 0;
+  size_t _outRead = 0;  // Dictionary bytes handed out
+  size_t _outWrite = 0; // Dictionary bytes inflated
+  bool _blockDone = false;
+};
+#endif
+
+enum FseqCommandType : uint8_t
+{
+  FSEQ_OPEN,
+  FSEQ_CLOSE
+};
+
+struct FseqCommand
+{
+  uint8_t type;
+  char path[FSEQ_MAX_PATH];
+};
+
+// A decoded frame queued for the render loop.  position counts frames played since the last seek,
+// loops included, so a looped sequence never goes backwards.
+struct FseqSlot
+{
+  uint32_t position;
+  uint32_t generation;
+  uint8_t data[kFseqFrameBytes];
+};
+
+static FseqSlot g_fseqSlots[2];
+static std::atomic<uint32_t> g_fseqHead(0);       // Slots filled, written by the reader task
+static std::atomic<uint32_t> g_fseqTail(0);       // Slots taken, written by the render loop
+static std::atomic<uint32_t> g_fseqGeneration(0); // Bumped by every seek; older slots are discarded
+static std::atomic<uint32_t> g_fseqSeekTo(0);     // Position the current generation starts from
+static std::atomic<uint32_t> g_fseqCommandsDone(0);
+static std::atomic<uint8_t> g_fseqStepMs(0);      // 0 while nothing is open
+static std::atomic<uint32_t> g_fseqFrameCount(0);
+static std::atomic<bool> g_fseqFinished(false);   // Reached the end without looping
+static QueueHandle_t g_fseqCommands = nullptr;
+static TaskHandle_t g_fseqTask = nullptr;
+static uint32_t g_fseqCommandsSent = 0;
+static char g_fseqPath[FSEQ_MAX_PATH] = FSEQ_DEFAULT_PATH;
+static const char *g_fseqError = "not loaded";
+static volatile bool g_fseqLoop = true;
+
+// Render loop side
+static uint64_t g_fseqStartUs = 0;  // Effect time of position 0
+static uint32_t g_fseqShown = 0;    // Position on the strip
+static uint32_t g_fseqLate = 0;     // Frames that weren't decoded in time
+static uint32_t g_fseqDropped = 0;  // Decoded frames skipped over to catch up
+static uint32_t g_fseqReadUs = 0;   // Smoothed cost of decoding one frame
+
+#if ENABLE_FSEQ
+static FseqReader g_fseqReader;
+
+static void FseqHandleCommand(const FseqCommand &command)
+{
+  g_fseqStepMs.store(0);
+  g_fseqReader.Close();
+  if (command.type == FSEQ_OPEN)
+  {
+    static FseqInflate *inflate = (FseqInflate *)heap_caps_malloc(sizeof(FseqInflate), MALLOC_CAP_8BIT);
+    g_fseqError = g_fseqReader.Open(command.path, inflate);
+    if (g_fseqError == nullptr)
+    {
+      const FseqInfo &info = g_fseqReader.Info();
+      g_fseqFrameCount.store(info.frameCount);
+      g_fseqStepMs.store(info.stepMs);
+      Serial.printf("Sequence: %s, %lu frames at %u ms, %lu channels, %s\n", command.path,
+                    (unsigned long)info.frameCount, info.stepMs, (unsigned long)info.channelCount,
+                    info.compression == FSEQ_ZLIB ? "zlib" : "uncompressed");
+    }
+    else
+    {
+      Serial.printf("Sequence: %s: %s\n", command.path, g_fseqError);
+    }
+  }
+  else
+  {
+    g_fseqError = "stopped";
+  }
+  g_fseqCommandsDone.fetch_add(1);
+}
+
+static void FseqTask(void *)
+{
+  uint32_t generation = g_fseqGeneration.load() - 1;
+  uint32_t position = 0;
+
+  for (;;)
+  {
+    const bool full = (g_fseqHead.load(std::memory_order_acquire) - g_fseqTail.load(std::memory_order_acquire)) >= 2;
+    FseqCommand command;
+    if (xQueueReceive(g_fseqCommands, &command, (full || !g_fseqReader.IsOpen()) ? pdMS_TO_TICKS(2) : 0) == pdTRUE)
+    {
+      FseqHandleCommand(command);
+      generation = g_fseqGeneration.load() - 1; // Start over from the requested position
+      continue;
+    }
+    if (full || !g_fseqReader.IsOpen())
+    {
+      continue;
+    }
+
+    if (g_fseqGeneration.load() != generation)
+    {
+      generation = g_fseqGeneration.load();
+      position = g_fseqSeekTo.load();
+      g_fseqFinished.store(false);
+    }
+
+    const uint32_t frameCount = g_fseqReader.Info().frameCount;
+    if (position >= frameCount && !g_fseqLoop)
+    {
+      g_fseqFinished.store(true);
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    const uint32_t frame = position % frameCount;
+    TraceScope trace(TRACE_FSEQ);
+    const uint32_t start = micros();
+    FseqSlot &slot = g_fseqSlots[g_fseqHead.load() & 1];
+    if ((g_fseqReader.Next() != frame && !g_fseqReader.Seek(frame)) || !g_fseqReader.ReadFrame(slot.data))
+    {
+      g_fseqError = "read error";
+      g_fseqReader.Close();
+      g_fseqStepMs.store(0);
+      continue;
+    }
+    const uint32_t elapsed = micros() - start;
+    g_fseqReadUs = g_fseqReadUs == 0 ? elapsed : (g_fseqReadUs * 7 + elapsed) / 8;
+    slot.position = position++;
+    slot.generation = generation;
+    g_fseqHead.fetch_add(1, std::memory_order_release);
+  }
+}
+#endif
+
+static void FseqSend(uint8_t type, const char *path)
+{
+  if (g_fseqCommands == nullptr)
+  {
+    return;
+  }
+  FseqCommand command = {};
+  command.type = type;
+  strncpy(command.path, path, sizeof(command.path) - 1);
+  xQueueSend(g_fseqCommands, &command, portMAX_DELAY);
+  g_fseqCommandsSent++;
+}
+
+// FseqBegin
+//
+// Start the reader task and open the default sequence if there is one.
+
+bool FseqBegin()
+{
+#if ENABLE_FSEQ
+  g_fseqCommands = xQueueCreate(4, sizeof(FseqCommand));
+  xTaskCreatePinnedToCore(FseqTask, "fseq", 4096, nullptr, 1, &g_fseqTask, 0);
+  if (SPIFFS.exists(g_fseqPath))
+  {
+    FseqSend(FSEQ_OPEN, g_fseqPath);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Seek the render loop's timeline to @p position at effect time @p nowUs; the reader follows
+void FseqSeek(uint32_t position, uint64_t nowUs)
+{
+  const uint32_t stepUs = max<uint8_t>(g_fseqStepMs.load(), 1) * 1000UL;
+  g_fseqStartUs = nowUs - (uint64_t)position * stepUs;
+  g_fseqShown = position - 1;
+  g_fseqSeekTo.store(position);
+  g_fseqGeneration.fetch_add(1, std::memory_order_release);
+}
+
+// Open @p path and play it from the start
+void FseqPlay(const char *path, uint64_t nowUs)
+{
+  strncpy(g_fseqPath, path, sizeof(g_fseqPath) - 1);
+  FseqSend(FSEQ_OPEN, g_fseqPath);
+  FseqSeek(0, nowUs);
+}
+
+// FseqStop
+//
+// Close the file, waiting (briefly) until the reader has, so the file can then be replaced.
+
+void FseqStop()
+{
+  FseqSend(FSEQ_CLOSE, "");
+  const uint32_t start = millis();
+  while (g_fseqCommandsDone.load() != g_fseqCommandsSent && (millis() - start) < 200)
+  {
+    delay(1);
+  }
+}
+
+const char *FseqPath()
+{
+  return g_fseqPath;
+}
+
+uint8_t FseqStepMs()
+{
+  const uint8_t step = g_fseqStepMs.load();
+  return step == 0 ? 0 : max(step, kFseqMinStepMs);
+}
+
+// FseqDraw
+//
+// Put the frame due at effect time @p nowUs into @p leds, taking it from the read-ahead queue.  Leaves
+// @p leds alone if that frame is already there, or isn't decoded yet.
+//
+// @return False if nothing is loaded
+
+bool FseqDraw(CRGB *leds, uint64_t nowUs)
+{
+  const uint32_t stepUs = g_fseqStepMs.load() * 1000UL;
+  if (stepUs == 0)
+  {
+    return false;
+  }
+  const uint32_t due = (uint32_t)((nowUs - g_fseqStartUs + stepUs / 2) / stepUs); // Nearest, so timer jitter can't skip one
+  const uint32_t generation = g_fseqGeneration.load(std::memory_order_acquire);
+
+  while (g_fseqHead.load(std::memory_order_acquire) != g_fseqTail.load())
+  {
+    FseqSlot &slot = g_fseqSlots[g_fseqTail.load() & 1];
+    if (slot.generation == generation && slot.position > due)
+    {
+      break; // Ahead of the timeline
+    }
+    const bool show = slot.generation == generation && slot.position == due;
+    if (show)
+    {
+      memcpy(leds, slot.data, kFseqFrameBytes);
+      g_fseqShown = due;
+    }
+    else if (slot.generation == generation)
+    {
+      g_fseqDropped++;
+    }
+    g_fseqTail.fetch_add(1, std::memory_order_release);
+    if (show)
+    {
+      return true;
+    }
+  }
+
+  if (g_fseqShown != due && !g_fseqFinished.load())
+  {
+    g_fseqLate++;
+  }
+  return true;
+}
+
+// Current position in frames, for the UI
+uint32_t FseqPosition()
+{
+  const uint32_t frames = g_fseqFrameCount.load();
+  return frames ? g_fseqShown % frames : 0;
+}
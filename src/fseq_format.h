@@ -0,0 +1,242 @@
+/**
+ * @file fseq_format.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief FSEQ v2 header, compression block index and sparse range parsing
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   FSEQ is the sequence format xLights and the Falcon Player use: a 32-byte header, an index of
+ *   compression blocks (each an independent zlib or zstd stream of whole frames), optional sparse
+ *   ranges saying which channels are stored, then the channel data.  Every frame stores the same
+ *   channels, so the bytes a controller needs from a frame are always the same few slices of it; the
+ *   parser works those slices out once, as segments, for the window of channels this strip plays.
+ *
+ *   The caller reads the file; everything here works on byte arrays and only needs <stdint.h>, so it
+ *   can be checked on the host against files exported by xLights.  All fields are little-endian.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial v2 parsing
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+const uint8_t kFseqHeaderSize = 32;
+const uint8_t kFseqBlockEntrySize = 8;
+const uint8_t kFseqRangeEntrySize = 6;
+const uint16_t kFseqMaxBlocks = 256;
+const uint8_t kFseqMaxRanges = 8;
+
+enum FseqCompression : uint8_t
+{
+  FSEQ_NONE = 0,
+  FSEQ_ZSTD = 1,
+  FSEQ_ZLIB = 2
+};
+
+struct FseqBlock
+{
+  uint32_t firstFrame;
+  uint32_t offset; // File offset of the compressed stream
+  uint32_t length; // Compressed bytes
+};
+
+// A slice of every frame that lands in the window being played
+struct FseqSegment
+{
+  uint32_t frameOffset;   // Byte offset within the stored frame
+  uint16_t windowOffset;  // Byte offset within the window
+  uint16_t length;
+};
+
+struct FseqInfo
+{
+  uint32_t dataOffset;   // First byte of channel data
+  uint32_t channelCount; // Bytes stored per frame
+  uint32_t frameCount;
+  uint8_t stepMs;        // Frame interval
+  uint8_t compression;
+  uint16_t blockCount;   // Compression blocks in the file's index
+  uint8_t rangeCount;    // Sparse ranges; 0 means every channel from 0 is stored
+  FseqBlock blocks[kFseqMaxBlocks];
+  FseqSegment segments[kFseqMaxRanges];
+  uint8_t segmentCount;
+};
+
+static inline uint32_t FseqRead16(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t FseqRead24(const uint8_t *p)
+{
+  return FseqRead16(p) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t FseqRead32(const uint8_t *p)
+{
+  return FseqRead24(p) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Parse the fixed 32-byte header.
+ *
+ * @return nullptr, or why the file can't be played
+ */
+const char *FseqParseHeader(const uint8_t *header, FseqInfo &info)
+{
+  memset(&info, 0, sizeof(info));
+  if (memcmp(header, "PSEQ", 4) != 0 && memcmp(header, "FSEQ", 4) != 0)
+  {
+    return "not an FSEQ file";
+  }
+  if (header[7] != 2)
+  {
+    return "not FSEQ version 2";
+  }
+  info.dataOffset = FseqRead16(header + 4);
+  info.channelCount = FseqRead32(header + 10);
+  info.frameCount = FseqRead32(header + 14);
+  info.stepMs = header[18];
+  info.compression = header[20] & 0x0F;
+  info.blockCount = (uint16_t)(header[21] | ((header[20] & 0xF0) << 4)); // v2.1 keeps the top bits here
+  info.rangeCount = header[22];
+
+  if (info.channelCount == 0 || info.frameCount == 0 || info.stepMs == 0)
+  {
+    return "empty sequence";
+  }
+  if (info.compression > FSEQ_ZLIB)
+  {
+    return "unknown compression";
+  }
+  if (info.blockCount > kFseqMaxBlocks)
+  {
+    return "too many compression blocks";
+  }
+  if (info.rangeCount > kFseqMaxRanges)
+  {
+    return "too many sparse ranges";
+  }
+  if ((uint32_t)kFseqHeaderSize + info.blockCount * kFseqBlockEntrySize + info.rangeCount * kFseqRangeEntrySize > info.dataOffset)
+  {
+    return "header overlaps channel data";
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Parse the compression block index that follows the header.
+ *
+ * xLights pads the index with zero-length entries, which are dropped, so blockCount can shrink.
+ */
+const char *FseqParseBlocks(const uint8_t *index, FseqInfo &info)
+{
+  uint32_t offset = info.dataOffset;
+  uint16_t used = 0;
+  for (uint16_t b = 0; b < info.blockCount; b++)
+  {
+    const uint8_t *entry = index + b * kFseqBlockEntrySize;
+    const uint32_t length = FseqRead32(entry + 4);
+    if (length == 0)
+    {
+      continue;
+    }
+    FseqBlock &block = info.blocks[used++];
+    block.firstFrame = FseqRead32(entry);
+    block.offset = offset;
+    block.length = length;
+    offset += length;
+    if (used > 1 && block.firstFrame <= info.blocks[used - 2].firstFrame)
+    {
+      return "compression blocks out of order";
+    }
+  }
+  info.blockCount = used;
+  if (info.compression != FSEQ_NONE && (used == 0 || info.blocks[0].firstFrame != 0))
+  {
+    return "compressed file without a block index";
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Parse the sparse ranges and work out the segments for a window of channels.
+ *
+ * @param ranges The rangeCount six-byte entries after the block index (ignored when there are none)
+ * @param windowStart First channel this controller plays
+ * @param windowLength Channels it plays, NUM_LEDS * 3
+ */
+void FseqBuildSegments(const uint8_t *ranges, uint32_t windowStart, uint16_t windowLength, FseqInfo &info)
+{
+  info.segmentCount = 0;
+  uint32_t frameOffset = 0;
+  const uint8_t count = info.rangeCount ? info.rangeCount : 1;
+  for (uint8_t r = 0; r < count; r++)
+  {
+    const uint32_t start = info.rangeCount ? FseqRead24(ranges + r * kFseqRangeEntrySize) : 0;
+    const uint32_t length = info.rangeCount ? FseqRead24(ranges + r * kFseqRangeEntrySize + 3) : info.channelCount;
+
+    const uint32_t from = start > windowStart ? start : windowStart;
+    const uint32_t end = start + length;
+    const uint32_t windowEnd = windowStart + windowLength;
+    const uint32_t to = end < windowEnd ? end : windowEnd;
+    if (from < to && frameOffset + (from - start) < info.channelCount)
+    {
+      FseqSegment &segment = info.segments[info.segmentCount++];
+      segment.frameOffset = frameOffset + (from - start);
+      segment.windowOffset = (uint16_t)(from - windowStart);
+      segment.length = (uint16_t)(to - from);
+      if (segment.frameOffset + segment.length > info.channelCount)
+      {
+        segment.length = (uint16_t)(info.channelCount - segment.frameOffset); // Truncated file header
+      }
+    }
+    frameOffset += length;
+  }
+}
+
+// The compression block holding @p frame
+uint16_t FseqBlockFor(const FseqInfo &info, uint32_t frame)
+{
+  uint16_t lo = 0;
+  uint16_t hi = info.blockCount;
+  while (hi - lo > 1)
+  {
+    const uint16_t mid = (lo + hi) / 2;
+    if (info.blocks[mid].firstFrame <= frame)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief Copy the window's part of a run of frame bytes.
+ *
+ * Decompression hands over a frame in arbitrary pieces, so this takes the piece's offset within the
+ * frame and copies whatever of it falls inside the segments.
+ */
+void FseqCopySegments(const FseqInfo &info, uint32_t frameOffset, const uint8_t *data, uint32_t length, uint8_t *window)
+{
+  for (uint8_t s = 0; s < info.segmentCount; s++)
+  {
+    const FseqSegment &segment = info.segments[s];
+    const uint32_t from = segment.frameOffset > frameOffset ? segment.frameOffset : frameOffset;
+    const uint32_t segmentEnd = segment.frameOffset + segment.length;
+    const uint32_t dataEnd = frameOffset + length;
+    const uint32_t to = segmentEnd < dataEnd ? segmentEnd : dataEnd;
+    if (from < to)
+    {
+      memcpy(window + segment.windowOffset + (from - segment.frameOffset), data + (from - frameOffset), to - from);
+    }
+  }
+}
@@ -0,0 +1,146 @@
+/**
+ * @file http_task.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief The HTTP server on a task of its own, and the only ways its handlers reach the render loop
+ * @version 0.3
+ * @date 10/19/26
+ *
+ *   WebServer::handleClient() used to run in the loop between frames, so parsing a request, building
+ *   the reply and streaming a file to the client all came out of the frame budget, and a phone on a
+ *   weak link held the strip still for as long as it took to send its request or read the page.  With
+ *   HTTP_TASK the server runs on core 0 beside the WiFi stack, and the render loop on core 1 never waits
+ *   on a client.
+ *
+ *   Handlers don't touch the loop's state directly.  They read what they report from a snapshot the
+ *   loop publishes once a pass (SharedSnapshot, under a sequence counter as in audio.h), and anything
+ *   that changes it - a new effect, a program to compile, a sequence to play - is handed to the loop
+ *   with HttpRunOnLoop(), through the queue in loop_queue.h that BLE uses too.  The loop runs it at
+ *   its next pass, between frames, and only the handler waits for that; the loop itself never blocks
+ *   on the HTTP task.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial HTTP task
+ *   0.2 - 10/19/26 - Calls go through the loop queue shared with BLE
+ *   0.3 - 10/19/26 - Fences around the SharedSnapshot copy
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include "loop_queue.h"
+
+#ifndef HTTP_TASK
+#define HTTP_TASK 1 // 0: handleClient() runs in the loop between frames, as it used to
+#endif
+#define HTTP_TASK_STACK 8192
+#define HTTP_TASK_PRIORITY 1
+#define HTTP_TASK_CORE 0 // With the WiFi stack, away from the render loop on core 1
+#define HTTP_POLL_MS 2   // Sleep between handleClient() calls
+
+/**
+ * @brief A value written by one task and read whole by others, without a lock.
+ *
+ * The writer never waits.  A reader that catches it mid-write copies the value again, which takes
+ * nanoseconds, so only suits small values.
+ */
+template <typename T>
+class SharedSnapshot
+{
+public:
+  void Publish(const T &value)
+  {
+    _sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // No write to _value can be seen before the odd count
+    _value = value;
+    _sequence.fetch_add(1, std::memory_order_release);
+  }
+
+  T Read() const
+  {
+    T value;
+    uint32_t before;
+    do
+    {
+      before = _sequence.load(std::memory_order_acquire);
+      value = _value;
+      std::atomic_thread_fence(std::memory_order_acquire); // The copy is finished before the count is checked again
+    } while ((before & 1) || _sequence.load(std::memory_order_relaxed) != before);
+    return value;
+  }
+
+private:
+  T _value = {};
+  std::atomic<uint32_t> _sequence{0}; // Odd while _value is being written
+};
+
+static void (*g_httpHandle)() = nullptr; // handleClient(), for the task to call
+static TaskHandle_t g_httpTask = nullptr;
+static SemaphoreHandle_t g_httpCallDone = nullptr;
+static uint32_t g_httpCalled = 0;      // Calls the loop has run for the handlers
+static uint32_t g_httpWaitMaxUs = 0;   // Longest a handler waited for the loop to run one
+
+// True on the HTTP task, where the loop's state is off limits
+static inline bool HttpOnTask()
+{
+  return g_httpTask != nullptr && xTaskGetCurrentTaskHandle() == g_httpTask;
+}
+
+// HttpRunOnLoop
+//
+// Run @p run(@p arg) on the render loop at its next pass, and wait for it to finish.  Anywhere but the
+// HTTP task (including every handler when HTTP_TASK is 0) it just runs there and then.
+
+void HttpRunOnLoop(void (*run)(void *), void *arg)
+{
+  if (!HttpOnTask())
+  {
+    run(arg);
+    return;
+  }
+  const uint32_t start = micros();
+  LoopRun(run, arg, g_httpCallDone);
+  g_httpCalled++;
+  g_httpWaitMaxUs = max<uint32_t>(g_httpWaitMaxUs, micros() - start);
+}
+
+// The same for a lambda, which may capture the handler's locals by reference: the handler waits
+template <typename Function>
+void HttpRunOnLoop(Function &&function)
+{
+  typedef typename std::remove_reference<Function>::type Callable;
+  HttpRunOnLoop([](void *arg)
+                { (*static_cast<Callable *>(arg))(); },
+                &function);
+}
+
+static void HttpTask(void *)
+{
+  for (;;)
+  {
+    g_httpHandle();
+    vTaskDelay(pdMS_TO_TICKS(HTTP_POLL_MS));
+  }
+}
+
+// HttpTaskBegin
+//
+// Start calling @p handle (the server's handleClient()) from a task of its own.  Returns false, and the
+// loop should go on calling it, when HTTP_TASK is 0 or the task can't be created.
+
+bool HttpTaskBegin(void (*handle)())
+{
+#if HTTP_TASK
+  g_httpHandle = handle;
+  g_httpCallDone = xSemaphoreCreateBinary(); // Handlers run one at a time, so one is all that waits
+  if (g_httpCallDone != nullptr &&
+      xTaskCreatePinnedToCore(HttpTask, "http", HTTP_TASK_STACK, nullptr, HTTP_TASK_PRIORITY, &g_httpTask, HTTP_TASK_CORE) == pdPASS)
+  {
+    return true;
+  }
+  g_httpTask = nullptr;
+#endif
+  return false;
+}
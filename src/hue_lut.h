@@ -0,0 +1,69 @@
+/**
+ * @file hue_lut.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Precomputed fully saturated hues and a hue gradient fill
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   setHue(), fill_rainbow() and CHSV assignment all run a full HSV to RGB conversion per pixel,
+ *   even though at full saturation and value there are only 256 possible results.  HueLutBuild()
+ *   works them out once, for FastLED's rainbow mapping (the one setHue() and CHSV use, with a
+ *   brighter yellow) and its spectrum mapping (evenly spaced, as hsv2rgb_spectrum), and
+ *   FillHueGradient() steps through a table with an 8.8 fixed-point hue, a load and a store a pixel.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial hue tables
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+enum HueMapping : uint8_t
+{
+  HUE_MAP_RAINBOW,  // hsv2rgb_rainbow
+  HUE_MAP_SPECTRUM, // hsv2rgb_spectrum
+  HUE_MAP_COUNT
+};
+
+static CRGB g_hueLut[HUE_MAP_COUNT][256];
+
+// HueLutBuild
+//
+// Fill the tables; call once from setup, before the first frame.
+
+void HueLutBuild()
+{
+  for (uint16_t hue = 0; hue < 256; hue++)
+  {
+    const CHSV hsv((uint8_t)hue, 255, 255);
+    hsv2rgb_rainbow(hsv, g_hueLut[HUE_MAP_RAINBOW][hue]);
+    hsv2rgb_spectrum(hsv, g_hueLut[HUE_MAP_SPECTRUM][hue]);
+  }
+}
+
+static inline const CRGB &HueColor(uint8_t hue, HueMapping mapping = HUE_MAP_RAINBOW)
+{
+  return g_hueLut[mapping][hue];
+}
+
+/**
+ * @brief Fill @p count pixels with a run of fully saturated hues.
+ *
+ * @param startHue hue of the first pixel, 8.8 fixed point
+ * @param deltaHue step from one pixel to the next, 8.8 fixed point; may be negative or fractional
+ */
+static inline void FillHueGradient(CRGB *leds, uint16_t count, uint16_t startHue, int16_t deltaHue,
+                                   HueMapping mapping = HUE_MAP_RAINBOW)
+{
+  const CRGB *lut = g_hueLut[mapping];
+  uint16_t hue = startHue;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    leds[i] = lut[hue >> 8];
+    hue += deltaHue;
+  }
+}
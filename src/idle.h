@@ -0,0 +1,267 @@
+/**
+ * @file idle.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Idle governor: low clock and sleep while the strip is off or showing a still frame
+ * @version 0.3
+ * @date 10/19/26
+ *
+ *   The strip keeps whatever was last clocked into it, so once the power is off (after its black
+ *   frame has gone out) or the effect has drawn IDLE_STATIC_FRAMES identical frames in a row, there
+ *   is nothing left to send.  The loop then stops refreshing the strip, renders only every
+ *   IDLE_FRAME_MS to notice a frame that starts moving again, redraws the OLED once a second, and
+ *   sleeps between passes with the CPU at IDLE_CPU_MHZ, the lowest clock WiFi and BLE run at.
+ *
+ *   WiFi stays in modem sleep (WIFI_PS_MIN_MODEM), waking for every DTIM beacon.  Maximum modem sleep
+ *   would save a little more but skips beacons, which would put a request to the controller hundreds
+ *   of milliseconds late.  Builds whose sdkconfig enables power management with tickless idle also
+ *   get automatic light sleep whenever every task is blocked; the stock Arduino core has no tickless
+ *   idle, so there the sleeping loop leaves the CPU clock-gated in the idle task instead.
+ *
+ *   Any input calls IdleWake(), from whichever task it arrives on; the loop puts the clock back at its
+ *   next pass, which it starts straight away.  The time from the IdleWake() to the first frame shown
+ *   after it is the wake latency, kept as a last and worst figure.
+ *
+ *   There is no current sensor on the board, so IdleFormat() reports the time spent in each state
+ *   and the module's current estimated from them with the datasheet figures below.  The strip's own
+ *   quiescent draw - about a milliamp per WS2812 even when black - is not included.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial idle governor
+ *   0.2 - 10/19/26 - Builds without WiFi (ENABLE_WIFI=0)
+ *   0.3 - 10/19/26 - WiFi.h only included with WiFi
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include "feature_flags.h"
+#if ENABLE_WIFI
+#include <WiFi.h>
+#endif
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#include <esp_pm.h>
+#endif
+
+#ifndef IDLE_STATIC_FRAMES
+#define IDLE_STATIC_FRAMES 100 // Identical frames in a row before a still effect idles; two seconds at 50 FPS
+#endif
+#define IDLE_CPU_MHZ 80        // Lowest clock WiFi and BLE run at
+#define IDLE_FRAME_MS 50       // Render interval while idle
+#define IDLE_SLEEP_MS 20       // Loop sleep while idle, unless IdleWake() ends it sooner
+#define IDLE_OLED_MS 1000      // OLED refresh while idle
+
+// Module supply current (ESP32 datasheet, modem sleep, upper ends), for the estimate in IdleFormat()
+#define IDLE_ACTIVE_MA 68      // 240 MHz
+#define IDLE_AWAKE_MA 31       // IDLE_CPU_MHZ, running
+#define IDLE_WAIT_MA 20        // IDLE_CPU_MHZ, idle task waiting for an interrupt
+#define IDLE_LIGHT_SLEEP_MA 1  // Light sleep (0.8 mA)
+
+static bool g_idle = false;
+static bool g_idleLightSleep = false;            // Automatic light sleep configured
+static uint32_t g_idleActiveMhz = 240;           // Clock to go back to
+static uint32_t g_idleFrameHash = 0;
+static uint16_t g_idleStaticFrames = 0;          // Frames in a row identical to the one before
+static const char *volatile g_idleWakeRequest = nullptr; // Set by IdleWake(), acted on by IdleUpdate()
+static volatile uint32_t g_idleWakeRequestUs = 0;
+static const char *g_idleWakeReason = "none";
+static uint32_t g_idleWakeStartUs = 0;           // Wake in progress: when it was asked for
+static uint32_t g_idleWakeLastUs = 0;
+static uint32_t g_idleWakeMaxUs = 0;
+static uint32_t g_idleEnters = 0;
+static uint32_t g_idleWakes = 0;
+static uint32_t g_idleEnteredMs = 0;
+static uint32_t g_idleTotalMs = 0;               // Time idle, not counting the current spell
+static uint64_t g_idleSleepUs = 0;               // Time spent in IdleSleep()
+static uint32_t g_idleBeginMs = 0;
+static TaskHandle_t g_idleLoopTask = nullptr;    // Woken out of IdleSleep() by IdleWake()
+
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+static esp_pm_lock_handle_t g_idleCpuLock = nullptr; // Held while active, to keep the full clock
+#endif
+
+// IdleBegin
+//
+// Call at the end of setup, with WiFi up or not.
+
+void IdleBegin(bool wifi)
+{
+  g_idleActiveMhz = getCpuFrequencyMhz();
+  g_idleBeginMs = millis();
+  g_idleLoopTask = xTaskGetCurrentTaskHandle();
+#if ENABLE_WIFI
+  if (wifi)
+  {
+    WiFi.setSleep(WIFI_PS_MIN_MODEM);
+  }
+#endif
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  esp_pm_config_esp32_t config = {};
+  config.max_freq_mhz = (int)g_idleActiveMhz;
+  config.min_freq_mhz = IDLE_CPU_MHZ;
+  config.light_sleep_enable = true;
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "render", &g_idleCpuLock) == ESP_OK &&
+      esp_pm_lock_acquire(g_idleCpuLock) == ESP_OK && esp_pm_configure(&config) == ESP_OK)
+  {
+    g_idleLightSleep = true;
+  }
+#endif
+}
+
+// IdleWake
+//
+// Input arrived: leave idle.  Safe from any task.
+
+void IdleWake(const char *reason)
+{
+  if (g_idleWakeRequest == nullptr)
+  {
+    g_idleWakeRequestUs = micros();
+    g_idleWakeRequest = reason;
+    if (g_idle && g_idleLoopTask != nullptr)
+    {
+      xTaskNotifyGive(g_idleLoopTask);
+    }
+  }
+}
+
+static void IdleSetClock(bool idle)
+{
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  if (g_idleLightSleep)
+  {
+    idle ? esp_pm_lock_release(g_idleCpuLock) : esp_pm_lock_acquire(g_idleCpuLock);
+    return;
+  }
+#endif
+  setCpuFrequencyMhz(idle ? IDLE_CPU_MHZ : g_idleActiveMhz);
+}
+
+static void IdleLeave(const char *reason, uint32_t sinceUs)
+{
+  g_idle = false;
+  IdleSetClock(false);
+  g_idleTotalMs += millis() - g_idleEnteredMs;
+  g_idleWakes++;
+  g_idleWakeReason = reason;
+  g_idleWakeStartUs = sinceUs;
+}
+
+// IdleFrame
+//
+// Call with every rendered frame.  Returns whether it differs from the one before.
+
+bool IdleFrame(const CRGB *frame, uint16_t count, uint8_t brightness)
+{
+  // FNV-1a over the pixels and the brightness they go out at
+  uint32_t hash = 2166136261u ^ brightness;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(frame);
+  for (uint16_t i = 0; i < count * 3; i++)
+  {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  const bool changed = hash != g_idleFrameHash;
+  g_idleFrameHash = hash;
+  if (changed)
+  {
+    g_idleStaticFrames = 0;
+  }
+  else if (g_idleStaticFrames < UINT16_MAX)
+  {
+    g_idleStaticFrames++;
+  }
+  return changed;
+}
+
+// IdleUpdate
+//
+// Once per loop pass, before the show: go idle or wake up.  @p allowed is false while something needs
+// full-rate frames regardless (a transition, an update, synchronized playback).  Powered off, one
+// repeat of the black frame is enough, as it means the first has been shown.
+
+void IdleUpdate(bool allowed, bool powerOff)
+{
+  const char *request = (const char *)g_idleWakeRequest;
+  if (request != nullptr)
+  {
+    g_idleWakeRequest = nullptr;
+    g_idleStaticFrames = 0;
+    if (g_idle)
+    {
+      IdleLeave(request, g_idleWakeRequestUs);
+    }
+    return;
+  }
+
+  const bool want = allowed && g_idleStaticFrames >= (powerOff ? 1 : IDLE_STATIC_FRAMES);
+  if (want && !g_idle)
+  {
+    g_idle = true;
+    g_idleEnters++;
+    g_idleEnteredMs = millis();
+    IdleSetClock(true);
+  }
+  else if (!want && g_idle)
+  {
+    IdleLeave(allowed ? "frame" : "busy", micros());
+  }
+}
+
+static inline bool IdleActive()
+{
+  return g_idle;
+}
+
+// IdleFrameShown
+//
+// Call when a new frame has gone out; completes the wake latency measurement.
+
+void IdleFrameShown()
+{
+  if (g_idleWakeStartUs != 0)
+  {
+    g_idleWakeLastUs = micros() - g_idleWakeStartUs;
+    g_idleWakeMaxUs = max(g_idleWakeMaxUs, g_idleWakeLastUs);
+    g_idleWakeStartUs = 0;
+  }
+}
+
+// IdleSleep
+//
+// The idle loop's wait between passes, cut short by IdleWake().  Blocking rather than spinning lets
+// the idle task stop the CPU (or light-sleep the chip) until the next tick something is due.
+
+void IdleSleep()
+{
+  const uint32_t start = micros();
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_SLEEP_MS));
+  g_idleSleepUs += micros() - start;
+}
+
+// IdleFormat
+//
+// State and the time spent in it since startup, with the estimated module current while idle and
+// averaged over the whole time, as one line.
+
+void IdleFormat(char *line, size_t size)
+{
+  const uint32_t now = millis();
+  const uint32_t idleMs = g_idleTotalMs + (g_idle ? now - g_idleEnteredMs : 0);
+  const uint32_t upMs = max<uint32_t>(1, now - g_idleBeginMs);
+  const uint32_t sleepMs = (uint32_t)(g_idleSleepUs / 1000);
+  const uint32_t sleepMa = g_idleLightSleep ? IDLE_LIGHT_SLEEP_MA : IDLE_WAIT_MA;
+
+  // While idle the loop is either asleep or awake at the low clock
+  const uint32_t idleSleepPct = idleMs ? min<uint32_t>(100, (uint32_t)((uint64_t)sleepMs * 100 / idleMs)) : 0;
+  const uint32_t idleMa = (sleepMa * idleSleepPct + IDLE_AWAKE_MA * (100 - idleSleepPct)) / 100;
+  const uint32_t idlePct = (uint32_t)((uint64_t)idleMs * 100 / upMs);
+  const uint32_t averageMa = (idleMa * idlePct + IDLE_ACTIVE_MA * (100 - idlePct)) / 100;
+
+  snprintf(line, size, "idle %s cpuMhz=%lu lightSleep=%u staticFrames=%u enters=%lu wakes=%lu wake=%s wakeUs=%lu wakeMaxUs=%lu idlePct=%lu sleepPct=%lu estIdleMa=%lu estAvgMa=%lu",
+           g_idle ? "on" : "off", (unsigned long)getCpuFrequencyMhz(), g_idleLightSleep, g_idleStaticFrames,
+           (unsigned long)g_idleEnters, (unsigned long)g_idleWakes, g_idleWakeReason, (unsigned long)g_idleWakeLastUs,
+           (unsigned long)g_idleWakeMaxUs, (unsigned long)idlePct, (unsigned long)idleSleepPct, (unsigned long)idleMa,
+           (unsigned long)averageMa);
+}
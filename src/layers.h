@@ -0,0 +1,190 @@
+/**
+ * @file layers.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Layer stack: blend kernels that composite effect layers over the main effect's frame
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   The main effect (with its transition, if one is running) is the bottom of the stack.  Up to
+ *   LAYER_MAX - 1 more effects each draw into a buffer of their own, and LayersComposite() lays them
+ *   over it in order, each at its own opacity and with one of these blend modes:
+ *
+ *     alpha     the layer covers what is under it, black being transparent: a pixel's brightest
+ *               channel is its coverage, so a comet over a palette wash hides the wash only where it is
+ *     add       saturating add, for sparkles on a solid color
+ *     screen    brightens like add but never clips: 1 - (1 - under)(1 - layer)
+ *     multiply  darkens what is under it by the layer, as a mask
+ *
+ *   Compositing is one pass over the strip: each pixel is read from the frame and every layer once,
+ *   taken through the whole stack in a register and written once.  Pixels are packed as 0x00RRGGBB
+ *   so that scaling all three channels by the opacity takes two multiplies rather than three, and the
+ *   saturating add is done on all three at once.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial layer stack
+ *   0.2 - 10/19/26 - ParseLayerBlend() rejects unknown names
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+#ifndef LAYER_MAX
+#define LAYER_MAX 4 // Layers in the stack, counting the main effect
+#endif
+#define LAYER_OVERLAYS (LAYER_MAX - 1)
+
+enum LayerBlend : uint8_t
+{
+  LAYER_ALPHA = 0,
+  LAYER_ADD = 1,
+  LAYER_SCREEN = 2,
+  LAYER_MULTIPLY = 3,
+  LAYER_BLEND_COUNT
+};
+
+// One layer over the main effect
+struct Layer
+{
+  bool enabled;
+  bool restart;   // Start the effect over, on a cleared buffer, on the next frame
+  uint8_t effect; // EffectId
+  uint8_t opacity;
+  LayerBlend blend;
+};
+
+// One layer's frame, as LayersComposite() takes it
+struct LayerInput
+{
+  const CRGB *pixels;
+  uint8_t opacity;
+  LayerBlend blend;
+};
+
+const char *LayerBlendName(uint8_t blend)
+{
+  switch (blend)
+  {
+  case LAYER_ADD:
+    return "add";
+  case LAYER_SCREEN:
+    return "screen";
+  case LAYER_MULTIPLY:
+    return "multiply";
+  case LAYER_ALPHA:
+  default:
+    return "alpha";
+  }
+}
+
+// ParseLayerBlend
+//
+// Read a blend by name, or by number.  False, leaving @p blend alone, for anything else.
+
+bool ParseLayerBlend(const char *name, LayerBlend &blend)
+{
+  for (uint8_t b = 0; b < LAYER_BLEND_COUNT; b++)
+  {
+    if (strcmp(name, LayerBlendName(b)) == 0)
+    {
+      blend = static_cast<LayerBlend>(b);
+      return true;
+    }
+  }
+  char *end = nullptr;
+  const long number = strtol(name, &end, 10);
+  if (end == name || *end != '\0' || number < 0 || number >= LAYER_BLEND_COUNT)
+  {
+    return false;
+  }
+  blend = static_cast<LayerBlend>(number);
+  return true;
+}
+
+static inline uint32_t LayerPack(const CRGB &c)
+{
+  return ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+}
+
+static inline CRGB LayerUnpack(uint32_t p)
+{
+  return CRGB((uint8_t)(p >> 16), (uint8_t)(p >> 8), (uint8_t)p);
+}
+
+// Every channel times (scale + 1) / 256, so 255 leaves it as it is (as scale8() does).  Red and blue are
+// 16 bits apart, room for their products, and go through one multiply together.
+static inline uint32_t LayerScale(uint32_t p, uint8_t scale)
+{
+  const uint32_t f = (uint32_t)scale + 1;
+  return ((((p & 0xFF00FF) * f) >> 8) & 0xFF00FF) | ((((p & 0x00FF00) * f) >> 8) & 0x00FF00);
+}
+
+// Channel by channel a * (b + 1) / 256; never more than either
+static inline uint32_t LayerMultiply(uint32_t a, uint32_t b)
+{
+  const uint32_t r = ((a >> 16) * ((b >> 16) + 1)) >> 8;
+  const uint32_t g = (((a >> 8) & 0xFF) * (((b >> 8) & 0xFF) + 1)) >> 8;
+  const uint32_t bl = ((a & 0xFF) * ((b & 0xFF) + 1)) >> 8;
+  return (r << 16) | (g << 8) | bl;
+}
+
+// All three channels added at once, each clamped at 255: add the low seven bits, put the top bit back
+// without a carry, and fill any channel that carried out of it
+static inline uint32_t LayerAddSaturate(uint32_t a, uint32_t b)
+{
+  const uint32_t sum = ((a & 0x7F7F7F) + (b & 0x7F7F7F)) ^ ((a ^ b) & 0x808080);
+  const uint32_t carry = ((a & b) | ((a | b) & ~sum)) & 0x808080;
+  return sum | ((carry >> 7) * 0xFF);
+}
+
+/**
+ * @brief Blend one packed layer pixel over one packed pixel beneath it.
+ *
+ * None of the modes can carry from one channel into the next: each sum below is at most 255 a channel.
+ */
+static inline uint32_t LayerBlendPixel(uint32_t under, uint32_t layer, uint8_t opacity, LayerBlend blend)
+{
+  switch (blend)
+  {
+  case LAYER_ADD:
+    return LayerAddSaturate(under, LayerScale(layer, opacity));
+  case LAYER_SCREEN:
+  {
+    const uint32_t over = LayerScale(layer, opacity);
+    return under + (over - LayerMultiply(under, over));
+  }
+  case LAYER_MULTIPLY:
+    return under - LayerScale(under - LayerMultiply(under, layer), opacity);
+  case LAYER_ALPHA:
+  default:
+  {
+    // The layer pixel is its color already multiplied by its coverage, its brightest channel
+    const uint8_t cover = scale8(max(max((uint8_t)(layer >> 16), (uint8_t)(layer >> 8)), (uint8_t)layer), opacity);
+    return LayerScale(layer, opacity) + LayerScale(under, 255 - cover);
+  }
+  }
+}
+
+/**
+ * @brief Composite @p count layers over @p base into @p out, in one pass.
+ *
+ * @param out Destination frame; may be @p base
+ * @param base The main effect's frame, at the bottom of the stack
+ * @param layers Bottom to top
+ * @param pixels Number of pixels in each frame
+ */
+void LayersComposite(CRGB *out, const CRGB *base, const LayerInput *layers, uint8_t count, uint16_t pixels)
+{
+  for (uint16_t i = 0; i < pixels; i++)
+  {
+    uint32_t p = LayerPack(base[i]);
+    for (uint8_t l = 0; l < count; l++)
+    {
+      p = LayerBlendPixel(p, LayerPack(layers[l].pixels[i]), layers[l].opacity, layers[l].blend);
+    }
+    out[i] = LayerUnpack(p);
+  }
+}
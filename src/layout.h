@@ -0,0 +1,233 @@
+/**
+ * @file layout.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Physical layout of the strip: segments, reversed runs, gaps and 2D positions
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   Effects draw in logical order: g_LEDs[0] to g_LEDs[NUM_LEDS - 1] run continuously along the bar,
+ *   whatever order the strip was actually wired in.  LED_LAYOUT describes the wiring as segments of
+ *   {first logical LED, count, first physical LED, reversed, x, y, dx, dy, gap}:
+ *
+ *     - the segment's LEDs are physical LEDs first to first + count - 1 on the strip, in that order
+ *       along the bar, or in the opposite order if reversed
+ *     - its first logical LED sits at (x, y), and each next one a step of (dx, dy) further on, in LED
+ *       pitches
+ *     - gap is the distance along the bar, in LED pitches, between the end of the previous segment and
+ *       the start of this one, such as a corner with no LEDs in it
+ *
+ *   An L-shaped bar whose strip starts at the corner, runs back along the 300 LED long side and then
+ *   carries on out along the 142 LED short side, with three LED pitches of corner between them, is
+ *
+ *     -D LED_LAYOUT="{{0,300,0,true,0,0,1,0,0},{300,142,300,false,302,2,0,1,3}}"
+ *
+ *   The remap costs nothing extra: OutputEncode() already walks every physical LED, and reads its
+ *   logical pixel through g_layoutLogical as it goes.  Dithering error is kept per physical LED.
+ *
+ *   FSEQ sequences are treated as logical like everything else, so export them for a single straight
+ *   model of NUM_LEDS pixels.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial layout table
+ *   0.2 - 10/19/26 - LayoutLogicalAt() for effects that move along the bar through its gaps
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+struct LayoutSegment
+{
+  uint16_t logical;  // First logical LED
+  uint16_t count;
+  uint16_t physical; // First LED on the strip
+  bool reversed;     // Physical order runs backwards along the bar
+  int16_t x;         // Position of the first logical LED, in LED pitches
+  int16_t y;
+  int8_t dx;         // Step from one logical LED to the next
+  int8_t dy;
+  uint16_t gap;      // Distance along the bar from the end of the previous segment, less the one pitch between neighbours
+};
+
+#ifndef LED_LAYOUT
+#define LED_LAYOUT {{0, NUM_LEDS, 0, false, 0, 0, 1, 0, 0}}
+#endif
+
+static const LayoutSegment kLayoutSegments[] = LED_LAYOUT;
+const uint8_t kLayoutSegmentCount = sizeof(kLayoutSegments) / sizeof(kLayoutSegments[0]);
+
+static uint16_t g_layoutLogical[NUM_LEDS]; // Physical LED to the logical pixel it shows
+static bool g_layoutValid = false;         // LED_LAYOUT checked out; otherwise logical is physical
+
+/**
+ * @brief Build the physical-to-logical table from LED_LAYOUT.  Call once at startup, before any output.
+ *
+ * @return false, leaving a straight one-to-one mapping, unless the segments follow on from each other
+ *         in logical order and cover every physical LED exactly once
+ */
+bool LayoutBegin()
+{
+  static const uint16_t kUnmapped = 0xFFFF;
+  for (uint16_t p = 0; p < NUM_LEDS; p++)
+  {
+    g_layoutLogical[p] = kUnmapped;
+  }
+
+  uint32_t covered = 0;
+  g_layoutValid = true;
+  for (uint8_t s = 0; s < kLayoutSegmentCount && g_layoutValid; s++)
+  {
+    const LayoutSegment &segment = kLayoutSegments[s];
+    if (segment.logical != covered)
+    {
+      Serial.printf("Layout: segment %u should start at logical LED %lu\n", s, (unsigned long)covered);
+      g_layoutValid = false;
+      break;
+    }
+    if (segment.logical + segment.count > NUM_LEDS || segment.physical + segment.count > NUM_LEDS)
+    {
+      Serial.printf("Layout: segment %u runs past LED %u\n", s, NUM_LEDS - 1);
+      g_layoutValid = false;
+      break;
+    }
+    for (uint16_t i = 0; i < segment.count; i++)
+    {
+      const uint16_t p = segment.reversed ? segment.physical + segment.count - 1 - i : segment.physical + i;
+      if (g_layoutLogical[p] != kUnmapped)
+      {
+        Serial.printf("Layout: physical LED %u is in more than one segment\n", p);
+        g_layoutValid = false;
+        break;
+      }
+      g_layoutLogical[p] = segment.logical + i;
+    }
+    covered += segment.count;
+  }
+  if (g_layoutValid && covered != NUM_LEDS)
+  {
+    Serial.printf("Layout: segments cover %lu of %u LEDs\n", (unsigned long)covered, NUM_LEDS);
+    g_layoutValid = false;
+  }
+
+  if (!g_layoutValid)
+  {
+    for (uint16_t p = 0; p < NUM_LEDS; p++)
+    {
+      g_layoutLogical[p] = p;
+    }
+    return false;
+  }
+  return true;
+}
+
+// LayoutSegmentOf
+//
+// Index of the segment holding logical LED @p logical.  Without a valid layout, or for an LED outside the
+// strip, 0.
+
+uint8_t LayoutSegmentOf(uint16_t logical)
+{
+  for (uint8_t s = 0; g_layoutValid && s < kLayoutSegmentCount; s++)
+  {
+    const LayoutSegment &segment = kLayoutSegments[s];
+    if (logical >= segment.logical && logical < segment.logical + segment.count)
+    {
+      return s;
+    }
+  }
+  return 0;
+}
+
+// LayoutPhysical
+//
+// Where logical LED @p logical is on the strip.
+
+uint16_t LayoutPhysical(uint16_t logical)
+{
+  if (!g_layoutValid)
+  {
+    return logical;
+  }
+  const LayoutSegment &segment = kLayoutSegments[LayoutSegmentOf(logical)];
+  const uint16_t i = logical - segment.logical;
+  return segment.reversed ? segment.physical + segment.count - 1 - i : segment.physical + i;
+}
+
+// LayoutPoint
+//
+// 2D position of logical LED @p logical, in LED pitches.
+
+void LayoutPoint(uint16_t logical, int16_t &x, int16_t &y)
+{
+  if (!g_layoutValid)
+  {
+    x = logical;
+    y = 0;
+    return;
+  }
+  const LayoutSegment &segment = kLayoutSegments[LayoutSegmentOf(logical)];
+  const int16_t i = logical - segment.logical;
+  x = segment.x + segment.dx * i;
+  y = segment.y + segment.dy * i;
+}
+
+// LayoutDistance
+//
+// How far logical LED @p logical is along the bar from the first, in LED pitches, counting the gaps.
+
+uint16_t LayoutDistance(uint16_t logical)
+{
+  uint16_t distance = logical;
+  for (uint8_t s = 0; g_layoutValid && s < kLayoutSegmentCount; s++)
+  {
+    if (kLayoutSegments[s].logical <= logical)
+    {
+      distance += kLayoutSegments[s].gap;
+    }
+  }
+  return distance;
+}
+
+// LayoutLength
+//
+// Length of the whole bar, in LED pitches, counting the gaps: one more than the last LED's distance.
+
+uint16_t LayoutLength()
+{
+  return LayoutDistance(NUM_LEDS - 1) + 1;
+}
+
+// LayoutLogicalAt
+//
+// The other way from LayoutDistance(): the logical position of the point @p distance along the bar, both in
+// 1/256ths of an LED pitch (particle units, see particles.h).  -1 if the point is in a gap or off the bar, where
+// there is nothing to draw.
+
+int32_t LayoutLogicalAt(int32_t distance)
+{
+  if (distance < 0)
+  {
+    return -1;
+  }
+  if (!g_layoutValid)
+  {
+    return distance < ((int32_t)NUM_LEDS << 8) ? distance : -1;
+  }
+  int32_t start = 0; // Distance to the first LED of segment s
+  for (uint8_t s = 0; s < kLayoutSegmentCount; s++)
+  {
+    const LayoutSegment &segment = kLayoutSegments[s];
+    start += (int32_t)segment.gap << 8;
+    if (distance < start)
+    {
+      return -1;
+    }
+    if (distance < start + ((int32_t)segment.count << 8))
+    {
+      return ((int32_t)segment.logical << 8) + distance - start;
+    }
+    start += (int32_t)segment.count << 8;
+  }
+  return -1;
+}
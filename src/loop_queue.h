@@ -0,0 +1,153 @@
+/**
+ * @file loop_queue.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief The one way other tasks hand work to the render loop
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   The show's state - g_State, the effects, the transition and sync timelines - belongs to the loop
+ *   and is only ever touched there.  The HTTP task, the BLE callbacks (which run on the Bluedroid task)
+ *   and the touch task put what they want done on this queue instead, and the loop runs it between
+ *   frames from LoopQueuePoll().
+ *
+ *   LoopRun() waits for the loop to get to it, for an HTTP handler that needs the answer.  LoopPost()
+ *   doesn't, for callers that mustn't be held up: a BLE write waiting on a frame would stall the radio.
+ *   What a posted call needs has to outlive the caller, so LoopPostData() posts a copy of a payload.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial queue, taken out of http_task.h for BLE
+ *   0.2 - 10/19/26 - Touch gestures
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#define LOOP_QUEUE_DEPTH 8 // Calls waiting; a full queue makes LoopPost() fail rather than block
+
+// One piece of work handed to the loop
+struct LoopCall
+{
+  void (*run)(void *);
+  void *arg;
+  SemaphoreHandle_t done; // Given once run has returned, or nullptr when nobody waits
+};
+
+// A payload copied for a posted call; the bytes follow, with a '\0' after them
+struct LoopData
+{
+  void (*run)(const uint8_t *data, size_t length, uint32_t context);
+  uint32_t context;
+  size_t length;
+};
+
+static TaskHandle_t g_loopTask = nullptr;
+static QueueHandle_t g_loopCalls = nullptr;
+static uint32_t g_loopCalled = 0;  // Calls the loop has run for other tasks
+static uint32_t g_loopDropped = 0; // Posts refused because the queue was full or the heap was
+
+// LoopQueueBegin
+//
+// Called first thing in setup(), on the task that goes on to run loop().
+
+void LoopQueueBegin()
+{
+  g_loopTask = xTaskGetCurrentTaskHandle();
+  g_loopCalls = xQueueCreate(LOOP_QUEUE_DEPTH, sizeof(LoopCall));
+}
+
+// True on the loop's own task, where its state can be touched directly
+static inline bool LoopOnTask()
+{
+  return g_loopCalls == nullptr || xTaskGetCurrentTaskHandle() == g_loopTask;
+}
+
+// LoopRun
+//
+// Run @p run(@p arg) on the loop at its next pass and wait, on @p done, for it to finish.  On the loop
+// itself it just runs there and then.
+
+void LoopRun(void (*run)(void *), void *arg, SemaphoreHandle_t done)
+{
+  if (LoopOnTask())
+  {
+    run(arg);
+    return;
+  }
+  const LoopCall call = {run, arg, done};
+  xQueueSend(g_loopCalls, &call, portMAX_DELAY);
+  xSemaphoreTake(done, portMAX_DELAY);
+}
+
+// LoopPost
+//
+// Have the loop run @p run(@p arg) at its next pass, without waiting for it.  Returns false, and it
+// won't run, if the queue is full.
+
+bool LoopPost(void (*run)(void *), void *arg)
+{
+  if (LoopOnTask())
+  {
+    run(arg);
+    return true;
+  }
+  const LoopCall call = {run, arg, nullptr};
+  if (xQueueSend(g_loopCalls, &call, 0) != pdTRUE)
+  {
+    g_loopDropped++;
+    return false;
+  }
+  return true;
+}
+
+static void LoopRunData(void *arg)
+{
+  LoopData *data = static_cast<LoopData *>(arg);
+  data->run(reinterpret_cast<const uint8_t *>(data + 1), data->length, data->context);
+  free(data);
+}
+
+// LoopPostData
+//
+// LoopPost() with a copy of @p length bytes at @p bytes, which @p run gets (with @p context) on the loop.
+// The copy is '\0'-terminated, so it can be taken as a string.
+
+bool LoopPostData(void (*run)(const uint8_t *, size_t, uint32_t), uint32_t context, const void *bytes, size_t length)
+{
+  LoopData *data = static_cast<LoopData *>(malloc(sizeof(LoopData) + length + 1));
+  if (data == nullptr)
+  {
+    g_loopDropped++;
+    return false;
+  }
+  data->run = run;
+  data->context = context;
+  data->length = length;
+  memcpy(data + 1, bytes, length);
+  reinterpret_cast<char *>(data + 1)[length] = '\0';
+  if (!LoopPost(LoopRunData, data))
+  {
+    free(data);
+    return false;
+  }
+  return true;
+}
+
+// LoopQueuePoll
+//
+// Run whatever the other tasks have handed over.  Called by the loop once a pass.
+
+void LoopQueuePoll()
+{
+  LoopCall call;
+  while (g_loopCalls != nullptr && xQueueReceive(g_loopCalls, &call, 0) == pdTRUE)
+  {
+    call.run(call.arg);
+    g_loopCalled++;
+    if (call.done != nullptr)
+    {
+      xSemaphoreGive(call.done);
+    }
+  }
+}
@@ -44,35 +44,77 @@
 
 #include <Arduino.h>
 #include <stdio.h>
+#include <limits.h>
+#include "feature_flags.h"
+#if ENABLE_OLED
 #include <U8g2lib.h>
 #include <Wire.h>
+#endif
+#if ENABLE_WIFI
 #include <WiFi.h>
+#endif
+#if ENABLE_WEBSERVER
 #include <WebServer.h>
+#endif
+#if ENABLE_SPIFFS
 #include <SPIFFS.h>
+#endif
+#if ENABLE_OTA
 #include <ArduinoOTA.h>
 #include <Update.h>
+#endif
+#if ENABLE_BLE
 #include <BLEDevice.h>
 #include <BLEServer.h>
 #include <BLEUtils.h>
 #include <BLE2902.h>
+#endif
 #define FASTLED_INTERNAL
 #include <FastLED.h>
 #include <Lib8tion.h>
 #include <color.h>
 #include "secrets.h"
+#include "trace.h"
+#include "alloc_stats.h"
+#include "ble_protocol.h"
 
 // OLED definitions
 // #define OLED_SCL 22      // Not required as it is the default
 // #define OLED_SDA 21      // for I2C on the ESP32
 #define OLED_RULER_TEST 0
 
+#ifndef NUM_LEDS
 #define NUM_LEDS 442 // FastLED definitions
-#define LED_PIN 5   // Data pin for FastLED
+#endif
+#define LED_PIN 5   // Data pin for FastLED, unless LED_OUTPUTS splits the strip; see output.h
 
-CRGB g_LEDs[NUM_LEDS] = {0}; // Frame buffer for FastLED
+static CRGB g_EffectBuffers[2][NUM_LEDS] = {};   // Incoming and outgoing effect during a transition
+static CRGB g_TransitionFrame[NUM_LEDS] = {};     // Blend of the two while a transition runs
+CRGB *g_LEDs = g_EffectBuffers[0];                // Frame buffer the current effect draws into
+static const CRGB *g_Frame = g_EffectBuffers[0];  // Finished frame handed to the output stage; see output.h
 
 void DrawPixels(float fPos, float count, CRGB color);
 
+#include "output.h"
+#include "transition.h"
+#include "layers.h"
+#include "quality.h"
+#include "hue_lut.h"
+#include "sync.h"
+#include "audio.h"
+#include "fseq.h"
+#include "loop_queue.h"
+#if ENABLE_WEBSERVER && ENABLE_SPIFFS
+#include "web_assets.h"
+#endif
+#if ENABLE_WEBSERVER
+#include "http_task.h"
+#endif
+#include "bench.h"
+#include "ota.h"
+#include "idle.h"
+#include "touch.h"
+
 #include "effects/marquee.h"
 #include "effects/rainbow.h"
 #include "effects/twinkle.h"
@@ -83,19 +125,29 @@ void DrawPixels(float fPos, float count, CRGB color);
 #include "effects/palette.h"
 #include "effects/doublepalette.h"
 #include "effects/stareffect.h"
+#include "effects/spectrum.h"
+#include "effects/vumeter.h"
+#include "effects/beatpulse.h"
+#include "effects/userprogram.h"
+#include "effects/sequence.h"
 
 // U8G2_SSD1305_128X32_NONAME_F_HW_I2C g_OLED(U8G2_R0, /* reset=*/U8X8_PIN_NONE);
 // U8G2_SSD1306_128X32_WINSTAR_1_HW_I2C g_OLED(U8G2_R0);
 // U8G2_SH1106_128X32_VISIONOX_F_HW_I2C g_OLED(U8G2_R0);
+#if ENABLE_OLED
 U8G2_SH1106_128X32_VISIONOX_F_HW_I2C g_OLED(U8G2_R0);
+#endif
 int g_lineHeight = 0;
 int g_oledTopOffset = 0;
 const int kOledTextXOffset = 6; // Nudge text away from left-edge artifacts on some panels.
 const int kOledHeight = 32;
+const uint16_t kOledRefreshMs = 250; // Status redraw while the show runs
 int g_Brightness = 12;              // 0 - 255 brightness scale
 int g_MaxPowerInMilliwatts = 19750; // max power in milliwatts for a 4 amp power supply
 uint8_t g_EffectSpeed = 96;         // 1 - 255
 uint8_t g_EffectCount = 4;          // 1 - 16 (effect-specific)
+uint32_t g_FrameIndex = 0;          // Frame being rendered; the shared timeline frame when synchronized
+uint64_t g_EffectTimeUs = 0;        // Time that frame belongs to, for effects that animate by time
 
 enum EffectId : uint8_t
 {
@@ -110,6 +162,11 @@ enum EffectId : uint8_t
   EFFECT_PALETTE = 8,
   EFFECT_DOUBLEPALETTE = 9,
   EFFECT_STAREFFECT = 10,
+  EFFECT_SPECTRUM = 11,
+  EFFECT_VUMETER = 12,
+  EFFECT_BEATPULSE = 13,
+  EFFECT_USERPROGRAM = 14,
+  EFFECT_SEQUENCE = 15,
   EFFECT_COUNT
 };
 
@@ -121,6 +178,8 @@ struct LightingState
   CRGB color;
   uint8_t speed;
   uint8_t count;
+  TransitionStyle transition;
+  uint16_t transitionMs;
 };
 
 struct HAConfig
@@ -133,7 +192,7 @@ struct HAConfig
   const char *availability_topic;
 };
 
-static LightingState g_State = {true, 12, EFFECT_MARQUEE, CRGB::White, 96, 4};
+static LightingState g_State = {true, 12, EFFECT_MARQUEE, CRGB::White, 96, 4, TRANSITION_FADE, 1000};
 static const HAConfig kHAConfig = {
     "underbar_lighting",
     "underbar_lighting_01",
@@ -142,20 +201,104 @@ static const HAConfig kHAConfig = {
     "underbar/lighting/state",
     "underbar/lighting/availability"};
 
-static char g_commandBuffer[96] = {0};
+#define MAX_COMMAND (PIXELVM_MAX_SOURCE + 16) // Longest text command taken, serial or BLE; room for "program <source>"
+static char g_commandBuffer[MAX_COMMAND + 1] = {0};
 static size_t g_commandLength = 0;
+static bool g_commandTooLong = false; // The line being read has overrun g_commandBuffer
 
 static const char *g_otaStatus = "OFF";
 static uint8_t g_i2cAddress = 0;
 static bool g_wifiConnected = false;
+#if ENABLE_WEBSERVER
 static WebServer g_httpServer(80);
+#endif
 static BouncingBallEffect g_bounceEffect(NUM_LEDS, 3, 20, false);
 static uint8_t g_lastBounceCount = 0;
-static uint8_t g_effectSpeedPreset[EFFECT_COUNT] = {96, 96, 96, 96, 96, 96, 120, 140, 110, 110, 80};
-static uint8_t g_effectCountPreset[EFFECT_COUNT] = {4, 4, 4, 4, 5, 3, 3, 4, 6, 6, 4};
+static uint8_t g_effectSpeedPreset[EFFECT_COUNT] = {96, 96, 96, 96, 96, 96, 120, 140, 110, 110, 80, 32, 64, 128, 96, 96};
+static uint8_t g_effectCountPreset[EFFECT_COUNT] = {4, 4, 4, 4, 5, 3, 3, 4, 6, 6, 4, 4, 4, 8, 4, 4};
+
+// Transition bookkeeping; see RenderEffect()
+#ifndef TRANSITION_RENDER_BUDGET_US
+#define TRANSITION_RENDER_BUDGET_US 6000 // A 20 ms frame also has to fit a ~13 ms show of 442 LEDs
+#endif
+static EffectId g_renderedEffect = EFFECT_MARQUEE; // Effect drawing into g_LEDs
+static EffectId g_outgoingEffect = EFFECT_MARQUEE; // Effect being transitioned away from
+static uint8_t g_activeBuffer = 0;                 // Which of g_EffectBuffers g_LEDs points at
+static bool g_transitionActive = false;
+static bool g_transitionFrozen = false;            // Outgoing frame held still because both effects don't fit
+static TransitionStyle g_transitionStyle = TRANSITION_FADE;
+static uint16_t g_transitionMs = 0;
+static uint32_t g_transitionStart = 0;
+static uint32_t g_effectRenderUs[EFFECT_COUNT] = {0}; // Smoothed cost of one DrawEffect() per effect
+static uint32_t g_renderUs = 0;                       // Cost of the last RenderEffect(), all effects included
+static uint32_t g_transitionPeakUs = 0;               // Worst RenderEffect() during the last transition
+static uint32_t g_frameStartUs = 0;                   // When the frame now waiting to be shown started rendering
+static uint32_t g_frameRenderUs = 0;                  // How long that frame took to render, for the governor
+static uint32_t g_showUs = 0;                         // Smoothed time spent clocking a frame out
+static uint32_t g_oledUs = 0;                         // Smoothed time to redraw and flush the OLED
+static CRGB g_PreviousFrame[NUM_LEDS];                // Frame before g_Frame, blended from between renders; see ShowFrame()
+static bool g_interpolate = OUTPUT_INTERPOLATE;
+static bool g_interpFrom = false;                     // g_PreviousFrame holds the frame g_Frame should blend in from
+static uint32_t g_frameRenderedUs = 0;                // When g_Frame started rendering
+static uint16_t g_showsThisFrame = 0;                 // Strip refreshes since g_Frame was rendered
+static uint16_t g_showsPerFrame = 0;                  // The same for the frame before
+
+// Layers over the main effect; see layers.h and RenderLayers()
+static Layer g_layers[LAYER_OVERLAYS] = {};
+static CRGB g_LayerBuffers[LAYER_OVERLAYS][NUM_LEDS] = {}; // Each layer's effect draws into its own
+static CRGB g_CompositeFrame[NUM_LEDS] = {};
+static uint32_t g_layersDrawUs = 0;      // Drawing the layers' effects, last frame
+static uint32_t g_layersCompositeUs = 0; // Compositing them over the main effect, last frame
+
+// Timeline rendering for synchronized controllers; see RenderSynced()
+#ifndef SYNC_CATCHUP_BUDGET_US
+#define SYNC_CATCHUP_BUDGET_US 8000 // Replay time allowed per loop pass while catching up
+#endif
+#ifndef SYNC_MAX_REPLAY_FRAMES
+#define SYNC_MAX_REPLAY_FRAMES 15000 // Five minutes at 50 FPS; a longer-running effect is joined this far back
+#endif
+#define SYNC_JOIN_FADE_MS 1000   // Fade used when a follower joins an effect that is already under way
+#define SYNC_PRESENT_SPIN_US 2000 // Busy-wait for a frame's slot when it is this close
+static uint32_t g_EffectEpoch = 0;       // Frame the current effect (re)started on
+static bool g_effectEpochValid = false;  // Cleared to restart the current effect on the next frame
+static bool g_syncWasActive = false;
+static bool g_syncPending = false;       // g_FrameIndex has been drawn ahead and waits for its slot
+static bool g_syncHolding = false;       // Follower replaying its way into an effect; the outgoing frame is held
+static bool g_syncLateJoin = false;      // and fades in from wherever it catches up, not from the epoch
+static uint32_t g_syncReplayed = 0;      // Frames drawn but not shown since synchronization started
+static uint32_t g_syncAdvanced = 0;      // How many of those were only simulated; see AdvanceEffect()
+
+// Simulation effects started part way in; see EffectWarmupFrames()
+#ifndef FIRE_WARMUP_FRAMES
+#define FIRE_WARMUP_FRAMES 100 // Two seconds at 50 FPS, for the heat to rise up the strip
+#endif
+#ifndef BOUNCE_WARMUP_FRAMES
+#define BOUNCE_WARMUP_FRAMES 250 // Five seconds, for the balls to fall out of step with each other
+#endif
+#define EFFECT_TRAIL_FRAMES 48 // A trail fading by 20/256 a frame is gone in this many; these are drawn, not simulated
+static uint32_t g_warmupUs = 0;          // Cost of the last effect start, warm-up included
+
+// BLE control; see ble_protocol.h
+#define BLE_MAX_MTU 517             // Largest ATT MTU; the client's limit usually wins
+#define BLE_MIN_INTERVAL 6          // Requested connection interval range, in 1.25 ms units: 7.5 ms
+#define BLE_MAX_INTERVAL 12         // to 15 ms, for quick control at a small cost in airtime
+#define BLE_SUPERVISION_TIMEOUT 400 // 4 s, in 10 ms units
+#if ENABLE_BLE
 static BLEServer *g_bleServer = nullptr;
 static BLECharacteristic *g_bleTx = nullptr;
+static BLECharacteristic *g_bleState = nullptr;
+static BLECharacteristic *g_bleParams[BLE_PARAM_COUNT_] = {nullptr};
+#endif
 static bool g_bleConnected = false;
+static uint16_t g_bleMtu = 23;                     // Negotiated ATT MTU; a notification carries 3 bytes less
+static uint32_t g_bleIntervalUs = 50000;           // Connection interval, the shortest useful gap between notifications
+static uint32_t g_bleNotifyUs = 0;                 // When STATE was last notified
+static BleState g_bleSent = {};                    // What it said
+static bool g_blePending = false;                  // A change is waiting for the interval to pass
+static uint32_t g_bleWrites = 0;                   // Binary parameter and state writes
+static uint32_t g_bleNotifies = 0;                 // STATE notifications sent
+static uint32_t g_bleCoalesced = 0;                // Notifications held back and merged into a later one
+static uint32_t g_bleHeapBytes = 0;                // Heap taken by the BLE stack and services at setup
 
 void ApplyCommand(const char *command);
 
@@ -180,21 +323,141 @@ void SaveEffectPreset(EffectId effect)
   g_effectCountPreset[effect] = g_State.count;
 }
 
+// SendBleLine
+//
+// Send a line over the text service, split to fit the negotiated MTU and ended with a newline so the
+// client can put the pieces back together.
+
 void SendBleLine(const char *line)
 {
+#if ENABLE_BLE
   if (!g_bleConnected || g_bleTx == nullptr || line == nullptr)
   {
     return;
   }
-  g_bleTx->setValue(const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(line)), strlen(line));
+  TraceScope trace(TRACE_BLE);
+  const size_t payload = g_bleMtu - 3;
+  size_t length = strlen(line);
+  while (length >= payload)
+  {
+    g_bleTx->setValue(const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(line)), payload);
+    g_bleTx->notify();
+    line += payload;
+    length -= payload;
+  }
+  char last[BLE_MAX_MTU];
+  memcpy(last, line, length);
+  last[length++] = '\n';
+  g_bleTx->setValue(reinterpret_cast<uint8_t *>(last), length);
   g_bleTx->notify();
+#endif
+}
+
+// A command longer than MAX_COMMAND is refused whole: a cut-off "program" could compile to something else
+void RejectLongCommand()
+{
+  char line[64];
+  snprintf(line, sizeof(line), "Command too long: at most %u characters", (unsigned)MAX_COMMAND);
+  Serial.println(line);
+  SendBleLine(line);
+}
+
+BleState BlePackState()
+{
+  BleState state;
+  state.version = kBleProtocolVersion;
+  state.effectCount = EFFECT_COUNT;
+  state.power = g_State.power;
+  state.brightness = g_State.brightness;
+  state.effect = g_State.effect;
+  state.r = g_State.color.r;
+  state.g = g_State.color.g;
+  state.b = g_State.color.b;
+  state.speed = g_State.speed;
+  state.count = g_State.count;
+  state.transition = g_State.transition;
+  state.transitionMs = g_State.transitionMs;
+  return state;
+}
+
+// Take on a state written over BLE, with the same limits as the text commands.  A new effect brings its own
+// speed and count unless the write changed them too, as when choosing an effect any other way.
+void BleApplyState(const BleState &state)
+{
+  IdleWake("ble");
+  g_State.power = state.power != 0;
+  g_State.brightness = state.brightness;
+  g_State.color = CRGB(state.r, state.g, state.b);
+  g_State.transition = state.transition < TRANSITION_COUNT ? static_cast<TransitionStyle>(state.transition) : TRANSITION_FADE;
+  g_State.transitionMs = min<uint16_t>(state.transitionMs, 10000);
+  const EffectId effect = ClampEffect(state.effect);
+  const bool effectChanged = effect != g_State.effect;
+  g_State.effect = effect;
+  if (state.speed != g_State.speed || state.count != g_State.count)
+  {
+    g_State.speed = max<uint8_t>(state.speed, 1);
+    g_State.count = (uint8_t)constrain(state.count, 1, 16);
+    SaveEffectPreset(g_State.effect);
+  }
+  else if (effectChanged)
+  {
+    ApplyEffectPreset(g_State.effect);
+  }
+}
+
+// BlePoll
+//
+// Notify STATE if anything has changed since it was last sent, whether over BLE, serial, HTTP or sync,
+// but no more than once a connection interval.  Also brings the parameter characteristics up to date
+// for reads.
+
+void BlePoll()
+{
+#if ENABLE_BLE
+  if (!g_bleConnected || g_bleState == nullptr)
+  {
+    return;
+  }
+  BleState state = BlePackState();
+  if (memcmp(&state, &g_bleSent, sizeof(state)) == 0)
+  {
+    return;
+  }
+  const uint32_t now = micros();
+  if (now - g_bleNotifyUs < g_bleIntervalUs)
+  {
+    if (!g_blePending)
+    {
+      g_blePending = true;
+      g_bleCoalesced++;
+    }
+    return;
+  }
+  TraceScope trace(TRACE_BLE);
+  g_blePending = false;
+  g_bleSent = state;
+  g_bleNotifyUs = now;
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(&state);
+  for (uint8_t p = 0; p < BLE_PARAM_COUNT_; p++)
+  {
+    g_bleParams[p]->setValue(bytes + kBleParamOffset[p], kBleParamSize[p]);
+  }
+  g_bleState->setValue(bytes, sizeof(state));
+  g_bleState->notify();
+  g_bleNotifies++;
+#endif
 }
 
+#if ENABLE_BLE
 class BleServerCallbacks : public BLEServerCallbacks
 {
-  void onConnect(BLEServer *server) override
+  void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) override
   {
     g_bleConnected = true;
+    g_bleMtu = 23;
+    g_bleIntervalUs = param->connect.conn_params.interval * 1250;
+    memset(&g_bleSent, 0, sizeof(g_bleSent)); // A new subscriber gets the current state
+    server->updateConnParams(param->connect.remote_bda, BLE_MIN_INTERVAL, BLE_MAX_INTERVAL, 0, BLE_SUPERVISION_TIMEOUT);
   }
 
   void onDisconnect(BLEServer *server) override
@@ -205,31 +468,141 @@ class BleServerCallbacks : public BLEServerCallbacks
       server->getAdvertising()->start();
     }
   }
+
+  void onMtuChanged(BLEServer *server, esp_ble_gatts_cb_param_t *param) override
+  {
+    g_bleMtu = min<uint16_t>(param->mtu.mtu, BLE_MAX_MTU);
+  }
 };
 
+// The connection interval the central settled on, after our request or its own change
+static void BleGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+  if (event == ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT && param->update_conn_params.status == ESP_BT_STATUS_SUCCESS)
+  {
+    g_bleIntervalUs = param->update_conn_params.conn_int * 1250;
+  }
+}
+
+// The write callbacks run on the Bluedroid task, so each posts a copy of what was written to the loop
+// (see loop_queue.h) and returns; these are the loop's halves.
+
+static void BleRunCommand(const uint8_t *data, size_t length, uint32_t)
+{
+  TraceScope trace(TRACE_BLE);
+  ApplyCommand(reinterpret_cast<const char *>(data));
+}
+
+static void BleRunTooLong(void *)
+{
+  RejectLongCommand();
+}
+
+static void BleRunParam(const uint8_t *data, size_t length, uint32_t param)
+{
+  TraceScope trace(TRACE_BLE);
+  BleState state = BlePackState();
+  if (BleWriteParam(state, static_cast<BleParam>(param), data, length))
+  {
+    BleApplyState(state);
+    g_bleWrites++;
+  }
+}
+
+static void BleRunState(const uint8_t *data, size_t length, uint32_t)
+{
+  TraceScope trace(TRACE_BLE);
+  BleState state = BlePackState();
+  if (BleWriteState(state, data, length))
+  {
+    BleApplyState(state);
+    g_bleWrites++;
+  }
+}
+
 class BleRxCallbacks : public BLECharacteristicCallbacks
 {
   void onWrite(BLECharacteristic *characteristic) override
   {
-    std::string value = characteristic->getValue();
-    if (value.empty())
+    TraceScope trace(TRACE_BLE);
+    const uint8_t *data = characteristic->getData();
+    size_t length = characteristic->getLength();
+    if (length > 0 && (data[length - 1] == '\n' || data[length - 1] == '\r'))
     {
-      return;
+      length--;
+    }
+    if (length > MAX_COMMAND)
+    {
+      LoopPost(BleRunTooLong, nullptr);
     }
-    if (value.back() == '\n' || value.back() == '\r')
+    else if (length > 0)
     {
-      value.pop_back();
+      LoopPostData(BleRunCommand, 0, data, length);
     }
-    ApplyCommand(value.c_str());
   }
 };
 
+class BleParamCallbacks : public BLECharacteristicCallbacks
+{
+public:
+  explicit BleParamCallbacks(BleParam param) : _param(param) {}
+
+  void onWrite(BLECharacteristic *characteristic) override
+  {
+    TraceScope trace(TRACE_BLE);
+    LoopPostData(BleRunParam, _param, characteristic->getData(), characteristic->getLength());
+  }
+
+private:
+  BleParam _param;
+};
+
+class BleStateCallbacks : public BLECharacteristicCallbacks
+{
+  void onWrite(BLECharacteristic *characteristic) override
+  {
+    TraceScope trace(TRACE_BLE);
+    LoopPostData(BleRunState, 0, characteristic->getData(), characteristic->getLength());
+  }
+};
+#endif
+
 void SetupBleSerial()
 {
+#if ENABLE_BLE
+  const uint32_t heapBefore = ESP.getFreeHeap();
   BLEDevice::init("UnderbarLighting");
+  BLEDevice::setMTU(BLE_MAX_MTU);
+  BLEDevice::setCustomGapHandler(BleGapEvent);
   g_bleServer = BLEDevice::createServer();
   g_bleServer->setCallbacks(new BleServerCallbacks());
 
+  // Binary control: STATE plus one characteristic per parameter, each a value and a declaration handle
+  BLEService *control = g_bleServer->createService(BLEUUID(BLE_CONTROL_SERVICE_UUID), 2 * (BLE_PARAM_COUNT_ + 1) + 4, 0);
+  g_bleState = control->createCharacteristic(
+      BLE_STATE_UUID,
+      BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE |
+          BLECharacteristic::PROPERTY_WRITE_NR | BLECharacteristic::PROPERTY_NOTIFY);
+  g_bleState->addDescriptor(new BLE2902());
+  g_bleState->setCallbacks(new BleStateCallbacks());
+  for (uint8_t p = 0; p < BLE_PARAM_COUNT_; p++)
+  {
+    char uuid[40];
+    BleParamUuid(uuid, sizeof(uuid), static_cast<BleParam>(p));
+    g_bleParams[p] = control->createCharacteristic(
+        uuid,
+        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR);
+    g_bleParams[p]->setCallbacks(new BleParamCallbacks(static_cast<BleParam>(p)));
+  }
+  BleState state = BlePackState();
+  g_bleState->setValue(reinterpret_cast<uint8_t *>(&state), sizeof(state));
+  for (uint8_t p = 0; p < BLE_PARAM_COUNT_; p++)
+  {
+    g_bleParams[p]->setValue(reinterpret_cast<uint8_t *>(&state) + kBleParamOffset[p], kBleParamSize[p]);
+  }
+  control->start();
+
+  // Text commands, as before
   BLEService *service = g_bleServer->createService("6E400001-B5A3-F393-E0A9-E50E24DCCA9E");
   BLECharacteristic *rx = service->createCharacteristic(
       "6E400002-B5A3-F393-E0A9-E50E24DCCA9E",
@@ -243,8 +616,11 @@ void SetupBleSerial()
 
   service->start();
   BLEAdvertising *advertising = BLEDevice::getAdvertising();
-  advertising->addServiceUUID("6E400001-B5A3-F393-E0A9-E50E24DCCA9E");
+  advertising->addServiceUUID(BLE_CONTROL_SERVICE_UUID);
   advertising->start();
+  g_bleHeapBytes = heapBefore - ESP.getFreeHeap();
+  Serial.printf("BLE ready: %lu bytes of heap\n", (unsigned long)g_bleHeapBytes);
+#endif
 }
 
 const char *EffectName(EffectId effect)
@@ -271,16 +647,22 @@ const char *EffectName(EffectId effect)
     return "DualPal";
   case EFFECT_STAREFFECT:
     return "Stars";
+  case EFFECT_SPECTRUM:
+    return "Spectrum";
+  case EFFECT_VUMETER:
+    return "VU";
+  case EFFECT_BEATPULSE:
+    return "Beat";
+  case EFFECT_USERPROGRAM:
+    return "User";
+  case EFFECT_SEQUENCE:
+    return "Seq";
   case EFFECT_MARQUEE:
   default:
     return "Marq";
   }
 }
 
-#ifndef ENABLE_OTA
-#define ENABLE_OTA 0
-#endif
-
 #ifndef WIFI_SSID
 #define WIFI_SSID "CHANGE_ME"
 #endif
@@ -299,7 +681,7 @@ const char *EffectName(EffectId effect)
 // FractionalColor
 /**
  * @brief Returns a fractional color from 0.0 to 1.0; abstracts the fadToBlackBy out to this function in case we
- * want to improve the color math or do color correction all in one location at a later date.
+ * want to improve the color math.  Gamma and color correction are applied once, in OutputEncode().
  *
  * @param colorIn The color to return a fraction of
  * @param fraction The fraction of @p colorIn to return, from 0.0 to 1.0
@@ -331,14 +713,14 @@ void DrawPixels(float fPos, float count, CRGB color)
   // Calculate how much the first pixel will hold
   float availFirstPixel = 1.0f - (fPos - (long)(fPos));
   float amtFirstPixel = min(availFirstPixel, count);
-  float remaining = min(count, FastLED.size() - fPos);
+  float remaining = min(count, NUM_LEDS - fPos);
   int iPos = fPos;
 
   // Blend (add) in the color of the first partial pixel
 
   if (remaining > 0.0f)
   {
-    FastLED.leds()[iPos++] += ColorFraction(color, amtFirstPixel);
+    g_LEDs[iPos++] += ColorFraction(color, amtFirstPixel);
     remaining -= amtFirstPixel;
   }
 
@@ -346,7 +728,7 @@ void DrawPixels(float fPos, float count, CRGB color)
 
   while (remaining > 1.0f)
   {
-    FastLED.leds()[iPos++] += color;
+    g_LEDs[iPos++] += color;
     remaining--;
   }
 
@@ -354,7 +736,7 @@ void DrawPixels(float fPos, float count, CRGB color)
 
   if (remaining > 0.0f)
   {
-    FastLED.leds()[iPos++] += ColorFraction(color, remaining);
+    g_LEDs[iPos++] += ColorFraction(color, remaining);
   }
 }
 
@@ -377,7 +759,7 @@ void ApplyState()
   g_Brightness = g_State.brightness;
   g_EffectSpeed = g_State.speed;
   g_EffectCount = g_State.count;
-  FastLED.setBrightness(g_Brightness);
+  OutputSetBrightness(g_Brightness);
 
   if (g_State.effect == EFFECT_BOUNCE && g_EffectCount != g_lastBounceCount)
   {
@@ -387,15 +769,63 @@ void ApplyState()
   }
 }
 
-void RenderEffect()
+// EffectSupportsLod
+//
+// Effects that draw every pixel from scratch each frame can be drawn at reduced resolution and upsampled.
+// Ones that fade or add into what is already in g_LEDs can't, as the upsample overwrites their history.
+
+bool EffectSupportsLod(EffectId effect)
 {
-  if (!g_State.power)
+  switch (effect)
   {
-    FastLED.clear();
-    return;
+  case EFFECT_RAINBOW:
+  case EFFECT_FIRE:
+  case EFFECT_PALETTE:
+  case EFFECT_DOUBLEPALETTE:
+  case EFFECT_USERPROGRAM:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// FrameIntervalMs
+//
+// Sequences are rendered at their own frame rate, so every frame of one is on the strip for the same
+// time; everything else at the governor's.
+
+uint8_t FrameIntervalMs()
+{
+  if (g_State.power && g_State.effect == EFFECT_SEQUENCE && FseqStepMs() != 0)
+  {
+    return FseqStepMs();
+  }
+  return QualityFrameMs();
+}
+
+// DrawEffect
+//
+// Draw one frame of the given effect into g_LEDs, at the governor's level of detail if the effect allows it.
+// Synchronized controllers always draw at full detail, from PRNGs seeded for this frame, so they all agree.
+
+static void SelectEffectDetail(EffectId effect, bool synced)
+{
+  g_LodShift = EffectSupportsLod(effect) && !synced ? QualityLodShift() : 0;
+  g_RenderLeds = (NUM_LEDS + (1 << g_LodShift) - 1) >> g_LodShift;
+}
+
+void DrawEffect(EffectId effect)
+{
+  const uint32_t start = micros();
+  const bool synced = SyncActive();
+
+  if (synced)
+  {
+    SyncSeedFrame(g_FrameIndex, effect);
   }
+  SelectEffectDetail(effect, synced);
 
-  switch (g_State.effect)
+  switch (effect)
   {
   case EFFECT_SOLID:
     fill_solid(g_LEDs, NUM_LEDS, g_State.color);
@@ -427,105 +857,1213 @@ void RenderEffect()
   case EFFECT_STAREFFECT:
     DrawStarEffect();
     break;
+  case EFFECT_SPECTRUM:
+    DrawSpectrum();
+    break;
+  case EFFECT_VUMETER:
+    DrawVuMeter();
+    break;
+  case EFFECT_BEATPULSE:
+    DrawBeatPulse();
+    break;
+  case EFFECT_USERPROGRAM:
+    DrawUserProgram();
+    break;
+  case EFFECT_SEQUENCE:
+    DrawSequence();
+    break;
   case EFFECT_MARQUEE:
   default:
     DrawMarquee();
     break;
   }
-}
 
-void PrintHAStubHelp()
-{
-  Serial.println("Home Assistant stub (future MQTT topics):");
-  Serial.printf("  device: %s\n", kHAConfig.device_name);
-  Serial.printf("  command: %s\n", kHAConfig.command_topic);
-  Serial.printf("  state: %s\n", kHAConfig.state_topic);
-  Serial.printf("  availability: %s\n", kHAConfig.availability_topic);
-  Serial.printf("Serial commands: power on|off, brightness 0-255, effect 0-%u, color r,g,b, speed 1-255, count 1-16\n", EFFECT_COUNT - 1);
-  SendBleLine("Serial commands: power on|off, brightness 0-255, effect 0-10, color r,g,b, speed 1-255, count 1-16");
+  if (g_LodShift != 0)
+  {
+    LodUpsample(g_LEDs, g_RenderLeds, NUM_LEDS);
+  }
+
+  uint32_t &average = g_effectRenderUs[effect];
+  const uint32_t elapsed = micros() - start;
+  average = average == 0 ? elapsed : (average * 7 + elapsed) / 8;
 }
 
-void ApplyCommand(const char *command)
+// ResetEffect
+//
+// Put an effect back to its first frame, from cold.  Run (by StartEffect()) whenever an effect starts, so
+// that the same effect started on the same frame draws the same thing; synchronized controllers depend on it.
+
+void ResetEffect(EffectId effect)
 {
-  if (strncmp(command, "power ", 6) == 0)
+  switch (effect)
   {
-    const char *value = command + 6;
-    g_State.power = (strcmp(value, "on") == 0 || strcmp(value, "1") == 0);
-    return;
+  case EFFECT_MARQUEE:
+    ResetMarquee();
+    break;
+  case EFFECT_RAINBOW:
+    ResetRainbow();
+    break;
+  case EFFECT_TWINKLE:
+    ResetTwinkle();
+    break;
+  case EFFECT_COMET:
+    ResetComet();
+    break;
+  case EFFECT_BOUNCE:
+    g_bounceEffect.Reset();
+    break;
+  case EFFECT_FIRE:
+    ResetFire();
+    break;
+  case EFFECT_METEOR:
+    ResetMeteor();
+    break;
+  case EFFECT_PALETTE:
+    ResetPalette();
+    break;
+  case EFFECT_DOUBLEPALETTE:
+    ResetDoublePalette();
+    break;
+  case EFFECT_STAREFFECT:
+    ResetStarEffect();
+    break;
+  case EFFECT_SPECTRUM:
+    ResetSpectrum();
+    break;
+  case EFFECT_VUMETER:
+    ResetVuMeter();
+    break;
+  case EFFECT_BEATPULSE:
+    ResetBeatPulse();
+    break;
+  case EFFECT_USERPROGRAM:
+    ResetUserProgram();
+    break;
+  case EFFECT_SEQUENCE:
+    ResetSequence();
+    break;
+  default:
+    break; // Solid and stars keep no state between frames
   }
+}
 
-  if (strncmp(command, "brightness ", 11) == 0)
-  {
-    g_State.brightness = (uint8_t)constrain(atoi(command + 11), 0, 255);
-    return;
-  }
+// EffectWarmupFrames
+//
+// Effects that run a simulation look wrong until it has been going a while: fire's heat has to rise up
+// the strip, meteors and balls leave trails, and the balls all start out bouncing in step.  These are
+// started this many frames in the past (see SeekEffect()); zero for effects that look the same from their
+// first frame, and have no simulation for AdvanceEffect() to run.
 
-  if (strncmp(command, "effect ", 7) == 0)
+uint16_t EffectWarmupFrames(EffectId effect)
+{
+  switch (effect)
   {
-    int effect = atoi(command + 7);
-    g_State.effect = ClampEffect(effect);
-    ApplyEffectPreset(g_State.effect);
-    return;
+  case EFFECT_FIRE:
+    return FIRE_WARMUP_FRAMES;
+  case EFFECT_BOUNCE:
+    return BOUNCE_WARMUP_FRAMES;
+  case EFFECT_METEOR:
+    return EFFECT_TRAIL_FRAMES;
+  default:
+    return 0;
   }
+}
 
-  if (strncmp(command, "color ", 6) == 0)
-  {
-    int r = 0;
-    int g = 0;
-    int b = 0;
-    sscanf(command + 6, "%d,%d,%d", &r, &g, &b);
-    g_State.color = CRGB(constrain(r, 0, 255), constrain(g, 0, 255), constrain(b, 0, 255));
-    return;
-  }
+// Effects that fade what is already in g_LEDs rather than drawing every pixel afresh
+static inline bool EffectLeavesTrails(EffectId effect)
+{
+  return effect == EFFECT_BOUNCE || effect == EFFECT_METEOR;
+}
 
-  if (strncmp(command, "speed ", 6) == 0)
+// AdvanceEffect
+//
+// Run frame g_FrameIndex of an effect's simulation, at g_EffectTimeUs, without drawing it: what
+// DrawEffect() does to the effect's state, for a fraction of the cost.  Synchronized controllers seed it
+// just as they would the drawn frame, so a frame advanced on one controller and drawn on another leaves
+// the effect in the same state on both.
+
+void AdvanceEffect(EffectId effect)
+{
+  const bool synced = SyncActive();
+  if (synced)
   {
-    g_State.speed = (uint8_t)constrain(atoi(command + 6), 1, 255);
-    SaveEffectPreset(g_State.effect);
-    return;
+    SyncSeedFrame(g_FrameIndex, effect);
   }
+  SelectEffectDetail(effect, synced);
 
-  if (strncmp(command, "count ", 6) == 0)
+  switch (effect)
   {
-    g_State.count = (uint8_t)constrain(atoi(command + 6), 1, 16);
-    SaveEffectPreset(g_State.effect);
-    return;
+  case EFFECT_BOUNCE:
+    g_bounceEffect.Advance();
+    break;
+  case EFFECT_FIRE:
+    AdvanceFire();
+    break;
+  case EFFECT_METEOR:
+    AdvanceMeteor();
+    break;
+  default:
+    break;
   }
 }
 
-void HandleSerialControl()
+// SeekEffect
+//
+// Start an effect over as if it had started @p frames frames before g_FrameIndex, and run it up to there
+// without showing anything, so the next DrawEffect() carries on from that point.  The frames are
+// simulated with AdvanceEffect() except for the last few of an effect that leaves trails, which are drawn
+// into g_LEDs to lay the trails down.  Timed as frames at the current rate would have been, or on the
+// shared timeline when synchronized, where every controller seeking to the same frame ends up in step.
+
+void SeekEffect(EffectId effect, uint32_t frames)
 {
-  while (Serial.available() > 0)
+  const uint32_t frame = g_FrameIndex;
+  const uint64_t timeUs = g_EffectTimeUs;
+  const uint32_t drawn = EffectLeavesTrails(effect) ? EFFECT_TRAIL_FRAMES : 0;
+  for (uint32_t back = frames;; back--)
   {
-    char c = (char)Serial.read();
-    if (c == '\r')
+    g_FrameIndex = frame - back;
+    if (SyncActive())
     {
-      continue;
+      g_EffectTimeUs = SyncFrameTimeUs(g_FrameIndex);
     }
-    if (c == '\n')
+    else
     {
-      if (g_commandLength > 0)
-      {
-        g_commandBuffer[g_commandLength] = '\0';
-        ApplyCommand(g_commandBuffer);
-        g_commandLength = 0;
-      }
-      continue;
+      g_EffectTimeUs = timeUs - min<uint64_t>(timeUs, (uint64_t)back * FrameIntervalMs() * 1000);
     }
-    if (g_commandLength < (sizeof(g_commandBuffer) - 1))
+    if (back == frames)
     {
-      g_commandBuffer[g_commandLength++] = c;
+      ResetEffect(effect);
+    }
+    if (back == 0)
+    {
+      break;
+    }
+    if (back > drawn)
+    {
+      AdvanceEffect(effect);
+    }
+    else
+    {
+      DrawEffect(effect);
     }
   }
 }
 
-void SetupWiFiAndOTA()
+// StartEffect
+//
+// Put an effect back to its first frame, warmed up: see EffectWarmupFrames().
+
+void StartEffect(EffectId effect)
 {
-#if ENABLE_OTA
-  g_otaStatus = "WIFI";
+  const uint32_t start = micros();
+  SeekEffect(effect, EffectWarmupFrames(effect));
+  g_warmupUs = micros() - start;
+}
+
+// Effect time in milliseconds, which is what transitions are timed by
+static inline uint32_t EffectMillis()
+{
+  return (uint32_t)(g_EffectTimeUs / 1000);
+}
+
+// StartTransition
+//
+// Hand the current buffer to the outgoing effect and give the incoming one a cleared buffer of its own.
+// If both effects together have been measured to overrun the render budget, the outgoing frame is held
+// still and only faded, so a transition never costs more than one effect.  Synchronized controllers
+// always hold it, since a follower may not have the outgoing effect's history to draw it from.
+
+void StartTransition(EffectId next, TransitionStyle style, uint16_t ms)
+{
+  g_transitionStyle = style;
+  g_transitionMs = ms;
+
+  if (g_transitionStyle == TRANSITION_NONE || g_transitionMs == 0)
+  {
+    g_transitionActive = false;
+    g_renderedEffect = next;
+    StartEffect(next);
+    return;
+  }
+
+  g_outgoingEffect = g_renderedEffect;
+  g_renderedEffect = next;
+  g_activeBuffer ^= 1;
+  g_LEDs = g_EffectBuffers[g_activeBuffer];
+  fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+  StartEffect(next);
+
+  g_transitionFrozen = SyncActive() ||
+                       (g_effectRenderUs[g_outgoingEffect] + g_effectRenderUs[next]) > TRANSITION_RENDER_BUDGET_US;
+  g_transitionPeakUs = 0;
+  g_transitionStart = EffectMillis();
+  g_transitionActive = true;
+}
+
+// The current effect starts over on this frame; tell the followers if we're leading
+void MarkEffectStart()
+{
+  g_EffectEpoch = g_FrameIndex;
+  g_effectEpochValid = true;
+  SyncOnEffectStart(g_FrameIndex, g_State.speed, g_State.count);
+}
+
+// RenderMainEffect
+//
+// Draw the bottom of the layer stack: the current effect, or the transition into it.
+
+void RenderMainEffect()
+{
+  const uint32_t start = micros();
+  AudioFrame();
+
+  if (!g_State.power)
+  {
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+    g_transitionActive = false;
+    g_renderedEffect = g_State.effect; // Nothing to fade out of when the power comes back on
+    g_effectEpochValid = false;        // but the effect starts over
+    g_Frame = g_LEDs;
+    return;
+  }
+
+  if (g_State.effect != g_renderedEffect)
+  {
+    StartTransition(g_State.effect, g_State.transition, g_State.transitionMs);
+    MarkEffectStart();
+  }
+  else if (!g_effectEpochValid)
+  {
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+    StartEffect(g_renderedEffect);
+    MarkEffectStart();
+  }
+
+  if (g_syncHolding)
+  {
+    // Follower still replaying its way into the incoming effect: keep its state moving, show the old frame
+    DrawEffect(g_renderedEffect);
+    g_Frame = g_EffectBuffers[g_activeBuffer ^ 1];
+    g_renderUs = micros() - start;
+    return;
+  }
+
+  const uint32_t elapsed = EffectMillis() - g_transitionStart;
+  if (g_transitionActive && elapsed >= g_transitionMs)
+  {
+    g_transitionActive = false;
+  }
+
+  if (!g_transitionActive)
+  {
+    DrawEffect(g_renderedEffect);
+    g_Frame = g_LEDs;
+    g_renderUs = micros() - start;
+    return;
+  }
+
+  CRGB *outgoing = g_EffectBuffers[g_activeBuffer ^ 1];
+  if (!g_transitionFrozen)
+  {
+    g_LEDs = outgoing;
+    DrawEffect(g_outgoingEffect);
+    g_LEDs = g_EffectBuffers[g_activeBuffer];
+  }
+  DrawEffect(g_renderedEffect);
+
+  const uint8_t progress = (uint8_t)((elapsed * 255) / g_transitionMs);
+  TransitionBlend(g_TransitionFrame, outgoing, g_LEDs, NUM_LEDS, progress, g_transitionStyle);
+  g_Frame = g_TransitionFrame;
+
+  g_renderUs = micros() - start;
+  g_transitionPeakUs = max(g_transitionPeakUs, g_renderUs);
+  if (g_renderUs > TRANSITION_RENDER_BUDGET_US)
+  {
+    g_transitionFrozen = true;
+  }
+}
+
+// RenderLayers
+//
+// Draw each enabled layer's effect into its own buffer, at that effect's saved speed and count, and
+// composite them over g_Frame.  Effects keep their state in globals, so a layer showing an effect that
+// is already being drawn this frame (the main one, the one being transitioned away from, or a lower
+// layer's) is left out rather than run twice as fast.
+//
+// Layers aren't part of the synced show state, so while sync is active (leading or following) they
+// are left off and every controller shows the same frame.  They come back when sync stops.
+
+void RenderLayers()
+{
+  g_layersDrawUs = 0;
+  g_layersCompositeUs = 0;
+  if (!g_State.power || g_syncHolding || SyncActive())
+  {
+    return;
+  }
+
+  uint32_t start = micros();
+  LayerInput inputs[LAYER_OVERLAYS];
+  uint8_t count = 0;
+  uint32_t drawn = 1UL << g_renderedEffect;
+  if (g_transitionActive && !g_transitionFrozen)
+  {
+    drawn |= 1UL << g_outgoingEffect;
+  }
+  CRGB *const leds = g_LEDs;
+  const uint8_t speed = g_EffectSpeed;
+  const uint8_t effectCount = g_EffectCount;
+  for (uint8_t l = 0; l < LAYER_OVERLAYS; l++)
+  {
+    Layer &layer = g_layers[l];
+    if (!layer.enabled || (drawn & (1UL << layer.effect)) != 0)
+    {
+      continue;
+    }
+    drawn |= 1UL << layer.effect;
+    g_LEDs = g_LayerBuffers[l];
+    g_EffectSpeed = g_effectSpeedPreset[layer.effect];
+    g_EffectCount = g_effectCountPreset[layer.effect];
+    if (layer.restart)
+    {
+      layer.restart = false;
+      fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+      StartEffect(static_cast<EffectId>(layer.effect));
+    }
+    DrawEffect(static_cast<EffectId>(layer.effect));
+    inputs[count++] = {g_LayerBuffers[l], layer.opacity, layer.blend};
+  }
+  g_LEDs = leds;
+  g_EffectSpeed = speed;
+  g_EffectCount = effectCount;
+  if (count == 0)
+  {
+    return;
+  }
+  g_layersDrawUs = micros() - start;
+
+  start = micros();
+  LayersComposite(g_CompositeFrame, g_Frame, inputs, count, NUM_LEDS);
+  g_Frame = g_CompositeFrame;
+  g_layersCompositeUs = micros() - start;
+}
+
+void RenderEffect()
+{
+  RenderMainEffect();
+  RenderLayers();
+  g_renderUs += g_layersDrawUs + g_layersCompositeUs;
+}
+
+// SetLayer
+//
+// Put @p effect on layer @p index, or take the layer away if @p effect is negative.  The effect starts
+// over on the next frame.
+
+void SetLayer(uint8_t index, int effect, LayerBlend blend, uint8_t opacity)
+{
+  Layer &layer = g_layers[index];
+  layer.blend = blend;
+  layer.opacity = opacity;
+  if (effect >= 0)
+  {
+    layer.effect = ClampEffect(effect);
+    layer.restart = true;
+  }
+  layer.enabled = effect >= 0;
+}
+
+static const char *const kUserProgramPath = "/program.txt";
+
+// SaveUserProgram
+//
+// Write the user program to SPIFFS (when built in).  This blocks on flash, so call it from a task, not the loop.
+
+void SaveUserProgram(const char *source)
+{
+#if ENABLE_SPIFFS
+  File file = SPIFFS.open(kUserProgramPath, FILE_WRITE);
+  if (file)
+  {
+    file.print(source);
+    file.close();
+  }
+#endif
+}
+
+#if ENABLE_SPIFFS
+static TaskHandle_t g_programSaveTask = nullptr;
+static SemaphoreHandle_t g_programSaveLock = nullptr;
+static char g_programToSave[PIXELVM_MAX_SOURCE + 1] = {0}; // Latest program for the save task, under g_programSaveLock
+
+// ProgramSaveTask
+//
+// Core 0: write whatever program the loop last handed over.  If several arrive while one is being written, only
+// the newest is saved next.
+
+static void ProgramSaveTask(void *)
+{
+  static char source[sizeof(g_programToSave)];
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(g_programSaveLock, portMAX_DELAY);
+    memcpy(source, g_programToSave, sizeof(source));
+    xSemaphoreGive(g_programSaveLock);
+    SaveUserProgram(source);
+  }
+}
+#endif
+
+// SaveUserProgramLater
+//
+// Hand the program to the save task so the loop never waits on flash.  Before the task exists (early setup) it is
+// written straight away.
+
+void SaveUserProgramLater(const char *source)
+{
+#if ENABLE_SPIFFS
+  if (g_programSaveTask == nullptr)
+  {
+    SaveUserProgram(source);
+    return;
+  }
+  xSemaphoreTake(g_programSaveLock, portMAX_DELAY);
+  strncpy(g_programToSave, source, sizeof(g_programToSave) - 1);
+  g_programToSave[sizeof(g_programToSave) - 1] = '\0';
+  xSemaphoreGive(g_programSaveLock);
+  xTaskNotifyGive(g_programSaveTask);
+#endif
+}
+
+// SetUserProgram
+//
+// Compile a new user program and, if it compiles, keep it in SPIFFS (when built in) so it is still there
+// after a reboot.  The save happens on the save task; flash writes stay off the loop.
+// Semicolons and newlines both end a line, so a one-line serial or BLE command can hold a whole program.
+
+bool SetUserProgram(const char *source, char *error, size_t errorSize)
+{
+  if (!CompileUserProgram(source, error, errorSize))
+  {
+    return false;
+  }
+  SaveUserProgramLater(source);
+  return true;
+}
+
+// UserProgramBegin
+//
+// Load the saved user program, falling back to the built-in one if there isn't one or it no longer compiles.
+
+void UserProgramBegin()
+{
+  PixelVmBuildTables();
+  char error[64];
+#if ENABLE_SPIFFS
+  g_programSaveLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(ProgramSaveTask, "save", 4096, nullptr, 1, &g_programSaveTask, 0);
+  if (SPIFFS.begin(true) && SPIFFS.exists(kUserProgramPath))
+  {
+    File file = SPIFFS.open(kUserProgramPath, FILE_READ);
+    const size_t length = file.readBytes(g_userProgramSource, sizeof(g_userProgramSource) - 1);
+    g_userProgramSource[length] = '\0';
+    file.close();
+    if (CompileUserProgram(g_userProgramSource, error, sizeof(error)))
+    {
+      return;
+    }
+    Serial.printf("Saved program doesn't compile (%s); using the default.\n", error);
+  }
+#endif
+  CompileUserProgram(kDefaultUserProgram, error, sizeof(error));
+}
+
+static volatile uint16_t g_benchRequest = 0; // Frames per effect for a bench the loop should run
+
+static void SendBenchLine(const char *line)
+{
+  Serial.println(line);
+  SendBleLine(line);
+}
+
+// RunBench
+//
+// The bench command.  Draws every effect for @p frames frames on a simulated 50 FPS clock, timing the
+// render, the output encoding (the CPU side of a show, with nothing sent to the strip) and the power
+// calculation; then a strip of hues converted per pixel against the hue table (hue_lut.h), the layer
+// compositor (layers.h) at each depth and in each blend mode, real shows of a black frame and OLED
+// flushes, and reports stack and heap low-water marks.  See bench.h for the
+// line format.  Blocks the loop for a few seconds; the current effect starts over afterwards.
+
+void RunBench(uint16_t frames)
+{
+  char line[128];
+  if (SyncActive() || OtaActive())
+  {
+    SendBenchLine("bench,error,busy");
+    return;
+  }
+  frames = constrain(frames, 1, BENCH_MAX_FRAMES);
+  static BenchSamples render; // Static: three of these are 3 KB, too much for the loop task's stack
+  static BenchSamples encode;
+  static BenchSamples power;
+
+  const uint32_t startMs = millis();
+  const uint32_t savedFrameIndex = g_FrameIndex;
+  const uint8_t savedTier = g_qualityTier;
+  const bool savedAuto = g_qualityAuto;
+  QualitySetTier(0, false); // Full detail, so that builds compare like for like
+  g_transitionActive = false;
+
+  snprintf(line, sizeof(line), "bench,begin,frames=%u,cpu_mhz=%lu,leds=%u,outputs=%u,build=%s %s", frames,
+           (unsigned long)ESP.getCpuFreqMHz(), NUM_LEDS, kOutputChannelCount, __DATE__, __TIME__);
+  SendBenchLine(line);
+  SendBenchLine("bench,stage,name,frames,min,median,max");
+
+#if OUTPUT_ASYNC
+  while (!OutputAsyncReady()) // Encoding below goes into the back buffers
+  {
+    delay(1);
+  }
+#endif
+  for (uint8_t e = 0; e < EFFECT_COUNT; e++)
+  {
+    const EffectId effect = static_cast<EffectId>(e);
+    ResetEffect(effect);
+    fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+    render.Clear();
+    encode.Clear();
+    power.Clear();
+    for (uint16_t f = 0; f < frames; f++)
+    {
+      g_FrameIndex++;
+      g_EffectTimeUs += kQualityTiers[0].frameMs * 1000ULL;
+
+      uint32_t start = BenchCycles();
+      DrawEffect(effect);
+      render.Add(BenchCycles() - start);
+
+      start = BenchCycles();
+      OutputEncode(g_LEDs);
+      encode.Add(BenchCycles() - start);
+
+      start = BenchCycles();
+      volatile uint32_t milliwatts = calculate_unscaled_power_mW(g_LEDs, NUM_LEDS);
+      power.Add(BenchCycles() - start);
+      (void)milliwatts;
+    }
+    const char *name = EffectName(effect);
+    render.Format(line, sizeof(line), "render", name);
+    SendBenchLine(line);
+    encode.Format(line, sizeof(line), "encode", name);
+    SendBenchLine(line);
+    power.Format(line, sizeof(line), "power", name);
+    SendBenchLine(line);
+    delay(1); // Let the idle task in
+  }
+
+  // The hue gradient a rainbow fill draws, converted per pixel as fill_rainbow() does and from the table
+  render.Clear();
+  encode.Clear();
+  for (uint16_t f = 0; f < frames; f++)
+  {
+    uint32_t start = BenchCycles();
+    CHSV hsv((uint8_t)f, 255, 255);
+    for (uint16_t i = 0; i < NUM_LEDS; i++, hsv.hue += 4)
+    {
+      hsv2rgb_rainbow(hsv, g_LEDs[i]);
+    }
+    render.Add(BenchCycles() - start);
+
+    start = BenchCycles();
+    FillHueGradient(g_LEDs, NUM_LEDS, f << 8, 4 << 8);
+    encode.Add(BenchCycles() - start);
+  }
+  render.Format(line, sizeof(line), "hue", "hsv2rgb");
+  SendBenchLine(line);
+  encode.Format(line, sizeof(line), "hue", "lut");
+  SendBenchLine(line);
+
+  // The layer compositor over the hue strip: one, two, ... layers deep, mixing the blend modes, for what
+  // each layer added on top costs; then each blend mode on its own
+  LayerInput inputs[LAYER_OVERLAYS];
+  for (uint8_t l = 0; l < LAYER_OVERLAYS; l++)
+  {
+    FillHueGradient(g_LayerBuffers[l], NUM_LEDS, l << 14, -(3 << 8));
+    inputs[l] = {g_LayerBuffers[l], 192, static_cast<LayerBlend>(l % LAYER_BLEND_COUNT)};
+  }
+  for (uint8_t depth = 1; depth <= LAYER_OVERLAYS + LAYER_BLEND_COUNT; depth++)
+  {
+    const bool stack = depth <= LAYER_OVERLAYS;
+    const LayerInput single = {g_LayerBuffers[0], 192, static_cast<LayerBlend>(depth - LAYER_OVERLAYS - 1)};
+    render.Clear();
+    for (uint16_t f = 0; f < frames; f++)
+    {
+      const uint32_t start = BenchCycles();
+      LayersComposite(g_CompositeFrame, g_LEDs, stack ? inputs : &single, stack ? depth : 1, NUM_LEDS);
+      render.Add(BenchCycles() - start);
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "depth%u", depth);
+    render.Format(line, sizeof(line), "layers", stack ? name : LayerBlendName(single.blend));
+    SendBenchLine(line);
+  }
+  for (uint8_t l = 0; l < LAYER_OVERLAYS; l++)
+  {
+    g_layers[l].restart = true; // Their buffers were drawn over
+  }
+
+  // The strip itself: a show costs the same whatever the pixels are, so keep it dark
+  fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+  g_Frame = g_LEDs;
+  render.Clear();
+  for (uint16_t f = 0; f < frames; f++)
+  {
+    const uint32_t start = BenchCycles();
+    while (!OutputShow(g_Frame)) // Asynchronous output: includes waiting for a free buffer
+    {
+    }
+    render.Add(BenchCycles() - start);
+  }
+  render.Format(line, sizeof(line), "show", "all");
+  SendBenchLine(line);
+
+  render.Clear();
+#if ENABLE_OLED
+  for (uint16_t f = 0; f < frames && g_i2cAddress != 0; f++) // No display: a zero line, not I2C timeouts
+  {
+    const uint32_t start = BenchCycles();
+    g_OLED.sendBuffer();
+    render.Add(BenchCycles() - start);
+  }
+#endif
+  render.Format(line, sizeof(line), "oled", "flush");
+  SendBenchLine(line);
+
+  snprintf(line, sizeof(line), "bench,mem,loop_stack_free_min=%lu,heap_free=%lu,heap_free_min=%lu,heap_max_block=%lu",
+           (unsigned long)uxTaskGetStackHighWaterMark(nullptr), (unsigned long)ESP.getFreeHeap(),
+           (unsigned long)ESP.getMinFreeHeap(), (unsigned long)ESP.getMaxAllocHeap());
+  SendBenchLine(line);
+  snprintf(line, sizeof(line), "bench,end,ms=%lu", (unsigned long)(millis() - startMs));
+  SendBenchLine(line);
+
+  QualitySetTier(savedTier, savedAuto);
+  g_FrameIndex = savedFrameIndex;
+  g_effectEpochValid = false; // The current effect starts over
+}
+
+void PrintHAStubHelp()
+{
+  Serial.println("Home Assistant stub (future MQTT topics):");
+  Serial.printf("  device: %s\n", kHAConfig.device_name);
+  Serial.printf("  command: %s\n", kHAConfig.command_topic);
+  Serial.printf("  state: %s\n", kHAConfig.state_topic);
+  Serial.printf("  availability: %s\n", kHAConfig.availability_topic);
+  Serial.printf("Serial commands: power on|off|toggle, brightness 0-255|next, effect 0-%u|next, color r,g,b, speed 1-255, count 1-16\n", EFFECT_COUNT - 1);
+  Serial.println("Transitions: transition none|fade|wipe|dissolve [ms]");
+  Serial.printf("Quality: quality (report), quality auto|0-%u\n", kQualityTierCount - 1);
+  Serial.println("Sync: sync (report), sync leader|follower|off");
+  Serial.println("Audio: audio (report features and analysis time)");
+  Serial.println("Programs: program (report), program <source> (compile and run; ; separates lines)");
+  Serial.println("Sequences: sequence (report), sequence play [/file.fseq], sequence stop, sequence seek <s>, sequence loop on|off");
+  Serial.println("Diagnostics: trace (dump Chrome trace JSON), trace clear, trace on|off, alloc, alloc arm");
+  Serial.printf("Benchmark: bench [frames] (per-effect cycle counts, default %u frames, up to %u)\n", BENCH_FRAMES, BENCH_MAX_FRAMES);
+  Serial.println("Updates: ota (report), ota bar on|off");
+  Serial.println("Power: idle (idle state, wake latency and estimated current)");
+  Serial.println("Layout: layout (segments from LED_LAYOUT), layout <led> (where one logical LED really is)");
+  Serial.println("Output: interp (report), interp on|off (blend refreshes between rendered frames)");
+  Serial.println("Frame times: frametime (percentiles of the time between new frames), frametime reset");
+  Serial.printf("Layers: layers (report), layer 1-%u off|<effect> [alpha|add|screen|multiply] [opacity 0-255]\n", LAYER_OVERLAYS);
+  Serial.println("Build: footprint (subsystems built in, flash, static RAM, free heap, boot time)");
+  Serial.println("Touch: touch (report); tap " TOUCH_TAP_COMMAND ", double tap " TOUCH_DOUBLE_COMMAND ", long press " TOUCH_LONG_COMMAND);
+  char line[160];
+  snprintf(line, sizeof(line), "Serial commands: power on|off|toggle, brightness 0-255|next, effect 0-%u|next, color r,g,b, speed 1-255, count 1-16", EFFECT_COUNT - 1);
+  SendBleLine(line);
+}
+
+void ApplyCommand(const char *command)
+{
+  IdleWake("command");
+  if (strcmp(command, "trace") == 0)
+  {
+    TraceDumpJson(Serial);
+    return;
+  }
+
+  if (strncmp(command, "trace ", 6) == 0)
+  {
+    const char *value = command + 6;
+    if (strcmp(value, "clear") == 0)
+    {
+      TraceClear();
+    }
+    else
+    {
+      g_traceEnabled = (strcmp(value, "on") == 0 || strcmp(value, "1") == 0);
+    }
+    return;
+  }
+
+  if (strcmp(command, "power toggle") == 0)
+  {
+    g_State.power = !g_State.power;
+    return;
+  }
+
+  if (strncmp(command, "power ", 6) == 0)
+  {
+    const char *value = command + 6;
+    g_State.power = (strcmp(value, "on") == 0 || strcmp(value, "1") == 0);
+    return;
+  }
+
+  if (strcmp(command, "brightness next") == 0)
+  {
+    // Step through a few levels, wrapping from the brightest back to the dimmest
+    static const uint8_t kBrightnessSteps[] = {12, 48, 128, 255};
+    uint8_t next = kBrightnessSteps[0];
+    for (uint8_t step : kBrightnessSteps)
+    {
+      if (step > g_State.brightness)
+      {
+        next = step;
+        break;
+      }
+    }
+    g_State.brightness = next;
+    g_State.power = true;
+    return;
+  }
+
+  if (strncmp(command, "brightness ", 11) == 0)
+  {
+    g_State.brightness = (uint8_t)constrain(atoi(command + 11), 0, 255);
+    return;
+  }
+
+  if (strcmp(command, "effect next") == 0)
+  {
+    // Also turns the power on: a touch double tap has just toggled it with its first tap
+    g_State.effect = ClampEffect((g_State.effect + 1) % EFFECT_COUNT);
+    ApplyEffectPreset(g_State.effect);
+    g_State.power = true;
+    return;
+  }
+
+  if (strncmp(command, "effect ", 7) == 0)
+  {
+    int effect = atoi(command + 7);
+    g_State.effect = ClampEffect(effect);
+    ApplyEffectPreset(g_State.effect);
+    return;
+  }
+
+  if (strcmp(command, "sync") == 0)
+  {
+    char line[176];
+    snprintf(line, sizeof(line), "sync role=%s active=%u locked=%u lost=%u offsetUs=%ld rttUs=%lu frame=%lu epoch=%lu replayed=%lu advanced=%lu packets=%lu dropped=%lu",
+             SyncRoleName(g_syncRole), SyncActive(), g_syncClock.Locked(), SyncLeaderLost(), (long)g_syncClock.Offset(),
+             (unsigned long)g_syncClock.BestRtt(), (unsigned long)g_FrameIndex, (unsigned long)g_EffectEpoch,
+             (unsigned long)g_syncReplayed, (unsigned long)g_syncAdvanced, (unsigned long)g_syncPackets,
+             (unsigned long)g_syncRxDropped);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "sync ", 5) == 0)
+  {
+    const char *value = command + 5;
+    if (strcmp(value, "leader") == 0)
+    {
+      SyncSetRole(SYNC_LEADER);
+    }
+    else if (strcmp(value, "follower") == 0)
+    {
+      SyncSetRole(SYNC_FOLLOWER);
+    }
+    else
+    {
+      SyncSetRole(SYNC_OFF);
+    }
+    return;
+  }
+
+  if (strcmp(command, "audio") == 0)
+  {
+    char line[128];
+    snprintf(line, sizeof(line), "audio level=%u bass=%u mid=%u treble=%u beats=%lu hops=%lu analyzeUs=%lu bands=%u,%u,%u,%u,%u,%u,%u,%u",
+             g_Audio.level, g_Audio.bass, g_Audio.mid, g_Audio.treble, (unsigned long)g_Audio.beatCount,
+             (unsigned long)g_Audio.hops, (unsigned long)g_audioAnalyzeUs, g_Audio.bands[0], g_Audio.bands[1],
+             g_Audio.bands[2], g_Audio.bands[3], g_Audio.bands[4], g_Audio.bands[5], g_Audio.bands[6], g_Audio.bands[7]);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "program") == 0)
+  {
+    char line[96];
+    snprintf(line, sizeof(line), "program valid=%u frameOps=%u pixelOps=%u registers=%u rgb=%u renderUs=%lu",
+             g_userProgram.valid, g_userProgram.frameCount, g_userProgram.pixelCount, g_userProgram.registerCount,
+             g_userProgram.rgb, (unsigned long)g_effectRenderUs[EFFECT_USERPROGRAM]);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "program ", 8) == 0)
+  {
+    char line[64];
+    if (SetUserProgram(command + 8, line + 6, sizeof(line) - 6))
+    {
+      if (g_State.effect != EFFECT_USERPROGRAM)
+      {
+        g_State.effect = EFFECT_USERPROGRAM;
+        ApplyEffectPreset(g_State.effect);
+      }
+      return;
+    }
+    memcpy(line, "error ", 6);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "sequence") == 0)
+  {
+    char line[128];
+    snprintf(line, sizeof(line), "sequence %s status=%s frame=%lu/%lu stepMs=%u loop=%u late=%lu dropped=%lu readUs=%lu",
+             FseqPath(), g_fseqError ? g_fseqError : "playing", (unsigned long)FseqPosition(),
+             (unsigned long)g_fseqFrameCount.load(), FseqStepMs(), g_fseqLoop, (unsigned long)g_fseqLate,
+             (unsigned long)g_fseqDropped, (unsigned long)g_fseqReadUs);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "sequence ", 9) == 0)
+  {
+    const char *value = command + 9;
+    if (strncmp(value, "play", 4) == 0)
+    {
+      FseqPlay(value[4] == ' ' ? value + 5 : FseqPath(), g_EffectTimeUs);
+      if (g_State.effect != EFFECT_SEQUENCE)
+      {
+        g_State.effect = EFFECT_SEQUENCE;
+        ApplyEffectPreset(g_State.effect);
+      }
+    }
+    else if (strcmp(value, "stop") == 0)
+    {
+      FseqStop();
+    }
+    else if (strncmp(value, "seek ", 5) == 0)
+    {
+      const uint32_t stepMs = max<uint32_t>(FseqStepMs(), 1);
+      FseqSeek((uint32_t)(atof(value + 5) * 1000.0f) / stepMs, g_EffectTimeUs);
+    }
+    else if (strncmp(value, "loop ", 5) == 0)
+    {
+      g_fseqLoop = strcmp(value + 5, "on") == 0 || strcmp(value + 5, "1") == 0;
+    }
+    return;
+  }
+
+  if (strcmp(command, "bench") == 0 || strncmp(command, "bench ", 6) == 0)
+  {
+    // Run from the loop, which owns the frame buffers, not from whichever task the command came in on
+    g_benchRequest = command[5] == ' ' ? (uint16_t)constrain(atoi(command + 6), 1, BENCH_MAX_FRAMES) : BENCH_FRAMES;
+    return;
+  }
+
+  if (strcmp(command, "alloc") == 0)
+  {
+    char line[256];
+    AllocFormat(line, sizeof(line));
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "alloc arm") == 0)
+  {
+    AllocArm();
+    return;
+  }
+
+  if (strcmp(command, "ota") == 0)
+  {
+    char line[160];
+    snprintf(line, sizeof(line), "ota %s%s%s progress=%u written=%lu ms=%lu writes=%lu writeMaxUs=%lu frames=%lu frameAvgUs=%lu frameMaxUs=%lu",
+             OtaStateName(), g_otaError[0] ? " error=" : "", g_otaError, OtaProgress(), (unsigned long)g_otaWritten,
+             (unsigned long)(OtaActive() ? millis() - g_otaStartMs : g_otaElapsedMs), (unsigned long)g_otaWrites,
+             (unsigned long)g_otaWriteMaxUs, (unsigned long)g_otaFrames,
+             (unsigned long)(g_otaFrames ? g_otaFrameTotalUs / g_otaFrames : 0), (unsigned long)g_otaFrameMaxUs);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "ota bar ", 8) == 0)
+  {
+    g_otaProgressBar = strcmp(command + 8, "on") == 0 || strcmp(command + 8, "1") == 0;
+    return;
+  }
+
+  if (strcmp(command, "footprint") == 0)
+  {
+    char line[192];
+    FootprintFormat(line, sizeof(line));
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "interp") == 0)
+  {
+    char line[96];
+    snprintf(line, sizeof(line), "interp %s frameMs=%u showUs=%lu showsPerFrame=%u", g_interpolate ? "on" : "off",
+             FrameIntervalMs(), (unsigned long)g_showUs, g_showsPerFrame);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "interp ", 7) == 0)
+  {
+    g_interpolate = strcmp(command + 7, "on") == 0 || strcmp(command + 7, "1") == 0;
+    return;
+  }
+
+  if (strcmp(command, "frametime") == 0)
+  {
+    char line[160];
+    snprintf(line, sizeof(line), "frametime frames=%lu frameMs=%u p50Us=%lu p90Us=%lu p99Us=%lu maxUs=%lu",
+             (unsigned long)g_frameTimeCount, FrameIntervalMs(), (unsigned long)FrameTimePercentileUs(500),
+             (unsigned long)FrameTimePercentileUs(900), (unsigned long)FrameTimePercentileUs(990),
+             (unsigned long)g_frameTimeMaxUs);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "frametime reset") == 0)
+  {
+    FrameTimeReset();
+    return;
+  }
+
+  if (strcmp(command, "layers") == 0)
+  {
+    char line[160];
+    int used = snprintf(line, sizeof(line), "layers drawUs=%lu compositeUs=%lu synced=%u", (unsigned long)g_layersDrawUs,
+                        (unsigned long)g_layersCompositeUs, SyncActive());
+    for (uint8_t l = 0; l < LAYER_OVERLAYS && used < (int)sizeof(line); l++)
+    {
+      const Layer &layer = g_layers[l];
+      if (layer.enabled)
+      {
+        used += snprintf(line + used, sizeof(line) - used, " %u=%s/%s/%u", l + 1,
+                         EffectName(static_cast<EffectId>(layer.effect)), LayerBlendName(layer.blend), layer.opacity);
+      }
+      else
+      {
+        used += snprintf(line + used, sizeof(line) - used, " %u=off", l + 1);
+      }
+    }
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "layer ", 6) == 0)
+  {
+    unsigned index = 0;
+    unsigned opacity = 255;
+    char effect[16] = "";
+    char blend[16] = "alpha";
+    if (sscanf(command + 6, "%u %15s %15s %u", &index, effect, blend, &opacity) < 2 || index < 1 || index > LAYER_OVERLAYS)
+    {
+      Serial.printf("Usage: layer 1-%u off|<effect> [alpha|add|screen|multiply] [opacity 0-255]\n", LAYER_OVERLAYS);
+      return;
+    }
+    LayerBlend layerBlend = LAYER_ALPHA;
+    if (!ParseLayerBlend(blend, layerBlend))
+    {
+      Serial.printf("Unknown blend '%s': alpha, add, screen or multiply\n", blend);
+      return;
+    }
+    SetLayer(index - 1, strcmp(effect, "off") == 0 ? -1 : atoi(effect), layerBlend, min(opacity, 255U));
+    if (SyncActive())
+    {
+      Serial.println("Layers are off while synced; this one shows once sync stops");
+    }
+    return;
+  }
+
+  if (strcmp(command, "layout") == 0)
+  {
+    char line[96];
+    snprintf(line, sizeof(line), "layout valid=%u segments=%u length=%u", g_layoutValid, kLayoutSegmentCount, LayoutLength());
+    Serial.println(line);
+    SendBleLine(line);
+    for (uint8_t s = 0; s < kLayoutSegmentCount; s++)
+    {
+      const LayoutSegment &segment = kLayoutSegments[s];
+      snprintf(line, sizeof(line), "layout segment=%u logical=%u count=%u physical=%u reversed=%u x=%d y=%d dx=%d dy=%d gap=%u",
+               s, segment.logical, segment.count, segment.physical, segment.reversed, segment.x, segment.y, segment.dx,
+               segment.dy, segment.gap);
+      Serial.println(line);
+      SendBleLine(line);
+    }
+    return;
+  }
+
+  if (strncmp(command, "layout ", 7) == 0)
+  {
+    const int logical = atoi(command + 7);
+    if (logical < 0 || logical >= NUM_LEDS)
+    {
+      Serial.printf("LED %d is not on the strip\n", logical);
+      return;
+    }
+    int16_t x, y;
+    LayoutPoint(logical, x, y);
+    char line[96];
+    snprintf(line, sizeof(line), "layout led=%d segment=%u physical=%u distance=%u x=%d y=%d", logical,
+             LayoutSegmentOf(logical), LayoutPhysical(logical), LayoutDistance(logical), x, y);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "touch") == 0)
+  {
+    char line[192];
+    TouchFormat(line, sizeof(line));
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "idle") == 0)
+  {
+    char line[256];
+    IdleFormat(line, sizeof(line));
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strcmp(command, "quality") == 0)
+  {
+    char line[112];
+    snprintf(line, sizeof(line), "quality tier=%u auto=%u lod=%u frameMs=%u workUs=%lu fixedUs=%lu renderUs=%lu",
+             g_qualityTier, g_qualityAuto, QualityLodShift(), QualityFrameMs(),
+             (unsigned long)g_frameWorkUs, (unsigned long)g_frameFixedUs, (unsigned long)g_renderUs);
+    Serial.println(line);
+    SendBleLine(line);
+    return;
+  }
+
+  if (strncmp(command, "quality ", 8) == 0)
+  {
+    const char *value = command + 8;
+    if (strcmp(value, "auto") == 0)
+    {
+      QualitySetTier(g_qualityTier, true);
+    }
+    else
+    {
+      QualitySetTier((uint8_t)constrain(atoi(value), 0, kQualityTierCount - 1), false);
+    }
+    return;
+  }
+
+  if (strncmp(command, "transition ", 11) == 0)
+  {
+    char style[16] = {0};
+    unsigned int ms = g_State.transitionMs;
+    sscanf(command + 11, "%15s %u", style, &ms);
+    if (!ParseTransition(style, g_State.transition))
+    {
+      Serial.printf("Unknown transition '%s': none, fade, wipe or dissolve\n", style);
+      return;
+    }
+    g_State.transitionMs = (uint16_t)constrain(ms, 0u, 10000u);
+    return;
+  }
+
+  if (strncmp(command, "color ", 6) == 0)
+  {
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    sscanf(command + 6, "%d,%d,%d", &r, &g, &b);
+    g_State.color = CRGB(constrain(r, 0, 255), constrain(g, 0, 255), constrain(b, 0, 255));
+    return;
+  }
+
+  if (strncmp(command, "speed ", 6) == 0)
+  {
+    g_State.speed = (uint8_t)constrain(atoi(command + 6), 1, 255);
+    SaveEffectPreset(g_State.effect);
+    return;
+  }
+
+  if (strncmp(command, "count ", 6) == 0)
+  {
+    g_State.count = (uint8_t)constrain(atoi(command + 6), 1, 16);
+    SaveEffectPreset(g_State.effect);
+    return;
+  }
+}
+
+void HandleSerialControl()
+{
+  while (Serial.available() > 0)
+  {
+    char c = (char)Serial.read();
+    if (c == '\r')
+    {
+      continue;
+    }
+    if (c == '\n')
+    {
+      if (g_commandTooLong)
+      {
+        RejectLongCommand();
+      }
+      else if (g_commandLength > 0)
+      {
+        g_commandBuffer[g_commandLength] = '\0';
+        ApplyCommand(g_commandBuffer);
+      }
+      g_commandLength = 0;
+      g_commandTooLong = false;
+      continue;
+    }
+    if (g_commandLength < MAX_COMMAND)
+    {
+      g_commandBuffer[g_commandLength++] = c;
+    }
+    else
+    {
+      g_commandTooLong = true;
+    }
+  }
+}
+
+void SetupWiFiAndOTA()
+{
+#if ENABLE_WIFI
+  g_otaStatus = "WIFI";
   if (strcmp(WIFI_SSID, "CHANGE_ME") == 0 || strlen(WIFI_SSID) == 0)
   {
-    Serial.println("OTA disabled: set WIFI_SSID/WIFI_PASS build flags.");
+    Serial.println("WiFi disabled: set WIFI_SSID/WIFI_PASS build flags.");
     g_otaStatus = "OFF";
     return;
   }
@@ -540,181 +2078,680 @@ void SetupWiFiAndOTA()
     delay(250);
   }
 
-  if (WiFi.status() != WL_CONNECTED)
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    Serial.println("WiFi connect failed; OTA not started.");
+    g_otaStatus = "FAIL";
+    g_wifiConnected = false;
+    return;
+  }
+
+  Serial.printf("WiFi connected, IP: %s\n", WiFi.localIP().toString().c_str());
+  g_wifiConnected = true;
+#endif
+
+#if ENABLE_OTA
+  if (!g_wifiConnected)
+  {
+    return;
+  }
+  g_otaStatus = "RDY";
+  ArduinoOTA.setHostname(OTA_HOSTNAME);
+  ArduinoOTA.setRebootOnSuccess(false); // OtaReboot() from the loop, between frames
+  // These run in the update task (see ota.h), which handles ArduinoOTA while the loop keeps rendering
+  ArduinoOTA.onStart([]()
+                     {
+                       Serial.println("OTA update start");
+                       g_otaStatus = "UPD";
+#if ENABLE_SPIFFS
+                       if (ArduinoOTA.getCommand() == U_SPIFFS)
+                       {
+                         FseqStop();
+                         SPIFFS.end();
+                       }
+#endif
+                       OtaArduinoStart();
+                       TraceBegin(TRACE_OTA);
+                     });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total)
+                        { OtaArduinoProgress(progress, total); });
+  ArduinoOTA.onEnd([]()
+                   {
+                     Serial.println("OTA update end");
+                     g_otaStatus = "RDY";
+                     OtaArduinoEnd(true, "");
+                     TraceEnd(TRACE_OTA);
+                   });
+  ArduinoOTA.onError([](ota_error_t error)
+                     {
+                       Serial.printf("OTA error: %u\n", error);
+                       g_otaStatus = "ERR";
+                       OtaArduinoEnd(false, "ArduinoOTA error");
+                       TraceEnd(TRACE_OTA);
+                     });
+  ArduinoOTA.begin();
+  Serial.println("OTA ready.");
+#endif
+}
+
+#if ENABLE_WEBSERVER
+// HttpChunkPrint
+//
+// Buffers Print output and forwards it as chunks of a chunked HTTP response, so large documents
+// such as the trace dump can be streamed without building a String in RAM.
+
+class HttpChunkPrint : public Print
+{
+public:
+  size_t write(uint8_t c) override
+  {
+    _buffer[_length++] = (char)c;
+    if (_length == sizeof(_buffer))
+    {
+      flush();
+    }
+    return 1;
+  }
+
+  void flush()
+  {
+    if (_length > 0)
+    {
+      g_httpServer.sendContent(_buffer, _length);
+      _length = 0;
+    }
+  }
+
+private:
+  char _buffer[512];
+  size_t _length = 0;
+};
+
+// HttpJson
+//
+// Streams a flat JSON object as a chunked response a field at a time, rather than growing a String
+// (and reallocating it) with every field.
+
+class HttpJson
+{
+public:
+  HttpJson()
+  {
+    g_httpServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    g_httpServer.send(200, "application/json", "");
+    _out.print("{");
+  }
+
+  void Field(const char *name, const char *value)
+  {
+    Name(name);
+    _out.print("\"");
+    _out.print(value);
+    _out.print("\"");
+  }
+
+  void Field(const char *name, bool value)
+  {
+    Name(name);
+    _out.print(value ? "true" : "false");
+  }
+
+  void Field(const char *name, int value) { Number(name, "%d", value); }
+  void Field(const char *name, unsigned value) { Number(name, "%u", value); }
+  void Field(const char *name, long value) { Number(name, "%ld", value); }
+  void Field(const char *name, unsigned long value) { Number(name, "%lu", value); }
+  void Field(const char *name, float value) { Number(name, "%.3f", (double)value); }
+
+  void Field(const char *name, const IPAddress &value)
+  {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", value[0], value[1], value[2], value[3]);
+    Field(name, text);
+  }
+
+  void End()
+  {
+    _out.print("}");
+    _out.flush();
+    g_httpServer.sendContent("");
+  }
+
+private:
+  void Name(const char *name)
+  {
+    _out.print(_first ? "\"" : ",\"");
+    _out.print(name);
+    _out.print("\":");
+    _first = false;
+  }
+
+  template <typename T>
+  void Number(const char *name, const char *format, T value)
+  {
+    char text[24];
+    snprintf(text, sizeof(text), format, value);
+    Name(name);
+    _out.print(text);
+  }
+
+  HttpChunkPrint _out;
+  bool _first = true;
+};
+
+// What the HTTP handlers report of the loop's state, published by the loop every pass; see http_task.h
+struct HttpState
+{
+  LightingState show;
+  const char *otaStatus;
+};
+
+static SharedSnapshot<HttpState> g_httpState;
+
+void HttpPublishState()
+{
+  HttpState state;
+  state.show = g_State;
+  state.otaStatus = g_otaStatus;
+  g_httpState.Publish(state);
+}
+
+static const long kHttpNoArg = LONG_MIN;
+
+// An integer argument of the request being handled, or kHttpNoArg without one
+static long HttpIntArg(const char *name)
+{
+  return g_httpServer.hasArg(name) ? g_httpServer.arg(name).toInt() : kHttpNoArg;
+}
+
+// HandleHttpSet
+//
+// /set and /status.  The arguments are read here, on the HTTP task, and applied on the loop.
+
+void HandleHttpSet()
+{
+  TraceScope trace(TRACE_HTTP);
+  IdleWake("http");
+  const String power = g_httpServer.arg("power");
+  const bool hasPower = g_httpServer.hasArg("power");
+  const long brightness = HttpIntArg("brightness");
+  const long effect = HttpIntArg("effect");
+  const long r = HttpIntArg("r");
+  const long g = HttpIntArg("g");
+  const long b = HttpIntArg("b");
+  const bool hasTransition = g_httpServer.hasArg("transition");
+  TransitionStyle transition = TRANSITION_FADE;
+  if (hasTransition && !ParseTransition(g_httpServer.arg("transition").c_str(), transition))
+  {
+    g_httpServer.send(400, "text/plain", "Unknown transition: none, fade, wipe or dissolve");
+    return;
+  }
+  const long transitionMs = HttpIntArg("transitionms");
+  const long speed = HttpIntArg("speed");
+  const long count = HttpIntArg("count");
+
+  if (g_httpServer.args() > 0)
   {
-    Serial.println("WiFi connect failed; OTA not started.");
-    g_otaStatus = "FAIL";
-    g_wifiConnected = false;
-    return;
+    HttpRunOnLoop([&]()
+                  {
+                    if (hasPower)
+                    {
+                      g_State.power = (power == "on" || power == "1" || power == "true");
+                    }
+                    if (brightness != kHttpNoArg)
+                    {
+                      g_State.brightness = (uint8_t)constrain(brightness, 0, 255);
+                    }
+                    if (effect != kHttpNoArg)
+                    {
+                      g_State.effect = ClampEffect(effect);
+                      ApplyEffectPreset(g_State.effect);
+                    }
+                    if (r != kHttpNoArg || g != kHttpNoArg || b != kHttpNoArg)
+                    {
+                      g_State.color = CRGB(r != kHttpNoArg ? constrain(r, 0, 255) : g_State.color.r,
+                                           g != kHttpNoArg ? constrain(g, 0, 255) : g_State.color.g,
+                                           b != kHttpNoArg ? constrain(b, 0, 255) : g_State.color.b);
+                    }
+                    if (hasTransition)
+                    {
+                      g_State.transition = transition;
+                    }
+                    if (transitionMs != kHttpNoArg)
+                    {
+                      g_State.transitionMs = (uint16_t)constrain(transitionMs, 0, 10000);
+                    }
+                    if (speed != kHttpNoArg)
+                    {
+                      g_State.speed = (uint8_t)constrain(speed, 1, 255);
+                      SaveEffectPreset(g_State.effect);
+                    }
+                    if (count != kHttpNoArg)
+                    {
+                      g_State.count = (uint8_t)constrain(count, 1, 16);
+                      SaveEffectPreset(g_State.effect);
+                    }
+                    HttpPublishState(); // So the reply shows the change
+                  });
   }
 
-  Serial.printf("WiFi connected, IP: %s\n", WiFi.localIP().toString().c_str());
-  g_otaStatus = "RDY";
-  g_wifiConnected = true;
+  const HttpState state = g_httpState.Read();
+  HttpJson json;
+  json.Field("power", state.show.power);
+  json.Field("brightness", state.show.brightness);
+  json.Field("effect", (int)state.show.effect);
+  json.Field("r", state.show.color.r);
+  json.Field("g", state.show.color.g);
+  json.Field("b", state.show.color.b);
+  json.Field("speed", state.show.speed);
+  json.Field("count", state.show.count);
+  json.Field("transition", TransitionName(state.show.transition));
+  json.Field("transitionms", state.show.transitionMs);
+  json.Field("ota", state.otaStatus);
+  json.End();
+}
 
-  ArduinoOTA.setHostname(OTA_HOSTNAME);
-  ArduinoOTA.onStart([]()
-                     {
-                       Serial.println("OTA update start");
-                       g_otaStatus = "UPD";
-                     });
-  ArduinoOTA.onEnd([]()
-                   {
-                     Serial.println("OTA update end");
-                     g_otaStatus = "RDY";
-                   });
-  ArduinoOTA.onError([](ota_error_t error)
-                     {
-                       Serial.printf("OTA error: %u\n", error);
-                       g_otaStatus = "ERR";
-                     });
-  ArduinoOTA.begin();
-  Serial.println("OTA ready.");
+#if ENABLE_SPIFFS
+static File g_sequenceUpload;
+static bool g_sequenceUploadOk = false;
+static char g_sequenceUploadPath[FSEQ_MAX_PATH] = FSEQ_DEFAULT_PATH;
 #endif
-}
 
-void HandleHttpSet()
+#if ENABLE_OTA
+
+// HandleUpdateUpload
+//
+// Upload handler for /update (firmware) and /updatefs (filesystem image).  Hands the data to the update
+// task in ota.h, which writes it between frames; the animation keeps running throughout.
+
+void HandleUpdateUpload(uint8_t target)
 {
-  if (g_httpServer.hasArg("power"))
-  {
-    String value = g_httpServer.arg("power");
-    g_State.power = (value == "on" || value == "1" || value == "true");
-  }
-  if (g_httpServer.hasArg("brightness"))
+  HTTPUpload &upload = g_httpServer.upload();
+  if (upload.status == UPLOAD_FILE_START)
   {
-    g_State.brightness = (uint8_t)constrain(g_httpServer.arg("brightness").toInt(), 0, 255);
+    Serial.printf("%s update: %s\n", target == U_SPIFFS ? "SPIFFS" : "Firmware", upload.filename.c_str());
+#if ENABLE_SPIFFS
+    if (target == U_SPIFFS)
+    {
+      HttpRunOnLoop([]()
+                    { FseqStop(); }); // Nothing may read the filesystem while it is being overwritten
+      SPIFFS.end();
+    }
+#endif
+    if (!OtaStart(target, g_httpServer.clientContentLength(), g_httpServer.arg("md5").c_str()))
+    {
+      Serial.println("Update already in progress.");
+    }
   }
-  if (g_httpServer.hasArg("effect"))
+  else if (upload.status == UPLOAD_FILE_WRITE)
   {
-    int effect = g_httpServer.arg("effect").toInt();
-    g_State.effect = ClampEffect(effect);
-    ApplyEffectPreset(g_State.effect);
+    OtaFeed(upload.buf, upload.currentSize);
   }
-  if (g_httpServer.hasArg("r") || g_httpServer.hasArg("g") || g_httpServer.hasArg("b"))
+  else if (upload.status == UPLOAD_FILE_END)
   {
-    int r = g_httpServer.hasArg("r") ? g_httpServer.arg("r").toInt() : g_State.color.r;
-    int g = g_httpServer.hasArg("g") ? g_httpServer.arg("g").toInt() : g_State.color.g;
-    int b = g_httpServer.hasArg("b") ? g_httpServer.arg("b").toInt() : g_State.color.b;
-    g_State.color = CRGB(constrain(r, 0, 255), constrain(g, 0, 255), constrain(b, 0, 255));
+    if (OtaFinish())
+    {
+      Serial.printf("Update verified: %u bytes, %lu ms, frames max %lu us\n", upload.totalSize,
+                    (unsigned long)g_otaElapsedMs, (unsigned long)g_otaFrameMaxUs);
+    }
+    else
+    {
+      Serial.printf("Update failed: %s\n", g_otaError);
+    }
   }
-  if (g_httpServer.hasArg("speed"))
+  else if (upload.status == UPLOAD_FILE_ABORTED)
   {
-    g_State.speed = (uint8_t)constrain(g_httpServer.arg("speed").toInt(), 1, 255);
-    SaveEffectPreset(g_State.effect);
+    OtaAbort();
+    Serial.println("Update aborted.");
   }
-  if (g_httpServer.hasArg("count"))
+}
+
+void HandleUpdateDone(const char *name)
+{
+  if (g_otaState != OTA_DONE)
   {
-    g_State.count = (uint8_t)constrain(g_httpServer.arg("count").toInt(), 1, 16);
-    SaveEffectPreset(g_State.effect);
+    char reply[64];
+    snprintf(reply, sizeof(reply), "%s update failed: %s", name, g_otaError);
+    g_httpServer.send(500, "text/plain", reply);
+#if ENABLE_SPIFFS
+    SPIFFS.begin(false); // Remount if this was a filesystem update; harmless otherwise
+#endif
+    return;
   }
-
-  String json = "{";
-  json += "\"power\":" + String(g_State.power ? "true" : "false");
-  json += ",\"brightness\":" + String(g_State.brightness);
-  json += ",\"effect\":" + String((int)g_State.effect);
-  json += ",\"r\":" + String(g_State.color.r);
-  json += ",\"g\":" + String(g_State.color.g);
-  json += ",\"b\":" + String(g_State.color.b);
-  json += ",\"speed\":" + String(g_State.speed);
-  json += ",\"count\":" + String(g_State.count);
-  json += ",\"ota\":\"" + String(g_otaStatus) + "\"";
-  json += "}";
-  g_httpServer.send(200, "application/json", json);
+  char reply[64];
+  snprintf(reply, sizeof(reply), "%s update complete. Rebooting...", name);
+  g_httpServer.send(200, "text/plain", reply);
+  OtaReboot(250);
 }
+#endif
 
 void SetupHttpServer()
 {
+#if ENABLE_SPIFFS
   if (!SPIFFS.begin(true))
   {
     Serial.println("SPIFFS mount failed.");
   }
 
-  g_httpServer.on("/", []()
-                  {
-                    File file = SPIFFS.open("/index.html", FILE_READ);
-                    if (!file)
-                    {
-                      g_httpServer.send(500, "text/plain", "index.html missing.");
-                      return;
-                    }
-                    g_httpServer.streamFile(file, "text/html");
-                    file.close();
-                  });
+  WebAssetsBegin(g_httpServer);
+#endif
   g_httpServer.on("/status", []()
                   { HandleHttpSet(); });
   g_httpServer.on("/set", []()
                   { HandleHttpSet(); });
+#if ENABLE_OTA
+  g_httpServer.on("/update", HTTP_POST, []()
+                  { HandleUpdateDone("Firmware"); },
+                  []()
+                  { HandleUpdateUpload(U_FLASH); });
+#if ENABLE_SPIFFS
   g_httpServer.on("/updatefs", HTTP_POST, []()
+                  { HandleUpdateDone("SPIFFS"); },
+                  []()
+                  { HandleUpdateUpload(U_SPIFFS); });
+#endif
+#endif
+  g_httpServer.on("/program", HTTP_GET, []()
                   {
-                    if (Update.hasError())
+                    TraceScope trace(TRACE_HTTP);
+                    static char source[sizeof(g_userProgramSource)]; // Only ever used by the HTTP task
+                    HttpRunOnLoop([]()
+                                  { memcpy(source, g_userProgramSource, sizeof(source)); });
+                    g_httpServer.send(200, "text/plain", source);
+                  });
+  g_httpServer.on("/program", HTTP_POST, []()
+                  {
+                    TraceScope trace(TRACE_HTTP);
+                    const String source = g_httpServer.arg("source");
+                    char error[64];
+                    bool compiled = false;
+                    uint16_t frameOps = 0;
+                    uint16_t pixelOps = 0;
+                    HttpRunOnLoop([&]()
+                                  {
+                                    compiled = CompileUserProgram(source.c_str(), error, sizeof(error));
+                                    if (compiled && g_State.effect != EFFECT_USERPROGRAM)
+                                    {
+                                      g_State.effect = EFFECT_USERPROGRAM;
+                                      ApplyEffectPreset(g_State.effect);
+                                    }
+                                    frameOps = g_userProgram.frameCount;
+                                    pixelOps = g_userProgram.pixelCount;
+                                  });
+                    if (!compiled)
                     {
-                      g_httpServer.send(500, "text/plain", "SPIFFS update failed.");
+                      g_httpServer.send(400, "text/plain", error);
+                      return;
                     }
-                    else
+                    SaveUserProgram(source.c_str()); // Flash writes stay off the loop
+                    char reply[64];
+                    snprintf(reply, sizeof(reply), "ok: %u per-frame and %u per-pixel operations", frameOps, pixelOps);
+                    g_httpServer.send(200, "text/plain", reply);
+                  });
+#if ENABLE_SPIFFS
+  g_httpServer.on("/sequence", HTTP_GET, []()
+                  {
+                    TraceScope trace(TRACE_HTTP);
+                    char path[FSEQ_MAX_PATH];
+                    const char *status = nullptr;
+                    uint32_t frame = 0;
+                    uint8_t stepMs = 0;
+                    HttpRunOnLoop([&]()
+                                  {
+                                    strncpy(path, FseqPath(), sizeof(path) - 1);
+                                    path[sizeof(path) - 1] = '\0';
+                                    status = g_fseqError ? g_fseqError : "playing";
+                                    frame = FseqPosition();
+                                    stepMs = FseqStepMs();
+                                  });
+                    HttpJson json;
+                    json.Field("path", path);
+                    json.Field("status", status);
+                    json.Field("frame", frame);
+                    json.Field("frames", g_fseqFrameCount.load());
+                    json.Field("stepMs", stepMs);
+                    json.Field("loop", g_fseqLoop);
+                    json.Field("freeBytes", SPIFFS.totalBytes() - SPIFFS.usedBytes());
+                    json.End();
+                  });
+  g_httpServer.on("/sequence", HTTP_POST, []()
+                  {
+                    if (!g_sequenceUploadOk)
                     {
-                      g_httpServer.send(200, "text/plain", "SPIFFS update complete. Rebooting...");
-                      delay(250);
-                      ESP.restart();
+                      g_httpServer.send(500, "text/plain", "Sequence upload failed (out of space?).");
+                      return;
                     }
+                    HttpRunOnLoop([]()
+                                  {
+                                    FseqPlay(g_sequenceUploadPath, g_EffectTimeUs);
+                                    if (g_State.effect != EFFECT_SEQUENCE)
+                                    {
+                                      g_State.effect = EFFECT_SEQUENCE;
+                                      ApplyEffectPreset(g_State.effect);
+                                    }
+                                  });
+                    g_httpServer.send(200, "text/plain", String("Playing ") + g_sequenceUploadPath);
                   },
                   []()
                   {
+                    TraceScope trace(TRACE_HTTP);
                     HTTPUpload &upload = g_httpServer.upload();
                     if (upload.status == UPLOAD_FILE_START)
                     {
-                      Serial.printf("SPIFFS update: %s\n", upload.filename.c_str());
-                      if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_SPIFFS))
-                      {
-                        Update.printError(Serial);
-                      }
+                      // Keep the base name; SPIFFS names are short and flat
+                      const char *name = strrchr(upload.filename.c_str(), '/');
+                      name = name ? name + 1 : upload.filename.c_str();
+                      snprintf(g_sequenceUploadPath, sizeof(g_sequenceUploadPath), "/%s", *name ? name : "show.fseq");
+                      HttpRunOnLoop([]()
+                                    {
+                                      if (strcmp(g_sequenceUploadPath, FseqPath()) == 0)
+                                      {
+                                        FseqStop(); // Replacing the file being played
+                                      }
+                                    });
+                      g_sequenceUpload = SPIFFS.open(g_sequenceUploadPath, FILE_WRITE);
+                      g_sequenceUploadOk = (bool)g_sequenceUpload;
+                      Serial.printf("Sequence upload: %s\n", g_sequenceUploadPath);
                     }
                     else if (upload.status == UPLOAD_FILE_WRITE)
                     {
-                      if (Update.write(upload.buf, upload.currentSize) != upload.currentSize)
+                      if (g_sequenceUploadOk && g_sequenceUpload.write(upload.buf, upload.currentSize) != upload.currentSize)
                       {
-                        Update.printError(Serial);
+                        g_sequenceUploadOk = false;
                       }
                     }
-                    else if (upload.status == UPLOAD_FILE_END)
+                    else if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED)
                     {
-                      if (!Update.end(true))
+                      if (g_sequenceUpload)
                       {
-                        Update.printError(Serial);
+                        g_sequenceUpload.close();
                       }
-                      else
+                      if (upload.status == UPLOAD_FILE_ABORTED || !g_sequenceUploadOk)
                       {
-                        Serial.printf("SPIFFS update success: %u bytes\n", upload.totalSize);
+                        g_sequenceUploadOk = false;
+                        SPIFFS.remove(g_sequenceUploadPath);
                       }
-                    }
-                    else if (upload.status == UPLOAD_FILE_ABORTED)
-                    {
-                      Update.end();
-                      Serial.println("SPIFFS update aborted.");
+                      Serial.printf("Sequence upload %s: %u bytes\n", g_sequenceUploadOk ? "complete" : "failed", upload.totalSize);
                     }
                   });
+#endif
+  g_httpServer.on("/trace", []()
+                  {
+                    TraceScope trace(TRACE_HTTP);
+                    g_httpServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+                    g_httpServer.sendHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+                    g_httpServer.send(200, "application/json", "");
+                    HttpChunkPrint out;
+                    TraceDumpJson(out);
+                    out.flush();
+                    g_httpServer.sendContent("");
+                  });
+  g_httpServer.on("/frametime", []()
+                  {
+                    TraceScope trace(TRACE_HTTP);
+                    const bool reset = g_httpServer.hasArg("reset");
+                    uint32_t frames = 0;
+                    uint8_t frameMs = 0;
+                    uint32_t percentiles[3] = {0};
+                    uint32_t maxUs = 0;
+                    HttpRunOnLoop([&]()
+                                  {
+                                    frames = g_frameTimeCount;
+                                    frameMs = FrameIntervalMs();
+                                    percentiles[0] = FrameTimePercentileUs(500);
+                                    percentiles[1] = FrameTimePercentileUs(900);
+                                    percentiles[2] = FrameTimePercentileUs(990);
+                                    maxUs = g_frameTimeMaxUs;
+                                    if (reset)
+                                    {
+                                      FrameTimeReset();
+                                    }
+                                  });
+                    HttpJson json;
+                    json.Field("frames", frames);
+                    json.Field("frameMs", frameMs);
+                    json.Field("p50Us", percentiles[0]);
+                    json.Field("p90Us", percentiles[1]);
+                    json.Field("p99Us", percentiles[2]);
+                    json.Field("maxUs", maxUs);
+                    json.Field("httpTask", g_httpTask != nullptr);
+                    json.Field("httpWaitMaxUs", g_httpWaitMaxUs);
+                    json.End();
+                  });
   g_httpServer.on("/debug", []()
                   {
-                    String json = "{";
-                    json += "\"wifi\":" + String(g_wifiConnected ? "true" : "false");
-                    json += ",\"ip\":\"" + WiFi.localIP().toString() + "\"";
-                    json += ",\"rssi\":" + String(WiFi.RSSI());
-                    json += ",\"i2c\":\"";
-                    if (g_i2cAddress == 0)
+                    TraceScope trace(TRACE_HTTP);
+                    // What the loop owns is copied out on the loop, between frames, so a reply never mixes
+                    // two frames (or a bench run's) values.  The other tasks' counters are single words.
+                    struct
                     {
-                      json += "none";
-                    }
-                    else
+                      uint32_t renderUs, transitionPeakUs, showUs, frameWorkUs, frameIndex, syncReplayed, syncAdvanced;
+                      uint32_t warmupUs, audioBeats, programUs, seqFrame, seqLate, seqDropped, idleWakeMaxUs;
+                      uint32_t layersDrawUs, layersCompositeUs, frameP99Us, frameMaxUs, syncRttUs;
+                      int64_t syncOffsetUs;
+                      uint16_t programOps, showsPerFrame;
+                      uint8_t qualityTier, lodShift, frameMs, audioLevel;
+                      bool transitionFrozen, qualityAuto, syncActive, syncLocked, idle, interp;
+                      const char *syncRole;
+                    } loop;
+                    HttpRunOnLoop([&]()
+                                  {
+                                    loop.renderUs = g_renderUs;
+                                    loop.transitionPeakUs = g_transitionPeakUs;
+                                    loop.transitionFrozen = g_transitionFrozen;
+                                    loop.showUs = g_showUs;
+                                    loop.qualityTier = g_qualityTier;
+                                    loop.qualityAuto = g_qualityAuto;
+                                    loop.lodShift = QualityLodShift();
+                                    loop.frameMs = QualityFrameMs();
+                                    loop.frameWorkUs = g_frameWorkUs;
+                                    loop.syncRole = SyncRoleName(g_syncRole);
+                                    loop.syncActive = SyncActive();
+                                    loop.syncLocked = g_syncClock.Locked();
+                                    loop.syncOffsetUs = g_syncClock.Offset();
+                                    loop.syncRttUs = g_syncClock.BestRtt();
+                                    loop.frameIndex = g_FrameIndex;
+                                    loop.syncReplayed = g_syncReplayed;
+                                    loop.syncAdvanced = g_syncAdvanced;
+                                    loop.warmupUs = g_warmupUs;
+                                    loop.audioLevel = g_Audio.level;
+                                    loop.audioBeats = g_Audio.beatCount;
+                                    loop.programOps = g_userProgram.pixelCount;
+                                    loop.programUs = g_effectRenderUs[EFFECT_USERPROGRAM];
+                                    loop.seqFrame = FseqPosition();
+                                    loop.seqLate = g_fseqLate;
+                                    loop.seqDropped = g_fseqDropped;
+                                    loop.idle = IdleActive();
+                                    loop.idleWakeMaxUs = g_idleWakeMaxUs;
+                                    loop.interp = g_interpolate;
+                                    loop.showsPerFrame = g_showsPerFrame;
+                                    loop.layersDrawUs = g_layersDrawUs;
+                                    loop.layersCompositeUs = g_layersCompositeUs;
+                                    loop.frameP99Us = FrameTimePercentileUs(990);
+                                    loop.frameMaxUs = g_frameTimeMaxUs;
+                                  });
+                    HttpJson json;
+                    json.Field("wifi", g_wifiConnected);
+                    json.Field("ip", WiFi.localIP());
+                    json.Field("rssi", WiFi.RSSI());
+                    json.Field("renderUs", loop.renderUs);
+                    json.Field("transitionPeakUs", loop.transitionPeakUs);
+                    json.Field("transitionFrozen", loop.transitionFrozen);
+                    json.Field("outputs", kOutputChannelCount);
+                    json.Field("showUs", loop.showUs);
+                    json.Field("qualityTier", loop.qualityTier);
+                    json.Field("qualityAuto", loop.qualityAuto);
+                    json.Field("lodShift", loop.lodShift);
+                    json.Field("frameMs", loop.frameMs);
+                    json.Field("frameWorkUs", loop.frameWorkUs);
+                    json.Field("syncRole", loop.syncRole);
+                    json.Field("syncActive", loop.syncActive);
+                    json.Field("syncLocked", loop.syncLocked);
+                    json.Field("syncOffsetUs", (long)loop.syncOffsetUs);
+                    json.Field("syncRttUs", loop.syncRttUs);
+                    json.Field("frameIndex", loop.frameIndex);
+                    json.Field("syncReplayed", loop.syncReplayed);
+                    json.Field("syncAdvanced", loop.syncAdvanced);
+                    json.Field("warmupUs", loop.warmupUs);
+                    json.Field("audioUs", g_audioAnalyzeUs);
+                    json.Field("audioLevel", loop.audioLevel);
+                    json.Field("audioBeats", loop.audioBeats);
+                    json.Field("programOps", loop.programOps);
+                    json.Field("programUs", loop.programUs);
+                    json.Field("seqFrame", loop.seqFrame);
+                    json.Field("seqLate", loop.seqLate);
+                    json.Field("seqDropped", loop.seqDropped);
+                    json.Field("seqReadUs", g_fseqReadUs);
+#if ENABLE_SPIFFS
+                    json.Field("webSent", g_webSent);
+                    json.Field("webNotModified", g_webNotModified);
+                    json.Field("webBytes", g_webBytes);
+                    json.Field("webServeUsMax", g_webServeUs);
+#endif
+                    json.Field("bleMtu", g_bleMtu);
+                    json.Field("bleIntervalUs", g_bleIntervalUs);
+                    json.Field("bleWrites", g_bleWrites);
+                    json.Field("bleNotifies", g_bleNotifies);
+                    json.Field("bleCoalesced", g_bleCoalesced);
+                    json.Field("bleHeap", g_bleHeapBytes);
+                    json.Field("otaState", OtaStateName());
+                    json.Field("otaProgress", OtaProgress());
+                    json.Field("otaWriteMaxUs", g_otaWriteMaxUs);
+                    json.Field("otaFrameMaxUs", g_otaFrameMaxUs);
+                    json.Field("idle", loop.idle);
+                    json.Field("idleWakeMaxUs", loop.idleWakeMaxUs);
+                    json.Field("touchLatencyMaxUs", g_touchLatencyMaxUs);
+                    json.Field("interp", loop.interp);
+                    json.Field("showsPerFrame", loop.showsPerFrame);
+                    json.Field("layersDrawUs", loop.layersDrawUs);
+                    json.Field("layersCompositeUs", loop.layersCompositeUs);
+                    json.Field("frameP99Us", loop.frameP99Us);
+                    json.Field("frameMaxUs", loop.frameMaxUs);
+                    json.Field("httpCalls", g_httpCalled);
+                    json.Field("loopCalls", g_loopCalled);
+                    json.Field("loopDropped", g_loopDropped);
+                    char i2c[8] = "none";
+                    if (g_i2cAddress != 0)
                     {
-                      json += "0x" + String(g_i2cAddress, HEX);
+                      snprintf(i2c, sizeof(i2c), "0x%x", g_i2cAddress);
                     }
-                    json += "\"";
-                    json += "}";
-                    g_httpServer.send(200, "application/json", json);
+                    json.Field("i2c", i2c);
+                    json.End();
                   });
   g_httpServer.begin();
-  Serial.println("HTTP server started on port 80.");
+  HttpPublishState();
+  if (HttpTaskBegin([]()
+                    { g_httpServer.handleClient(); }))
+  {
+    Serial.println("HTTP server started on port 80, on its own task.");
+  }
+  else
+  {
+    Serial.println("HTTP server started on port 80.");
+  }
 }
+#endif
 
+#if ENABLE_OLED
 uint8_t ScanI2C()
 {
   uint8_t found = 0;
@@ -729,29 +2766,350 @@ uint8_t ScanI2C()
   }
   return found;
 }
+#endif
+
+bool ShowFrame()
+{
+  TraceScope trace(TRACE_SHOW);
+  const uint32_t start = micros();
+
+  // Refreshes between renders step from the frame before to this one over the frame interval, rather
+  // than repeating it.  The OTA overlay and synchronized frames go out as they are.
+  const CRGB *from = nullptr;
+  uint8_t amount = 255;
+  if (g_interpFrom && !g_syncWasActive && !OtaActive())
+  {
+    const uint32_t intervalUs = FrameIntervalMs() * 1000UL;
+    const uint32_t sinceUs = start - g_frameRenderedUs;
+    if (sinceUs < intervalUs)
+    {
+      from = g_PreviousFrame;
+      amount = (uint8_t)(sinceUs * 255 / intervalUs);
+    }
+  }
+
+  if (!OutputShow(OtaOverlay(g_Frame), from, amount))
+  {
+    return false; // Asynchronous output still busy with the last two frames
+  }
+  const uint32_t elapsed = micros() - start;
+  g_showUs = g_showUs == 0 ? elapsed : (g_showUs * 7 + elapsed) / 8;
+  g_showsThisFrame++;
+
+  // The first show after a render completes that frame; tell the governor how long it took to render.
+  // The show itself, and the OLED flush the loop does between frames, cost the same at every tier and
+  // come off the time the render has.
+  if (g_frameStartUs != 0)
+  {
+    FrameTimeRecord(IdleActive() ? 0 : micros());
+    QualityFrameDone(g_frameRenderUs, g_showUs + g_oledUs * QualityFrameMs() / kOledRefreshMs);
+    g_frameStartUs = 0;
+    OtaFrameShown(); // A flash write can go now, before the next frame is due
+    AllocFrameDone();
+    IdleFrameShown();
+    TouchFrameShown();
+  }
+  return true;
+}
+
+// ShowAndDelay
+//
+// Same as FastLED.delay(): keep refreshing the strip until the delay has expired, but with each show traced.
+
+void ShowAndDelay(uint32_t ms)
+{
+  const uint32_t start = millis();
+  do
+  {
+    if (!ShowFrame())
+    {
+      delay(1);
+    }
+    yield();
+  } while ((millis() - start) < ms && !g_touchRenderNow); // A touch gesture's frame doesn't wait
+}
+
+void SyncCaptureState(SyncShowState &state)
+{
+  state.power = g_State.power;
+  state.brightness = g_State.brightness;
+  state.effect = g_State.effect;
+  state.r = g_State.color.r;
+  state.g = g_State.color.g;
+  state.b = g_State.color.b;
+  state.transition = g_State.transition;
+  state.transitionMs = g_State.transitionMs;
+}
+
+void SyncApplyState(const SyncShowState &state, uint32_t frame)
+{
+  g_State.power = state.power != 0;
+  g_State.brightness = state.brightness;
+  g_State.effect = ClampEffect(state.effect);
+  g_State.color = CRGB(state.r, state.g, state.b);
+  g_State.transition = static_cast<TransitionStyle>(min<uint8_t>(state.transition, TRANSITION_COUNT - 1));
+  g_State.transitionMs = min<uint16_t>(state.transitionMs, 10000);
+  SyncParamsAt(state, frame, g_State.speed, g_State.count);
+}
+
+// EnterTimelineFrame
+//
+// Move the clock to timeline frame @p frame.  Followers take speed and count from the leader's log for
+// that frame, so replayed frames see the same parameters the leader drew them with.
+
+void EnterTimelineFrame(uint32_t frame)
+{
+  g_FrameIndex = frame;
+  g_EffectTimeUs = SyncFrameTimeUs(frame);
+  if (SyncIsFollower())
+  {
+    SyncParamsAt(g_syncState, frame, g_State.speed, g_State.count);
+    ApplyState();
+  }
+  else
+  {
+    SyncOnParams(frame, g_State.speed, g_State.count);
+  }
+}
+
+// RenderTimelineFrame
+//
+// Draw timeline frame @p frame.
+
+void RenderTimelineFrame(uint32_t frame)
+{
+  EnterTimelineFrame(frame);
+  RenderEffect();
+}
+
+// AdvanceTimelineFrame
+//
+// Catching up: run timeline frame @p frame of the current effect's simulation instead of drawing it, if
+// that leaves the effect in the same state.  It does for a simulation effect that is simply carrying on;
+// anything else (a new or restarted effect, the power off) goes through RenderTimelineFrame().
+
+bool AdvanceTimelineFrame(uint32_t frame)
+{
+  if (!g_State.power || !g_effectEpochValid || g_State.effect != g_renderedEffect ||
+      EffectWarmupFrames(g_renderedEffect) == 0)
+  {
+    return false;
+  }
+  EnterTimelineFrame(frame);
+  AdvanceEffect(g_renderedEffect);
+  g_syncAdvanced++;
+  return true;
+}
+
+// SyncJoinEffect
+//
+// Follower: start the leader's effect on the leader's epoch frame.  The frames from there to now are
+// replayed (without being shown) by RenderSynced() while the old frame is held.  If the leader's own
+// transition would already be well under way by then, the follower fades in from where it catches up
+// instead, so joining mid-show never jumps.
+
+void SyncJoinEffect(uint32_t due)
+{
+  const uint32_t epoch = g_syncState.epochFrame;
+  uint32_t first = epoch;
+  if ((int32_t)(due - epoch) < 0)
+  {
+    first = due; // Leader's clock is ahead of ours; start now and let the clock discipline sort it out
+  }
+  else if (due - epoch > SYNC_MAX_REPLAY_FRAMES)
+  {
+    first = due - SYNC_MAX_REPLAY_FRAMES;
+  }
+
+  const uint32_t behindMs = (uint32_t)(((uint64_t)(due - first) * SyncFrameUs()) / 1000);
+  g_syncLateJoin = behindMs > max<uint32_t>(g_State.transitionMs / 2, 2 * SyncFrameUs() / 1000);
+
+  g_FrameIndex = first;
+  g_EffectTimeUs = SyncFrameTimeUs(first);
+  if (SyncIsFollower())
+  {
+    // The incoming effect's warm-up runs at the speed and count the leader's did
+    SyncParamsAt(g_syncState, first, g_State.speed, g_State.count);
+    ApplyState();
+  }
+  if (g_syncLateJoin)
+  {
+    StartTransition(g_State.effect, TRANSITION_FADE, SYNC_JOIN_FADE_MS);
+  }
+  else
+  {
+    StartTransition(g_State.effect, g_State.transition, g_State.transitionMs);
+  }
+  g_EffectEpoch = epoch;
+  g_effectEpochValid = true;
+  g_syncHolding = g_transitionActive;
+  g_FrameIndex = first - 1; // So the next frame drawn is the first one
+}
+
+// RenderSynced
+//
+// Timeline rendering, used in place of the frame timer while synchronized.  Frame n is drawn ahead and
+// presented when the timeline reaches n * frameUs, so every controller clocks out the same frame at the
+// same moment.  Frames whose slot has already passed (the loop was blocked, or a follower is catching up)
+// are still drawn, just not shown, since most effects carry state from one frame to the next.
+
+void RenderSynced()
+{
+  if (!g_syncWasActive)
+  {
+    g_syncWasActive = true;
+    g_syncPending = false;
+    g_syncReplayed = 0;
+    g_syncAdvanced = 0;
+    g_effectEpochValid = false; // Leader restarts its effect on the timeline; followers join it
+    g_FrameIndex = SyncCurrentFrame();
+  }
+
+  if (g_syncPending)
+  {
+    const int32_t wait = SyncUsUntilFrame(g_FrameIndex);
+    if (wait > SYNC_PRESENT_SPIN_US)
+    {
+      return;
+    }
+    if (wait > 0)
+    {
+      delayMicroseconds(wait);
+    }
+    if (ShowFrame())
+    {
+      g_syncPending = false;
+    }
+    return;
+  }
+
+  const uint32_t due = SyncCurrentFrame();
+  if (SyncIsFollower() && g_State.power &&
+      (!g_effectEpochValid || g_State.effect != g_renderedEffect || g_syncState.epochFrame != g_EffectEpoch))
+  {
+    SyncJoinEffect(due);
+  }
+
+  TraceScope trace(TRACE_RENDER);
+  const uint32_t start = micros();
+  while ((int32_t)(due - g_FrameIndex) > 0)
+  {
+    if (micros() - start > SYNC_CATCHUP_BUDGET_US)
+    {
+      return; // Carry on next pass; the held frame stays up meanwhile
+    }
+    // Frames well before the one to be shown only need the effect's state, not its pixels
+    const uint32_t next = g_FrameIndex + 1;
+    if ((int32_t)(due - next) < EFFECT_TRAIL_FRAMES || !AdvanceTimelineFrame(next))
+    {
+      RenderTimelineFrame(next);
+    }
+    g_syncReplayed++;
+  }
+
+  if (g_syncHolding)
+  {
+    g_syncHolding = false;
+    if (g_syncLateJoin)
+    {
+      g_transitionStart = EffectMillis();
+    }
+  }
+
+  g_frameStartUs = micros();
+  RenderTimelineFrame(due + 1);
+  g_frameRenderUs = micros() - g_frameStartUs;
+  g_syncPending = true;
+}
+
+// RenderFrameIfDue
+//
+// Render the next frame on the free-running timer, when not synchronized to other controllers.
+
+void RenderFrameIfDue()
+{
+  // A touch gesture's frame goes out straight away; the timer carries on from there
+  const bool touched = TouchTakeRender();
+  bool due = touched;
+  EVERY_N_MILLISECONDS_DYNAMIC(IdleActive() ? IDLE_FRAME_MS : FrameIntervalMs())
+  {
+    due = true;
+  }
+  if (!due)
+  {
+    return;
+  }
+
+  // Keep the frame being replaced to blend from.  A gesture's frame goes out whole rather than easing in,
+  // and idle renders have no refreshes between them to blend.
+  g_interpFrom = g_interpolate && !touched && !IdleActive();
+  if (g_interpFrom)
+  {
+    memcpy(g_PreviousFrame, g_Frame, sizeof(g_PreviousFrame));
+  }
+  g_showsPerFrame = g_showsThisFrame;
+  g_showsThisFrame = 0;
+
+  g_frameStartUs = micros();
+  g_frameRenderedUs = g_frameStartUs;
+  g_FrameIndex++;
+  g_EffectTimeUs = (uint64_t)esp_timer_get_time();
+  /*
+  fadeToBlackBy(g_LEDs, NUM_LEDS, 64);
+  int cometsize = 15;
+  int iPos = beatsin16(16, 0, NUM_LEDS - cometsize);
+  byte hue = beatsin8(48);
+
+  for (int i = iPos; i < iPos + cometsize; i++)
+    g_LEDs[i] = CHSV(hue, 255, 255);
+  */
+
+  TraceScope trace(TRACE_RENDER);
+  RenderEffect();
+  IdleFrame(g_Frame, NUM_LEDS, g_Brightness);
+  g_frameRenderUs = micros() - g_frameStartUs;
+}
+
+// PumpFrame
+//
+// One pass of the frame loop's rendering and output, for code that has to block the loop for a while
+// (an HTTP update upload, see ota.h) but should keep the animation going.
+
+void PumpFrame()
+{
+#if ENABLE_WEBSERVER
+  if (HttpOnTask())
+  {
+    return; // Uploads on the HTTP task don't hold the loop up; it carries on by itself
+  }
+#endif
+  if (g_syncWasActive)
+  {
+    RenderSynced();
+    return;
+  }
+  RenderFrameIfDue();
+  ShowFrame();
+}
 
 void StartupLedTest()
 {
-  FastLED.clear();
   fill_solid(g_LEDs, NUM_LEDS, CRGB::Red);
-  FastLED.show();
-  delay(350);
+  ShowAndDelay(350);
   fill_solid(g_LEDs, NUM_LEDS, CRGB::Green);
-  FastLED.show();
-  delay(350);
+  ShowAndDelay(350);
   fill_solid(g_LEDs, NUM_LEDS, CRGB::Blue);
-  FastLED.show();
-  delay(350);
-  FastLED.clear();
-  FastLED.show();
+  ShowAndDelay(350);
+  fill_solid(g_LEDs, NUM_LEDS, CRGB::Black);
+  ShowFrame();
 }
 
 void setup()
 {
 
   // put your setup code here, to run once:
+  LoopQueueBegin(); // Before BLE, HTTP or touch can hand the loop anything
   pinMode(LED_BUILTIN, OUTPUT);
-  pinMode(LED_PIN, OUTPUT);
 
 
 
@@ -767,9 +3125,17 @@ void setup()
   SetupWiFiAndOTA();
   if (g_wifiConnected)
   {
+#if ENABLE_WEBSERVER
     SetupHttpServer();
+#endif
+    SyncBegin();
+#if ENABLE_OTA
+    OtaBegin(true);
+    g_otaPump = PumpFrame;
+#endif
   }
 
+#if ENABLE_OLED
   Wire.begin(21, 22);
   Wire.setClock(100000);
   Wire.setTimeOut(50);
@@ -808,14 +3174,24 @@ void setup()
   }
   g_OLED.clearBuffer();
   g_OLED.sendBuffer();
+#endif
 
-  FastLED.addLeds<WS2812B, LED_PIN, GRB>(g_LEDs, NUM_LEDS); // Add our LED strip to the FastLED Library
-  FastLED.setBrightness(g_Brightness);
+  LayoutBegin();                     // Wiring order, which OutputEncode() remaps to
+  OutputBegin();                     // Add our LED strip(s) to the FastLED Library
+  FastLED.setBrightness(255);         // Brightness, gamma and dithering are
+  FastLED.setDither(DISABLE_DITHER);  // all handled by OutputEncode()
+  OutputBuildLut(OUTPUT_GAMMA, CRGB(OUTPUT_WHITE_BALANCE));
+  HueLutBuild();
+  OutputSetBrightness(g_Brightness);
 
-  FastLED.setMaxPowerInMilliWatts(g_MaxPowerInMilliwatts);
+  OutputSetMaxPower(g_MaxPowerInMilliwatts);
+  AudioBegin();
+  UserProgramBegin();
+  FseqBegin();
 
   StartupLedTest();
 
+#if ENABLE_OLED
   g_OLED.clearBuffer();
   g_OLED.setCursor(kOledTextXOffset, g_oledTopOffset);
   if (g_i2cAddress == 0)
@@ -830,7 +3206,15 @@ void setup()
   g_OLED.printf("LED test done");
   g_OLED.sendBuffer();
   delay(8000);
+#endif
 
+  TouchBegin(ApplyCommand);
+  IdleBegin(g_wifiConnected);
+  AllocArm(); // Everything that needs the heap has it; the frame loop must not ask for more
+  FootprintBootDone();
+  char footprint[192];
+  FootprintFormat(footprint, sizeof(footprint));
+  Serial.println(footprint);
 }
 
 void loop()
@@ -841,23 +3225,27 @@ void loop()
   while (true)
   {
 
-    EVERY_N_MILLISECONDS(20)
+    if (!SyncActive())
     {
-      /*
-      fadeToBlackBy(g_LEDs, NUM_LEDS, 64);
-      int cometsize = 15;
-      int iPos = beatsin16(16, 0, NUM_LEDS - cometsize);
-      byte hue = beatsin8(48);
-
-      for (int i = iPos; i < iPos + cometsize; i++)
-        g_LEDs[i] = CHSV(hue, 255, 255);
-      */
+      g_syncWasActive = false;
+      g_syncPending = false;
+      g_syncHolding = false;
+    }
+    else
+    {
+      RenderSynced();
+    }
 
-      RenderEffect();
+    if (!g_syncWasActive)
+    {
+      RenderFrameIfDue();
     }
 
-    EVERY_N_MILLISECONDS(250)
+#if ENABLE_OLED
+    EVERY_N_MILLISECONDS_DYNAMIC(IdleActive() ? IDLE_OLED_MS : kOledRefreshMs)
     {
+      TraceScope trace(TRACE_OLED);
+      const uint32_t oledStart = micros();
       const char *effectName = EffectName(g_State.effect);
 
       g_OLED.clearBuffer();
@@ -869,19 +3257,57 @@ void loop()
       g_OLED.setCursor(kOledTextXOffset, g_oledTopOffset + g_lineHeight);
       g_OLED.printf("Pwr:%4umW Bright:%3u", calculate_unscaled_power_mW(g_LEDs, NUM_LEDS), g_Brightness);
       g_OLED.setCursor(kOledTextXOffset, g_oledTopOffset + (g_lineHeight * 2));
-      g_OLED.printf("OTA: %s IP: %s", g_otaStatus, WiFi.localIP().toString().c_str());
+#if ENABLE_WIFI
+      const IPAddress ip = WiFi.localIP(); // Not toString(): no String to allocate four times a second
+#else
+      const IPAddress ip;
+#endif
+      g_OLED.printf("OTA: %s IP: %u.%u.%u.%u", g_otaStatus, ip[0], ip[1], ip[2], ip[3]);
       g_OLED.sendBuffer();
+      const uint32_t oledElapsed = micros() - oledStart;
+      g_oledUs = g_oledUs == 0 ? oledElapsed : (g_oledUs * 7 + oledElapsed) / 8;
     }
+#endif
 
     HandleSerialControl();
+    LoopQueuePoll();                     // BLE writes, touch gestures, and what the HTTP handlers hand over
     ApplyState();
-#if ENABLE_OTA
-    ArduinoOTA.handle();
-#endif
+    BlePoll();
+    AllocReport();
+    if (g_benchRequest != 0)
+    {
+      RunBench(g_benchRequest);
+      g_benchRequest = 0;
+    }
+    if (OtaRebootPending())
+    {
+      OtaReboot(0);
+    }
+#if ENABLE_WEBSERVER
     if (g_wifiConnected)
     {
-      g_httpServer.handleClient();
+      if (g_httpTask == nullptr)
+      {
+        g_httpServer.handleClient();
+      }
+      HttpPublishState();
+    }
+#endif
+    SyncPoll();
+    IdleUpdate(!g_syncWasActive && !g_transitionActive && !OtaActive(), !g_State.power);
+    if (g_syncWasActive)
+    {
+      RenderSynced();                    // Present on the frame's slot rather than refreshing on a timer
+      yield();
+    }
+    else if (IdleActive())
+    {
+      g_frameStartUs = 0;                // Idle frames are the one already on the strip
+      IdleSleep();
+    }
+    else
+    {
+      ShowAndDelay(10);                  // Show and delay
     }
-    FastLED.delay(10);                   // Show and delay
   }
 }
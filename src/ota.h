@@ -0,0 +1,422 @@
+/**
+ * @file ota.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Firmware and filesystem updates written from a background task, between frames
+ * @version 0.3
+ * @date 10/19/26
+ *
+ *   Erasing and writing flash stalls both cores for the length of the operation, so the update task on
+ *   core 0 only writes right after a new frame has gone out, and only one sector (OTA_CHUNK bytes, one
+ *   erase and one write inside Update) at a time.  The animation then loses at most one frame's worth
+ *   of time per sector instead of freezing for the whole transfer.
+ *
+ *   HTTP uploads (/update and /updatefs) arrive in WebServer's upload callback.  OtaFeed() only copies
+ *   into a stream buffer, and while that is full it runs g_otaPump, which main.cpp points at one pass of
+ *   the frame loop: that keeps the animation going when the callback runs inside the loop, and does
+ *   nothing when it runs on the HTTP task (http_task.h), where the loop never waits on it.
+ *   ArduinoOTA blocks whatever calls handle() for the whole transfer, so handle() runs in the update
+ *   task instead, and its progress callback holds each sector's write back to a frame gap.
+ *
+ *   The update finishes with Update.end(true): for firmware that checks the image before the boot
+ *   partition is switched, and an MD5 given with the upload (?md5=...) is checked for both kinds.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial background updates
+ *   0.2 - 10/19/26 - Uploads from the HTTP task
+ *   0.3 - 10/19/26 - Update and ArduinoOTA left out with ENABLE_OTA=0; the rest reports idle
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include "feature_flags.h"
+#if ENABLE_OTA
+#include <ArduinoOTA.h>
+#include <Update.h>
+#endif
+#include <freertos/stream_buffer.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "trace.h"
+
+#ifndef OTA_PROGRESS_BAR
+#define OTA_PROGRESS_BAR 1 // Show update progress across the strip
+#endif
+
+#define OTA_CHUNK 4096                  // One flash sector
+#define OTA_BUFFER (4 * OTA_CHUNK)      // Received but not yet written
+#define OTA_GAP_US 4000                 // A write starting this soon after a new frame is "between frames"
+#define OTA_GAP_WAIT_MS 100             // Write anyway if no frame has gone out for this long
+#define OTA_ARDUINO_CHUNK 1460          // Largest write ArduinoOTA makes
+
+enum OtaState : uint8_t
+{
+  OTA_IDLE,
+  OTA_RECEIVING, // HTTP upload in progress
+  OTA_FINISHING, // Upload complete; writing what's buffered, then verifying
+  OTA_ARDUINO,   // ArduinoOTA transfer in progress
+  OTA_DONE,      // Verified; reboot to use it
+  OTA_FAILED
+};
+
+void (*g_otaPump)() = nullptr; // One pass of the frame loop, run while an upload waits on the buffer
+
+static StreamBufferHandle_t g_otaStream = nullptr;
+static TaskHandle_t g_otaTask = nullptr;
+static bool g_otaArduinoOta = false; // ArduinoOTA was set up; its handle() runs in the update task
+static volatile uint8_t g_otaState = OTA_IDLE;
+static volatile uint8_t g_otaTarget = 0; // U_FLASH or U_SPIFFS, from OtaStart()
+static char g_otaMd5[33] = {0};
+static volatile uint32_t g_otaSize = 0;    // Bytes expected, for progress only; 0 if unknown
+static volatile uint32_t g_otaWritten = 0; // Bytes handed to Update
+static const char *g_otaError = "";
+static volatile bool g_otaRebootPending = false; // ArduinoOTA finished; the loop reboots
+static volatile bool g_otaProgressBar = OTA_PROGRESS_BAR;
+static CRGB g_otaFrame[NUM_LEDS]; // Frame with the progress bar drawn over it
+
+// Frame-time impact, measured over the update in progress or the last one
+static volatile uint32_t g_otaLastFrameUs = 0;
+static uint32_t g_otaFrames = 0;         // New frames shown during the update
+static uint32_t g_otaFrameMaxUs = 0;     // Longest time between new frames
+static uint32_t g_otaFrameTotalUs = 0;
+static uint32_t g_otaWrites = 0;
+static uint32_t g_otaWriteMaxUs = 0;     // Longest single sector write
+static uint32_t g_otaWriteTotalUs = 0;
+static uint32_t g_otaStartMs = 0;
+static uint32_t g_otaElapsedMs = 0;
+
+bool OtaActive()
+{
+  return g_otaState == OTA_RECEIVING || g_otaState == OTA_FINISHING || g_otaState == OTA_ARDUINO;
+}
+
+static void OtaResetStats()
+{
+  g_otaFrames = 0;
+  g_otaFrameMaxUs = 0;
+  g_otaFrameTotalUs = 0;
+  g_otaWrites = 0;
+  g_otaWriteMaxUs = 0;
+  g_otaWriteTotalUs = 0;
+  g_otaWritten = 0;
+  g_otaStartMs = millis();
+  g_otaElapsedMs = 0;
+}
+
+// OtaFrameShown
+//
+// Call when a newly rendered frame has gone out.  Frees the update task to write its next sector.
+
+void OtaFrameShown()
+{
+  const uint32_t now = micros();
+  if (OtaActive())
+  {
+    const uint32_t interval = now - g_otaLastFrameUs;
+    g_otaFrames++;
+    g_otaFrameTotalUs += interval;
+    g_otaFrameMaxUs = max(g_otaFrameMaxUs, interval);
+  }
+  g_otaLastFrameUs = now;
+  if (g_otaTask != nullptr)
+  {
+    xTaskNotifyGive(g_otaTask);
+  }
+}
+
+// Block the calling (update) task until a new frame has just gone out, or OTA_GAP_WAIT_MS has passed
+static void OtaWaitForGap()
+{
+  if (micros() - g_otaLastFrameUs < OTA_GAP_US)
+  {
+    return;
+  }
+  ulTaskNotifyTake(pdTRUE, 0); // Forget frames shown before now
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OTA_GAP_WAIT_MS));
+}
+
+#if ENABLE_OTA
+static bool OtaWrite(uint8_t *data, size_t length)
+{
+  OtaWaitForGap();
+  TraceScope trace(TRACE_OTA);
+  const uint32_t start = micros();
+  const size_t written = Update.write(data, length);
+  const uint32_t elapsed = micros() - start;
+  g_otaWrites++;
+  g_otaWriteTotalUs += elapsed;
+  g_otaWriteMaxUs = max(g_otaWriteMaxUs, elapsed);
+  g_otaWritten += written;
+  return written == length;
+}
+
+static void OtaFail(const char *error)
+{
+  g_otaError = error;
+  Update.printError(Serial);
+  Update.abort();
+  g_otaElapsedMs = millis() - g_otaStartMs;
+  g_otaState = OTA_FAILED;
+}
+
+static void OtaTask(void *)
+{
+  static uint8_t chunk[OTA_CHUNK];
+  bool begun = false;
+
+  for (;;)
+  {
+    const uint8_t state = g_otaState;
+    if (state != OTA_RECEIVING && state != OTA_FINISHING)
+    {
+      if (begun && Update.isRunning())
+      {
+        Update.abort(); // OtaAbort() from the loop; the write in progress has finished by now
+      }
+      begun = false;
+      if (g_otaArduinoOta)
+      {
+        ArduinoOTA.handle(); // Blocks here, not in the loop, for the length of an ArduinoOTA transfer
+      }
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    if (!begun)
+    {
+      begun = true;
+      if (!Update.begin(UPDATE_SIZE_UNKNOWN, g_otaTarget)) // A multipart body is longer than the image
+      {
+        OtaFail("not enough space");
+        continue;
+      }
+      if (g_otaMd5[0] != '\0')
+      {
+        Update.setMD5(g_otaMd5);
+      }
+    }
+
+    const size_t buffered = xStreamBufferBytesAvailable(g_otaStream);
+    if (buffered >= OTA_CHUNK || (state == OTA_FINISHING && buffered > 0))
+    {
+      const size_t length = xStreamBufferReceive(g_otaStream, chunk, OTA_CHUNK, 0);
+      if (!OtaWrite(chunk, length))
+      {
+        OtaFail("flash write failed");
+      }
+      continue;
+    }
+
+    if (state == OTA_FINISHING)
+    {
+      OtaWaitForGap();
+      if (!Update.end(true)) // Checks the MD5 and, for firmware, the image before switching partitions
+      {
+        OtaFail(g_otaMd5[0] != '\0' ? "MD5 or image check failed" : "image check failed");
+        continue;
+      }
+      g_otaElapsedMs = millis() - g_otaStartMs;
+      g_otaState = OTA_DONE;
+      continue;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for a full sector to arrive
+  }
+}
+
+// OtaBegin
+//
+// Create the update task.  If @p arduinoOta, ArduinoOTA has been begun and the task handles it from now on.
+
+void OtaBegin(bool arduinoOta)
+{
+  g_otaArduinoOta = arduinoOta;
+  g_otaStream = xStreamBufferCreate(OTA_BUFFER, 1);
+  xTaskCreatePinnedToCore(OtaTask, "update", 6144, nullptr, 1, &g_otaTask, 0);
+}
+#endif
+
+/**
+ * @brief Start an HTTP upload into @p target (U_FLASH or U_SPIFFS).
+ *
+ * @param size Roughly the bytes expected, for the progress bar, or 0 if unknown
+ * @param md5 Expected MD5 of the image in hex, or empty
+ */
+bool OtaStart(uint8_t target, uint32_t size, const char *md5)
+{
+  if (OtaActive() || g_otaStream == nullptr)
+  {
+    return false;
+  }
+  xStreamBufferReset(g_otaStream);
+  g_otaTarget = target;
+  g_otaSize = size;
+  strncpy(g_otaMd5, md5 ? md5 : "", sizeof(g_otaMd5) - 1);
+  g_otaError = "";
+  OtaResetStats();
+  g_otaState = OTA_RECEIVING;
+  return true;
+}
+
+// OtaFeed
+//
+// Queue received bytes for the update task.  Keeps the frame loop running while the buffer is full.
+
+bool OtaFeed(const uint8_t *data, size_t length)
+{
+  while (length > 0)
+  {
+    if (g_otaState != OTA_RECEIVING)
+    {
+      return false;
+    }
+    const size_t sent = xStreamBufferSend(g_otaStream, data, length, 0);
+    data += sent;
+    length -= sent;
+    if (length > 0)
+    {
+      if (g_otaPump != nullptr)
+      {
+        g_otaPump();
+      }
+      delay(1);
+    }
+  }
+  return true;
+}
+
+// OtaFinish
+//
+// The upload is complete: wait (with the frame loop running) until it is written and verified.
+
+bool OtaFinish()
+{
+  if (g_otaState != OTA_RECEIVING)
+  {
+    return false;
+  }
+  g_otaState = OTA_FINISHING;
+  while (g_otaState == OTA_FINISHING)
+  {
+    if (g_otaPump != nullptr)
+    {
+      g_otaPump();
+    }
+    delay(1);
+  }
+  return g_otaState == OTA_DONE;
+}
+
+void OtaAbort()
+{
+  if (g_otaState == OTA_RECEIVING)
+  {
+    g_otaError = "upload aborted";
+    g_otaElapsedMs = millis() - g_otaStartMs;
+    g_otaState = OTA_FAILED; // The update task stops writing and aborts Update
+  }
+}
+
+// Reboot into the update once @p afterMs have passed (to let a response go out) and the next frame has shown
+void OtaReboot(uint32_t afterMs)
+{
+  const uint32_t start = millis();
+  uint32_t frame = g_otaLastFrameUs;
+  while ((millis() - start) < afterMs || (g_otaLastFrameUs == frame && (millis() - start) < afterMs + OTA_GAP_WAIT_MS))
+  {
+    if ((millis() - start) < afterMs)
+    {
+      frame = g_otaLastFrameUs;
+    }
+    if (g_otaPump != nullptr)
+    {
+      g_otaPump();
+    }
+    delay(1);
+  }
+  ESP.restart();
+}
+
+// ArduinoOTA hooks, called from its callbacks in the update task
+void OtaArduinoStart()
+{
+  g_otaSize = 0;
+  g_otaError = "";
+  OtaResetStats();
+  g_otaState = OTA_ARDUINO;
+}
+
+void OtaArduinoProgress(uint32_t progress, uint32_t total)
+{
+  g_otaSize = total;
+  g_otaWritten = progress;
+  // Update flushes a sector each time its buffer fills; hold back the write that might do that
+  if ((progress % OTA_CHUNK) + OTA_ARDUINO_CHUNK >= OTA_CHUNK)
+  {
+    OtaWaitForGap();
+  }
+}
+
+void OtaArduinoEnd(bool ok, const char *error)
+{
+  g_otaElapsedMs = millis() - g_otaStartMs;
+  g_otaError = error;
+  g_otaState = ok ? OTA_DONE : OTA_FAILED;
+  g_otaRebootPending = ok;
+}
+
+bool OtaRebootPending()
+{
+  return g_otaRebootPending;
+}
+
+// Progress in thousandths, or 0 if the size isn't known
+uint16_t OtaProgress()
+{
+  return g_otaSize ? (uint16_t)min<uint64_t>(1000, (uint64_t)g_otaWritten * 1000 / g_otaSize) : 0;
+}
+
+// OtaOverlay
+//
+// The frame to send: @p frame itself, or during an update a copy dimmed to a quarter with the finished
+// fraction tinted green, so it is obvious something is happening and how far along it is.
+
+const CRGB *OtaOverlay(const CRGB *frame)
+{
+  if (!g_otaProgressBar || !OtaActive())
+  {
+    return frame;
+  }
+  const uint16_t done = (uint16_t)((uint32_t)OtaProgress() * NUM_LEDS / 1000);
+  for (uint16_t i = 0; i < NUM_LEDS; i++)
+  {
+    g_otaFrame[i] = frame[i];
+    g_otaFrame[i].nscale8_video(64);
+    if (i < done)
+    {
+      g_otaFrame[i] += CRGB(0, 48, 0);
+    }
+  }
+  return g_otaFrame;
+}
+
+const char *OtaStateName()
+{
+  switch (g_otaState)
+  {
+  case OTA_RECEIVING:
+    return "receiving";
+  case OTA_FINISHING:
+    return "finishing";
+  case OTA_ARDUINO:
+    return "arduinoota";
+  case OTA_DONE:
+    return "done";
+  case OTA_FAILED:
+    return "failed";
+  case OTA_IDLE:
+  default:
+    return "idle";
+  }
+}
@@ -0,0 +1,438 @@
+/**
+ * @file output.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Output stage: gamma / white balance LUT and temporal dithering between g_LEDs and the strip
+ * @version 0.6
+ * @date 10/19/26
+ *
+ *   Effects draw 8-bit colors into g_LEDs.  Every refresh, OutputEncode() runs each channel through a
+ *   16-bit gamma and white balance table, applies the global brightness at 16 bits, and carries the
+ *   low byte that does not fit into the 8-bit strip value over to the next refresh (first order
+ *   sigma-delta).  At low brightness the strip alternates between neighbouring levels so the average
+ *   over a few refreshes keeps the gradient that plain 8-bit scaling would crush.  Since the error
+ *   only moves forward when the strip is refreshed, the loop should show more often than it renders.
+ *
+ *   FastLED is registered against g_OutputLEDs with its own brightness at 255 and its own dithering
+ *   off, so effects must never touch FastLED.leds() or FastLED.clear(); use g_LEDs instead.
+ *
+ *   g_OutputLEDs can be split over up to eight data pins with LED_OUTPUTS, a list of {pin, first LED,
+ *   LED count}.  Each range gets its own FastLED controller; the ESP32 RMT driver clocks them all out at
+ *   the same time, so a show takes as long as the longest range rather than the whole strip.
+ *
+ *   With OUTPUT_ASYNC=1 FastLED is bypassed: the same pass that applies the LUT and dithering writes
+ *   each pixel straight into a DMA-capable WS2812 waveform buffer (see ws2812_encode.h) that the SPI
+ *   peripheral clocks out on its own.  OutputShow() returns as soon as the frame is encoded; completion
+ *   is counted from the SPI interrupt.  Two buffers per output let the next frame be encoded while the
+ *   last one is still on the wire.  This mode supports up to two outputs, one per free SPI host.
+ *
+ *   The strip can be refreshed faster than most effects render.  Given the frame before as well,
+ *   OutputEncode() blends the two as it reads them, so the refreshes in between step smoothly from one
+ *   rendered frame to the next instead of repeating it, at the cost of showing motion one render
+ *   interval late.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial gamma LUT and dithering
+ *   0.2 - 10/19/26 - Multiple parallel outputs
+ *   0.3 - 10/19/26 - Asynchronous SPI/DMA output
+ *   0.4 - 10/19/26 - Logical to physical remap from layout.h
+ *   0.5 - 10/19/26 - Blending between the last two frames
+ *   0.6 - 10/19/26 - Asynchronous completion tracked per output and per buffer
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "layout.h"
+
+#ifndef OUTPUT_GAMMA
+#define OUTPUT_GAMMA 2.2f
+#endif
+
+#ifndef OUTPUT_WHITE_BALANCE
+#define OUTPUT_WHITE_BALANCE TypicalLEDStrip // Any FastLED LEDColorCorrection or 0xRRGGBB value
+#endif
+
+#ifndef OUTPUT_DITHER
+#define OUTPUT_DITHER 1
+#endif
+
+#ifndef OUTPUT_ASYNC
+#define OUTPUT_ASYNC 0
+#endif
+
+#ifndef OUTPUT_INTERPOLATE
+#define OUTPUT_INTERPOLATE 1 // Refreshes between renders blend from the previous frame; see OutputEncode()
+#endif
+
+// e.g. -D LED_OUTPUTS="{{5,0,221},{18,221,221}}" drives the two halves of the strip from pins 5 and 18
+#ifndef LED_OUTPUTS
+#define LED_OUTPUTS {{LED_PIN, 0, NUM_LEDS}}
+#endif
+
+struct OutputChannel
+{
+  uint8_t pin;
+  uint16_t start; // First index in g_OutputLEDs
+  uint16_t count;
+};
+
+static const OutputChannel kOutputChannels[] = LED_OUTPUTS;
+const uint8_t kOutputChannelCount = sizeof(kOutputChannels) / sizeof(kOutputChannels[0]);
+static_assert(kOutputChannelCount >= 1 && kOutputChannelCount <= 8, "LED_OUTPUTS needs 1 - 8 entries, one per RMT channel");
+
+static uint16_t g_gammaLut[3][256];        // 8-bit channel value to 8.8 fixed point output level
+static uint8_t g_ditherError[NUM_LEDS][3]; // Fraction carried over to the next refresh
+static uint8_t g_outputBrightness = 0;     // Global brightness, 0 - 255
+static uint32_t g_outputMaxPowerMw = 0;    // 0 for no limit
+
+#if OUTPUT_ASYNC
+
+#include <driver/spi_master.h>
+#include <esp_heap_caps.h>
+#include "ws2812_encode.h"
+
+static_assert(kOutputChannelCount <= 2, "OUTPUT_ASYNC drives at most two outputs, one per free SPI host");
+
+static const spi_host_device_t kAsyncHosts[2] = {SPI3_HOST, SPI2_HOST};
+static spi_device_handle_t g_asyncDevice[2] = {nullptr, nullptr};
+static uint8_t *g_asyncBuffers[2][2] = {{nullptr, nullptr}, {nullptr, nullptr}}; // [output][buffer]
+static spi_transaction_t g_asyncTransactions[2][2];
+static uint8_t g_asyncPending[2] = {0, 0}; // Queued and not yet reaped, per output
+static uint8_t g_asyncBack = 0;            // Buffer the next frame is encoded into
+static uint8_t g_asyncDone[2] = {0, 0};    // Per buffer, a bit for each output that has finished sending it
+static portMUX_TYPE g_asyncLock = portMUX_INITIALIZER_UNLOCKED; // Guards g_asyncDone between the loop and the SPI interrupts
+
+volatile uint32_t g_OutputFramesDone = 0; // Frames completely clocked out
+volatile uint32_t g_OutputLastDoneUs = 0; // esp_timer time the last one finished
+void (*g_OutputDoneCallback)() = nullptr; // Optional; runs in the SPI interrupt, so keep it short and in IRAM
+
+// OutputAsyncFinished
+//
+// Output @p output is finished with buffer @p buffer.  The frame in that buffer is done once every output is,
+// whatever order they finish in and even if one output is still sending the other buffer.  Call it under
+// g_asyncLock; true when that made the frame done.
+
+static bool IRAM_ATTR OutputAsyncFinished(uint8_t output, uint8_t buffer)
+{
+  g_asyncDone[buffer] |= 1 << output;
+  if (g_asyncDone[buffer] != (1 << kOutputChannelCount) - 1)
+  {
+    return false;
+  }
+  g_asyncDone[buffer] = 0;
+  g_OutputFramesDone++;
+  g_OutputLastDoneUs = (uint32_t)esp_timer_get_time();
+  return true;
+}
+
+static void IRAM_ATTR OutputFrameDone()
+{
+  if (g_OutputDoneCallback != nullptr)
+  {
+    g_OutputDoneCallback();
+  }
+}
+
+// The transaction's user field carries which output and buffer it was: output << 1 | buffer
+static void IRAM_ATTR OutputAsyncDone(spi_transaction_t *transaction)
+{
+  const uintptr_t tag = (uintptr_t)transaction->user;
+  portENTER_CRITICAL_ISR(&g_asyncLock);
+  const bool done = OutputAsyncFinished(tag >> 1, tag & 1);
+  portEXIT_CRITICAL_ISR(&g_asyncLock);
+  if (done)
+  {
+    OutputFrameDone();
+  }
+}
+
+static bool OutputAsyncBegin(uint8_t index, const OutputChannel &channel)
+{
+  const size_t size = Ws2812EncodedSize(channel.count);
+
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = channel.pin;
+  bus.miso_io_num = -1;
+  bus.sclk_io_num = -1;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = size;
+
+  spi_device_interface_config_t device = {};
+  device.clock_speed_hz = WS2812_SPI_HZ;
+  device.mode = 0;
+  device.spics_io_num = -1;
+  device.queue_size = 2;
+  device.post_cb = OutputAsyncDone;
+
+  for (int b = 0; b < 2; b++)
+  {
+    g_asyncBuffers[index][b] = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_DMA);
+    if (g_asyncBuffers[index][b] == nullptr)
+    {
+      Serial.printf("Output %u: no DMA memory for a %u byte frame\n", index, (unsigned)size);
+      return false;
+    }
+  }
+
+  if (spi_bus_initialize(kAsyncHosts[index], &bus, SPI_DMA_CH_AUTO) != ESP_OK ||
+      spi_bus_add_device(kAsyncHosts[index], &device, &g_asyncDevice[index]) != ESP_OK)
+  {
+    Serial.printf("Output %u: SPI setup failed\n", index);
+    return false;
+  }
+  return true;
+}
+
+// OutputAsyncReady
+//
+// Collect finished transfers.  The back buffers are free to encode into once at most one transfer (the
+// front buffer's) is still outstanding on every output.
+
+static bool OutputAsyncReady()
+{
+  for (uint8_t i = 0; i < kOutputChannelCount; i++)
+  {
+    spi_transaction_t *done = nullptr;
+    while (g_asyncPending[i] > 0 && spi_device_get_trans_result(g_asyncDevice[i], &done, 0) == ESP_OK)
+    {
+      g_asyncPending[i]--;
+    }
+    if (g_asyncDevice[i] == nullptr || g_asyncPending[i] > 1)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void OutputAsyncQueue()
+{
+  for (uint8_t i = 0; i < kOutputChannelCount; i++)
+  {
+    spi_transaction_t &transaction = g_asyncTransactions[i][g_asyncBack];
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.length = Ws2812EncodedSize(kOutputChannels[i].count) * 8;
+    transaction.tx_buffer = g_asyncBuffers[i][g_asyncBack];
+    transaction.user = (void *)(uintptr_t)((i << 1) | g_asyncBack);
+    if (spi_device_queue_trans(g_asyncDevice[i], &transaction, 0) == ESP_OK)
+    {
+      g_asyncPending[i]++;
+      continue;
+    }
+    // Not sent on this output; count it finished so the frame still completes once the others are
+    portENTER_CRITICAL(&g_asyncLock);
+    const bool done = OutputAsyncFinished(i, g_asyncBack);
+    portEXIT_CRITICAL(&g_asyncLock);
+    if (done)
+    {
+      OutputFrameDone();
+    }
+  }
+  g_asyncBack ^= 1;
+}
+
+#else
+
+CRGB g_OutputLEDs[NUM_LEDS] = {0}; // What FastLED actually clocks out
+
+#endif
+
+/**
+ * @brief Precompute the gamma / white balance table.  Call once at startup (or after changing either).
+ *
+ * The table tops out at 255 << 8 rather than 0xFFFF so that adding the carried error can never
+ * overflow past the top 8-bit level.
+ *
+ * @param gamma Exponent applied to the normalized channel value
+ * @param balance Per-channel maximum, as in FastLED's setCorrection()
+ */
+void OutputBuildLut(float gamma, CRGB balance)
+{
+  for (int c = 0; c < 3; c++)
+  {
+    const float top = 255.0f * 256.0f * (balance[c] / 255.0f);
+    for (int i = 0; i < 256; i++)
+    {
+      g_gammaLut[c][i] = (uint16_t)(powf(i / 255.0f, gamma) * top + 0.5f);
+    }
+  }
+  memset(g_ditherError, 0, sizeof(g_ditherError));
+}
+
+template <uint8_t PIN>
+static void AddOutputPin(CRGB *leds, uint16_t count)
+{
+  FastLED.addLeds<WS2812B, PIN, GRB>(leds, count);
+}
+
+/**
+ * @brief Set up every range in LED_OUTPUTS: a FastLED controller each, or an SPI host each with OUTPUT_ASYNC.
+ *
+ * FastLED needs the data pin at compile time, so the table's pins are dispatched through a switch over
+ * the ESP32 pins that can drive a strip (21 and 22 are left out; they carry the OLED's I2C bus).
+ *
+ * @return false if a range falls outside the strip or names an unusable pin; the rest are still added
+ */
+bool OutputBegin()
+{
+  bool ok = true;
+#if OUTPUT_ASYNC
+  Ws2812BuildLut();
+#endif
+  for (uint8_t i = 0; i < kOutputChannelCount; i++)
+  {
+    const OutputChannel &channel = kOutputChannels[i];
+    if (channel.count == 0 || channel.start + channel.count > NUM_LEDS)
+    {
+      Serial.printf("Output %u: LEDs %u-%u are outside the strip\n", i, channel.start, channel.start + channel.count - 1);
+      ok = false;
+      continue;
+    }
+
+#if OUTPUT_ASYNC
+    if (!OutputAsyncBegin(i, channel))
+    {
+      ok = false;
+      continue;
+    }
+#else
+    CRGB *leds = g_OutputLEDs + channel.start;
+    pinMode(channel.pin, OUTPUT);
+    switch (channel.pin)
+    {
+    case 2: AddOutputPin<2>(leds, channel.count); break;
+    case 4: AddOutputPin<4>(leds, channel.count); break;
+    case 5: AddOutputPin<5>(leds, channel.count); break;
+    case 12: AddOutputPin<12>(leds, channel.count); break;
+    case 13: AddOutputPin<13>(leds, channel.count); break;
+    case 14: AddOutputPin<14>(leds, channel.count); break;
+    case 15: AddOutputPin<15>(leds, channel.count); break;
+    case 16: AddOutputPin<16>(leds, channel.count); break;
+    case 17: AddOutputPin<17>(leds, channel.count); break;
+    case 18: AddOutputPin<18>(leds, channel.count); break;
+    case 19: AddOutputPin<19>(leds, channel.count); break;
+    case 23: AddOutputPin<23>(leds, channel.count); break;
+    case 25: AddOutputPin<25>(leds, channel.count); break;
+    case 26: AddOutputPin<26>(leds, channel.count); break;
+    case 27: AddOutputPin<27>(leds, channel.count); break;
+    case 32: AddOutputPin<32>(leds, channel.count); break;
+    case 33: AddOutputPin<33>(leds, channel.count); break;
+    default:
+      Serial.printf("Output %u: pin %u can't drive LEDs\n", i, channel.pin);
+      ok = false;
+      continue;
+    }
+#endif
+    Serial.printf("Output %u: pin %u, LEDs %u-%u%s\n", i, channel.pin, channel.start, channel.start + channel.count - 1,
+                  OUTPUT_ASYNC ? " (SPI DMA)" : "");
+  }
+  return ok;
+}
+
+void OutputSetBrightness(uint8_t brightness)
+{
+  g_outputBrightness = brightness;
+}
+
+void OutputSetMaxPower(uint32_t milliwatts)
+{
+  g_outputMaxPowerMw = milliwatts;
+#if !OUTPUT_ASYNC
+  FastLED.setMaxPowerInMilliWatts(milliwatts);
+#endif
+}
+
+// OutputLevel
+//
+// One channel through the LUT, brightness and dither.
+
+static inline uint8_t OutputLevel(uint8_t value, uint8_t channel, uint8_t &error, uint32_t scale)
+{
+  uint32_t level = (g_gammaLut[channel][value] * scale) >> 8;
+#if OUTPUT_DITHER
+  level += error;
+  error = (uint8_t)level;
+#else
+  level += 0x80;
+#endif
+  return (uint8_t)(level >> 8);
+}
+
+/**
+ * @brief Convert a finished frame into strip data: g_OutputLEDs for FastLED, or the DMA waveform buffers.
+ *
+ * Call once per refresh, not once per render: each call advances the dithering.
+ *
+ * @param frame NUM_LEDS pixels in logical order; normally g_LEDs, or the blended frame during a transition
+ * @param from the frame rendered before @p frame, to blend from; nullptr for @p frame as it is
+ * @param amount how far from @p from to @p frame, 0 - 255
+ */
+void OutputEncode(const CRGB *frame, const CRGB *from = nullptr, uint8_t amount = 255)
+{
+  if (amount == 255)
+  {
+    from = nullptr;
+  }
+  uint8_t brightness = g_outputBrightness;
+#if OUTPUT_ASYNC
+  // FastLED.show() isn't there to enforce the power budget, so do what it would have done
+  if (g_outputMaxPowerMw != 0)
+  {
+    brightness = calculate_max_brightness_for_power_mW(frame, NUM_LEDS, brightness, g_outputMaxPowerMw);
+  }
+#endif
+  const uint32_t scale = brightness == 0 ? 0 : brightness + 1;
+
+  for (uint8_t i = 0; i < kOutputChannelCount; i++)
+  {
+    const OutputChannel &channel = kOutputChannels[i];
+#if OUTPUT_ASYNC
+    uint8_t *wave = g_asyncBuffers[i][g_asyncBack];
+#endif
+    for (uint16_t p = channel.start; p < channel.start + channel.count; p++)
+    {
+      const uint16_t logical = g_layoutLogical[p]; // Remapped here rather than copied; see layout.h
+      const CRGB pixel = from == nullptr ? frame[logical] : blend(from[logical], frame[logical], amount);
+      uint8_t *error = g_ditherError[p];
+      const uint8_t r = OutputLevel(pixel.r, 0, error[0], scale);
+      const uint8_t g = OutputLevel(pixel.g, 1, error[1], scale);
+      const uint8_t b = OutputLevel(pixel.b, 2, error[2], scale);
+#if OUTPUT_ASYNC
+      wave = Ws2812EncodePixel(wave, g, r, b);
+#else
+      g_OutputLEDs[p] = CRGB(r, g, b);
+#endif
+    }
+#if OUTPUT_ASYNC
+    Ws2812EncodeReset(wave);
+#endif
+  }
+}
+
+/**
+ * @brief Encode @p frame and start sending it.
+ *
+ * With FastLED this blocks until the strip has been written.  With OUTPUT_ASYNC it returns once the frame
+ * is encoded and queued, or straight away (returning false, frame dropped) if both buffers are still busy.
+ * @p from and @p amount are as for OutputEncode().
+ */
+bool OutputShow(const CRGB *frame, const CRGB *from = nullptr, uint8_t amount = 255)
+{
+#if OUTPUT_ASYNC
+  if (!OutputAsyncReady())
+  {
+    return false;
+  }
+  OutputEncode(frame, from, amount);
+  OutputAsyncQueue();
+  FastLED.countFPS();
+#else
+  OutputEncode(frame, from, amount);
+  FastLED.show();
+#endif
+  return true;
+}
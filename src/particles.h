@@ -0,0 +1,240 @@
+/**
+ * @file particles.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Fixed-point particle system shared by the moving and spawning effects
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   Particles are kept as a structure of arrays - every position together, every velocity
+ *   together - so the update loop walks each array once in order.  Positions and velocities are
+ *   fixed point in 1/256 of a pixel, so nothing is ever compared as a float, and bounds are
+ *   enforced by clamping: a particle can't land past the end of the strip whatever its speed.
+ *
+ *   Live particles are packed at the front of the arrays; one that dies is replaced by the last, so
+ *   spawning and culling are constant time and the loops only ever visit live particles.  Particles
+ *   that never die keep their index, which the effects that steer their particles rely on.
+ *
+ *   Render() splats each particle as a run of pixels with anti-aliased ends: the first and last
+ *   pixels get the fraction of them the particle covers.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial particle system
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+#define PARTICLE_ONE 256 // One pixel in particle units
+
+static inline int32_t ParticlePixels(int32_t pixels)
+{
+  return pixels * PARTICLE_ONE;
+}
+
+// What happens to a particle that leaves the bounds
+enum ParticleEdge : uint8_t
+{
+  PARTICLE_DIE,    // It is culled
+  PARTICLE_BOUNCE, // It is reflected back in and its velocity reversed
+  PARTICLE_WRAP    // It reappears at the other end
+};
+
+// How a particle combines with the pixels under it
+enum ParticleBlend : uint8_t
+{
+  PARTICLE_ADD,    // Saturating add, for points of light on a dark sky
+  PARTICLE_LIGHTEN // Per-channel maximum, so a head passing over its own trail keeps its hue
+};
+
+// ParticleSplat
+//
+// Draw @p color over [pos, pos + size), both in particle units, clipped to the strip.
+
+static inline void ParticleSplat(CRGB *leds, uint16_t count, int32_t pos, int32_t size, const CRGB &color,
+                                 ParticleBlend blend)
+{
+  const int32_t start = max<int32_t>(pos, 0);
+  const int32_t end = min<int32_t>(pos + size, ParticlePixels(count));
+  if (start >= end)
+  {
+    return;
+  }
+  const int32_t first = start / PARTICLE_ONE;
+  const int32_t last = (end - 1) / PARTICLE_ONE;
+  for (int32_t i = first; i <= last; i++)
+  {
+    const int32_t covered = min<int32_t>(end, ParticlePixels(i + 1)) - max<int32_t>(start, ParticlePixels(i));
+    CRGB c = color;
+    if (covered < PARTICLE_ONE)
+    {
+      c.nscale8((uint8_t)covered);
+    }
+    if (blend == PARTICLE_ADD)
+    {
+      leds[i] += c;
+    }
+    else
+    {
+      leds[i].r = max(leds[i].r, c.r);
+      leds[i].g = max(leds[i].g, c.g);
+      leds[i].b = max(leds[i].b, c.b);
+    }
+  }
+}
+
+template <uint16_t Capacity>
+class ParticleSystem
+{
+public:
+  // Live particles are [0, Count())
+  int32_t pos[Capacity];       // Particle units
+  int16_t vel[Capacity];       // Particle units per Update()
+  uint8_t life[Capacity];      // Updates left to live; 0 lives forever
+  uint8_t lifeSpan[Capacity];  // life at spawn, if it fades out over its life; otherwise 0
+  CRGB color[Capacity];
+
+  ParticleSystem()
+  {
+    SetBounds(0, ParticlePixels(NUM_LEDS - 1), PARTICLE_DIE);
+  }
+
+  void Clear()
+  {
+    _count = 0;
+  }
+
+  uint16_t Count() const
+  {
+    return _count;
+  }
+
+  // Drop the particles past the first @p count
+  void Truncate(uint16_t count)
+  {
+    _count = min(_count, count);
+  }
+
+  // Positions are held to [lo, hi]
+  void SetBounds(int32_t lo, int32_t hi, ParticleEdge edge)
+  {
+    _lo = lo;
+    _hi = max(lo, hi);
+    _edge = edge;
+  }
+
+  /**
+   * @brief Add a particle.
+   *
+   * @param lifetime updates it lives for, 0 for ever
+   * @param fade whether it dims to black over its lifetime
+   * @return its index, or -1 if the system is full
+   */
+  int Spawn(int32_t position, int16_t velocity, const CRGB &c, uint8_t lifetime = 0, bool fade = false)
+  {
+    if (_count >= Capacity)
+    {
+      return -1;
+    }
+    const uint16_t i = _count++;
+    pos[i] = constrain(position, _lo, _hi);
+    vel[i] = velocity;
+    life[i] = lifetime;
+    lifeSpan[i] = fade ? lifetime : 0;
+    color[i] = c;
+    return i;
+  }
+
+  // Update
+  //
+  // Move every particle one step, apply the edge rule and age them, culling the dead.
+
+  void Update()
+  {
+    for (uint16_t i = 0; i < _count; i++)
+    {
+      pos[i] += vel[i];
+    }
+
+    if (_edge == PARTICLE_BOUNCE)
+    {
+      for (uint16_t i = 0; i < _count; i++)
+      {
+        if (pos[i] < _lo)
+        {
+          pos[i] = min(_hi, 2 * _lo - pos[i]);
+          vel[i] = -vel[i];
+        }
+        else if (pos[i] > _hi)
+        {
+          pos[i] = max(_lo, 2 * _hi - pos[i]);
+          vel[i] = -vel[i];
+        }
+      }
+    }
+    else if (_edge == PARTICLE_WRAP)
+    {
+      const int32_t span = _hi - _lo + 1;
+      for (uint16_t i = 0; i < _count; i++)
+      {
+        if (pos[i] < _lo || pos[i] > _hi)
+        {
+          pos[i] = _lo + (((pos[i] - _lo) % span) + span) % span;
+        }
+      }
+    }
+
+    for (uint16_t i = 0; i < _count;)
+    {
+      const bool outside = _edge == PARTICLE_DIE && (pos[i] < _lo || pos[i] > _hi);
+      if (outside || (life[i] != 0 && --life[i] == 0))
+      {
+        Kill(i);
+      }
+      else
+      {
+        i++;
+      }
+    }
+  }
+
+  // Render
+  //
+  // Splat every particle over [pos + offset, pos + offset + size), in particle units.
+
+  void Render(CRGB *leds, uint16_t count, int32_t size, int32_t offset, ParticleBlend blend) const
+  {
+    for (uint16_t i = 0; i < _count; i++)
+    {
+      if (lifeSpan[i] != 0)
+      {
+        CRGB c = color[i];
+        c.nscale8((uint8_t)(((uint16_t)life[i] << 8) / (lifeSpan[i] + 1)));
+        ParticleSplat(leds, count, pos[i] + offset, size, c, blend);
+      }
+      else
+      {
+        ParticleSplat(leds, count, pos[i] + offset, size, color[i], blend);
+      }
+    }
+  }
+
+private:
+  void Kill(uint16_t i)
+  {
+    const uint16_t last = --_count;
+    pos[i] = pos[last];
+    vel[i] = vel[last];
+    life[i] = life[last];
+    lifeSpan[i] = lifeSpan[last];
+    color[i] = color[last];
+  }
+
+  uint16_t _count = 0;
+  int32_t _lo = 0;
+  int32_t _hi = 0;
+  ParticleEdge _edge = PARTICLE_DIE;
+};
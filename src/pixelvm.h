@@ -0,0 +1,752 @@
+/**
+ * @file pixelvm.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Compiler and interpreter for small user-written per-pixel effect programs
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   A program is a list of assignments, one per line or separated by semicolons:
+ *
+ *       h = x * count + t * speed
+ *       v = wave(x * 4 - t) * (0.3 + level)
+ *
+ *   Assigning h, s and v gives a hue / saturation / value pixel; assigning any of r, g and b gives an RGB
+ *   one.  Everything is 0 to 1 (hue wraps), and unassigned outputs default to s = v = 1, r = g = b = 0.
+ *   Other names assigned become variables.
+ *
+ *     Inputs     i (pixel index), n (pixel count), x (i / n), t (seconds), speed (0-1), count (1-16),
+ *                level, bass, mid, treble, beat (audio features, 0-1)
+ *     Operators  + - * / % < > and parentheses; comparisons give 0 or 1
+ *     Functions  sin(a) cos(a) in turns, wave(a) = (1 + sin(a)) / 2, tri(a), frac(a), floor(a), abs(a),
+ *                min(a, b), max(a, b), clamp(a, lo, hi), hash(a) (0-1, same for the same floor(a))
+ *
+ *   The compiler turns that into three-address register code, every value Q16.16 fixed point and every
+ *   register written exactly once, so variables are just names for registers and no copies are needed.
+ *   Constant subexpressions are folded at compile time, and ones that don't depend on i or x are put in a
+ *   separate block run once per frame instead of once per pixel.  Nothing allocates: the compiled
+ *   program is a fixed-size struct and the interpreter's registers live on its stack.
+ *
+ *   Only <stdint.h>, <string.h> and <math.h> (for the sine table) are used, so it can be benchmarked on
+ *   the host: test/test_pixelvm times it against native code drawing the same thing.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial compiler and interpreter
+ *   0.2 - 10/19/26 - Nesting limit, so a hostile program can't run the compiler off its stack
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define PIXELVM_MAX_SOURCE 1024
+
+const uint8_t kPixelVmMaxCode = 128;   // Instructions per block
+const uint8_t kPixelVmRegisters = 128; // Inputs, constants and results together
+const uint8_t kPixelVmMaxNames = 24;   // Variables a program can define
+const uint8_t kPixelVmMaxDepth = 32;   // Nested parentheses, calls and unary minuses
+const int32_t kPixelVmOne = 1L << 16;
+
+enum PixelVmOp : uint8_t
+{
+  PVM_ADD,
+  PVM_SUB,
+  PVM_MUL,
+  PVM_DIV,
+  PVM_MOD,
+  PVM_NEG,
+  PVM_LT,
+  PVM_GT,
+  PVM_SIN,
+  PVM_COS,
+  PVM_WAVE,
+  PVM_TRI,
+  PVM_FRAC,
+  PVM_FLOOR,
+  PVM_ABS,
+  PVM_MIN,
+  PVM_MAX,
+  PVM_HASH
+};
+
+// Input registers, in the order of kPixelVmInputNames
+enum PixelVmInput : uint8_t
+{
+  PVM_IN_I,
+  PVM_IN_X,
+  PVM_IN_N,
+  PVM_IN_T,
+  PVM_IN_SPEED,
+  PVM_IN_COUNT,
+  PVM_IN_LEVEL,
+  PVM_IN_BASS,
+  PVM_IN_MID,
+  PVM_IN_TREBLE,
+  PVM_IN_BEAT,
+  PVM_INPUT_COUNT
+};
+
+static const char *const kPixelVmInputNames[PVM_INPUT_COUNT] =
+    {"i", "x", "n", "t", "speed", "count", "level", "bass", "mid", "treble", "beat"};
+
+struct PixelVmInstruction
+{
+  uint8_t op;
+  uint8_t dst;
+  uint8_t a;
+  uint8_t b;
+};
+
+struct PixelProgram
+{
+  PixelVmInstruction frameCode[kPixelVmMaxCode]; // Run once per frame
+  PixelVmInstruction pixelCode[kPixelVmMaxCode]; // Run for every pixel
+  int32_t initial[kPixelVmRegisters];            // Constant registers' values
+  uint8_t frameCount;
+  uint8_t pixelCount;
+  uint8_t registerCount;
+  uint8_t out[3]; // Registers holding h, s, v or r, g, b
+  bool rgb;
+  bool valid;
+};
+
+// Per-frame inputs, all Q16.16
+struct PixelVmFrame
+{
+  int32_t t;
+  int32_t speed;
+  int32_t count;
+  int32_t level;
+  int32_t bass;
+  int32_t mid;
+  int32_t treble;
+  int32_t beat;
+};
+
+static int32_t g_pixelVmSin[257]; // One turn of sine, Q16.16, with the first entry repeated at the end
+
+void PixelVmBuildTables()
+{
+  for (int i = 0; i <= 256; i++)
+  {
+    g_pixelVmSin[i] = (int32_t)lrintf(65536.0f * sinf(2.0f * (float)M_PI * i / 256));
+  }
+}
+
+// Sine of @p turns (Q16.16), by table lookup on the fraction and linear interpolation
+static inline int32_t PixelVmSin(int32_t turns)
+{
+  const uint16_t phase = (uint16_t)turns;
+  const int32_t a = g_pixelVmSin[phase >> 8];
+  const int32_t b = g_pixelVmSin[(phase >> 8) + 1];
+  return a + (((b - a) * (int32_t)(phase & 0xFF)) >> 8);
+}
+
+static inline int32_t PixelVmFloor(int32_t a)
+{
+  return a & ~(kPixelVmOne - 1);
+}
+
+// PixelVmApply
+//
+// The meaning of every operation, shared by the interpreter and by constant folding in the compiler.
+
+static inline int32_t PixelVmApply(uint8_t op, int32_t a, int32_t b)
+{
+  switch (op)
+  {
+  case PVM_ADD:
+    return a + b;
+  case PVM_SUB:
+    return a - b;
+  case PVM_MUL:
+    return (int32_t)(((int64_t)a * b) >> 16);
+  case PVM_DIV:
+    return b == 0 ? 0 : (int32_t)(((int64_t)a << 16) / b);
+  case PVM_MOD:
+  {
+    if (b == 0)
+    {
+      return 0;
+    }
+    const int32_t r = a % b;
+    return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r; // Result takes the sign of b, so x % 1 is frac(x)
+  }
+  case PVM_NEG:
+    return -a;
+  case PVM_LT:
+    return a < b ? kPixelVmOne : 0;
+  case PVM_GT:
+    return a > b ? kPixelVmOne : 0;
+  case PVM_SIN:
+    return PixelVmSin(a);
+  case PVM_COS:
+    return PixelVmSin(a + kPixelVmOne / 4);
+  case PVM_WAVE:
+    return (PixelVmSin(a) + kPixelVmOne) >> 1;
+  case PVM_TRI:
+  {
+    const int32_t f = a & (kPixelVmOne - 1);
+    return f < kPixelVmOne / 2 ? f * 2 : (kPixelVmOne - f) * 2;
+  }
+  case PVM_FRAC:
+    return a & (kPixelVmOne - 1);
+  case PVM_FLOOR:
+    return PixelVmFloor(a);
+  case PVM_ABS:
+    return a < 0 ? -a : a;
+  case PVM_MIN:
+    return a < b ? a : b;
+  case PVM_MAX:
+    return a > b ? a : b;
+  case PVM_HASH:
+  {
+    uint32_t h = (uint32_t)(a >> 16) * 0x9E3779B1u;
+    h ^= h >> 15;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return (int32_t)(h & 0xFFFF);
+  }
+  default:
+    return 0;
+  }
+}
+
+static inline void PixelVmExecute(const PixelVmInstruction *code, uint8_t count, int32_t *regs)
+{
+  for (const PixelVmInstruction *ins = code, *end = code + count; ins != end; ins++)
+  {
+    regs[ins->dst] = PixelVmApply(ins->op, regs[ins->a], regs[ins->b]);
+  }
+}
+
+static inline uint8_t PixelVmUnit(int32_t value)
+{
+  return value <= 0 ? 0 : (value >= kPixelVmOne ? 255 : (uint8_t)(value >> 8));
+}
+
+/**
+ * @brief Run @p program for @p count pixels, writing three bytes per pixel to @p out.
+ *
+ * The bytes are r, g, b for an RGB program and h, s, v otherwise (see PixelProgram::rgb).  Pixel p is
+ * evaluated at index p << @p indexShift, so a reduced level of detail still sees physical positions.
+ *
+ * @param total Physical pixel count, the program's n
+ */
+void PixelVmRun(const PixelProgram &program, const PixelVmFrame &frame, uint8_t *out, uint16_t count,
+                uint16_t total, uint8_t indexShift = 0)
+{
+  int32_t regs[kPixelVmRegisters];
+  memcpy(regs, program.initial, sizeof(regs[0]) * program.registerCount);
+  regs[PVM_IN_N] = (int32_t)total << 16;
+  regs[PVM_IN_T] = frame.t;
+  regs[PVM_IN_SPEED] = frame.speed;
+  regs[PVM_IN_COUNT] = frame.count;
+  regs[PVM_IN_LEVEL] = frame.level;
+  regs[PVM_IN_BASS] = frame.bass;
+  regs[PVM_IN_MID] = frame.mid;
+  regs[PVM_IN_TREBLE] = frame.treble;
+  regs[PVM_IN_BEAT] = frame.beat;
+  PixelVmExecute(program.frameCode, program.frameCount, regs);
+
+  const uint32_t xStep = total > 0 ? (uint32_t)(((uint64_t)kPixelVmOne << (8 + indexShift)) / total) : 0; // Q16.24
+  const uint8_t r0 = program.out[0];
+  const uint8_t r1 = program.out[1];
+  const uint8_t r2 = program.out[2];
+  for (uint16_t p = 0; p < count; p++)
+  {
+    regs[PVM_IN_I] = (int32_t)(p << indexShift) << 16;
+    regs[PVM_IN_X] = (int32_t)((p * xStep) >> 8);
+    PixelVmExecute(program.pixelCode, program.pixelCount, regs);
+    out[0] = program.rgb ? PixelVmUnit(regs[r0]) : (uint8_t)(regs[r0] >> 8);
+    out[1] = PixelVmUnit(regs[r1]);
+    out[2] = PixelVmUnit(regs[r2]);
+    out += 3;
+  }
+}
+
+// PixelVmCompiler
+//
+// Recursive descent straight to register code; there is no syntax tree.  Each parse function returns
+// the register holding its value, or kPixelVmRegisters after an error.
+
+class PixelVmCompiler
+{
+public:
+  /**
+   * @brief Compile @p source into @p program.
+   *
+   * @return True on success; otherwise Error() and ErrorColumn() say what went wrong and where
+   */
+  bool Compile(const char *source, PixelProgram &program)
+  {
+    memset(&program, 0, sizeof(program));
+    _program = &program;
+    _source = source;
+    _pos = 0;
+    _error = nullptr;
+    _errorPos = 0;
+    _depth = 0;
+    _nameCount = 0;
+    memset(_varying, 0, sizeof(_varying));
+    memset(_constant, 0, sizeof(_constant));
+    _varying[PVM_IN_I] = true;
+    _varying[PVM_IN_X] = true;
+    program.registerCount = PVM_INPUT_COUNT;
+
+    bool assigned[6] = {false}; // h s v r g b
+    uint8_t outputReg[6] = {0};
+    static const char *const kOutputs[6] = {"h", "s", "v", "r", "g", "b"};
+
+    while (!_error)
+    {
+      SkipSpace(true);
+      if (_source[_pos] == '\0')
+      {
+        break;
+      }
+      char name[16];
+      if (!ReadName(name, sizeof(name)))
+      {
+        return Fail("expected a name");
+      }
+      SkipSpace(false);
+      if (_source[_pos] != '=')
+      {
+        return Fail("expected =");
+      }
+      _pos++;
+      const uint8_t value = ParseExpression();
+      if (_error)
+      {
+        return false;
+      }
+      SkipSpace(false);
+      if (_source[_pos] != '\0' && _source[_pos] != '\n' && _source[_pos] != ';' && _source[_pos] != '\r')
+      {
+        return Fail("expected end of line");
+      }
+
+      bool isOutput = false;
+      for (uint8_t o = 0; o < 6; o++)
+      {
+        if (strcmp(name, kOutputs[o]) == 0)
+        {
+          assigned[o] = true;
+          outputReg[o] = value;
+          isOutput = true;
+        }
+      }
+      if (!isOutput && !Bind(name, value))
+      {
+        return false;
+      }
+    }
+
+    const bool rgb = assigned[3] || assigned[4] || assigned[5];
+    if (rgb && (assigned[0] || assigned[1] || assigned[2]))
+    {
+      _pos = 0;
+      return Fail("assign h, s, v or r, g, b, not both");
+    }
+    program.rgb = rgb;
+    for (uint8_t c = 0; c < 3; c++)
+    {
+      const uint8_t o = rgb ? c + 3 : c;
+      if (assigned[o])
+      {
+        program.out[c] = outputReg[o];
+      }
+      else
+      {
+        program.out[c] = Constant(rgb || c == 0 ? 0 : kPixelVmOne); // s and v default to 1, the rest to 0
+      }
+    }
+    if (_error)
+    {
+      return false;
+    }
+    program.valid = true;
+    return true;
+  }
+
+  const char *Error() const
+  {
+    return _error ? _error : "";
+  }
+
+  uint16_t ErrorColumn() const
+  {
+    return _errorPos;
+  }
+
+private:
+  static const uint8_t kBad = kPixelVmRegisters;
+
+  bool Fail(const char *message)
+  {
+    if (!_error)
+    {
+      _error = message;
+      _errorPos = _pos;
+    }
+    return false;
+  }
+
+  uint8_t FailRegister(const char *message)
+  {
+    Fail(message);
+    return kBad;
+  }
+
+  void SkipSpace(bool newlines)
+  {
+    for (;;)
+    {
+      const char c = _source[_pos];
+      if (c == ' ' || c == '\t' || (newlines && (c == '\n' || c == '\r' || c == ';')))
+      {
+        _pos++;
+      }
+      else if (c == '/' && _source[_pos + 1] == '/')
+      {
+        while (_source[_pos] != '\0' && _source[_pos] != '\n')
+        {
+          _pos++;
+        }
+      }
+      else
+      {
+        return;
+      }
+    }
+  }
+
+  static bool IsNameChar(char c, bool first)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (!first && c >= '0' && c <= '9');
+  }
+
+  bool ReadName(char *name, size_t size)
+  {
+    size_t length = 0;
+    if (!IsNameChar(_source[_pos], true))
+    {
+      return false;
+    }
+    while (IsNameChar(_source[_pos], false))
+    {
+      if (length + 1 >= size)
+      {
+        return Fail("name too long");
+      }
+      name[length++] = _source[_pos++];
+    }
+    name[length] = '\0';
+    return true;
+  }
+
+  bool Bind(const char *name, uint8_t reg)
+  {
+    for (uint8_t v = 0; v < PVM_INPUT_COUNT; v++)
+    {
+      if (strcmp(name, kPixelVmInputNames[v]) == 0)
+      {
+        return Fail("can't assign to an input");
+      }
+    }
+    for (uint8_t v = 0; v < _nameCount; v++)
+    {
+      if (strcmp(name, _names[v]) == 0)
+      {
+        _nameReg[v] = reg; // Reassignment just renames the new value
+        return true;
+      }
+    }
+    if (_nameCount == kPixelVmMaxNames)
+    {
+      return Fail("too many variables");
+    }
+    memcpy(_names[_nameCount], name, strlen(name) + 1); // ReadName() keeps it short enough
+    _nameReg[_nameCount++] = reg;
+    return true;
+  }
+
+  uint8_t Allocate()
+  {
+    if (_program->registerCount >= kPixelVmRegisters)
+    {
+      return FailRegister("program too long");
+    }
+    return _program->registerCount++;
+  }
+
+  uint8_t Constant(int32_t value)
+  {
+    for (uint8_t r = PVM_INPUT_COUNT; r < _program->registerCount; r++)
+    {
+      if (_constant[r] && _program->initial[r] == value)
+      {
+        return r;
+      }
+    }
+    const uint8_t r = Allocate();
+    if (r != kBad)
+    {
+      _program->initial[r] = value;
+      _constant[r] = true;
+      _varying[r] = false;
+    }
+    return r;
+  }
+
+  // Emit @p op, folding it if both operands are constants and hoisting it to the frame block if
+  // neither depends on the pixel
+  uint8_t Emit(uint8_t op, uint8_t a, uint8_t b)
+  {
+    if (a == kBad || b == kBad)
+    {
+      return kBad;
+    }
+    if (_constant[a] && _constant[b])
+    {
+      return Constant(PixelVmApply(op, _program->initial[a], _program->initial[b]));
+    }
+    const bool varying = _varying[a] || _varying[b];
+    uint8_t &count = varying ? _program->pixelCount : _program->frameCount;
+    if (count >= kPixelVmMaxCode)
+    {
+      return FailRegister("program too long");
+    }
+    const uint8_t dst = Allocate();
+    if (dst == kBad)
+    {
+      return kBad;
+    }
+    _constant[dst] = false;
+    _varying[dst] = varying;
+    PixelVmInstruction &ins = (varying ? _program->pixelCode : _program->frameCode)[count++];
+    ins.op = op;
+    ins.dst = dst;
+    ins.a = a;
+    ins.b = b;
+    return dst;
+  }
+
+  uint8_t ParseExpression()
+  {
+    uint8_t left = ParseSum();
+    SkipSpace(false);
+    const char c = _source[_pos];
+    if (c == '<' || c == '>')
+    {
+      _pos++;
+      left = Emit(c == '<' ? PVM_LT : PVM_GT, left, ParseSum());
+    }
+    return left;
+  }
+
+  uint8_t ParseSum()
+  {
+    uint8_t left = ParseTerm();
+    for (;;)
+    {
+      SkipSpace(false);
+      const char c = _source[_pos];
+      if (c != '+' && c != '-')
+      {
+        return left;
+      }
+      _pos++;
+      left = Emit(c == '+' ? PVM_ADD : PVM_SUB, left, ParseTerm());
+    }
+  }
+
+  uint8_t ParseTerm()
+  {
+    uint8_t left = ParseUnary();
+    for (;;)
+    {
+      SkipSpace(false);
+      const char c = _source[_pos];
+      if (c != '*' && c != '/' && c != '%')
+      {
+        return left;
+      }
+      _pos++;
+      left = Emit(c == '*' ? PVM_MUL : (c == '/' ? PVM_DIV : PVM_MOD), left, ParseUnary());
+    }
+  }
+
+  // Every way an expression can nest comes back through here, so this is where the recursion is bounded:
+  // the compiler runs on the loop's stack, and a program is only limited to PIXELVM_MAX_SOURCE characters
+  uint8_t ParseUnary()
+  {
+    if (_depth >= kPixelVmMaxDepth)
+    {
+      return FailRegister("nested too deep");
+    }
+    _depth++;
+    SkipSpace(false);
+    uint8_t value;
+    if (_source[_pos] == '-')
+    {
+      _pos++;
+      value = ParseUnary();
+      value = Emit(PVM_NEG, value, value);
+    }
+    else
+    {
+      value = ParsePrimary();
+    }
+    _depth--;
+    return value;
+  }
+
+  uint8_t ParseNumber()
+  {
+    int64_t whole = 0;
+    int64_t fraction = 0;
+    int64_t scale = 1;
+    while (_source[_pos] >= '0' && _source[_pos] <= '9')
+    {
+      whole = whole * 10 + (_source[_pos++] - '0');
+      if (whole > 32767)
+      {
+        return FailRegister("number too large");
+      }
+    }
+    if (_source[_pos] == '.')
+    {
+      _pos++;
+      while (_source[_pos] >= '0' && _source[_pos] <= '9')
+      {
+        if (scale < 100000)
+        {
+          fraction = fraction * 10 + (_source[_pos] - '0');
+          scale *= 10;
+        }
+        _pos++;
+      }
+    }
+    return Constant((int32_t)((whole << 16) + ((fraction << 16) + scale / 2) / scale));
+  }
+
+  uint8_t ParseCall(const char *name)
+  {
+    static const struct
+    {
+      const char *name;
+      uint8_t op;
+      uint8_t args;
+    } kFunctions[] = {
+        {"sin", PVM_SIN, 1}, {"cos", PVM_COS, 1}, {"wave", PVM_WAVE, 1}, {"tri", PVM_TRI, 1},
+        {"frac", PVM_FRAC, 1}, {"floor", PVM_FLOOR, 1}, {"abs", PVM_ABS, 1}, {"hash", PVM_HASH, 1},
+        {"min", PVM_MIN, 2}, {"max", PVM_MAX, 2}, {"clamp", PVM_MAX, 3}};
+
+    for (const auto &function : kFunctions)
+    {
+      if (strcmp(name, function.name) != 0)
+      {
+        continue;
+      }
+      uint8_t args[3];
+      for (uint8_t a = 0; a < function.args; a++)
+      {
+        if (a > 0)
+        {
+          SkipSpace(false);
+          if (_source[_pos] != ',')
+          {
+            return FailRegister("expected ,");
+          }
+          _pos++;
+        }
+        args[a] = ParseExpression();
+      }
+      SkipSpace(false);
+      if (_source[_pos] != ')')
+      {
+        return FailRegister("expected )");
+      }
+      _pos++;
+      if (function.args == 3)
+      {
+        return Emit(PVM_MIN, Emit(PVM_MAX, args[0], args[1]), args[2]); // clamp(a, lo, hi)
+      }
+      return Emit(function.op, args[0], function.args == 2 ? args[1] : args[0]);
+    }
+    return FailRegister("unknown function");
+  }
+
+  uint8_t ParsePrimary()
+  {
+    SkipSpace(false);
+    const char c = _source[_pos];
+    if ((c >= '0' && c <= '9') || c == '.')
+    {
+      return ParseNumber();
+    }
+    if (c == '(')
+    {
+      if (_depth >= kPixelVmMaxDepth)
+      {
+        return FailRegister("nested too deep");
+      }
+      _pos++;
+      const uint8_t value = ParseExpression();
+      SkipSpace(false);
+      if (_source[_pos] != ')')
+      {
+        return FailRegister("expected )");
+      }
+      _pos++;
+      return value;
+    }
+
+    char name[16];
+    if (!ReadName(name, sizeof(name)))
+    {
+      return FailRegister("expected a value");
+    }
+    SkipSpace(false);
+    if (_source[_pos] == '(')
+    {
+      _pos++;
+      return ParseCall(name);
+    }
+    if (strcmp(name, "pi") == 0)
+    {
+      return Constant(205887); // 3.14159 in Q16.16
+    }
+    for (uint8_t v = 0; v < PVM_INPUT_COUNT; v++)
+    {
+      if (strcmp(name, kPixelVmInputNames[v]) == 0)
+      {
+        return v;
+      }
+    }
+    for (uint8_t v = 0; v < _nameCount; v++)
+    {
+      if (strcmp(name, _names[v]) == 0)
+      {
+        return _nameReg[v];
+      }
+    }
+    return FailRegister("unknown name");
+  }
+
+  PixelProgram *_program;
+  const char *_source;
+  uint16_t _pos;
+  const char *_error;
+  uint16_t _errorPos;
+  uint8_t _depth; // ParseUnary() calls open
+  bool _varying[kPixelVmRegisters];
+  bool _constant[kPixelVmRegisters];
+  char _names[kPixelVmMaxNames][16];
+  uint8_t _nameReg[kPixelVmMaxNames];
+  uint8_t _nameCount;
+};
@@ -0,0 +1,211 @@
+/**
+ * @file quality.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Level-of-detail rendering and the adaptive quality governor
+ * @version 0.4
+ * @date 10/19/26
+ *
+ *   Effects that opt in draw only the first g_RenderLeds pixels, stepping 1 << g_LodShift physical
+ *   pixels per logical one, and LodUpsample() stretches the result back over the whole strip.
+ *
+ *   The governor is fed the render time of every frame (up to, not including, its show) and walks
+ *   a table of tiers, each a LOD shift and a frame interval.  A window that overruns its frame budget
+ *   drops one tier straight away; several comfortable windows in a row are needed to climb back up,
+ *   so a WiFi or OTA burst doesn't make it oscillate.  The show and the OLED flush cost the same at
+ *   every tier, so they aren't counted as render time, but they come out of the frame interval: the
+ *   budget the render has to fit is what is left of the interval after them.
+ *
+ *   Separately, the time from one new frame going out to the next is kept as a histogram, so the
+ *   percentiles of what the strip actually shows can be read at any time: a stalled loop shows up there
+ *   however short its render time.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial LOD tiers and governor
+ *   0.2 - 10/19/26 - Frame time percentiles
+ *   0.3 - 10/19/26 - Governor fed render time only
+ *   0.4 - 10/19/26 - Show and OLED time taken off the render budget
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+struct QualityTier
+{
+  uint8_t lodShift; // Logical resolution is NUM_LEDS >> lodShift
+  uint8_t frameMs;  // Render interval
+};
+
+static const QualityTier kQualityTiers[] =
+    {
+        {0, 20}, // 50 FPS, full resolution
+        {1, 20}, // 50 FPS, half resolution
+        {2, 20}, // 50 FPS, quarter resolution
+        {2, 25}, // 40 FPS
+        {2, 33}, // 30 FPS
+        {3, 40}, // 25 FPS, eighth resolution
+};
+const uint8_t kQualityTierCount = sizeof(kQualityTiers) / sizeof(kQualityTiers[0]);
+
+const uint8_t kGovernorWindow = 16;        // Frames averaged per decision
+const uint8_t kGovernorRecoverWindows = 4; // Comfortable windows needed before stepping back up
+const uint8_t kGovernorHeadroomPct = 70;   // "Comfortable" means using under this much of the budget
+const uint16_t kGovernorMinBudgetUs = 1000; // Floor on the render budget when the show takes the rest
+
+uint16_t g_RenderLeds = NUM_LEDS; // Logical pixels the current effect should draw
+uint8_t g_LodShift = 0;           // log2 of physical pixels per logical pixel
+
+static uint8_t g_qualityTier = 0;
+static bool g_qualityAuto = true;
+static uint32_t g_frameWorkUs = 0;  // Average render time over the last full window
+static uint32_t g_frameFixedUs = 0; // Show and OLED time per frame, as of the last window
+static uint32_t g_windowWorkUs = 0; // Running sum for the window in progress
+static uint8_t g_windowFrames = 0;
+static uint8_t g_comfortableWindows = 0;
+
+#define FRAME_TIME_BUCKET_US 250
+#define FRAME_TIME_BUCKETS 256 // Up to 64 ms; anything longer goes in the last bucket
+static uint32_t g_frameTimeHistogram[FRAME_TIME_BUCKETS];
+static uint32_t g_frameTimeCount = 0;
+static uint32_t g_frameTimeMaxUs = 0;
+static uint32_t g_frameTimeLastUs = 0; // When the last new frame went out; 0 to start over
+
+uint8_t QualityLodShift()
+{
+  return kQualityTiers[g_qualityTier].lodShift;
+}
+
+uint8_t QualityFrameMs()
+{
+  return kQualityTiers[g_qualityTier].frameMs;
+}
+
+// QualitySetTier
+//
+// Pin the governor to a tier, or hand control back to it when @p automatic is true.
+
+void QualitySetTier(uint8_t tier, bool automatic)
+{
+  g_qualityTier = min<uint8_t>(tier, kQualityTierCount - 1);
+  g_qualityAuto = automatic;
+  g_windowWorkUs = 0;
+  g_windowFrames = 0;
+  g_comfortableWindows = 0;
+}
+
+/**
+ * @brief Report how long the last frame took to render, from its start to just before its show.
+ *
+ * @param fixedUs What else each frame costs whatever the tier (the show, the OLED flush's share), taken
+ * off the frame interval to leave the render budget
+ */
+void QualityFrameDone(uint32_t renderUs, uint32_t fixedUs)
+{
+  g_windowWorkUs += renderUs;
+  if (++g_windowFrames < kGovernorWindow)
+  {
+    return;
+  }
+
+  g_frameWorkUs = g_windowWorkUs / g_windowFrames;
+  g_windowWorkUs = 0;
+  g_windowFrames = 0;
+  if (!g_qualityAuto)
+  {
+    return;
+  }
+
+  g_frameFixedUs = fixedUs;
+  const uint32_t intervalUs = QualityFrameMs() * 1000UL;
+  const uint32_t budgetUs = intervalUs > fixedUs + kGovernorMinBudgetUs ? intervalUs - fixedUs : kGovernorMinBudgetUs;
+  if (g_frameWorkUs > budgetUs)
+  {
+    g_comfortableWindows = 0;
+    if (g_qualityTier + 1 < kQualityTierCount)
+    {
+      g_qualityTier++;
+    }
+  }
+  else if (g_frameWorkUs * 100 < budgetUs * kGovernorHeadroomPct)
+  {
+    if (++g_comfortableWindows >= kGovernorRecoverWindows && g_qualityTier > 0)
+    {
+      g_qualityTier--;
+      g_comfortableWindows = 0;
+    }
+  }
+  else
+  {
+    g_comfortableWindows = 0;
+  }
+}
+
+// FrameTimeRecord
+//
+// A new frame went out at @p nowUs.  0 leaves the gap before the next one out: an idle frame, say,
+// which is meant to be late.
+
+void FrameTimeRecord(uint32_t nowUs)
+{
+  if (g_frameTimeLastUs != 0 && nowUs != 0)
+  {
+    const uint32_t elapsed = nowUs - g_frameTimeLastUs;
+    g_frameTimeHistogram[min<uint32_t>(elapsed / FRAME_TIME_BUCKET_US, FRAME_TIME_BUCKETS - 1)]++;
+    g_frameTimeCount++;
+    g_frameTimeMaxUs = max(g_frameTimeMaxUs, elapsed);
+  }
+  g_frameTimeLastUs = nowUs;
+}
+
+void FrameTimeReset()
+{
+  memset(g_frameTimeHistogram, 0, sizeof(g_frameTimeHistogram));
+  g_frameTimeCount = 0;
+  g_frameTimeMaxUs = 0;
+  g_frameTimeLastUs = 0;
+}
+
+// FrameTimePercentileUs
+//
+// The frame time that @p permille of frames since the last reset came in under, to the top of its bucket.
+
+uint32_t FrameTimePercentileUs(uint16_t permille)
+{
+  const uint32_t rank = ((uint64_t)g_frameTimeCount * permille + 999) / 1000;
+  uint32_t seen = 0;
+  for (uint16_t b = 0; b + 1 < FRAME_TIME_BUCKETS && rank > 0; b++)
+  {
+    seen += g_frameTimeHistogram[b];
+    if (seen >= rank)
+    {
+      return min<uint32_t>((b + 1) * FRAME_TIME_BUCKET_US, g_frameTimeMaxUs);
+    }
+  }
+  return g_frameTimeMaxUs;
+}
+
+/**
+ * @brief Stretch the first @p logical pixels of @p leds over all @p physical pixels, in place.
+ *
+ * Works from the end of the strip backwards.  Since logical <= physical / 2, every source pixel read
+ * for position i sits at or before i and so has not been overwritten yet.
+ */
+void LodUpsample(CRGB *leds, uint16_t logical, uint16_t physical)
+{
+  if (logical >= physical || logical < 2)
+  {
+    return;
+  }
+
+  const uint32_t step = ((uint32_t)(logical - 1) << 16) / (physical - 1);
+  for (int i = physical - 1; i >= 0; i--)
+  {
+    const uint32_t pos = i * step;
+    const uint16_t idx = pos >> 16;
+    const uint8_t frac = (pos >> 8) & 0xFF;
+    leds[i] = frac == 0 ? leds[idx] : blend(leds[idx], leds[idx + 1], frac);
+  }
+}
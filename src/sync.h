@@ -0,0 +1,476 @@
+/**
+ * @file sync.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Keep several controllers on the same effect and frame over the LAN
+ * @version 0.4
+ * @date 10/19/26
+ *
+ *   UDP multicast glue around sync_protocol.h.  A leader beacons its show state and answers clock
+ *   pings; a follower applies the leader's state, disciplines its clock from the pongs, and renders
+ *   by the shared timeline frame index rather than its own timer.  See RenderSynced() in main.cpp for
+ *   how a follower that joins mid-show replays the current effect up to the leader's frame.
+ *
+ *   Set the role with -D SYNC_ROLE=SYNC_LEADER / SYNC_FOLLOWER, or at run time with "sync leader",
+ *   "sync follower" and "sync off".
+ *
+ *   The clock exchange is only as good as its timestamps, so the socket is read by a small task on
+ *   core 0 that stamps each packet the moment it comes off the socket.  The leader answers a PING there
+ *   and then, stamping t2 on arrival and t3 just before the PONG goes out; everything else, a follower's
+ *   PONG with its arrival time included, is queued for the loop.  Render time and the wait before a
+ *   synced frame is presented never show up in the offset.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial leader / follower sync
+ *   0.2 - 10/19/26 - Builds without WiFi (ENABLE_WIFI=0)
+ *   0.3 - 10/19/26 - WiFi.h only included with WiFi
+ *   0.4 - 10/19/26 - Packets stamped on arrival by a receive task
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include "feature_flags.h"
+#if ENABLE_WIFI
+#include <WiFi.h>
+#endif
+#include <lwip/sockets.h>
+#include <esp_timer.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+#include "sync_protocol.h"
+
+enum SyncRole : uint8_t
+{
+  SYNC_OFF = 0,
+  SYNC_LEADER = 1,
+  SYNC_FOLLOWER = 2
+};
+
+#ifndef SYNC_ROLE
+#define SYNC_ROLE SYNC_OFF
+#endif
+
+#ifndef SYNC_FRAME_MS
+#define SYNC_FRAME_MS 20 // Timeline frame interval the leader announces
+#endif
+
+const uint16_t kSyncBeaconMs = 100;     // Leader state beacon interval
+const uint16_t kSyncPingFastMs = 100;   // Follower ping interval until the clock has a few samples
+const uint16_t kSyncPingMs = 500;       // and after
+const uint16_t kSyncLeaderLostMs = 3000; // Beacons missing this long and a follower runs free
+
+#define SYNC_RX_QUEUE 8       // Packets waiting for the loop
+#define SYNC_RX_STACK 3072
+#define SYNC_RX_PRIORITY 5    // Above the loop and WebServer, so a packet is stamped as it arrives
+#define SYNC_RX_CORE 0
+#define SYNC_RX_TIMEOUT_MS 50 // Longest a read blocks, so the task notices the socket being swapped
+
+// Implemented in main.cpp: copy the show state out of, and into, the current lighting state
+void SyncCaptureState(SyncShowState &state);
+void SyncApplyState(const SyncShowState &state, uint32_t frame);
+
+// A plain socket rather than WiFiUDP, whose parsePacket() allocates two buffers for every packet
+static int g_syncSocket = -1;
+static sockaddr_in g_syncFrom = {}; // Sender of the packet being handled
+static SyncRole g_syncRole = SYNC_ROLE;
+static bool g_syncStarted = false;
+static SyncClock g_syncClock;
+static SyncShowState g_syncState = {}; // Leader: what it announces.  Follower: the last state received.
+static bool g_syncHaveState = false;
+static uint16_t g_syncNode = 0;
+static uint32_t g_syncSequence = 0;
+static uint32_t g_syncLastBeacon = 0;
+static uint32_t g_syncLastPing = 0;
+static uint32_t g_syncLastHeard = 0;
+static uint8_t g_syncSamples = 0;
+static IPAddress g_syncLeaderIp;
+static uint32_t g_syncPackets = 0;
+
+// A received packet for the loop, stamped when it came off the socket
+struct SyncReceived
+{
+  uint64_t receivedUs;
+  sockaddr_in from;
+  uint16_t length;
+  uint8_t data[sizeof(SyncStatePacket) + 8];
+};
+
+static TaskHandle_t g_syncRxTask = nullptr;
+static QueueHandle_t g_syncRx = nullptr;
+static volatile int g_syncRxSocket = -1; // Socket the receive task is reading from, or -1
+static uint32_t g_syncRxDropped = 0;     // Packets lost because the loop hadn't emptied the queue
+
+const char *SyncRoleName(uint8_t role)
+{
+  switch (role)
+  {
+  case SYNC_LEADER:
+    return "leader";
+  case SYNC_FOLLOWER:
+    return "follower";
+  case SYNC_OFF:
+  default:
+    return "off";
+  }
+}
+
+// Local monotonic clock; micros() wraps after 71 minutes, which a show can easily outlast
+static inline uint64_t SyncLocalUs()
+{
+  return (uint64_t)esp_timer_get_time();
+}
+
+// SyncActive
+//
+// True when frames should be rendered by the shared timeline: always on the leader, and on a follower
+// once its clock is locked and it has the leader's state.
+
+bool SyncActive()
+{
+  if (!g_syncStarted)
+  {
+    return false;
+  }
+  if (g_syncRole == SYNC_LEADER)
+  {
+    return true;
+  }
+  return g_syncRole == SYNC_FOLLOWER && g_syncClock.Locked() && g_syncHaveState;
+}
+
+bool SyncIsFollower()
+{
+  return SyncActive() && g_syncRole == SYNC_FOLLOWER;
+}
+
+bool SyncLeaderLost()
+{
+  return g_syncRole == SYNC_FOLLOWER && g_syncHaveState && (millis() - g_syncLastHeard) > kSyncLeaderLostMs;
+}
+
+// Timeline time now; the leader's clock, as best this controller knows it
+uint64_t SyncNowUs()
+{
+  return g_syncRole == SYNC_FOLLOWER ? g_syncClock.ToLeader(SyncLocalUs()) : SyncLocalUs();
+}
+
+uint32_t SyncFrameUs()
+{
+  return g_syncState.frameUs != 0 ? g_syncState.frameUs : SYNC_FRAME_MS * 1000UL;
+}
+
+uint64_t SyncFrameTimeUs(uint32_t frame)
+{
+  return (uint64_t)frame * SyncFrameUs();
+}
+
+// The timeline frame that is due now (rendered frames are presented at the start of their slot)
+uint32_t SyncCurrentFrame()
+{
+  return (uint32_t)(SyncNowUs() / SyncFrameUs());
+}
+
+// Microseconds until @p frame is due, or a negative number if it's late
+int32_t SyncUsUntilFrame(uint32_t frame)
+{
+  return (int32_t)((int64_t)SyncFrameTimeUs(frame) - (int64_t)SyncNowUs());
+}
+
+// SyncSeedFrame
+//
+// Seed every PRNG an effect might use, so that the same (seed, frame, effect) draws the same pixels.
+// Arduino's random() switches from the hardware RNG to rand() once randomSeed() has been called.
+
+void SyncSeedFrame(uint32_t frame, uint8_t effect)
+{
+  const uint32_t seed = SyncFrameSeed(g_syncState.seed, frame, effect);
+  random16_set_seed((uint16_t)seed);
+  randomSeed(seed | 1); // randomSeed() ignores zero
+}
+
+// Leader: the current effect was (re)started on @p frame, so the parameter log starts over
+void SyncOnEffectStart(uint32_t frame, uint8_t speed, uint8_t count)
+{
+  if (g_syncRole != SYNC_LEADER)
+  {
+    return;
+  }
+  g_syncState.epochFrame = frame;
+  g_syncState.paramCount = 0;
+  SyncLogParams(g_syncState, frame, speed, count);
+  g_syncLastBeacon = millis() - kSyncBeaconMs; // Announce it on the next poll
+}
+
+// Leader: called every frame; only logs anything when speed or count actually changed
+void SyncOnParams(uint32_t frame, uint8_t speed, uint8_t count)
+{
+  if (g_syncRole != SYNC_LEADER)
+  {
+    return;
+  }
+  const uint8_t before = g_syncState.paramCount;
+  const SyncParamChange last = before ? g_syncState.params[before - 1] : SyncParamChange();
+  SyncLogParams(g_syncState, frame, speed, count);
+  if (g_syncState.paramCount != before || last.speed != speed || last.count != count)
+  {
+    g_syncLastBeacon = millis() - kSyncBeaconMs;
+  }
+}
+
+static void SyncSendTo(uint32_t ip, uint16_t port, const void *data, size_t length)
+{
+  sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_port = htons(port);
+  to.sin_addr.s_addr = ip;
+  sendto(g_syncSocket, data, length, 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+}
+
+static void SyncSendState()
+{
+  SyncStatePacket packet;
+  SyncFillHeader(packet.header, SYNC_STATE, g_syncNode);
+  packet.sequence = ++g_syncSequence;
+  packet.state = g_syncState;
+  packet.leaderUs = SyncLocalUs();
+  SyncSendTo((uint32_t)IPAddress(SYNC_GROUP), SYNC_PORT, &packet, sizeof(packet));
+}
+
+static void SyncSendPing()
+{
+  SyncPingPacket packet;
+  SyncFillHeader(packet.header, SYNC_PING, g_syncNode);
+  packet.t1 = SyncLocalUs();
+  SyncSendTo((uint32_t)g_syncLeaderIp, SYNC_PORT, &packet, sizeof(packet));
+}
+
+// Leader, on the receive task: answer a PING straight away.  Returns false for anything else.
+static bool SyncAnswerPing(const SyncReceived &packet)
+{
+  if (g_syncRole != SYNC_LEADER || SyncPacketTypeOf(packet.data, packet.length) != SYNC_PING)
+  {
+    return false;
+  }
+  SyncPingPacket ping;
+  memcpy(&ping, packet.data, sizeof(ping));
+  SyncPongPacket pong;
+  SyncFillHeader(pong.header, SYNC_PONG, g_syncNode);
+  pong.t1 = ping.t1;
+  pong.t2 = packet.receivedUs;
+  pong.t3 = SyncLocalUs();
+  SyncSendTo(packet.from.sin_addr.s_addr, ntohs(packet.from.sin_port), &pong, sizeof(pong));
+  g_syncPackets++;
+  return true;
+}
+
+// SyncReceiveTask
+//
+// Read the socket, stamping each packet as it arrives; PINGs are answered here, the rest go to the loop.
+
+static void SyncReceiveTask(void *)
+{
+  SyncReceived packet;
+  for (;;)
+  {
+    const int fd = g_syncSocket;
+    g_syncRxSocket = fd;
+    if (fd < 0)
+    {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    socklen_t fromLength = sizeof(packet.from);
+    const int length = recvfrom(fd, packet.data, sizeof(packet.data), 0, reinterpret_cast<sockaddr *>(&packet.from), &fromLength);
+    packet.receivedUs = SyncLocalUs();
+    if (length <= 0)
+    {
+      continue; // Timed out
+    }
+    packet.length = (uint16_t)length;
+    if (!SyncAnswerPing(packet) && xQueueSend(g_syncRx, &packet, 0) != pdTRUE)
+    {
+      g_syncRxDropped++;
+    }
+  }
+}
+
+static void SyncHandlePacket(const uint8_t *data, size_t length, uint64_t receivedUs)
+{
+  const uint8_t type = SyncPacketTypeOf(data, length);
+  if (type == 0)
+  {
+    return;
+  }
+  SyncHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.node == g_syncNode)
+  {
+    return; // Our own multicast looped back
+  }
+  g_syncPackets++;
+
+  if (g_syncRole != SYNC_FOLLOWER)
+  {
+    return;
+  }
+
+  if (type == SYNC_STATE)
+  {
+    SyncStatePacket packet;
+    memcpy(&packet, data, sizeof(packet));
+    if (packet.state.frameUs == 0)
+    {
+      return;
+    }
+    if ((uint32_t)g_syncLeaderIp != g_syncFrom.sin_addr.s_addr)
+    {
+      g_syncLeaderIp = IPAddress(g_syncFrom.sin_addr.s_addr); // New (or first) leader: its clock needs measuring afresh
+      g_syncClock.Reset();
+      g_syncSamples = 0;
+    }
+    g_syncState = packet.state;
+    g_syncHaveState = true;
+    g_syncLastHeard = millis();
+    if (g_syncClock.Locked())
+    {
+      SyncApplyState(g_syncState, SyncCurrentFrame());
+    }
+  }
+  else if (type == SYNC_PONG)
+  {
+    SyncPongPacket pong;
+    memcpy(&pong, data, sizeof(pong));
+    g_syncClock.AddSample(pong.t1, pong.t2, pong.t3, receivedUs);
+    if (g_syncSamples < SyncClock::kSamples)
+    {
+      g_syncSamples++;
+    }
+  }
+}
+
+// SyncBegin
+//
+// Join the multicast group.  Needs WiFi; does nothing when the role is off.
+
+void SyncBegin()
+{
+  g_syncStarted = false;
+  if (g_syncSocket >= 0)
+  {
+    // Let the receive task's read time out before the socket goes
+    const int old = g_syncSocket;
+    g_syncSocket = -1;
+    const uint32_t start = millis();
+    while (g_syncRxSocket == old && (millis() - start) < 2 * SYNC_RX_TIMEOUT_MS)
+    {
+      delay(1);
+    }
+    close(old);
+  }
+  SyncReceived stale;
+  while (g_syncRx != nullptr && xQueueReceive(g_syncRx, &stale, 0) == pdTRUE)
+  {
+  }
+  g_syncClock.Reset();
+  g_syncHaveState = false;
+  g_syncSamples = 0;
+  g_syncLeaderIp = IPAddress();
+#if ENABLE_WIFI
+  if (g_syncRole == SYNC_OFF || WiFi.status() != WL_CONNECTED)
+  {
+    return;
+  }
+#else
+  return; // Nothing to sync over
+#endif
+  const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  const int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(SYNC_PORT);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  ip_mreq group = {};
+  group.imr_multiaddr.s_addr = (uint32_t)IPAddress(SYNC_GROUP);
+  group.imr_interface.s_addr = htonl(INADDR_ANY);
+  if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&local), sizeof(local)) < 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0)
+  {
+    Serial.println("Sync: multicast join failed.");
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return;
+  }
+  timeval timeout = {};
+  timeout.tv_usec = SYNC_RX_TIMEOUT_MS * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  g_syncNode = (uint16_t)(ESP.getEfuseMac() >> 32); // Last two bytes of the MAC
+  if (g_syncRxTask == nullptr)
+  {
+    g_syncRx = xQueueCreate(SYNC_RX_QUEUE, sizeof(SyncReceived));
+    xTaskCreatePinnedToCore(SyncReceiveTask, "sync", SYNC_RX_STACK, nullptr, SYNC_RX_PRIORITY, &g_syncRxTask, SYNC_RX_CORE);
+  }
+  g_syncSocket = fd; // The receive task starts reading it
+
+  if (g_syncRole == SYNC_LEADER)
+  {
+    g_syncState = SyncShowState();
+    g_syncState.frameUs = SYNC_FRAME_MS * 1000UL;
+    g_syncState.seed = esp_random();
+    g_syncState.epochFrame = SyncCurrentFrame();
+  }
+  g_syncStarted = true;
+  Serial.printf("Sync: %s, node %04X\n", SyncRoleName(g_syncRole), g_syncNode);
+}
+
+void SyncSetRole(SyncRole role)
+{
+  g_syncRole = role;
+  SyncBegin();
+}
+
+// SyncPoll
+//
+// Handle what the receive task has queued, then beacon (leader) or ping (follower) when due.  Call every
+// loop pass.
+
+void SyncPoll()
+{
+  if (!g_syncStarted)
+  {
+    return;
+  }
+
+  SyncReceived packet;
+  while (xQueueReceive(g_syncRx, &packet, 0) == pdTRUE)
+  {
+    g_syncFrom = packet.from;
+    SyncHandlePacket(packet.data, packet.length, packet.receivedUs);
+  }
+
+  const uint32_t now = millis();
+  if (g_syncRole == SYNC_LEADER)
+  {
+    SyncShowState current = g_syncState;
+    SyncCaptureState(current);
+    const bool changed = memcmp(&current, &g_syncState, sizeof(current)) != 0;
+    if (changed || (now - g_syncLastBeacon) >= kSyncBeaconMs)
+    {
+      g_syncState = current;
+      g_syncLastBeacon = now;
+      SyncSendState();
+    }
+  }
+  else if (g_syncRole == SYNC_FOLLOWER && g_syncHaveState)
+  {
+    const uint16_t interval = g_syncSamples <= SyncClock::kStepSamples ? kSyncPingFastMs : kSyncPingMs;
+    if ((now - g_syncLastPing) >= interval)
+    {
+      g_syncLastPing = now;
+      SyncSendPing();
+    }
+  }
+}
@@ -0,0 +1,315 @@
+/**
+ * @file sync_protocol.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Wire format and clock discipline for keeping several controllers on the same frame
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   One controller leads.  It multicasts a STATE packet ten times a second (and straight away when
+ *   anything changes) carrying its clock, the frame interval, the effect and its parameters, and a
+ *   PRNG seed.  Every controller renders timeline frame n at leader time n * frameUs, seeding the
+ *   PRNGs from (seed, n) before each effect draws, so the same frame index gives the same pixels.
+ *
+ *   Followers measure their offset from the leader with NTP-style PING/PONG exchanges.  Each exchange
+ *   bounds the offset on both sides, as neither leg of the trip can have taken less than no time; the
+ *   bounds of the last several exchanges are intersected, so a quick outward leg from one and a quick
+ *   return from another together pin it down closer than either alone, whatever WiFi queuing did to
+ *   the rest.  Once the first few exchanges are in, the applied offset slews toward the middle rather
+ *   than jumping, so the timeline never steps backwards.
+ *
+ *   Only <stdint.h> and <string.h> are used, so the same code can run in Linux processes for testing
+ *   several followers on one host.  All fields are little-endian (ESP32 and x86 alike).
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial protocol
+ *   0.2 - 10/19/26 - Offset from the intersected bounds of the last eight seconds' exchanges
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define SYNC_PORT 7272
+#define SYNC_GROUP 239, 255, 72, 72 // Administratively scoped multicast group
+
+const uint32_t kSyncMagic = 0x534C4255; // "UBLS" on the wire
+const uint8_t kSyncVersion = 1;
+const uint8_t kSyncParamLogSize = 8;
+
+enum SyncPacketType : uint8_t
+{
+  SYNC_STATE = 1,
+  SYNC_PING = 2,
+  SYNC_PONG = 3
+};
+
+struct __attribute__((packed)) SyncHeader
+{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint16_t node; // Sender's node ID, for logging
+};
+
+// Speed and count in force from a given timeline frame on
+struct __attribute__((packed)) SyncParamChange
+{
+  uint32_t frame;
+  uint8_t speed;
+  uint8_t count;
+};
+
+struct __attribute__((packed)) SyncShowState
+{
+  uint32_t frameUs;    // Timeline frame interval
+  uint32_t epochFrame; // Timeline frame the current effect started on
+  uint32_t seed;       // Mixed with the frame number to seed the PRNGs
+  uint8_t power;
+  uint8_t brightness;
+  uint8_t effect;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t transition;
+  uint16_t transitionMs;
+  uint8_t paramCount;                        // Valid entries in params, oldest first
+  SyncParamChange params[kSyncParamLogSize]; // Changes since epochFrame, so a late joiner can replay them
+};
+
+struct __attribute__((packed)) SyncStatePacket
+{
+  SyncHeader header;
+  uint32_t sequence;
+  uint64_t leaderUs; // Leader's timeline clock when sent
+  SyncShowState state;
+};
+
+struct __attribute__((packed)) SyncPingPacket
+{
+  SyncHeader header;
+  uint64_t t1; // Follower clock when sent
+};
+
+struct __attribute__((packed)) SyncPongPacket
+{
+  SyncHeader header;
+  uint64_t t1; // Echoed from the ping
+  uint64_t t2; // Leader clock when the ping arrived
+  uint64_t t3; // Leader clock when the pong left
+};
+
+static inline void SyncFillHeader(SyncHeader &header, SyncPacketType type, uint16_t node)
+{
+  header.magic = kSyncMagic;
+  header.version = kSyncVersion;
+  header.type = type;
+  header.node = node;
+}
+
+// SyncPacketType
+//
+// The type of a received datagram, or 0 if it isn't one of ours or is too short for its type.
+
+static inline uint8_t SyncPacketTypeOf(const uint8_t *data, size_t length)
+{
+  SyncHeader header;
+  if (length < sizeof(header))
+  {
+    return 0;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kSyncMagic || header.version != kSyncVersion)
+  {
+    return 0;
+  }
+  switch (header.type)
+  {
+  case SYNC_STATE:
+    return length >= sizeof(SyncStatePacket) ? SYNC_STATE : 0;
+  case SYNC_PING:
+    return length >= sizeof(SyncPingPacket) ? SYNC_PING : 0;
+  case SYNC_PONG:
+    return length >= sizeof(SyncPongPacket) ? SYNC_PONG : 0;
+  default:
+    return 0;
+  }
+}
+
+// SyncFrameSeed
+//
+// PRNG seed for one effect on one timeline frame (murmur3 finalizer, so neighbouring frames differ).
+
+static inline uint32_t SyncFrameSeed(uint32_t seed, uint32_t frame, uint8_t effect)
+{
+  uint32_t h = seed ^ (frame * 0x9E3779B1u) ^ ((uint32_t)effect << 24);
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  return h;
+}
+
+// SyncParamsAt
+//
+// Speed and count that were in force on @p frame, according to the state's change log.
+
+static inline void SyncParamsAt(const SyncShowState &state, uint32_t frame, uint8_t &speed, uint8_t &count)
+{
+  for (uint8_t i = 0; i < state.paramCount && i < kSyncParamLogSize; i++)
+  {
+    if (i > 0 && (int32_t)(frame - state.params[i].frame) < 0)
+    {
+      break;
+    }
+    speed = state.params[i].speed;
+    count = state.params[i].count;
+  }
+}
+
+// SyncLogParams
+//
+// Leader side: record a speed / count change.  When the log is full the oldest change is dropped, which
+// only makes a follower that joins later replay the earliest frames with slightly wrong parameters.
+
+static inline void SyncLogParams(SyncShowState &state, uint32_t frame, uint8_t speed, uint8_t count)
+{
+  if (state.paramCount > 0)
+  {
+    SyncParamChange &last = state.params[state.paramCount - 1];
+    if (last.speed == speed && last.count == count)
+    {
+      return;
+    }
+    if (last.frame == frame)
+    {
+      last.speed = speed;
+      last.count = count;
+      return;
+    }
+  }
+  if (state.paramCount == kSyncParamLogSize)
+  {
+    memmove(&state.params[0], &state.params[1], sizeof(state.params[0]) * (kSyncParamLogSize - 1));
+    state.paramCount--;
+  }
+  SyncParamChange &entry = state.params[state.paramCount++];
+  entry.frame = frame;
+  entry.speed = speed;
+  entry.count = count;
+}
+
+// SyncClock
+//
+// Follower's estimate of (leader clock - local clock), disciplined from PING/PONG round trips.  Exchange
+// i puts the offset between t3 - t4 and t2 - t1; the estimate is the middle of where all of them agree,
+// or, when crystal drift has pulled old ones apart, the middle of the one with the shortest round trip.
+
+class SyncClock
+{
+public:
+  static const uint8_t kSamples = 16;     // Round trips remembered; at 2 Hz, the last eight seconds
+  static const int64_t kStepUs = 5000;    // Larger errors are stepped, not slewed
+  static const int64_t kSlewUs = 250;     // Most the applied offset moves per sample otherwise
+  static const uint32_t kMaxRttUs = 50000; // Round trips slower than this are discarded
+  static const uint8_t kStepSamples = 4;  // The first few samples are stepped to; the first alone is rough
+
+  SyncClock()
+  {
+    Reset();
+  }
+
+  void Reset()
+  {
+    _count = 0;
+    _next = 0;
+    _applied = 0;
+    _locked = false;
+  }
+
+  /**
+   * @brief Add one exchange: t1 ping sent and t4 pong received (local clock), t2 / t3 at the leader.
+   */
+  void AddSample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+  {
+    const int64_t rtt = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+    if (rtt < 0 || rtt > (int64_t)kMaxRttUs)
+    {
+      return;
+    }
+    _rtt[_next] = (uint32_t)rtt;
+    _offset[_next] = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    _next = (_next + 1) % kSamples;
+    if (_count < kSamples)
+    {
+      _count++;
+    }
+
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < _count; i++)
+    {
+      if (_rtt[i] < _rtt[best])
+      {
+        best = i;
+      }
+    }
+    _bestRtt = _rtt[best];
+
+    int64_t lower = _offset[0] - _rtt[0] / 2;
+    int64_t upper = _offset[0] + _rtt[0] / 2;
+    for (uint8_t i = 1; i < _count; i++)
+    {
+      if (_offset[i] - _rtt[i] / 2 > lower)
+      {
+        lower = _offset[i] - _rtt[i] / 2;
+      }
+      if (_offset[i] + _rtt[i] / 2 < upper)
+      {
+        upper = _offset[i] + _rtt[i] / 2;
+      }
+    }
+    const int64_t target = lower <= upper ? (lower + upper) / 2 : _offset[best];
+
+    const int64_t error = target - _applied;
+    if (!_locked || _count <= kStepSamples || error > kStepUs || error < -kStepUs)
+    {
+      _applied = target;
+      _locked = true;
+    }
+    else
+    {
+      _applied += error > kSlewUs ? kSlewUs : (error < -kSlewUs ? -kSlewUs : error);
+    }
+  }
+
+  bool Locked() const
+  {
+    return _locked;
+  }
+
+  int64_t Offset() const
+  {
+    return _applied;
+  }
+
+  uint32_t BestRtt() const
+  {
+    return _locked ? _bestRtt : 0;
+  }
+
+  uint64_t ToLeader(uint64_t localUs) const
+  {
+    return localUs + _applied;
+  }
+
+private:
+  int64_t _offset[kSamples];
+  uint32_t _rtt[kSamples];
+  uint32_t _bestRtt = 0;
+  uint8_t _count;
+  uint8_t _next;
+  int64_t _applied;
+  bool _locked;
+};
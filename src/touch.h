@@ -0,0 +1,298 @@
+/**
+ * @file touch.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Capacitive touch pad: interrupt-driven edges, baseline tracking and gesture decoding
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   The touch peripheral measures the pad on its own timer and interrupts when the reading crosses
+ *   the threshold.  The interrupt flips the trigger direction, so it fires once on the press and once
+ *   on the release rather than on every measurement while the pad is held, and the two thresholds
+ *   give the edges some hysteresis.  Edges go with their time to a task on core 0 that decodes them:
+ *
+ *     tap         press and release shorter than TOUCH_LONG_MS; acted on at the release
+ *     double tap  a second press within TOUCH_DOUBLE_MS of a tap's release; acted on at that press
+ *     long press  held for TOUCH_LONG_MS; acted on then, without waiting for the release
+ *
+ *   A tap isn't held back to see whether a second one follows, so the double-tap command has to make
+ *   sense after the tap's; the defaults are "power toggle" and "effect next", which turns the power
+ *   on whatever the tap did.  Gestures go through ApplyCommand() like any serial or BLE command, posted
+ *   to the render loop (see loop_queue.h) rather than run on the touch task, and ask for the next
+ *   frame to be rendered straight away rather than when the frame timer is due.
+ *
+ *   While the pad is untouched the task follows its filtered reading with a slow average, so that
+ *   the thresholds track temperature, humidity and the enclosure rather than being fixed at boot.
+ *
+ *   The latency reported is from the edge that completed a gesture to the first frame shown after
+ *   its command, and leaves out the touch measurement period (TOUCH_SLEEP_CYCLE, about 2 ms).
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial touch input
+ *   0.2 - 10/19/26 - Commands run on the loop
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <driver/touch_pad.h>
+#include "loop_queue.h"
+
+#ifndef ENABLE_TOUCH
+#define ENABLE_TOUCH 1
+#endif
+
+#ifndef TOUCH_PAD
+#define TOUCH_PAD TOUCH_PAD_NUM0 // T0, GPIO 4
+#endif
+#define TOUCH_PRESS_PCT 70      // Press below this percentage of the baseline
+#define TOUCH_RELEASE_PCT 80    // Release above this one
+#define TOUCH_SLEEP_CYCLE 0x100 // 150 kHz cycles between measurements: 1.7 ms
+#define TOUCH_MEAS_CYCLE 0x1000 // 8 MHz cycles per measurement: 0.5 ms
+#define TOUCH_FILTER_MS 10      // Driver IIR filter period, for the baseline reading
+#define TOUCH_BASELINE_MS 500   // Baseline update interval while untouched
+#define TOUCH_BASELINE_SHIFT 3  // Baseline moves 1/8 of the way to the reading each update
+#define TOUCH_DEBOUNCE_MS 20    // Shorter presses are noise
+#define TOUCH_DOUBLE_MS 300
+#define TOUCH_LONG_MS 600
+#define TOUCH_STUCK_MS 10000    // Held this long, the pad is taken to have drifted and recalibrated
+
+#ifndef TOUCH_TAP_COMMAND
+#define TOUCH_TAP_COMMAND "power toggle"
+#endif
+#ifndef TOUCH_DOUBLE_COMMAND
+#define TOUCH_DOUBLE_COMMAND "effect next"
+#endif
+#ifndef TOUCH_LONG_COMMAND
+#define TOUCH_LONG_COMMAND "brightness next"
+#endif
+
+struct TouchEdge
+{
+  uint32_t us;
+  bool down;
+};
+
+static QueueHandle_t g_touchQueue = nullptr;
+static TaskHandle_t g_touchTask = nullptr;
+static portMUX_TYPE g_touchMux = portMUX_INITIALIZER_UNLOCKED;
+static bool g_touchDown = false;             // Edge the interrupt is waiting for is a release
+static uint16_t g_touchBaseline = 0;
+static uint16_t g_touchPressThreshold = 0;
+static uint16_t g_touchReleaseThreshold = 0;
+static void (*g_touchCommand)(const char *) = nullptr;
+
+static volatile bool g_touchRenderNow = false;   // A gesture's frame should be rendered without waiting
+static volatile uint32_t g_touchGestureUs = 0;   // Edge of the gesture whose frame is due
+static bool g_touchFramePending = false;         // Its frame has been rendered but not shown
+static uint32_t g_touchTaps = 0;
+static uint32_t g_touchDoubles = 0;
+static uint32_t g_touchLongs = 0;
+static uint32_t g_touchLatencyUs = 0;
+static uint32_t g_touchLatencyMaxUs = 0;
+
+static void IRAM_ATTR TouchIsr(void *)
+{
+  const uint32_t status = touch_pad_get_status();
+  touch_pad_clear_status();
+  if ((status & (1u << TOUCH_PAD)) == 0)
+  {
+    return;
+  }
+
+  TouchEdge edge = {(uint32_t)esp_timer_get_time(), !g_touchDown};
+  portENTER_CRITICAL_ISR(&g_touchMux);
+  g_touchDown = edge.down;
+  touch_pad_set_thresh(TOUCH_PAD, g_touchDown ? g_touchReleaseThreshold : g_touchPressThreshold);
+  touch_pad_set_trigger_mode(g_touchDown ? TOUCH_TRIGGER_ABOVE : TOUCH_TRIGGER_BELOW);
+  portEXIT_CRITICAL_ISR(&g_touchMux);
+
+  BaseType_t woken = pdFALSE;
+  xQueueSendFromISR(g_touchQueue, &edge, &woken);
+  if (woken)
+  {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Take @p value as the untouched reading (or move towards it) and set the thresholds from it
+static void TouchSetBaseline(uint16_t value, bool follow)
+{
+  int32_t baseline = value;
+  if (follow && g_touchBaseline != 0)
+  {
+    baseline = g_touchBaseline + ((baseline - g_touchBaseline) >> TOUCH_BASELINE_SHIFT);
+  }
+  portENTER_CRITICAL(&g_touchMux);
+  g_touchBaseline = (uint16_t)baseline;
+  g_touchPressThreshold = (uint16_t)(baseline * TOUCH_PRESS_PCT / 100);
+  g_touchReleaseThreshold = (uint16_t)(baseline * TOUCH_RELEASE_PCT / 100);
+  if (!g_touchDown)
+  {
+    touch_pad_set_thresh(TOUCH_PAD, g_touchPressThreshold);
+  }
+  portEXIT_CRITICAL(&g_touchMux);
+}
+
+// The loop's half of a gesture: its command, and then its frame
+static void TouchRunCommand(void *command)
+{
+  g_touchCommand(static_cast<const char *>(command));
+  g_touchRenderNow = true;
+}
+
+static void TouchGesture(const char *command, uint32_t &count, uint32_t edgeUs)
+{
+  count++;
+  g_touchGestureUs = edgeUs;
+  LoopPost(TouchRunCommand, const_cast<char *>(command)); // The commands are literals; nothing to copy
+}
+
+static void TouchTask(void *)
+{
+  TouchEdge edge;
+  bool down = false;
+  bool handled = false; // The current press has already done its gesture
+  uint32_t downUs = 0;
+  uint32_t tapUs = 0;   // Release of the last tap, while a second press would make it a double
+
+  for (;;)
+  {
+    const uint32_t heldMs = down ? ((uint32_t)esp_timer_get_time() - downUs) / 1000 : 0;
+    TickType_t wait = pdMS_TO_TICKS(TOUCH_BASELINE_MS);
+    if (down)
+    {
+      wait = pdMS_TO_TICKS(handled ? TOUCH_STUCK_MS - min<uint32_t>(heldMs, TOUCH_STUCK_MS) + 1
+                                   : TOUCH_LONG_MS - min<uint32_t>(heldMs, TOUCH_LONG_MS) + 1);
+    }
+
+    if (xQueueReceive(g_touchQueue, &edge, wait) != pdTRUE)
+    {
+      uint16_t value = 0;
+      const uint32_t now = (uint32_t)esp_timer_get_time();
+      if (!down)
+      {
+        if (touch_pad_read_filtered(TOUCH_PAD, &value) == ESP_OK && value != 0)
+        {
+          TouchSetBaseline(value, true);
+        }
+      }
+      else if (!handled && now - downUs >= TOUCH_LONG_MS * 1000UL)
+      {
+        handled = true;
+        TouchGesture(TOUCH_LONG_COMMAND, g_touchLongs, now);
+      }
+      else if (now - downUs >= TOUCH_STUCK_MS * 1000UL &&
+               touch_pad_read_filtered(TOUCH_PAD, &value) == ESP_OK && value != 0)
+      {
+        // Nobody holds a pad for ten seconds: what's being read is the new untouched level
+        TouchSetBaseline(value, false);
+        downUs = now;
+      }
+      continue;
+    }
+
+    if (edge.down)
+    {
+      down = true;
+      downUs = edge.us;
+      handled = false;
+      if (tapUs != 0 && edge.us - tapUs < TOUCH_DOUBLE_MS * 1000UL)
+      {
+        handled = true;
+        tapUs = 0;
+        TouchGesture(TOUCH_DOUBLE_COMMAND, g_touchDoubles, edge.us);
+      }
+      continue;
+    }
+
+    down = false;
+    if (handled || edge.us - downUs < TOUCH_DEBOUNCE_MS * 1000UL)
+    {
+      continue;
+    }
+    tapUs = edge.us;
+    TouchGesture(TOUCH_TAP_COMMAND, g_touchTaps, edge.us);
+  }
+}
+
+// TouchBegin
+//
+// Calibrate the pad, hook its interrupt and start the gesture task, which hands each gesture's command
+// to @p command.  Returns false if the touch driver can't be set up.
+
+bool TouchBegin(void (*command)(const char *))
+{
+#if ENABLE_TOUCH
+  g_touchCommand = command;
+  uint16_t value = 0;
+  if (touch_pad_init() != ESP_OK || touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER) != ESP_OK ||
+      touch_pad_set_voltage(TOUCH_HVOLT_2V7, TOUCH_LVOLT_0V5, TOUCH_HVOLT_ATTEN_1V) != ESP_OK ||
+      touch_pad_config(TOUCH_PAD, 0) != ESP_OK || touch_pad_set_meas_time(TOUCH_SLEEP_CYCLE, TOUCH_MEAS_CYCLE) != ESP_OK ||
+      touch_pad_filter_start(TOUCH_FILTER_MS) != ESP_OK)
+  {
+    Serial.println("Touch: driver setup failed.");
+    return false;
+  }
+  delay(TOUCH_FILTER_MS * 4); // Let the filter settle on the untouched reading
+  if (touch_pad_read_filtered(TOUCH_PAD, &value) != ESP_OK || value == 0)
+  {
+    Serial.println("Touch: no reading from the pad.");
+    return false;
+  }
+  TouchSetBaseline(value, false);
+  touch_pad_set_trigger_mode(TOUCH_TRIGGER_BELOW);
+
+  g_touchQueue = xQueueCreate(8, sizeof(TouchEdge));
+  xTaskCreatePinnedToCore(TouchTask, "touch", 3072, nullptr, 3, &g_touchTask, 0);
+  touch_pad_isr_register(TouchIsr, nullptr);
+  touch_pad_intr_enable();
+  Serial.printf("Touch: pad %u, baseline %u\n", TOUCH_PAD, value);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// TouchTakeRender
+//
+// From the frame loop: whether a gesture wants its frame rendered now.  Clears the request.
+
+bool TouchTakeRender()
+{
+  if (!g_touchRenderNow)
+  {
+    return false;
+  }
+  g_touchRenderNow = false;
+  g_touchFramePending = true;
+  return true;
+}
+
+// TouchFrameShown
+//
+// Call when a new frame has gone out; completes the gesture latency measurement.
+
+void TouchFrameShown()
+{
+  if (g_touchFramePending)
+  {
+    g_touchFramePending = false;
+    g_touchLatencyUs = (uint32_t)esp_timer_get_time() - g_touchGestureUs;
+    g_touchLatencyMaxUs = max(g_touchLatencyMaxUs, g_touchLatencyUs);
+  }
+}
+
+// TouchFormat
+//
+// Calibration, gesture counts and latency, as one line.
+
+void TouchFormat(char *line, size_t size)
+{
+  uint16_t value = 0;
+  touch_pad_read_filtered(TOUCH_PAD, &value);
+  snprintf(line, size, "touch pad=%u value=%u baseline=%u press=%u release=%u down=%u taps=%lu doubles=%lu longs=%lu latencyUs=%lu latencyMaxUs=%lu",
+           TOUCH_PAD, value, g_touchBaseline, g_touchPressThreshold, g_touchReleaseThreshold, g_touchDown,
+           (unsigned long)g_touchTaps, (unsigned long)g_touchDoubles, (unsigned long)g_touchLongs,
+           (unsigned long)g_touchLatencyUs, (unsigned long)g_touchLatencyMaxUs);
+}
@@ -0,0 +1,325 @@
+/**
+ * @file trace.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Fixed-size, lock-free trace ring exportable as Chrome trace-event JSON
+ * @version 0.4
+ * @date 10/19/26
+ *
+ *   Every slot is claimed with a single atomic increment, so recording is safe from either core
+ *   (and from the BLE/WiFi tasks) without taking a lock.  The newest TRACE_RING_SIZE events are
+ *   kept; older ones are overwritten.  Load the dump into https://ui.perfetto.dev to view it.
+ *
+ *   Each event carries the task that recorded it, and every task gets a track of its own in the
+ *   viewer under its FreeRTOS name.  Tasks that aren't pinned move between cores, so a track per core
+ *   would have interleaved their scopes.  A task keeps its track for good, even once deleted, since the
+ *   ring may still hold its events; events from tasks beyond TRACE_MAX_TASKS are counted and the count
+ *   is reported in the dump's otherData.droppedEvents, so a missing track doesn't pass for idleness.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial ring and JSON export
+ *   0.2 - 10/19/26 - A track per task rather than per core; slots published with a release store
+ *   0.3 - 10/19/26 - Open scope kept per task for alloc_stats.h
+ *   0.4 - 10/19/26 - Events dropped for want of a track are counted and reported
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE 1
+#endif
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024 // Must be a power of two; 8 bytes per event
+#endif
+
+#ifndef TRACE_MAX_TASKS
+#define TRACE_MAX_TASKS 16 // Tasks that get a track; events from any beyond that are dropped and counted
+#endif
+
+#ifndef ALLOC_TRACE
+#define ALLOC_TRACE 0 // Attribute heap allocations to the open TraceScope; see alloc_stats.h
+#endif
+
+// FreeRTOS thread-local storage slot for the open TraceScope.  ESP-IDF keeps slot 0 for its pthread
+// keys, and the Arduino SDK is built with only that one, so by default there is none to use and the
+// scope is kept in the task's g_traceTasks entry instead.
+#ifndef TRACE_TLS_INDEX
+#define TRACE_TLS_INDEX (configNUM_THREAD_LOCAL_STORAGE_POINTERS - 1)
+#endif
+#define TRACE_SCOPE_TLS (TRACE_TLS_INDEX > 0)
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+enum TraceId : uint8_t
+{
+  TRACE_RENDER = 0,
+  TRACE_SHOW,
+  TRACE_OLED,
+  TRACE_HTTP,
+  TRACE_BLE,
+  TRACE_OTA,
+  TRACE_AUDIO,
+  TRACE_FSEQ,
+  TRACE_COUNT
+};
+
+struct TraceEvent
+{
+  uint32_t timestamp; // micros() at the time of the event
+  uint8_t id;         // TraceId
+  char phase;         // 'B'egin or 'E'nd, as in the Chrome trace format
+  uint8_t task;       // Index into g_traceTasks of the task that recorded it
+  uint8_t valid;      // Set, with release ordering, once the other fields are written
+};
+
+// A task that has recorded an event, in the order they first did
+struct TraceTask
+{
+  std::atomic<void *> handle;
+  char name[configMAX_TASK_NAME_LEN];
+  std::atomic<bool> named; // name is filled in
+#if ALLOC_TRACE && !TRACE_SCOPE_TLS
+  volatile uint8_t openScope; // Innermost TraceScope open on the task, plus one; 0 for none
+#endif
+};
+
+static TraceEvent g_traceRing[TRACE_RING_SIZE];
+static std::atomic<uint32_t> g_traceHead(0);
+static volatile bool g_traceEnabled = ENABLE_TRACE;
+static TraceTask g_traceTasks[TRACE_MAX_TASKS];
+static std::atomic<uint32_t> g_traceDropped(0); // Events not recorded because their task had no track
+
+const char *TraceName(uint8_t id)
+{
+  switch (id)
+  {
+  case TRACE_RENDER:
+    return "render";
+  case TRACE_SHOW:
+    return "show";
+  case TRACE_OLED:
+    return "oled";
+  case TRACE_HTTP:
+    return "http";
+  case TRACE_BLE:
+    return "ble";
+  case TRACE_OTA:
+    return "ota";
+  case TRACE_AUDIO:
+    return "audio";
+  case TRACE_FSEQ:
+    return "fseq";
+  default:
+    return "unknown";
+  }
+}
+
+// TraceTaskIndex
+//
+// The calling task's slot in g_traceTasks, claiming the first free one the first time it records
+// (unless @p claim is false).  TRACE_MAX_TASKS when it has none.
+
+static uint8_t TraceTaskIndex(bool claim = true)
+{
+  void *const self = xTaskGetCurrentTaskHandle();
+  for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++)
+  {
+    TraceTask &task = g_traceTasks[i];
+    void *handle = task.handle.load(std::memory_order_acquire);
+    if (handle == self)
+    {
+      return i;
+    }
+    if (!claim && handle == nullptr)
+    {
+      break; // Slots are claimed in order, so it isn't further on
+    }
+    if (handle == nullptr && task.handle.compare_exchange_strong(handle, self, std::memory_order_acq_rel))
+    {
+      strncpy(task.name, pcTaskGetName(nullptr), sizeof(task.name) - 1);
+      task.named.store(true, std::memory_order_release);
+      return i;
+    }
+    // Another task took it first; carry on looking
+  }
+  return TRACE_MAX_TASKS;
+}
+
+static inline void TraceRecord(TraceId id, char phase)
+{
+#if ENABLE_TRACE
+  if (!g_traceEnabled)
+  {
+    return;
+  }
+  const uint8_t task = TraceTaskIndex();
+  if (task >= TRACE_MAX_TASKS)
+  {
+    g_traceDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const uint32_t slot = g_traceHead.fetch_add(1, std::memory_order_relaxed) & (TRACE_RING_SIZE - 1);
+  TraceEvent &event = g_traceRing[slot];
+  __atomic_store_n(&event.valid, 0, __ATOMIC_RELAXED);
+  event.timestamp = micros();
+  event.id = id;
+  event.phase = phase;
+  event.task = task;
+  // The dump may run on the other core: it must not see valid before the fields it vouches for
+  __atomic_store_n(&event.valid, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+#if ALLOC_TRACE
+// TraceOpenScope
+//
+// The innermost TraceScope open on the calling task, for alloc_stats.h to charge allocations to;
+// TRACE_COUNT when there is none.
+
+static inline uint8_t TraceOpenScope()
+{
+#if TRACE_SCOPE_TLS
+  const uintptr_t open = (uintptr_t)pvTaskGetThreadLocalStoragePointer(nullptr, TRACE_TLS_INDEX);
+#else
+  const uint8_t task = TraceTaskIndex(false);
+  const uint8_t open = task < TRACE_MAX_TASKS ? g_traceTasks[task].openScope : 0;
+#endif
+  return open == 0 ? TRACE_COUNT : (uint8_t)(open - 1);
+}
+
+// Make @p scope (TRACE_COUNT for none) the calling task's innermost one
+static inline void TraceSetOpenScope(uint8_t scope)
+{
+  const uint8_t open = scope < TRACE_COUNT ? scope + 1 : 0;
+#if TRACE_SCOPE_TLS
+  vTaskSetThreadLocalStoragePointer(nullptr, TRACE_TLS_INDEX, (void *)(uintptr_t)open);
+#else
+  const uint8_t task = TraceTaskIndex();
+  if (task < TRACE_MAX_TASKS)
+  {
+    g_traceTasks[task].openScope = open;
+  }
+#endif
+}
+#endif
+
+static inline void TraceBegin(TraceId id)
+{
+  TraceRecord(id, 'B');
+}
+
+static inline void TraceEnd(TraceId id)
+{
+  TraceRecord(id, 'E');
+}
+
+// TraceScope
+//
+// Records a begin event on construction and the matching end event when it goes out of scope.
+
+class TraceScope
+{
+public:
+  explicit TraceScope(TraceId id) : _id(id)
+  {
+    TraceBegin(_id);
+#if ALLOC_TRACE
+    _outer = TraceOpenScope();
+    TraceSetOpenScope(_id);
+#endif
+  }
+
+  ~TraceScope()
+  {
+#if ALLOC_TRACE
+    TraceSetOpenScope(_outer);
+#endif
+    TraceEnd(_id);
+  }
+
+private:
+  TraceId _id;
+#if ALLOC_TRACE
+  uint8_t _outer;
+#endif
+};
+
+void TraceClear()
+{
+  const bool wasEnabled = g_traceEnabled;
+  g_traceEnabled = false;
+  memset(g_traceRing, 0, sizeof(g_traceRing));
+  g_traceHead.store(0);
+  g_traceDropped.store(0);
+  g_traceEnabled = wasEnabled;
+}
+
+/**
+ * @brief Write the ring, oldest event first, as a Chrome trace-event JSON document.
+ *
+ * Recording is paused for the duration of the dump so that slots are not overwritten while they
+ * are being read.  End events whose begin has already been overwritten are dropped, and timestamps
+ * are rebased to the oldest event so that micros() wrapping does not confuse the viewer.  Events
+ * dropped since the last clear because every track was taken go in otherData.droppedEvents.
+ *
+ * @param out Where to write the JSON (Serial, or a chunked HTTP response)
+ */
+void TraceDumpJson(Print &out)
+{
+  const bool wasEnabled = g_traceEnabled;
+  g_traceEnabled = false;
+
+  const uint32_t head = g_traceHead.load();
+  const uint32_t count = min<uint32_t>(head, TRACE_RING_SIZE);
+  const uint32_t first = head - count;
+  uint8_t openDepth[TRACE_COUNT][TRACE_MAX_TASKS] = {{0}};
+  bool firstEvent = true;
+  uint32_t base = 0;
+
+  out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  out.print("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"firmware\"}}");
+  for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++)
+  {
+    if (g_traceTasks[i].named.load(std::memory_order_acquire))
+    {
+      out.printf(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 i, g_traceTasks[i].name);
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const TraceEvent &event = g_traceRing[(first + i) & (TRACE_RING_SIZE - 1)];
+    if (!__atomic_load_n(&event.valid, __ATOMIC_ACQUIRE) || event.id >= TRACE_COUNT || event.task >= TRACE_MAX_TASKS)
+    {
+      continue;
+    }
+    if (firstEvent)
+    {
+      base = event.timestamp;
+      firstEvent = false;
+    }
+    uint8_t &depth = openDepth[event.id][event.task];
+    if (event.phase == 'E')
+    {
+      if (depth == 0)
+      {
+        continue;
+      }
+      depth--;
+    }
+    else if (depth < 255)
+    {
+      depth++;
+    }
+    out.printf(",{\"name\":\"%s\",\"cat\":\"fw\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":1,\"tid\":%u}",
+               TraceName(event.id), event.phase, (unsigned long)(event.timestamp - base), event.task);
+  }
+  out.printf("],\"otherData\":{\"droppedEvents\":%lu}}\n", (unsigned long)g_traceDropped.load());
+
+  g_traceEnabled = wasEnabled;
+}
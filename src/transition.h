@@ -0,0 +1,129 @@
+/**
+ * @file transition.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Blend kernels used to transition from one effect's frame to the next
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   RenderEffect() draws the outgoing and incoming effects into their own buffers and hands both to
+ *   TransitionBlend() along with how far along the transition is.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Fade, wipe and dissolve
+ *   0.2 - 10/19/26 - ParseTransition() rejects unknown names
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#define FASTLED_INTERNAL
+#include <FastLED.h>
+
+enum TransitionStyle : uint8_t
+{
+  TRANSITION_NONE = 0,
+  TRANSITION_FADE = 1,
+  TRANSITION_WIPE = 2,
+  TRANSITION_DISSOLVE = 3,
+  TRANSITION_COUNT
+};
+
+const uint8_t kWipeEdge = 16; // Width in pixels of the soft edge on the wipe
+
+const char *TransitionName(uint8_t style)
+{
+  switch (style)
+  {
+  case TRANSITION_FADE:
+    return "fade";
+  case TRANSITION_WIPE:
+    return "wipe";
+  case TRANSITION_DISSOLVE:
+    return "dissolve";
+  case TRANSITION_NONE:
+  default:
+    return "none";
+  }
+}
+
+// ParseTransition
+//
+// Read a transition by name, or by number.  False, leaving @p style alone, for anything else.
+
+bool ParseTransition(const char *name, TransitionStyle &style)
+{
+  for (uint8_t s = 0; s < TRANSITION_COUNT; s++)
+  {
+    if (strcmp(name, TransitionName(s)) == 0)
+    {
+      style = static_cast<TransitionStyle>(s);
+      return true;
+    }
+  }
+  char *end = nullptr;
+  const long number = strtol(name, &end, 10);
+  if (end == name || *end != '\0' || number < 0 || number >= TRANSITION_COUNT)
+  {
+    return false;
+  }
+  style = static_cast<TransitionStyle>(number);
+  return true;
+}
+
+// Fixed per-pixel threshold for the dissolve, so pixels flip in a scattered but stable order
+static inline uint8_t DissolveThreshold(uint16_t i)
+{
+  return (uint8_t)(((uint32_t)i * 2654435761u) >> 24);
+}
+
+/**
+ * @brief Combine the outgoing and incoming frames into @p out.
+ *
+ * @param out Destination frame; may not alias either input
+ * @param from Outgoing effect's frame
+ * @param to Incoming effect's frame
+ * @param count Number of pixels
+ * @param progress 0 shows only @p from, 255 shows only @p to
+ * @param style One of TransitionStyle
+ */
+void TransitionBlend(CRGB *out, const CRGB *from, const CRGB *to, uint16_t count, uint8_t progress, uint8_t style)
+{
+  switch (style)
+  {
+  case TRANSITION_WIPE:
+  {
+    // The edge travels from -kWipeEdge to count so both ends finish fully on one frame or the other
+    const int32_t edge = ((int32_t)(count + kWipeEdge) * progress) / 255 - kWipeEdge;
+    for (uint16_t i = 0; i < count; i++)
+    {
+      const int32_t depth = edge + kWipeEdge - i;
+      if (depth <= 0)
+      {
+        out[i] = from[i];
+      }
+      else if (depth >= kWipeEdge)
+      {
+        out[i] = to[i];
+      }
+      else
+      {
+        out[i] = blend(from[i], to[i], (uint8_t)(depth * 255 / kWipeEdge));
+      }
+    }
+    break;
+  }
+  case TRANSITION_DISSOLVE:
+    for (uint16_t i = 0; i < count; i++)
+    {
+      // Each pixel cross-fades quickly (over 1/8th of the transition) once progress passes its threshold
+      const int16_t over = (int16_t)(((uint16_t)progress * 288) / 255) - DissolveThreshold(i);
+      out[i] = over <= 0 ? from[i] : blend(from[i], to[i], (uint8_t)min<int16_t>(255, over * 8));
+    }
+    break;
+  case TRANSITION_FADE:
+  default:
+    blend(from, to, out, count, progress);
+    break;
+  }
+}
@@ -0,0 +1,154 @@
+/**
+ * @file web_assets.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Serves the gzipped, fingerprinted web UI built by scripts/build_web.py
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   The manifest the build writes next to the assets is read once at boot, so every asset's ETag is
+ *   in RAM.  A browser revalidating gets its 304 without SPIFFS being touched, and the fingerprinted
+ *   CSS and JS are marked immutable so it doesn't even ask for those.  Anything that does need sending
+ *   goes out gzipped, a third or less of the source.
+ *
+ *   A filesystem image from before the manifest existed still works: "/" falls back to streaming
+ *   /index.html as it always did.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial manifest-driven asset serving
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <SPIFFS.h>
+#include "trace.h"
+
+#define WEB_MANIFEST_PATH "/web.manifest"
+
+const uint8_t kWebMaxAssets = 8;
+
+struct WebAsset
+{
+  char url[32];
+  char path[32];
+  char etag[16]; // Quoted, as sent
+  char type[28];
+  uint32_t maxAge;
+};
+
+static WebServer *g_webServer = nullptr;
+static WebAsset g_webAssets[kWebMaxAssets];
+static uint8_t g_webAssetCount = 0;
+static uint32_t g_webSent = 0;        // Responses with a body
+static uint32_t g_webNotModified = 0; // 304s
+static uint32_t g_webBytes = 0;       // Body bytes sent
+static uint32_t g_webServeUs = 0;     // Longest time spent serving one asset
+
+// WebAssetsLoad
+//
+// Read the manifest.  Returns the number of assets found.
+
+uint8_t WebAssetsLoad()
+{
+  g_webAssetCount = 0;
+  File file = SPIFFS.open(WEB_MANIFEST_PATH, FILE_READ);
+  if (!file)
+  {
+    return 0;
+  }
+  char line[128];
+  while (g_webAssetCount < kWebMaxAssets && file.available())
+  {
+    const size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+    WebAsset &asset = g_webAssets[g_webAssetCount];
+    char etag[sizeof(asset.etag) - 2];
+    unsigned long maxAge = 0;
+    if (sscanf(line, "%31s %31s %13s %27s %lu", asset.url, asset.path, etag, asset.type, &maxAge) == 5)
+    {
+      snprintf(asset.etag, sizeof(asset.etag), "\"%s\"", etag);
+      asset.maxAge = maxAge;
+      g_webAssetCount++;
+    }
+  }
+  file.close();
+  return g_webAssetCount;
+}
+
+static void WebSendCaching(const WebAsset &asset)
+{
+  g_webServer->sendHeader("ETag", asset.etag);
+  if (asset.maxAge != 0)
+  {
+    g_webServer->sendHeader("Cache-Control", String("public, max-age=") + asset.maxAge + ", immutable");
+  }
+  else
+  {
+    g_webServer->sendHeader("Cache-Control", "no-cache"); // Revalidate every time; the ETag makes that cheap
+  }
+}
+
+static void WebServeAsset(const WebAsset &asset)
+{
+  TraceScope trace(TRACE_HTTP);
+  const uint32_t start = micros();
+  if (g_webServer->header("If-None-Match") == asset.etag)
+  {
+    WebSendCaching(asset);
+    g_webServer->send(304);
+    g_webNotModified++;
+    return;
+  }
+
+  File file = SPIFFS.open(asset.path, FILE_READ);
+  if (!file)
+  {
+    g_webServer->send(500, "text/plain", "Asset missing; upload the filesystem image again.");
+    return;
+  }
+  WebSendCaching(asset);
+  g_webBytes += g_webServer->streamFile(file, asset.type); // Adds Content-Encoding: gzip for the .gz name
+  file.close();
+  g_webSent++;
+  g_webServeUs = max<uint32_t>(g_webServeUs, micros() - start);
+}
+
+// WebAssetsBegin
+//
+// Register a handler per asset, and the uncompressed fallback for "/" if there is no manifest.  Call
+// before @p server is begun.
+
+void WebAssetsBegin(WebServer &server)
+{
+  g_webServer = &server;
+  static const char *kHeaders[] = {"If-None-Match"};
+  server.collectHeaders(kHeaders, 1);
+
+  if (WebAssetsLoad() == 0)
+  {
+    Serial.println("No " WEB_MANIFEST_PATH "; serving /index.html uncompressed.");
+    server.on("/", []()
+              {
+                TraceScope trace(TRACE_HTTP);
+                File file = SPIFFS.open("/index.html", FILE_READ);
+                if (!file)
+                {
+                  g_webServer->send(500, "text/plain", "index.html missing.");
+                  return;
+                }
+                g_webServer->streamFile(file, "text/html");
+                file.close();
+              });
+    return;
+  }
+
+  for (uint8_t a = 0; a < g_webAssetCount; a++)
+  {
+    const WebAsset *asset = &g_webAssets[a];
+    server.on(asset->url, HTTP_GET, [asset]()
+              { WebServeAsset(*asset); });
+  }
+  Serial.printf("Web UI: %u gzipped assets\n", g_webAssetCount);
+}
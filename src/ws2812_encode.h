@@ -0,0 +1,98 @@
+/**
+ * @file ws2812_encode.h
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Encode pixels into a WS2812 waveform for a 2.4 MHz SPI (or any DMA-fed shift register)
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   Each WS2812 data bit becomes three line bits of 416.7 ns:
+ *
+ *     0 -> 1 0 0   417 ns high, 833 ns low   (datasheet T0H 400 +-150 ns, T0L 850 +-150 ns)
+ *     1 -> 1 1 0   833 ns high, 417 ns low   (datasheet T1H 800 +-150 ns, T1L 450 +-150 ns)
+ *
+ *   so one 8-bit channel is exactly three bytes and a pixel is nine, sent MSB first in G, R, B order.
+ *   The frame ends with WS2812_RESET_BYTES of zeros to latch it.
+ *
+ *   Deliberately free of Arduino and FastLED so it can be compiled and checked on the host:
+ *   test/test_ws2812_encode rebuilds every byte from the datasheet timings and compares.
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial encoder
+ *   0.2 - 10/19/26 - Checked against the datasheet timings by a host test
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WS2812_SPI_HZ 2400000UL   // Line bit rate; three line bits per data bit
+#define WS2812_BYTES_PER_PIXEL 9  // 24 data bits * 3 line bits / 8
+#define WS2812_RESET_BYTES 90     // 300 us low, enough for the newer 280 us reset parts
+
+static uint8_t g_ws2812Lut[256][3]; // Channel value to its three line bytes
+
+static inline size_t Ws2812EncodedSize(uint16_t pixels)
+{
+  return (size_t)pixels * WS2812_BYTES_PER_PIXEL + WS2812_RESET_BYTES;
+}
+
+// Ws2812LineBits
+//
+// The line pattern for one channel value, built bit by bit from the table above: 24 significant bits,
+// first line bit in bit 23.
+
+static inline uint32_t Ws2812LineBits(uint8_t value)
+{
+  uint32_t bits = 0;
+  for (int bit = 7; bit >= 0; bit--)
+  {
+    bits = (bits << 3) | (((value >> bit) & 1) ? 0x6 : 0x4);
+  }
+  return bits;
+}
+
+void Ws2812BuildLut()
+{
+  for (int value = 0; value < 256; value++)
+  {
+    const uint32_t bits = Ws2812LineBits((uint8_t)value);
+    g_ws2812Lut[value][0] = (uint8_t)(bits >> 16);
+    g_ws2812Lut[value][1] = (uint8_t)(bits >> 8);
+    g_ws2812Lut[value][2] = (uint8_t)bits;
+  }
+}
+
+// Ws2812EncodePixel
+//
+// Write one pixel's nine line bytes.  Values are in strip order (G, R, B for WS2812B).
+
+static inline uint8_t *Ws2812EncodePixel(uint8_t *out, uint8_t first, uint8_t second, uint8_t third)
+{
+  const uint8_t *a = g_ws2812Lut[first];
+  const uint8_t *b = g_ws2812Lut[second];
+  const uint8_t *c = g_ws2812Lut[third];
+  out[0] = a[0];
+  out[1] = a[1];
+  out[2] = a[2];
+  out[3] = b[0];
+  out[4] = b[1];
+  out[5] = b[2];
+  out[6] = c[0];
+  out[7] = c[1];
+  out[8] = c[2];
+  return out + WS2812_BYTES_PER_PIXEL;
+}
+
+// Ws2812EncodeReset
+//
+// Write the latch gap that ends a frame.
+
+static inline void Ws2812EncodeReset(uint8_t *out)
+{
+  for (int i = 0; i < WS2812_RESET_BYTES; i++)
+  {
+    out[i] = 0;
+  }
+}
@@ -0,0 +1,306 @@
+/**
+ * @file test_main.cpp
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Host harness for audio_dsp.h: read a WAV, push it through the analyzer, print the beats
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   With no arguments, writes click tracks at known tempos (a decaying 55 Hz kick on every beat, hats
+ *   on the off-beats and a bed of noise) to WAV files, reads them back and checks that every kick and
+ *   nothing else is reported, each within a hop of where it is, and that the tempo from the beats is
+ *   the one it was written at.
+ *
+ *   A real recording can be checked the same way; 16-bit PCM, mono or stereo, any rate:
+ *
+ *     AUDIO_WAV=song.wav AUDIO_BPM=124 pio test -e native -f test_audio_beats -v
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial harness
+ *
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "audio_dsp.h"
+
+struct Wav
+{
+  uint32_t sampleRate;
+  std::vector<int16_t> samples; // Mono
+};
+
+static void PutLe(FILE *file, uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    fputc((value >> (8 * i)) & 0xFF, file);
+  }
+}
+
+static uint32_t GetLe(const uint8_t *data, int bytes)
+{
+  uint32_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+  {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+static bool WriteWav(const char *path, const Wav &wav)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr)
+  {
+    return false;
+  }
+  const uint32_t dataBytes = (uint32_t)wav.samples.size() * 2;
+  fwrite("RIFF", 1, 4, file);
+  PutLe(file, 36 + dataBytes, 4);
+  fwrite("WAVEfmt ", 1, 8, file);
+  PutLe(file, 16, 4);
+  PutLe(file, 1, 2); // PCM
+  PutLe(file, 1, 2); // Mono
+  PutLe(file, wav.sampleRate, 4);
+  PutLe(file, wav.sampleRate * 2, 4);
+  PutLe(file, 2, 2);
+  PutLe(file, 16, 2);
+  fwrite("data", 1, 4, file);
+  PutLe(file, dataBytes, 4);
+  for (int16_t sample : wav.samples)
+  {
+    PutLe(file, (uint16_t)sample, 2);
+  }
+  fclose(file);
+  return true;
+}
+
+// ReadWav
+//
+// 16-bit PCM only; stereo and up are mixed down to mono.  Unknown chunks are skipped.
+
+static bool ReadWav(const char *path, Wav &wav)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr)
+  {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t got;
+  while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + got);
+  }
+  fclose(file);
+  if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0)
+  {
+    return false;
+  }
+
+  uint16_t channels = 0, bits = 0;
+  wav.sampleRate = 0;
+  wav.samples.clear();
+  for (size_t at = 12; at + 8 <= data.size();)
+  {
+    const uint32_t size = GetLe(&data[at + 4], 4);
+    const size_t body = at + 8;
+    if (body + size > data.size())
+    {
+      break;
+    }
+    if (memcmp(&data[at], "fmt ", 4) == 0 && size >= 16)
+    {
+      if (GetLe(&data[body], 2) != 1)
+      {
+        return false; // Not PCM
+      }
+      channels = (uint16_t)GetLe(&data[body + 2], 2);
+      wav.sampleRate = GetLe(&data[body + 4], 4);
+      bits = (uint16_t)GetLe(&data[body + 14], 2);
+    }
+    else if (memcmp(&data[at], "data", 4) == 0 && channels != 0 && bits == 16)
+    {
+      for (size_t frame = body; frame + 2 * channels <= body + size; frame += 2 * channels)
+      {
+        int32_t sum = 0;
+        for (uint16_t channel = 0; channel < channels; channel++)
+        {
+          sum += (int16_t)GetLe(&data[frame + 2 * channel], 2);
+        }
+        wav.samples.push_back((int16_t)(sum / channels));
+      }
+    }
+    at = body + size + (size & 1);
+  }
+  return wav.sampleRate != 0 && !wav.samples.empty();
+}
+
+// The analyzer's beats, in seconds from the start
+static std::vector<double> DetectBeats(const Wav &wav)
+{
+  static AudioAnalyzer analyzer; // Too big for the stack of some test runners
+  analyzer.Begin(wav.sampleRate);
+  std::vector<double> beats;
+  uint32_t lastCount = 0;
+  for (size_t at = 0; at + AUDIO_HOP <= wav.samples.size(); at += AUDIO_HOP)
+  {
+    analyzer.Push(&wav.samples[at], AUDIO_HOP);
+    if (analyzer.Features().beatCount != lastCount)
+    {
+      lastCount = analyzer.Features().beatCount;
+      beats.push_back((double)(at + AUDIO_HOP) / wav.sampleRate);
+    }
+  }
+  return beats;
+}
+
+// Tempo from the median gap between beats
+static double TempoBpm(const std::vector<double> &beats)
+{
+  if (beats.size() < 2)
+  {
+    return 0;
+  }
+  std::vector<double> gaps;
+  for (size_t i = 1; i < beats.size(); i++)
+  {
+    gaps.push_back(beats[i] - beats[i - 1]);
+  }
+  std::nth_element(gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end());
+  return 60.0 / gaps[gaps.size() / 2];
+}
+
+static void PrintBeats(const char *name, const std::vector<double> &beats, double bpm)
+{
+  printf("%s: %u beats, %.1f BPM detected against %.1f known\n", name, (unsigned)beats.size(), TempoBpm(beats), bpm);
+  for (size_t i = 0; i < beats.size(); i++)
+  {
+    printf("%8.3f s%s", beats[i], (i % 8 == 7 || i + 1 == beats.size()) ? "\n" : "");
+  }
+}
+
+static Wav ClickTrack(double bpm, double seconds, uint32_t sampleRate)
+{
+  Wav wav;
+  wav.sampleRate = sampleRate;
+  wav.samples.resize((size_t)(seconds * sampleRate));
+  const double beat = 60.0 / bpm;
+  uint32_t random = 0xC0FFEE;
+  for (size_t i = 0; i < wav.samples.size(); i++)
+  {
+    const double t = (double)i / sampleRate;
+    const double sinceKick = fmod(t, beat);
+    const double sinceHat = fmod(t + beat / 2, beat);
+    random = random * 1664525u + 1013904223u;
+    const double noise = ((int32_t)(random >> 8) - (1 << 23)) / (double)(1 << 23);
+
+    double x = 0.05 * noise;
+    x += 0.8 * exp(-sinceKick * 18) * sin(2 * M_PI * 55 * sinceKick);
+    x += 0.2 * exp(-sinceHat * 60) * noise;
+    wav.samples[i] = (int16_t)(x * 32767 * 0.9);
+  }
+  return wav;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void CheckClickTrack(double bpm)
+{
+  const double seconds = 30;
+  const Wav written = ClickTrack(bpm, seconds, AUDIO_SAMPLE_RATE);
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/audio_beats_%d.wav", (int)bpm);
+  TEST_ASSERT_TRUE(WriteWav(path, written));
+  Wav wav;
+  TEST_ASSERT_TRUE(ReadWav(path, wav));
+  remove(path);
+  TEST_ASSERT_EQUAL_UINT32(written.samples.size(), wav.samples.size());
+
+  const std::vector<double> beats = DetectBeats(wav);
+  snprintf(path, sizeof(path), "click track %d BPM", (int)bpm);
+  PrintBeats(path, beats, bpm);
+
+  // Every kick after the first second (the automatic gain and bass average settling), and no others
+  const double beat = 60.0 / bpm;
+  const double hop = (double)AUDIO_HOP / AUDIO_SAMPLE_RATE;
+  size_t matched = 0, expected = 0;
+  for (double kick = beat * ceil(1.0 / beat); kick + 2 * hop < seconds; kick += beat)
+  {
+    expected++;
+    for (double at : beats)
+    {
+      if (at >= kick && at <= kick + 2 * hop)
+      {
+        matched++;
+        break;
+      }
+    }
+  }
+  size_t extra = 0;
+  for (double at : beats)
+  {
+    const double phase = fmod(at, beat);
+    if (at >= 1.0 && phase > 2 * hop)
+    {
+      extra++;
+    }
+  }
+  printf("  %u of %u kicks found, %u beats between them\n", (unsigned)matched, (unsigned)expected, (unsigned)extra);
+  TEST_ASSERT_EQUAL_UINT32(expected, matched);
+  TEST_ASSERT_EQUAL_UINT32(0, extra);
+  TEST_ASSERT_FLOAT_WITHIN(2.0, bpm, TempoBpm(beats));
+}
+
+void test_click_track_100_bpm()
+{
+  CheckClickTrack(100);
+}
+
+void test_click_track_128_bpm()
+{
+  CheckClickTrack(128);
+}
+
+void test_click_track_174_bpm()
+{
+  CheckClickTrack(174);
+}
+
+void test_recording()
+{
+  const char *path = getenv("AUDIO_WAV");
+  if (path == nullptr)
+  {
+    TEST_IGNORE_MESSAGE("Set AUDIO_WAV (and AUDIO_BPM) to check a recording");
+  }
+  Wav wav;
+  TEST_ASSERT_TRUE_MESSAGE(ReadWav(path, wav), "not a 16-bit PCM WAV");
+  const char *bpm = getenv("AUDIO_BPM");
+  const std::vector<double> beats = DetectBeats(wav);
+  PrintBeats(path, beats, bpm != nullptr ? atof(bpm) : 0);
+  if (bpm != nullptr)
+  {
+    TEST_ASSERT_FLOAT_WITHIN(3.0, atof(bpm), TempoBpm(beats));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_click_track_100_bpm);
+  RUN_TEST(test_click_track_128_bpm);
+  RUN_TEST(test_click_track_174_bpm);
+  RUN_TEST(test_recording);
+  return UNITY_END();
+}
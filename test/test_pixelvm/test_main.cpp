@@ -0,0 +1,242 @@
+/**
+ * @file test_main.cpp
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Host test and benchmark of pixelvm.h against the same effects written natively
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   Each program here has a hand-written C++ twin doing the same Q16.16 arithmetic in the same order,
+ *   as a built-in effect would.  The two have to agree on every byte of a 442-pixel frame, and then both
+ *   are timed over many frames: the VM's cost per frame, and how many times the native version's it is.
+ *   The figures are the host's; the "program" command reports the interpreter's cost on the ESP32.
+ *
+ *   The compiler's limits are checked too: nesting past kPixelVmMaxDepth is an error, not a stack
+ *   overflow, however long the source.
+ *
+ *     pio test -e native -f test_pixelvm -v
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial test and benchmark
+ *
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include "pixelvm.h"
+
+const uint16_t kPixels = 442;
+const int kBenchFrames = 20000;
+
+typedef void (*NativeEffect)(const PixelVmFrame &frame, uint8_t *out, uint16_t count);
+
+static inline int32_t Mul(int32_t a, int32_t b)
+{
+  return (int32_t)(((int64_t)a * b) >> 16);
+}
+
+static inline int32_t Wave(int32_t a)
+{
+  return (PixelVmSin(a) + kPixelVmOne) >> 1;
+}
+
+static inline int32_t Tri(int32_t a)
+{
+  const int32_t f = a & (kPixelVmOne - 1);
+  return f < kPixelVmOne / 2 ? f * 2 : (kPixelVmOne - f) * 2;
+}
+
+static inline uint8_t Unit(int32_t value)
+{
+  return value <= 0 ? 0 : (value >= kPixelVmOne ? 255 : (uint8_t)(value >> 8));
+}
+
+static inline int32_t PixelX(uint16_t p, uint16_t total)
+{
+  const uint32_t xStep = (uint32_t)(((uint64_t)kPixelVmOne << 8) / total);
+  return (int32_t)((p * xStep) >> 8);
+}
+
+// The user program effect's default: a scrolling rainbow under a travelling wave
+const char *const kRainbowSource = "h = x * count + t * speed / 4\nv = wave(x * 3 - t * speed)";
+
+static void NativeRainbow(const PixelVmFrame &frame, uint8_t *out, uint16_t count)
+{
+  const int32_t drift = (int32_t)(((int64_t)Mul(frame.t, frame.speed) << 16) / (4 * kPixelVmOne));
+  const int32_t phase = Mul(frame.t, frame.speed);
+  for (uint16_t p = 0; p < count; p++)
+  {
+    const int32_t x = PixelX(p, count);
+    out[0] = (uint8_t)((Mul(x, frame.count) + drift) >> 8);
+    out[1] = 255;
+    out[2] = Unit(Wave(Mul(x, 3 * kPixelVmOne) - phase));
+    out += 3;
+  }
+}
+
+// Three waves at different rates, one per channel
+const char *const kPlasmaSource = "r = wave(x * 2 + t)\ng = wave(x * 3 - t * 0.5)\nb = tri(x + t * 0.25)";
+
+static void NativePlasma(const PixelVmFrame &frame, uint8_t *out, uint16_t count)
+{
+  const int32_t half = Mul(frame.t, kPixelVmOne / 2);
+  const int32_t quarter = Mul(frame.t, kPixelVmOne / 4);
+  for (uint16_t p = 0; p < count; p++)
+  {
+    const int32_t x = PixelX(p, count);
+    out[0] = Unit(Wave(Mul(x, 2 * kPixelVmOne) + frame.t));
+    out[1] = Unit(Wave(Mul(x, 3 * kPixelVmOne) - half));
+    out[2] = Unit(Tri(x + quarter));
+    out += 3;
+  }
+}
+
+// A VU bar from the middle, coloured by the bass
+const char *const kMeterSource = "h = x + bass\nv = clamp(level * 2 - abs(x - 0.5), 0, 1)";
+
+static void NativeMeter(const PixelVmFrame &frame, uint8_t *out, uint16_t count)
+{
+  const int32_t reach = Mul(frame.level, 2 * kPixelVmOne);
+  for (uint16_t p = 0; p < count; p++)
+  {
+    const int32_t x = PixelX(p, count);
+    const int32_t from = x - kPixelVmOne / 2;
+    int32_t v = reach - (from < 0 ? -from : from);
+    v = v < 0 ? 0 : (v > kPixelVmOne ? kPixelVmOne : v);
+    out[0] = (uint8_t)((x + frame.bass) >> 8);
+    out[1] = 255;
+    out[2] = Unit(v);
+    out += 3;
+  }
+}
+
+static PixelVmFrame FrameAt(int n)
+{
+  PixelVmFrame frame;
+  frame.t = n * kPixelVmOne / 60;
+  frame.speed = kPixelVmOne / 2;
+  frame.count = 3 * kPixelVmOne;
+  frame.level = (n * 997) % kPixelVmOne;
+  frame.bass = (n * 1499) % kPixelVmOne;
+  frame.mid = 0;
+  frame.treble = 0;
+  frame.beat = 0;
+  return frame;
+}
+
+template <typename Draw>
+static double MicrosPerFrame(Draw draw)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < kBenchFrames; n++)
+  {
+    draw(n);
+  }
+  const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / kBenchFrames;
+}
+
+static void CompareAndTime(const char *name, const char *source, NativeEffect native)
+{
+  static PixelProgram program;
+  PixelVmCompiler compiler;
+  TEST_ASSERT_TRUE_MESSAGE(compiler.Compile(source, program), compiler.Error());
+
+  static uint8_t vm[kPixels * 3];
+  static uint8_t reference[kPixels * 3];
+  for (int n = 0; n < 600; n += 7)
+  {
+    const PixelVmFrame frame = FrameAt(n);
+    PixelVmRun(program, frame, vm, kPixels, kPixels);
+    native(frame, reference, kPixels);
+    for (int i = 0; i < kPixels * 3; i++)
+    {
+      char message[48];
+      snprintf(message, sizeof(message), "%s frame %d pixel %d byte %d", name, n, i / 3, i % 3);
+      TEST_ASSERT_EQUAL_HEX8_MESSAGE(reference[i], vm[i], message);
+    }
+  }
+
+  // Keep the results live so neither loop is optimized away
+  volatile uint8_t sink = 0;
+  const double vmUs = MicrosPerFrame([&](int n)
+                                     { PixelVmRun(program, FrameAt(n), vm, kPixels, kPixels); sink ^= vm[n % kPixels]; });
+  const double nativeUs = MicrosPerFrame([&](int n)
+                                         { native(FrameAt(n), reference, kPixels); sink ^= reference[n % kPixels]; });
+  printf("%-8s %3u + %3u instructions: VM %7.2f us/frame, native %7.2f us/frame, %4.1fx; %4.2f%% of a 60 FPS frame\n",
+         name, program.frameCount, program.pixelCount, vmUs, nativeUs, vmUs / nativeUs, vmUs * 100 / 16667);
+}
+
+void setUp()
+{
+  PixelVmBuildTables();
+}
+
+void tearDown()
+{
+}
+
+void test_rainbow()
+{
+  CompareAndTime("rainbow", kRainbowSource, NativeRainbow);
+}
+
+void test_plasma()
+{
+  CompareAndTime("plasma", kPlasmaSource, NativePlasma);
+}
+
+void test_meter()
+{
+  CompareAndTime("meter", kMeterSource, NativeMeter);
+}
+
+static bool Compiles(const std::string &source, PixelVmCompiler &compiler)
+{
+  static PixelProgram program;
+  return compiler.Compile(source.c_str(), program);
+}
+
+void test_nesting_limit()
+{
+  PixelVmCompiler compiler;
+
+  // The outermost expression takes one level, so 31 pairs of parentheses is as deep as it goes
+  const int deepest = kPixelVmMaxDepth - 1;
+  TEST_ASSERT_TRUE(Compiles("v = " + std::string(deepest, '(') + "x" + std::string(deepest, ')'), compiler));
+  TEST_ASSERT_FALSE(Compiles("v = " + std::string(deepest + 1, '(') + "x" + std::string(deepest + 1, ')'), compiler));
+  TEST_ASSERT_EQUAL_STRING("nested too deep", compiler.Error());
+
+  TEST_ASSERT_TRUE(Compiles("v = " + std::string(deepest, '-') + "x", compiler));
+  TEST_ASSERT_FALSE(Compiles("v = " + std::string(deepest + 1, '-') + "x", compiler));
+
+  std::string calls = "v = ";
+  for (int i = 0; i < kPixelVmMaxDepth; i++)
+  {
+    calls += "min(x, ";
+  }
+  calls += "x" + std::string(kPixelVmMaxDepth, ')');
+  TEST_ASSERT_FALSE(Compiles(calls, compiler));
+  TEST_ASSERT_EQUAL_STRING("nested too deep", compiler.Error());
+
+  // As long as a program can be, all of it nesting: an error, not a stack overflow
+  TEST_ASSERT_FALSE(Compiles("v = " + std::string(PIXELVM_MAX_SOURCE - 4, '('), compiler));
+  TEST_ASSERT_FALSE(Compiles("v = " + std::string(PIXELVM_MAX_SOURCE - 4, '-'), compiler));
+  std::string mixed = "v = ";
+  while (mixed.size() + 5 < PIXELVM_MAX_SOURCE)
+  {
+    mixed += "-sin(";
+  }
+  TEST_ASSERT_FALSE(Compiles(mixed, compiler));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rainbow);
+  RUN_TEST(test_plasma);
+  RUN_TEST(test_meter);
+  RUN_TEST(test_nesting_limit);
+  return UNITY_END();
+}
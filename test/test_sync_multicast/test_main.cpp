@@ -0,0 +1,423 @@
+/**
+ * @file test_main.cpp
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Host harness for sync_protocol.h: a leader and several followers as processes, over multicast
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   The test forks a leader and kFollowers followers, each its own process with its own clock (an
+ *   offset and a crystal drift over the host's monotonic clock), talking over real UDP on loopback
+ *   multicast exactly as controllers do on the LAN: STATE beacons to the group, PINGs to wherever the
+ *   beacons came from, PONGs back.  Each process is built like the firmware: a receive thread stamps
+ *   packets as they arrive (and on the leader answers PINGs there and then), and a loop thread that is
+ *   busy rendering for most of every frame handles the rest in between.  The followers' queuing delay
+ *   is simulated on both legs of each round trip; loopback has none of its own.
+ *
+ *   After settling, every follower's estimate of the leader's clock, checked every frame against the
+ *   clock it is simulating, has to be within 1 ms, and its timeline must never step backwards.
+ *
+ *     pio test -e native -f test_sync_multicast -v
+ *     SYNC_SECONDS=60 SYNC_JITTER_US=3000 pio test -e native -f test_sync_multicast -v
+ *
+ *   Linux only (fork, and multicast on the loopback interface).
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial harness
+ *
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "sync_protocol.h"
+
+#if defined(__linux__)
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+const uint16_t kGroupPort = SYNC_PORT + 10000; // Not the port a real show on this network would use
+const uint16_t kLeaderPort = kGroupPort + 1;
+const char *const kGroup = "239.255.72.72";
+const int kFollowers = 4;
+const uint32_t kFrameUs = 20000;
+const uint32_t kRenderUs = 15000; // The loop is busy this much of every frame
+const uint32_t kTargetErrorUs = 1000;
+const uint64_t kSettleUs = 5000000;
+const uint32_t kBeaconUs = 100000; // As kSyncBeaconMs
+const uint32_t kPingFastUs = 100000;
+const uint32_t kPingUs = 500000;
+
+struct Result
+{
+  int index;
+  bool locked;
+  bool steppedBack;
+  uint32_t pongs;
+  uint32_t bestRtt;
+  int64_t worstErrorUs;
+};
+
+static uint64_t g_startUs = 0; // Set before forking, so every process measures from the same point
+static uint64_t g_runUs = 15000000;
+static uint32_t g_jitterUs = 1500;
+
+static uint64_t MonoUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000 - g_startUs;
+}
+
+static void SleepUs(uint64_t us)
+{
+  timespec duration = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+  nanosleep(&duration, nullptr);
+}
+
+// Exponential queuing with mean @p meanUs, from the process's own generator
+static uint32_t QueuingUs(uint32_t meanUs, uint32_t &random)
+{
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  return (uint32_t)(-log((random % 10000 + 1) / 10001.0) * meanUs);
+}
+
+static sockaddr_in Address(const char *ip, uint16_t port)
+{
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = inet_addr(ip);
+  return address;
+}
+
+// The group's socket: every process on the host gets every packet sent to it
+static int GroupSocket()
+{
+  const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  const int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in local = Address("0.0.0.0", kGroupPort);
+  ip_mreq group = {};
+  group.imr_multiaddr.s_addr = inet_addr(kGroup);
+  group.imr_interface.s_addr = inet_addr("127.0.0.1");
+  if (bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) < 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// A unicast socket on loopback that can also send to the group
+static int LoopbackSocket(uint16_t port)
+{
+  const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  sockaddr_in local = Address("127.0.0.1", port);
+  in_addr loopback = {};
+  loopback.s_addr = inet_addr("127.0.0.1");
+  const unsigned char on = 1;
+  if (bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) < 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback)) < 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  timeval timeout = {0, 50000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+// RunLeader
+//
+// Beacon STATE to the group from the loop, and answer PINGs on the receive thread as they arrive.
+
+static int RunLeader()
+{
+  const int fd = LoopbackSocket(kLeaderPort);
+  if (fd < 0)
+  {
+    return 1;
+  }
+  std::atomic<bool> stop(false);
+  std::thread receive([&]()
+                      {
+                        uint8_t buffer[sizeof(SyncStatePacket) + 8];
+                        while (!stop.load())
+                        {
+                          sockaddr_in from;
+                          socklen_t fromLength = sizeof(from);
+                          const ssize_t length = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&from), &fromLength);
+                          const uint64_t receivedUs = MonoUs();
+                          if (length <= 0 || SyncPacketTypeOf(buffer, (size_t)length) != SYNC_PING)
+                          {
+                            continue;
+                          }
+                          SyncPingPacket ping;
+                          memcpy(&ping, buffer, sizeof(ping));
+                          SyncPongPacket pong;
+                          SyncFillHeader(pong.header, SYNC_PONG, 1);
+                          pong.t1 = ping.t1;
+                          pong.t2 = receivedUs;
+                          pong.t3 = MonoUs();
+                          sendto(fd, &pong, sizeof(pong), 0, reinterpret_cast<sockaddr *>(&from), fromLength);
+                        } });
+
+  const sockaddr_in group = Address(kGroup, kGroupPort);
+  uint32_t sequence = 0;
+  SyncStatePacket packet = {};
+  SyncFillHeader(packet.header, SYNC_STATE, 1);
+  packet.state.frameUs = kFrameUs;
+  packet.state.seed = 0x5EED;
+  while (MonoUs() < g_runUs)
+  {
+    packet.sequence = ++sequence;
+    packet.leaderUs = MonoUs();
+    sendto(fd, &packet, sizeof(packet), 0, reinterpret_cast<const sockaddr *>(&group), sizeof(group));
+    SleepUs(kBeaconUs);
+  }
+  stop.store(true);
+  receive.join();
+  close(fd);
+  return 0;
+}
+
+// A packet the follower's receive thread has stamped, for its loop
+struct Received
+{
+  uint64_t receivedUs;
+  sockaddr_in from;
+  size_t length;
+  uint8_t data[sizeof(SyncStatePacket) + 8];
+};
+
+// RunFollower
+//
+// Follow the leader with a clock @p offsetUs and @p driftPpm off the host's, and report how close it got.
+
+static int RunFollower(int index, int64_t offsetUs, double driftPpm, int resultFd)
+{
+  const int groupFd = GroupSocket();
+  const int fd = LoopbackSocket(0);
+  if (groupFd < 0 || fd < 0)
+  {
+    return 1;
+  }
+  // The follower's own clock, for the timestamps it sends and receives
+  auto local = [&](uint64_t hostUs)
+  { return (uint64_t)((int64_t)hostUs + offsetUs + (int64_t)(hostUs * driftPpm / 1e6)); };
+
+  std::mutex lock;
+  std::deque<Received> queue;
+  std::atomic<bool> stop(false);
+  std::thread receive([&]()
+                      {
+                        uint32_t random = 0x9E3779B9u * (index + 1);
+                        pollfd fds[2] = {{groupFd, POLLIN, 0}, {fd, POLLIN, 0}};
+                        while (!stop.load())
+                        {
+                          if (poll(fds, 2, 50) <= 0)
+                          {
+                            continue;
+                          }
+                          for (const pollfd &ready : fds)
+                          {
+                            if (!(ready.revents & POLLIN))
+                            {
+                              continue;
+                            }
+                            Received packet;
+                            socklen_t fromLength = sizeof(packet.from);
+                            const ssize_t length = recvfrom(ready.fd, packet.data, sizeof(packet.data), 0,
+                                                            reinterpret_cast<sockaddr *>(&packet.from), &fromLength);
+                            if (length <= 0)
+                            {
+                              continue;
+                            }
+                            packet.length = (size_t)length;
+                            if (SyncPacketTypeOf(packet.data, packet.length) == SYNC_PONG)
+                            {
+                              SleepUs(QueuingUs(g_jitterUs, random)); // The return leg's queuing
+                            }
+                            packet.receivedUs = local(MonoUs());
+                            std::lock_guard<std::mutex> guard(lock);
+                            queue.push_back(packet);
+                          }
+                        } });
+
+  SyncClock clock;
+  bool haveState = false;
+  sockaddr_in leader = {};
+  uint64_t lastPing = 0;
+  uint64_t lastLeaderUs = 0;
+  uint32_t random = 0x2545F491u * (index + 1);
+  Result result = {index, false, false, 0, 0, 0};
+  while (MonoUs() < g_runUs)
+  {
+    SleepUs(kRenderUs); // Rendering; the receive thread carries on stamping meanwhile
+
+    std::deque<Received> received;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      received.swap(queue);
+    }
+    for (const Received &packet : received)
+    {
+      const uint8_t type = SyncPacketTypeOf(packet.data, packet.length);
+      if (type == SYNC_STATE)
+      {
+        haveState = true;
+        leader = packet.from;
+      }
+      else if (type == SYNC_PONG)
+      {
+        SyncPongPacket pong;
+        memcpy(&pong, packet.data, sizeof(pong));
+        clock.AddSample(pong.t1, pong.t2, pong.t3, packet.receivedUs);
+        result.pongs++;
+      }
+    }
+
+    const uint64_t now = MonoUs();
+    if (haveState && now - lastPing >= (result.pongs <= SyncClock::kStepSamples ? kPingFastUs : kPingUs))
+    {
+      lastPing = now;
+      SyncPingPacket ping;
+      SyncFillHeader(ping.header, SYNC_PING, (uint16_t)(index + 2));
+      ping.t1 = local(now);
+      const uint32_t queuing = QueuingUs(g_jitterUs, random);
+      std::thread([=]()
+                  {
+                    SleepUs(queuing); // The outward leg's queuing
+                    sendto(fd, &ping, sizeof(ping), 0, reinterpret_cast<const sockaddr *>(&leader), sizeof(leader)); })
+          .detach();
+    }
+
+    if (!clock.Locked())
+    {
+      continue;
+    }
+    // Where the follower puts the leader's clock, against where it is
+    const uint64_t hostUs = MonoUs();
+    const uint64_t leaderUs = clock.ToLeader(local(hostUs));
+    const int64_t error = (int64_t)(leaderUs - hostUs);
+    if (hostUs >= kSettleUs)
+    {
+      result.steppedBack |= lastLeaderUs != 0 && leaderUs < lastLeaderUs;
+      result.worstErrorUs = llabs(error) > result.worstErrorUs ? llabs(error) : result.worstErrorUs;
+    }
+    lastLeaderUs = leaderUs;
+  }
+  stop.store(true);
+  receive.join();
+  result.locked = clock.Locked();
+  result.bestRtt = clock.BestRtt();
+  const bool written = write(resultFd, &result, sizeof(result)) == (ssize_t)sizeof(result);
+  close(groupFd);
+  close(fd);
+  return written ? 0 : 1;
+}
+
+void setUp()
+{
+  const char *seconds = getenv("SYNC_SECONDS");
+  const char *jitter = getenv("SYNC_JITTER_US");
+  g_runUs = seconds != nullptr ? (uint64_t)(atof(seconds) * 1e6) : g_runUs;
+  g_jitterUs = jitter != nullptr ? (uint32_t)atoi(jitter) : g_jitterUs;
+}
+
+void tearDown()
+{
+}
+
+void test_processes_converge_over_multicast()
+{
+  const int probe = GroupSocket();
+  if (probe < 0)
+  {
+    TEST_IGNORE_MESSAGE("No multicast on the loopback interface");
+  }
+  close(probe);
+
+  int results[2];
+  TEST_ASSERT_EQUAL_INT(0, pipe(results));
+  g_startUs = 0;
+  g_startUs = MonoUs();
+  fflush(stdout);
+
+  pid_t children[kFollowers + 1];
+  const int64_t offsets[kFollowers] = {1500000, -2750000, 123456789, 42};
+  const double drifts[kFollowers] = {20, -20, 35, -5};
+  for (int i = 0; i <= kFollowers; i++)
+  {
+    children[i] = fork();
+    TEST_ASSERT_TRUE(children[i] >= 0);
+    if (children[i] == 0)
+    {
+      close(results[0]);
+      _exit(i == 0 ? RunLeader() : RunFollower(i - 1, offsets[i - 1], drifts[i - 1], results[1]));
+    }
+  }
+  close(results[1]);
+
+  Result reported[kFollowers] = {};
+  int count = 0;
+  Result result;
+  while (count < kFollowers && read(results[0], &result, sizeof(result)) == (ssize_t)sizeof(result))
+  {
+    reported[result.index] = result;
+    count++;
+  }
+  close(results[0]);
+  for (int i = 0; i <= kFollowers; i++)
+  {
+    int status = 0;
+    waitpid(children[i], &status, 0);
+    TEST_ASSERT_TRUE_MESSAGE(WIFEXITED(status) && WEXITSTATUS(status) == 0, i == 0 ? "leader failed" : "follower failed");
+  }
+  TEST_ASSERT_EQUAL_INT(kFollowers, count);
+
+  for (int i = 0; i < kFollowers; i++)
+  {
+    const Result &follower = reported[i];
+    printf("process %d: offset %11lld us  drift %+5.1f ppm  jitter %5u us  pongs %4u  best rtt %6u us  worst error %5lld us\n",
+           i, (long long)offsets[i], drifts[i], g_jitterUs, follower.pongs, follower.bestRtt, (long long)follower.worstErrorUs);
+    TEST_ASSERT_TRUE(follower.locked);
+    TEST_ASSERT_FALSE_MESSAGE(follower.steppedBack, "timeline stepped backwards after settling");
+    TEST_ASSERT_TRUE_MESSAGE(follower.worstErrorUs <= (int64_t)kTargetErrorUs, "follower more than 1 ms out");
+  }
+}
+#else
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_processes_converge_over_multicast()
+{
+  TEST_IGNORE_MESSAGE("Needs Linux");
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_processes_converge_over_multicast);
+  return UNITY_END();
+}
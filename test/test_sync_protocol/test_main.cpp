@@ -0,0 +1,251 @@
+/**
+ * @file test_main.cpp
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Host harness for sync_protocol.h: one leader and several followers over a jittery network
+ * @version 0.2
+ * @date 10/19/26
+ *
+ *   Each follower has its own clock offset and crystal drift, and pings the leader twice a second over
+ *   a simulated link whose one-way delay is a few ms plus random queuing, with the occasional WiFi stall
+ *   in one direction only.  Every exchange goes through the packet structs and SyncPacketTypeOf() as it
+ *   would on the air.  After a settling period each follower's SyncClock has to put it within 1 ms of
+ *   the leader, and its view of the timeline must never step backwards.
+ *
+ *   The 1 ms holds on links whose mean queuing is up to 3 ms, which covers a home or venue network that
+ *   isn't saturated.  The last three followers sit on a congested one (5 to 12 ms of mean queuing, each
+ *   way, independently) and are only held to the same frame, half a frame either side: the clock needs
+ *   an outward and a return leg that barely queued among its last sixteen exchanges, and on those links
+ *   eight seconds often goes by without one, leaving it a millisecond or two out until one comes.
+ *
+ *   test_sync_multicast runs the same protocol between real processes over loopback multicast.
+ *
+ *   The leader's parameter log is checked the same way: a follower that joins late replays speed and
+ *   count for every frame the log still covers exactly as the leader drew them.
+ *
+ *     pio test -e native -f test_sync_protocol -v
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial harness
+ *   0.2 - 10/19/26 - 1 ms on realistic links
+ *
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <math.h>
+#include "sync_protocol.h"
+
+const uint32_t kFrameUs = 20000;
+const uint32_t kTargetErrorUs = 1000;
+const uint32_t kRealisticJitterUs = 3000; // Mean queuing the target holds for; above it, congested
+const uint64_t kPingIntervalUs = 500000; // SYNC_PING_MS
+const uint64_t kRunUs = 120000000ULL;    // Two minutes of simulated time
+const uint64_t kSettleUs = 10000000ULL;  // Followers aren't judged for the first ten seconds
+const int kFollowers = 6;
+
+// xorshift32, so every run sees the same network
+static uint32_t g_random = 0x12345678;
+
+static uint32_t Random()
+{
+  g_random ^= g_random << 13;
+  g_random ^= g_random >> 17;
+  g_random ^= g_random << 5;
+  return g_random;
+}
+
+// One-way delay in us: 2 ms of air time plus exponential queuing, and now and then a stall
+static uint64_t LinkDelayUs(uint32_t meanJitterUs)
+{
+  uint64_t delay = 2000 + (uint64_t)(-log((Random() % 10000 + 1) / 10001.0) * meanJitterUs);
+  if (Random() % 50 == 0)
+  {
+    delay += 20000 + Random() % 60000;
+  }
+  return delay;
+}
+
+struct Follower
+{
+  int64_t offsetUs;  // Local clock minus leader clock at the start
+  double driftPpm;   // Local crystal error
+  uint32_t jitterUs; // Mean queuing on this follower's link
+  SyncClock clock;
+  uint64_t lastLeaderUs;
+  int64_t worstErrorUs;
+  bool steppedBack;
+
+  uint64_t Local(uint64_t leaderUs) const
+  {
+    return (uint64_t)((int64_t)leaderUs + offsetUs + (int64_t)(leaderUs * driftPpm / 1e6));
+  }
+};
+
+void setUp()
+{
+  g_random = 0x12345678;
+}
+
+void tearDown()
+{
+}
+
+// One PING/PONG exchange, serialized and parsed as the firmware does; returns false if a packet was refused
+static bool Exchange(Follower &follower, uint64_t leaderNowUs)
+{
+  uint8_t wire[64];
+
+  SyncPingPacket ping;
+  SyncFillHeader(ping.header, SYNC_PING, 2);
+  ping.t1 = follower.Local(leaderNowUs);
+  memcpy(wire, &ping, sizeof(ping));
+  if (SyncPacketTypeOf(wire, sizeof(ping)) != SYNC_PING)
+  {
+    return false;
+  }
+
+  const uint64_t arrives = leaderNowUs + LinkDelayUs(follower.jitterUs);
+  SyncPingPacket received;
+  memcpy(&received, wire, sizeof(received));
+  SyncPongPacket pong;
+  SyncFillHeader(pong.header, SYNC_PONG, 1);
+  pong.t1 = received.t1;
+  pong.t2 = arrives;
+  pong.t3 = arrives + 150; // Leader's turnaround
+  memcpy(wire, &pong, sizeof(pong));
+  if (SyncPacketTypeOf(wire, sizeof(pong)) != SYNC_PONG)
+  {
+    return false;
+  }
+
+  const uint64_t returns = pong.t3 + LinkDelayUs(follower.jitterUs);
+  SyncPongPacket reply;
+  memcpy(&reply, wire, sizeof(reply));
+  follower.clock.AddSample(reply.t1, reply.t2, reply.t3, follower.Local(returns));
+  return true;
+}
+
+void test_followers_converge()
+{
+  Follower followers[kFollowers] = {};
+  const int64_t offsets[kFollowers] = {0, 1500000, -2750000, 123456789, -987654, 42};
+  const double drifts[kFollowers] = {0, 20, -20, 35, -10, 5};
+  const uint32_t jitters[kFollowers] = {500, 1500, 3000, 5000, 8000, 12000};
+  for (int i = 0; i < kFollowers; i++)
+  {
+    followers[i].offsetUs = offsets[i];
+    followers[i].driftPpm = drifts[i];
+    followers[i].jitterUs = jitters[i];
+  }
+
+  for (uint64_t now = 0; now < kRunUs; now += kPingIntervalUs)
+  {
+    for (int i = 0; i < kFollowers; i++)
+    {
+      Follower &follower = followers[i];
+      TEST_ASSERT_TRUE_MESSAGE(Exchange(follower, now), "packet refused");
+      if (!follower.clock.Locked())
+      {
+        continue;
+      }
+
+      // Where the follower thinks the leader's timeline is, just after the exchange and halfway to the next
+      for (uint64_t at = now + 100000; at < now + kPingIntervalUs; at += 200000)
+      {
+        const uint64_t leaderUs = follower.clock.ToLeader(follower.Local(at));
+        if (follower.lastLeaderUs != 0 && leaderUs < follower.lastLeaderUs)
+        {
+          follower.steppedBack |= now >= kSettleUs;
+        }
+        follower.lastLeaderUs = leaderUs;
+        const int64_t error = (int64_t)(leaderUs - at);
+        if (now >= kSettleUs && (error > follower.worstErrorUs || -error > follower.worstErrorUs))
+        {
+          follower.worstErrorUs = error < 0 ? -error : error;
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < kFollowers; i++)
+  {
+    const Follower &follower = followers[i];
+    printf("follower %d: offset %11lld us  drift %+5.1f ppm  jitter %5u us  best rtt %6u us  worst error %5lld us\n",
+           i, (long long)follower.offsetUs, follower.driftPpm, follower.jitterUs, follower.clock.BestRtt(),
+           (long long)follower.worstErrorUs);
+    TEST_ASSERT_TRUE(follower.clock.Locked());
+    TEST_ASSERT_FALSE_MESSAGE(follower.steppedBack, "timeline stepped backwards after settling");
+    if (follower.jitterUs <= kRealisticJitterUs)
+    {
+      TEST_ASSERT_TRUE_MESSAGE(follower.worstErrorUs <= (int64_t)kTargetErrorUs, "follower more than 1 ms out");
+    }
+    else
+    {
+      TEST_ASSERT_TRUE_MESSAGE(follower.worstErrorUs < (int64_t)kFrameUs / 2, "follower more than half a frame out");
+    }
+  }
+}
+
+void test_slow_round_trips_ignored()
+{
+  SyncClock clock;
+  clock.AddSample(1000, 501000, 501100, 2100); // 1 ms round trip, leader 499.5 ms ahead
+  TEST_ASSERT_TRUE(clock.Locked());
+  TEST_ASSERT_INT_WITHIN(100, 499500, clock.Offset());
+  clock.AddSample(10000, 600000, 600100, 10000 + SyncClock::kMaxRttUs + 1000); // Far too slow
+  TEST_ASSERT_INT_WITHIN(100, 499500, clock.Offset());
+}
+
+void test_late_joiner_replays_params()
+{
+  SyncShowState leader = {};
+  uint8_t drawn[400][2];
+  uint8_t speed = 128, count = 10;
+  SyncLogParams(leader, 0, speed, count);
+  for (uint32_t frame = 0; frame < 400; frame++)
+  {
+    if (frame % 37 == 5)
+    {
+      speed = (uint8_t)Random();
+    }
+    if (frame % 53 == 7)
+    {
+      count = (uint8_t)(Random() % 40 + 1);
+    }
+    SyncLogParams(leader, frame, speed, count);
+    drawn[frame][0] = speed;
+    drawn[frame][1] = count;
+  }
+
+  // Through the wire as a STATE packet
+  SyncStatePacket packet = {};
+  SyncFillHeader(packet.header, SYNC_STATE, 1);
+  packet.state = leader;
+  uint8_t wire[sizeof(packet)];
+  memcpy(wire, &packet, sizeof(packet));
+  TEST_ASSERT_EQUAL_INT(SYNC_STATE, SyncPacketTypeOf(wire, sizeof(wire)));
+  TEST_ASSERT_EQUAL_INT(0, SyncPacketTypeOf(wire, sizeof(wire) - 1));
+  SyncStatePacket joined;
+  memcpy(&joined, wire, sizeof(joined));
+  TEST_ASSERT_EQUAL_INT(kSyncParamLogSize, joined.state.paramCount);
+
+  // Every frame from the oldest change the log kept on replays as the leader drew it
+  for (uint32_t frame = joined.state.params[0].frame; frame < 400; frame++)
+  {
+    uint8_t replaySpeed = 0, replayCount = 0;
+    SyncParamsAt(joined.state, frame, replaySpeed, replayCount);
+    char message[32];
+    snprintf(message, sizeof(message), "frame %u", (unsigned)frame);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(drawn[frame][0], replaySpeed, message);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(drawn[frame][1], replayCount, message);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_followers_converge);
+  RUN_TEST(test_slow_round_trips_ignored);
+  RUN_TEST(test_late_joiner_replays_params);
+  return UNITY_END();
+}
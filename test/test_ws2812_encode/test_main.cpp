@@ -0,0 +1,164 @@
+/**
+ * @file test_main.cpp
+ * @author Kevin Murphy (https://www.SomerledDesign.com)
+ * @brief Host test of ws2812_encode.h against the WS2812B datasheet timings
+ * @version 0.1
+ * @date 10/19/26
+ *
+ *   The expected waveform is built here from nothing but the datasheet's T0H, T1H and bit period and the
+ *   SPI line rate: each data bit is held high for its TxH, rounded to whole line bits, and low for the
+ *   rest of the period.  Every byte of the encoder's table, a whole pixel and the latch gap are compared
+ *   against it, and the pulses the encoder produces are measured back against the datasheet tolerances.
+ *
+ *     pio test -e native -f test_ws2812_encode
+ *
+ *   Version History -
+ *
+ *   0.1 - 10/19/26 - Initial test
+ *
+ */
+#include <unity.h>
+#include <string.h>
+#include "ws2812_encode.h"
+
+// WS2812B datasheet, all in ns
+const double kT0HNs = 400;
+const double kT1HNs = 800;
+const double kBitNs = 1250;
+const double kPulseToleranceNs = 150; // On each of T0H, T0L, T1H, T1L
+const double kBitToleranceNs = 600;   // On the whole bit period
+
+const double kLineBitNs = 1e9 / WS2812_SPI_HZ;
+
+// A run of line bits written MSB first into a byte buffer
+struct LineWriter
+{
+  uint8_t *out;
+  size_t bit;
+
+  void Put(bool high, int count)
+  {
+    for (int i = 0; i < count; i++, bit++)
+    {
+      if (high)
+      {
+        out[bit / 8] |= (uint8_t)(0x80 >> (bit % 8));
+      }
+    }
+  }
+};
+
+static int LineBits(double ns)
+{
+  return (int)(ns / kLineBitNs + 0.5);
+}
+
+// The reference: one channel value, MSB first, from the timings alone
+static void ReferenceChannel(LineWriter &line, uint8_t value)
+{
+  const int period = LineBits(kBitNs);
+  for (int bit = 7; bit >= 0; bit--)
+  {
+    const int high = LineBits(((value >> bit) & 1) ? kT1HNs : kT0HNs);
+    line.Put(true, high);
+    line.Put(false, period - high);
+  }
+}
+
+void setUp()
+{
+  Ws2812BuildLut();
+}
+
+void tearDown()
+{
+}
+
+void test_line_bits_per_pixel()
+{
+  // The encoder's fixed layout has to agree with what the timings work out to
+  TEST_ASSERT_EQUAL_INT(WS2812_BYTES_PER_PIXEL * 8, 24 * LineBits(kBitNs));
+}
+
+void test_every_channel_value()
+{
+  for (int value = 0; value < 256; value++)
+  {
+    uint8_t expected[3] = {0};
+    LineWriter line = {expected, 0};
+    ReferenceChannel(line, (uint8_t)value);
+    for (int i = 0; i < 3; i++)
+    {
+      char message[32];
+      snprintf(message, sizeof(message), "value %d byte %d", value, i);
+      TEST_ASSERT_EQUAL_HEX8_MESSAGE(expected[i], g_ws2812Lut[value][i], message);
+    }
+  }
+}
+
+void test_pixel_order_and_reset()
+{
+  const uint8_t first = 0xA5, second = 0x0F, third = 0xF0;
+  uint8_t encoded[WS2812_BYTES_PER_PIXEL + WS2812_RESET_BYTES];
+  memset(encoded, 0xFF, sizeof(encoded));
+  uint8_t *end = Ws2812EncodePixel(encoded, first, second, third);
+  TEST_ASSERT_TRUE(end == encoded + WS2812_BYTES_PER_PIXEL);
+  Ws2812EncodeReset(end);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(encoded), Ws2812EncodedSize(1));
+
+  uint8_t expected[sizeof(encoded)] = {0};
+  LineWriter line = {expected, 0};
+  ReferenceChannel(line, first);
+  ReferenceChannel(line, second);
+  ReferenceChannel(line, third);
+  for (size_t i = 0; i < sizeof(encoded); i++)
+  {
+    char message[32];
+    snprintf(message, sizeof(message), "byte %u", (unsigned)i);
+    TEST_ASSERT_EQUAL_HEX8_MESSAGE(expected[i], encoded[i], message);
+  }
+
+  // The latch gap has to hold the line low for the reset time
+  TEST_ASSERT_TRUE(WS2812_RESET_BYTES * 8 * kLineBitNs >= 280000);
+}
+
+void test_pulses_within_tolerance()
+{
+  // Measure the encoder's own output as a receiver would: every bit starts on a rising edge
+  for (int value = 0; value < 256; value++)
+  {
+    const uint32_t bits = ((uint32_t)g_ws2812Lut[value][0] << 16) | (g_ws2812Lut[value][1] << 8) | g_ws2812Lut[value][2];
+    int position = 23;
+    for (int bit = 7; bit >= 0; bit--)
+    {
+      TEST_ASSERT_TRUE_MESSAGE((bits >> position) & 1, "bit does not start high");
+      int high = 0, low = 0;
+      while (position >= 0 && ((bits >> position) & 1))
+      {
+        high++;
+        position--;
+      }
+      while (position >= 0 && !((bits >> position) & 1))
+      {
+        low++;
+        position--;
+      }
+      const bool one = (value >> bit) & 1;
+      const double highNs = high * kLineBitNs;
+      const double lowNs = low * kLineBitNs;
+      TEST_ASSERT_FLOAT_WITHIN(kPulseToleranceNs, one ? kT1HNs : kT0HNs, highNs);
+      TEST_ASSERT_FLOAT_WITHIN(kPulseToleranceNs, kBitNs - (one ? kT1HNs : kT0HNs), lowNs);
+      TEST_ASSERT_FLOAT_WITHIN(kBitToleranceNs, kBitNs, highNs + lowNs);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_line_bits_per_pixel);
+  RUN_TEST(test_every_channel_value);
+  RUN_TEST(test_pixel_order_and_reset);
+  RUN_TEST(test_pulses_within_tolerance);
+  return UNITY_END();
+}
@@ -0,0 +1,317 @@
+const statusText = document.getElementById("statusText");
+const powerBtn = document.getElementById("powerBtn");
+const powerOffBtn = document.getElementById("powerOffBtn");
+const brightness = document.getElementById("brightness");
+const brightnessValue = document.getElementById("brightnessValue");
+const speedValue = document.getElementById("speedValue");
+const countValue = document.getElementById("countValue");
+const effect = document.getElementById("effect");
+const speed = document.getElementById("speed");
+const count = document.getElementById("count");
+const color = document.getElementById("color");
+const applyColor = document.getElementById("applyColor");
+const otaStatus = document.getElementById("otaStatus");
+const effectStatus = document.getElementById("effectStatus");
+const powerStatus = document.getElementById("powerStatus");
+const effectAscii = document.getElementById("effectAscii");
+const program = document.getElementById("program");
+const runProgram = document.getElementById("runProgram");
+const programResult = document.getElementById("programResult");
+const sequenceFile = document.getElementById("sequenceFile");
+const uploadSequence = document.getElementById("uploadSequence");
+const sequenceResult = document.getElementById("sequenceResult");
+
+const effectLabels = {
+  0: "Marquee",
+  1: "Solid",
+  2: "Rainbow",
+  3: "Twinkle",
+  4: "Comet",
+  5: "Bounce",
+  6: "Fire",
+  7: "Meteor",
+  8: "Palette",
+  9: "Double Palette",
+  10: "Star Effect",
+  11: "Spectrum",
+  12: "VU Meter",
+  13: "Beat Pulse",
+  14: "User Program",
+  15: "Sequence",
+};
+
+let debounceTimer = null;
+let asciiEffect = 0;
+let asciiTick = 0;
+let asciiTimer = null;
+
+function setStatus(ok) {
+  statusText.textContent = ok ? "CONNECTED" : "DISCONNECTED";
+  statusText.style.color = ok ? "var(--success)" : "var(--muted)";
+}
+
+function sendUpdate(params) {
+  const query = new URLSearchParams(params);
+  return fetch(`/set?${query.toString()}`)
+    .then((res) => res.json())
+    .then((data) => {
+      applyState(data);
+      return data;
+    })
+    .catch(() => setStatus(false));
+}
+
+function applyState(data) {
+  if (!data) return;
+  setStatus(true);
+  brightness.value = data.brightness ?? brightness.value;
+  brightnessValue.textContent = brightness.value;
+  speed.value = data.speed ?? speed.value;
+  speedValue.textContent = speed.value;
+  count.value = data.count ?? count.value;
+  countValue.textContent = count.value;
+  effect.value = data.effect ?? effect.value;
+  powerStatus.textContent = `Power: ${data.power ? "On" : "Off"}`;
+  effectStatus.textContent = `Effect: ${effectLabels[data.effect] ?? "Unknown"}`;
+  powerBtn.textContent = data.power ? "Power On" : "Power Off";
+  otaStatus.textContent = `OTA: ${data.ota || "unknown"}`;
+  setAsciiEffect(data.effect ?? 0);
+}
+
+function loadStatus() {
+  fetch("/status")
+    .then((res) => res.json())
+    .then((data) => {
+      applyState(data);
+    })
+    .catch(() => setStatus(false));
+}
+
+powerBtn.addEventListener("click", () => {
+  const next = powerBtn.textContent.includes("On") ? "off" : "on";
+  sendUpdate({ power: next });
+});
+
+powerOffBtn.addEventListener("click", () => {
+  sendUpdate({ power: "off" });
+});
+
+brightness.addEventListener("input", () => {
+  brightnessValue.textContent = brightness.value;
+  clearTimeout(debounceTimer);
+  debounceTimer = setTimeout(() => {
+    sendUpdate({ brightness: brightness.value });
+  }, 120);
+});
+
+speed.addEventListener("input", () => {
+  speedValue.textContent = speed.value;
+  clearTimeout(debounceTimer);
+  debounceTimer = setTimeout(() => {
+    sendUpdate({ speed: speed.value });
+  }, 120);
+});
+
+count.addEventListener("input", () => {
+  countValue.textContent = count.value;
+  clearTimeout(debounceTimer);
+  debounceTimer = setTimeout(() => {
+    sendUpdate({ count: count.value });
+  }, 120);
+});
+
+effect.addEventListener("change", () => {
+  sendUpdate({ effect: effect.value });
+});
+
+applyColor.addEventListener("click", () => {
+  const hex = color.value.replace("#", "");
+  const r = parseInt(hex.slice(0, 2), 16);
+  const g = parseInt(hex.slice(2, 4), 16);
+  const b = parseInt(hex.slice(4, 6), 16);
+  sendUpdate({ r, g, b });
+});
+
+runProgram.addEventListener("click", () => {
+  fetch("/program", { method: "POST", body: new URLSearchParams({ source: program.value }) })
+    .then((res) => res.text().then((text) => {
+      programResult.textContent = res.ok ? text : `Error at ${text}`;
+      if (res.ok) loadStatus();
+    }))
+    .catch(() => setStatus(false));
+});
+
+uploadSequence.addEventListener("click", () => {
+  const file = sequenceFile.files[0];
+  if (!file) return;
+  const form = new FormData();
+  form.append("file", file, file.name);
+  sequenceResult.textContent = `Uploading ${file.name}...`;
+  fetch("/sequence", { method: "POST", body: form })
+    .then((res) => res.text().then((text) => {
+      sequenceResult.textContent = text;
+      if (res.ok) loadStatus();
+    }))
+    .catch(() => setStatus(false));
+});
+
+function loadProgram() {
+  fetch("/program")
+    .then((res) => res.text())
+    .then((text) => {
+      program.value = text;
+    })
+    .catch(() => {});
+}
+
+function lcg(seed) {
+  return (seed * 1664525 + 1013904223) >>> 0;
+}
+
+function buildMarquee(t) {
+  const len = 26;
+  const base = "***   ".repeat(6);
+  const ping = t % ((base.length - len) * 2);
+  const offset = ping < base.length - len ? ping : (base.length - len) * 2 - ping;
+  return base.slice(offset, offset + len);
+}
+
+function buildComet(t) {
+  const len = 26;
+  const pos = t % (len * 2);
+  const head = pos < len ? pos : len * 2 - pos - 1;
+  const chars = Array(len).fill(" ");
+  chars[head] = "@";
+  if (head > 0) chars[head - 1] = "*";
+  if (head > 1) chars[head - 2] = ".";
+  return chars.join("");
+}
+
+function buildMeteor(t) {
+  const len = 26;
+  const a = t % len;
+  const b = (t + 9) % len;
+  const chars = Array(len).fill(" ");
+  chars[a] = "#";
+  if (a > 0) chars[a - 1] = "+";
+  if (a > 1) chars[a - 2] = ".";
+  chars[b] = "#";
+  if (b > 0) chars[b - 1] = "+";
+  return chars.join("");
+}
+
+function buildFire(t) {
+  const len = 26;
+  const ramp = " .:-=+*#%@";
+  let line1 = "";
+  let line2 = "";
+  for (let i = 0; i < len; i++) {
+    const seed = lcg(t * 31 + i * 17);
+    const heat = (seed % 100) / 100;
+    const idx1 = Math.min(ramp.length - 1, Math.floor(heat * ramp.length));
+    const idx2 = Math.min(ramp.length - 1, Math.floor((heat * 0.7) * ramp.length));
+    line1 += ramp[idx1];
+    line2 += ramp[idx2];
+  }
+  return `${line1}\n${line2}`;
+}
+
+function buildTwinkle(t) {
+  const len = 26;
+  const chars = Array(len).fill(" ");
+  for (let i = 0; i < 5; i++) {
+    const seed = lcg(t * 13 + i * 97);
+    chars[seed % len] = (seed % 3) === 0 ? "*" : "+";
+  }
+  return chars.join("");
+}
+
+function buildStars(t) {
+  const len = 26;
+  const chars = Array(len).fill(".");
+  for (let i = 0; i < 4; i++) {
+    const seed = lcg(t * 19 + i * 211);
+    chars[seed % len] = "*";
+  }
+  return chars.join("");
+}
+
+function buildPalette(t) {
+  const len = 26;
+  const ramp = " .:-=+*#%@";
+  let line = "";
+  for (let i = 0; i < len; i++) {
+    const idx = (i + t) % ramp.length;
+    line += ramp[idx];
+  }
+  return line;
+}
+
+function buildDoublePalette(t) {
+  const len = 26;
+  const rampA = " .:-=+*#%@";
+  const rampB = "@%#*+=-:. ";
+  let line = "";
+  for (let i = 0; i < len; i++) {
+    const idxA = (i + t) % rampA.length;
+    const idxB = (rampB.length - 1 - ((i + t * 2) % rampB.length));
+    line += (t % 2 === 0) ? rampA[idxA] : rampB[idxB];
+  }
+  return line;
+}
+
+function buildAscii(effectId, t) {
+  switch (Number(effectId)) {
+    case 0:
+      return buildMarquee(t);
+    case 1:
+      return "##########################";
+    case 2:
+      return buildPalette(t);
+    case 3:
+      return buildTwinkle(t);
+    case 4:
+      return buildComet(t);
+    case 5:
+      return buildComet(t + 4);
+    case 6:
+      return buildFire(t);
+    case 7:
+      return buildMeteor(t);
+    case 8:
+      return buildPalette(t);
+    case 9:
+      return buildDoublePalette(t);
+    case 10:
+      return buildStars(t);
+    case 11:
+    case 12:
+      return buildPalette(t);
+    case 13:
+      return buildComet(t);
+    case 14:
+      return buildPalette(t);
+    case 15:
+      return buildTwinkle(t);
+    default:
+      return "---";
+  }
+}
+
+function renderAscii() {
+  asciiTick += 1;
+  const frame = buildAscii(asciiEffect, asciiTick);
+  effectAscii.textContent = frame;
+}
+
+function setAsciiEffect(id) {
+  asciiEffect = Number(id) || 0;
+  asciiTick = 0;
+  renderAscii();
+  if (!asciiTimer) {
+    asciiTimer = setInterval(renderAscii, 140);
+  }
+}
+
+loadStatus();
+loadProgram();